@@ -16,6 +16,7 @@
 #include "file_utils.h"
 #include "draw_utils.h"
 #include "tree_leaf.h"
+#include "profiler.h"
 #include <set>
 
 #ifdef _WIN32 // wglew.h seems to be Windows only
@@ -73,7 +74,7 @@ char *lighting_file[NUM_LIGHTING_TYPES] = {0};
 bool combined_gu(0), underwater(0), kbd_text_mode(0), univ_stencil_shadows(1), use_waypoint_app_spots(0), enable_tiled_mesh_ao(0), tiled_terrain_only(0);
 bool show_lightning(0), disable_shader_effects(0), use_waypoints(0), group_back_face_cull(0), start_maximized(0), claim_planet(0), skip_light_vis_test(0);
 bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0), lighting_update_offline(0), mesh_difuse_tex_comp(1), smoke_dlights(0), keep_keycards_on_death(0);
-bool texture_alpha_in_red_comp(0), use_model2d_tex_mipmaps(1), mt_cobj_tree_build(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
+bool texture_alpha_in_red_comp(0), use_model2d_tex_mipmaps(1), mt_cobj_tree_build(0), sah_cobj_tree_build(1), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
 bool gen_tree_roots(1), fast_water_reflect(0), vsync_enabled(0), use_voxel_cobjs(0), disable_sound(0), enable_depth_clamp(0), volume_lighting(0), no_subdiv_model(0);
 bool detail_normal_map(0), init_core_context(0), use_core_context(0), enable_multisample(1), dynamic_smap_bias(0), model3d_wn_normal(0), snow_shadows(0), user_action_key(0);
 bool enable_dlight_shadows(1), tree_indir_lighting(0), ctrl_key_pressed(0), only_pine_palm_trees(0), enable_gamma_correct(0), use_z_prepass(0), reflect_dodgeballs(0);
@@ -103,7 +104,7 @@ int read_snow_file(0), write_snow_file(0), mesh_detail_tex(NOISE_TEX);
 int read_light_files[NUM_LIGHTING_TYPES] = {0}, write_light_files[NUM_LIGHTING_TYPES] = {0};
 unsigned num_snowflakes(0), create_voxel_landscape(0), hmap_filter_width(0), num_dynam_parts(100), snow_coverage_resolution(2);
 unsigned num_birds_per_tile(2), num_fish_per_tile(15), num_bflies_per_tile(4);
-unsigned erosion_iters(0), erosion_iters_tt(0), skybox_tid(0), tiled_terrain_gen_heightmap_sz(0);
+unsigned erosion_iters(0), erosion_iters_tt(0), skybox_tid(0), tiled_terrain_gen_heightmap_sz(0), cobj_tree_bench_queries(0);
 float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
 float mesh_file_scale(1.0), mesh_file_tz(0.0), speed_mult(1.0), mesh_z_cutoff(-FAR_CLIP), relh_adj_tex(0.0), dodgeball_metalness(1.0), ray_step_size_mult(1.0);
@@ -117,7 +118,7 @@ float model_hemi_lighting_scale(0.5), pine_tree_radius_scale(1.0), sunlight_brig
 float light_int_scale[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0}, first_ray_weight[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0};
 double camera_zh(0.0);
 point mesh_origin(all_zeros), camera_pos(all_zeros), cube_map_center(all_zeros);
-string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn, skybox_cube_map_name, coll_damage_name;
+string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn, skybox_cube_map_name, coll_damage_name, trace_filename;
 colorRGB ambient_lighting_scale(1,1,1), mesh_color_scale(1,1,1);
 colorRGBA flower_color(ALPHA0);
 set<unsigned char> keys, keyset;
@@ -133,14 +134,14 @@ char player_name[MAX_CHARS] = "Player";
 bool vert_opt_flags[3] = {0}; // {enable, full_opt, verbose}
 
 
-extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection, flashlight_on;
+extern bool clear_landscape_vbo, use_ray_packets, progressive_lighting, tile_streaming, compress_lighting_files, use_model_cache, use_texture_cache, mt_obj_file_reader, soa_object_physics, mt_object_physics, use_obj_grid, cpu_noise_gen, async_model_texture_load, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, ship_cube_map_reflection, flashlight_on;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y;
 extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
-extern unsigned scene_smap_vbo_invalid, spheres_mode, max_cube_map_tex_sz, DL_GRID_BS;
+extern unsigned scene_smap_vbo_invalid, spheres_mode, max_cube_map_tex_sz, DL_GRID_BS, lighting_cache_chunks_per_frame;
 extern float fticks, team_damage, self_damage, player_damage, smiley_damage, smiley_speed, tree_deadness, tree_dead_prob, lm_dz_adj, nleaves_scale, flower_density, universe_ambient_scale;
 extern float mesh_scale, tree_scale, mesh_height_scale, smiley_acc, hmv_scale, last_temp, grass_length, grass_width, branch_radius_scale, tree_height_scale, planet_update_rate;
-extern float MESH_START_MAG, MESH_START_FREQ, MESH_MAG_MULT, MESH_FREQ_MULT, def_tex_aniso;
+extern float MESH_START_MAG, MESH_START_FREQ, MESH_MAG_MULT, MESH_FREQ_MULT, def_tex_aniso, cobj_tree_refit_max_area_ratio, tile_upload_budget_ms, model_tex_upload_budget_ms;
 extern double map_x, map_y;
 extern point hmv_pos, camera_last_pos;
 extern colorRGBA sunlight_color;
@@ -253,6 +254,7 @@ void clear_context() { // free all textures, shaders, VBOs, etc.; used on contex
 void quit_3dworld() { // called once at the end for proper cleanup
 
 	cout << "quitting" << endl;
+	if (trace_enabled) {stop_trace_and_write(trace_filename);}
 	kill_current_raytrace_threads();
 	end_building_rt_job();
 	clear_context();
@@ -1702,13 +1704,25 @@ int load_config(string const &config_file) {
 	kwmb.add("fast_water_reflect", fast_water_reflect);
 	kwmb.add("disable_shader_effects", disable_shader_effects);
 	kwmb.add("enable_model3d_tex_comp", enable_model3d_tex_comp);
+	kwmb.add("use_model_cache", use_model_cache); // write/read binary cache files next to OBJ/3DS/assimp models
+	kwmb.add("use_texture_cache", use_texture_cache); // write/read GPU-ready mipmapped and compressed cache files next to model textures
+	kwmb.add("mt_obj_file_reader", mt_obj_file_reader);
+	kwmb.add("async_model_texture_load", async_model_texture_load);
+	kwmb.add("soa_object_physics", soa_object_physics); // advance objects in free fall above the scene in a batched structure-of-arrays step
+	kwmb.add("mt_object_physics", mt_object_physics); // update particle clouds, bubbles, and particles in parallel blocks on job system threads
+	kwmb.add("use_obj_grid", use_obj_grid); // uniform grid broadphase for object queries such as explosion damage
+	kwmb.add("cpu_noise_gen", cpu_noise_gen); // generate GPU simplex noise terrain and voxels with SIMD on the CPU
 	kwmb.add("texture_alpha_in_red_comp", texture_alpha_in_red_comp);
 	kwmb.add("use_model2d_tex_mipmaps", use_model2d_tex_mipmaps);
 	kwmb.add("use_dense_voxels", use_dense_voxels);
 	kwmb.add("use_voxel_cobjs", use_voxel_cobjs);
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
+	kwmb.add("sah_cobj_tree_build", sah_cobj_tree_build);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
+	kwmb.add("use_ray_packets", use_ray_packets);
+	kwmb.add("progressive_lighting", progressive_lighting);
+	kwmb.add("compress_lighting_files", compress_lighting_files);
 	kwmb.add("two_sided_lighting", two_sided_lighting);
 	kwmb.add("disable_sound", disable_sound);
 	kwmb.add("start_maximized", start_maximized);
@@ -1775,6 +1789,7 @@ int load_config(string const &config_file) {
 	kwmb.add("disable_dlights", disable_dlights);
 	kwmb.add("enable_hcopter_shadows", enable_hcopter_shadows);
 	kwmb.add("pre_load_full_tiled_terrain", pre_load_full_tiled_terrain);
+	kwmb.add("tile_streaming", tile_streaming);
 
 	kw_to_val_map_t<int> kwmi(error);
 	kwmi.add("verbose", verbose_mode);
@@ -1814,12 +1829,14 @@ int load_config(string const &config_file) {
 	kwmu.add("grass_density", grass_density);
 	kwmu.add("max_unique_trees", max_unique_trees);
 	kwmu.add("shadow_map_sz", shadow_map_sz);
+	kwmu.add("lighting_cache_chunks_per_frame", lighting_cache_chunks_per_frame);
 	kwmu.add("max_ray_bounces", MAX_RAY_BOUNCES);
 	kwmu.add("num_test_snowflakes", num_snowflakes);
 	kwmu.add("hmap_filter_width", hmap_filter_width);
 	kwmu.add("erosion_iters", erosion_iters);
 	kwmu.add("erosion_iters_tt", erosion_iters_tt);
 	kwmu.add("num_dynam_parts", num_dynam_parts);
+	kwmu.add("cobj_tree_benchmark_queries", cobj_tree_bench_queries);
 	kwmu.add("num_birds_per_tile", num_birds_per_tile);
 	kwmu.add("num_fish_per_tile", num_fish_per_tile);
 	kwmu.add("num_bflies_per_tile", num_bflies_per_tile);
@@ -1832,6 +1849,9 @@ int load_config(string const &config_file) {
 	kwmf.add("gravity", base_gravity);
 	kwmf.add("mesh_height", mesh_height_scale);
 	kwmf.add("mesh_scale", mesh_scale);
+	kwmf.add("cobj_tree_refit_max_area_ratio", cobj_tree_refit_max_area_ratio);
+	kwmf.add("tile_upload_budget_ms", tile_upload_budget_ms);
+	kwmf.add("model_tex_upload_budget_ms", model_tex_upload_budget_ms);
 	kwmf.add("mesh_z_cutoff", mesh_z_cutoff);
 	kwmf.add("disabled_mesh_z", disabled_mesh_z);
 	kwmf.add("relh_adj_tex", relh_adj_tex);
@@ -1932,6 +1952,7 @@ int load_config(string const &config_file) {
 
 	kw_to_val_map_t<string> kwms(error);
 	kwms.add("cobjs_out_filename", cobjs_out_fn);
+	kwms.add("trace_filename",     trace_filename);
 	kwms.add("coll_damage_name",   coll_damage_name);
 	kwms.add("read_hmap_modmap_filename",  read_hmap_modmap_fn);
 	kwms.add("write_hmap_modmap_filename", write_hmap_modmap_fn);
@@ -1975,6 +1996,9 @@ int load_config(string const &config_file) {
 		else if (str == "sphere_gen") { // sphere_gen options
 			if (!parse_sphere_gen_option(fp)) cfg_err("sphere_gen option", error);
 		}
+		else if (str == "benchmark") { // benchmark options
+			if (!parse_benchmark_option(fp)) cfg_err("benchmark option", error);
+		}
 		else if (str == "include") {
 			if (!read_str(fp, include_fname)) cfg_err("include", error);
 			if (!load_config(include_fname )) cfg_err("nested include file", error);
@@ -2266,7 +2290,9 @@ void init_debug_callback() {
 int main(int argc, char** argv) {
 
 	cout << "Starting 3DWorld" << endl;
-	if (argc == 2) {read_ueventlist(argv[1]);}
+	char const *top_config_file(defaults_file);
+	if (argc == 3 && strcmp(argv[1], "-config") == 0) {top_config_file = argv[2];} // alternate top-level config file, for example for benchmarks
+	else if (argc == 2) {read_ueventlist(argv[1]);}
 	int rs(1);
 	if      (srand_param == 1) {rs = GET_TIME_MS();}
 	else if (srand_param != 0) {rs = srand_param;}
@@ -2274,8 +2300,10 @@ int main(int argc, char** argv) {
 	create_sin_table();
 	set_scene_constants();
 	load_texture_names(); // needs to be before config file load
-	load_top_level_config(defaults_file);
+	load_top_level_config(top_config_file);
 	gen_gauss_rand_arr(); // after reading seed from config file
+	if (!init_benchmark()) {exit(1);}
+	if (benchmark_cpu_only()) {run_cpu_only_benchmark();} // never returns
 	cout << "Loading."; cout.flush();
 	
  	// Initialize GLUT
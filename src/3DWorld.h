@@ -23,6 +23,7 @@
 #include <string>
 #include <sstream>
 #include <iterator>
+#include <atomic>
 
 #undef timer_t
 
@@ -44,7 +45,6 @@ using std::max;
 
 int      const CAMERA_ID        = -1;
 int      const NO_SOURCE        = -2;
-unsigned const INIT_CCELL_SIZE  = 16;
 float    const LARGE_OBJ_RAD    = 0.01;
 float    const TOLERANCE        = 1.0E-12;
 float    const ABSOLUTE_ZERO    = -273; // in degrees C
@@ -1005,6 +1005,15 @@ public:
 colorRGBA const DEF_TEX_COLOR(0.0, 0.0, 0.0, 0.0); // black with alpha of 0.0
 
 
+struct texture_level_t { // one mipmap level, ready to send to the GPU
+	unsigned w, h;
+	bool compressed;
+	vector<unsigned char> data; // empty for an uncompressed base level, which is sent from the texture's data
+	texture_level_t(unsigned w_=0, unsigned h_=0, bool comp=0) : w(w_), h(h_), compressed(comp) {}
+};
+typedef vector<texture_level_t> texture_levels_t;
+
+
 class texture_t { // size >= 116
 
 public:
@@ -1018,7 +1027,8 @@ protected:
 	unsigned char *data, *orig_data, *colored_data;
 	unsigned tid;
 	colorRGBA color;
-	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, NUM_DEFER_TYPE};
+	uint64_t cache_params_hash=0; // set by read_from_cache(), to validate the file when it's read again for the upload
+	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, DEFER_TYPE_CACHE, NUM_DEFER_TYPE}; // cache: mipmap levels are read from a texture cache file
 
 	void maybe_swap_rb(unsigned char *ptr) const;
 
@@ -1036,8 +1046,15 @@ public:
 	void set_16_bit_grayscale();
 	void init() {calc_color();}
 	void do_gl_init(bool free_after_upload=0);
-	void compress_and_send_texture();
-	void create_compressed_mipmaps();
+	bool uses_custom_compress() const;
+	void calc_gl_levels(texture_levels_t &levels, bool full_mip_chain=0) const; // CPU part of do_gl_init(); makes no GL calls, so can be run on a worker thread
+	void gl_init_from_levels(texture_levels_t const &levels, bool free_after_upload=0);
+	void upload_levels(texture_levels_t const &levels);
+	bool read_from_cache(uint64_t params_hash, texture_levels_t &levels);
+	bool write_to_cache (uint64_t params_hash, texture_levels_t const &levels) const;
+	void deferred_load_cache();
+	void ensure_data_loaded();
+	void calc_mipmap_level(unsigned char const *const idata, unsigned w, unsigned h, vector<unsigned char> &odata, bool custom_alpha) const;
 	void upload_cube_map_face(unsigned ix);
 	bool is_texture_compressed() const;
 	GLenum calc_internal_format() const;
@@ -1046,7 +1063,6 @@ public:
 	void calc_color();
 	void copy_alpha_from_texture(texture_t const &at, bool alpha_in_red_comp);
 	void merge_in_alpha_channel(texture_t const &at);
-	void create_custom_mipmaps();
 	void set_to_color(colorRGBA const &c);
 	void maybe_assign_normal_map_tid(int nm_tid) {if (nm_tid >= 0 && bump_tid < 0) {bump_tid = nm_tid;}}
 	void alloc();
@@ -1275,6 +1291,9 @@ colorRGBA const BACKGROUND_NIGHT(BLACK);
 void register_timing_value(const char *str, int delta_time, bool no_loading_screen=0);
 void toggle_timing_profiler();
 void timing_profiler_stats();
+void set_timing_sample_recording(bool enable);
+void add_timing_sample(const char *str, float delta_time_ms);
+bool write_timing_sample_report(std::string const &fn, unsigned num_frames);
 
 // macros
 #define GET_TIME_MS()    glutGet(GLUT_ELAPSED_TIME)
@@ -1297,15 +1316,26 @@ void timing_profiler_stats();
 #define PRINT_TIME2(str) {cout << str << " time = " << GET_DELTA_TIME << endl;}
 #endif
 
+// trace zones, see profiler.h; timers also add themselves to the trace when tracing is enabled
+extern std::atomic<bool> trace_enabled; // written by start_trace()/stop_trace_and_write(), read by any thread
+unsigned long long get_trace_time_ns();
+void add_trace_zone(std::string const &name, unsigned long long start_ns);
+
 class timer_t {
 	std::string name;
 	int timer1;
 	bool enabled, no_loading_screen;
+	unsigned long long trace_start;
 public:
-	timer_t(char const *const name_,  bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls) {}
-	timer_t(std::string const &name_, bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls) {}
+	timer_t(char const *const name_,  bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls), trace_start(trace_enabled.load(std::memory_order_relaxed) ? get_trace_time_ns() : 0) {}
+	timer_t(std::string const &name_, bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls), trace_start(trace_enabled.load(std::memory_order_relaxed) ? get_trace_time_ns() : 0) {}
 	~timer_t() {end();}
-	void end() {if (enabled && !name.empty()) {register_timing_value(name.c_str(), GET_DELTA_TIME, no_loading_screen); name.clear();}}
+	void end() {
+		if (!enabled || name.empty()) return;
+		if (trace_start) {add_trace_zone(name, trace_start);}
+		register_timing_value(name.c_str(), GET_DELTA_TIME, no_loading_screen);
+		name.clear();
+	}
 };
 
 
@@ -1187,6 +1187,8 @@ void exp_damage_groups(point const &pos, int shooter, int chain_level, float dam
 			camera_collision(type, shooter, zero_vector, pos, damage*(1.02 - dist/size), BLAST_RADIUS);
 		}
 	}
+	obj_grid_query_t grid_query(pos, size); // objects that may be within size of pos
+
 	for (int g = 0; g < num_groups; ++g) { // apply blast radius damage to objects
 		obj_group &objg(obj_groups[g]);
 		if (!objg.enabled) continue;
@@ -1203,7 +1205,7 @@ void exp_damage_groups(point const &pos, int shooter, int chain_level, float dam
 		unsigned const nobj(objg.end_id);
 		assert(nobj <= objg.max_objects());
 
-		for (unsigned i = 0; i < nobj; ++i) {
+		for (unsigned i : grid_query.get_group_ixs(g, nobj)) {
 			if (!objg.obj_within_dist(i, pos, size)) continue; // size+radius?
 			dwobject &obj(objg.get_obj(i));
 			if (large_obj && !check_explosion_damage(pos, obj.pos, obj.coll_id)) continue; // blocked by an object
@@ -1413,6 +1415,7 @@ void do_impact_damage(point const &fpos, vector3d const &dir, vector3d const &ve
 	}
 	point pos(fpos + dir*(1.25*radius));
 	float const coll_radius(0.75*radius);
+	obj_grid_query_t grid_query(pos, coll_radius);
 
 	for (int g = 0; g < num_groups; ++g) {
 		obj_group &objg(obj_groups[g]);
@@ -1420,7 +1423,7 @@ void do_impact_damage(point const &fpos, vector3d const &dir, vector3d const &ve
 		int const type(objg.type);
 		float const robj(object_types[type].radius), rad(coll_radius + robj);
 		
-		for (unsigned i = 0; i < objg.end_id; ++i) {
+		for (unsigned i : grid_query.get_group_ixs(g, objg.end_id)) {
 			if (type == SMILEY && (int)i == shooter) continue; // this is the shooter
 			if (!objg.obj_within_dist(i, pos, rad))  continue;
 
@@ -1470,8 +1473,8 @@ void do_impact_damage(point const &fpos, vector3d const &dir, vector3d const &ve
 }
 
 
-// fire and gas damage and telefrags (Note: index is unused)
-void do_area_effect_damage(point const &pos, float effect_radius, float damage, int index, int source, int type) {
+// fire and gas damage and telefrags (Note: index is unused); smiley_cands are the smileys that may be within effect_radius, from a batch query
+void do_area_effect_damage(point const &pos, float effect_radius, float damage, int index, int source, int type, vector<obj_grid_ref_t> const *smiley_cands) {
 
 	float const radius(object_types[SMILEY].radius + effect_radius);
 	point camera_pos(get_camera_pos());
@@ -1490,7 +1493,9 @@ void do_area_effect_damage(point const &pos, float effect_radius, float damage,
 	obj_group const &objg(obj_groups[coll_id[SMILEY]]);
 	
 	if (objg.enabled) { // test the smileys
-		for (unsigned i = 0; i < objg.end_id; ++i) {
+		obj_grid_query_t grid_query(smiley_cands ? obj_grid_query_t(*smiley_cands) : obj_grid_query_t(pos, radius, coll_id[SMILEY]));
+
+		for (unsigned i : grid_query.get_group_ixs(coll_id[SMILEY], objg.end_id)) {
 			if (!objg.get_obj(i).disabled() && dist_less_than(pos, objg.get_obj(i).pos, radius)) {
 				// test for objects blocking the damage effects?
 				smiley_collision(i, ((source == NO_SOURCE) ? i : source), zero_vector, pos, damage, type);
@@ -5,6 +5,8 @@
 #include "3DWorld.h"
 #include "mesh.h"
 #include "physics_objects.h"
+#include "job_system.h"
+#include "profiler.h"
 
 
 float    const KILL_DEPTH          = 12.0;
@@ -26,10 +28,12 @@ float    const BURN_DAMAGE         = 1200.0;
 unsigned const MAX_FIRE_TIME       = 10000;
 bool     const ball_camera_view    = 0;
 bool     const PRINT_TIME_OF_DAY   = 1;
+unsigned const OBJ_PHYS_BLOCK_SIZE = 64; // objects per command buffer in parallel object physics
+unsigned const PART_PHYS_BLOCK_SIZE= 1024; // particles per parallel block
 
 
 // Global Variables
-bool no_sun_lpos_update(0);
+bool no_sun_lpos_update(0), mt_object_physics(1);
 int TIMESCALE2(TIMESCALE), I_TIMESCALE2(0);
 float temperature(DEF_TEMPERATURE), max_obj_radius(0.0), cloud_cover(0.0), rain_wetness(0.0), snow_cov_amt(0.0); // temp in degrees C
 float TIMESTEP(DEF_TIMESTEP), orig_timestep(DEF_TIMESTEP);
@@ -58,6 +62,41 @@ extern physics_particle_manager explosion_part_man[];
 int get_obj_zval(point &pt, float &dz, float z_offset);
 int snow_height(point pos);
 
+thread_local physics_cmd_buffer_t *cur_physics_cmd_buf(nullptr);
+
+
+void physics_cmd_t::apply(vector<obj_grid_ref_t> const *smiley_cands) const {
+
+	switch (type) {
+	case CMD_SPLASH: draw_splash(pos.x, pos.y, pos.z, radius, color); break;
+	case CMD_SMOKE:  add_smoke(pos, 1.0); break;
+	case CMD_AREA_DAMAGE:
+		if (flag) {modify_grass_at(pos, radius, 0, 1);} // burn grass
+		do_area_effect_damage(pos, radius, value, obj_ix, source, damage_type, smiley_cands);
+		break;
+	case CMD_FIRE_LIGHT:
+		add_dynamic_light(3*radius, pos, color);
+		if (flag) {gen_fire(pos, 1.0, source);}
+		break;
+	case CMD_EXPLOSION: create_explosion(pos, source, 0, value, 4*radius, BLAST_RADIUS, 0); break;
+	default: assert(0);
+	}
+}
+
+physics_cmd_scope_t::physics_cmd_scope_t(physics_cmd_buffer_t &buf) : prev(cur_physics_cmd_buf) {cur_physics_cmd_buf = &buf;}
+physics_cmd_scope_t::~physics_cmd_scope_t() {cur_physics_cmd_buf = prev;}
+
+void defer_physics_cmd(physics_cmd_t const &cmd) {
+	if (cur_physics_cmd_buf) {cur_physics_cmd_buf->add(cmd);} else {cmd.apply();}
+}
+
+rand_gen_t get_obj_physics_rgen(unsigned obj_ix, unsigned group_ix) { // depends only on the frame and object, not on which thread runs it
+	rand_gen_t rgen;
+	rgen.set_state((frame_counter + 1), ((group_ix << 24) + obj_ix + 1));
+	rgen.rand_mix();
+	return rgen;
+}
+
 
 float get_max_t(int obj_type) {return object_types[obj_type].max_t;}
 
@@ -699,6 +738,7 @@ float dwobject::get_true_radius() const {
 	case DIRT:       return radius*orientation.x;
 	case ROCK:       return radius*orientation.x;
 	case PLASMA:     return radius*init_dir.x;
+	case SMOKE:      return init_dir.x; // temporary object for particle cloud collisions; the cloud radius is stored here
 	case MAT_SPHERE: return radius*get_mat_sphere_rscale(*this);
 	}
 	return radius;
@@ -1428,7 +1468,7 @@ void bubble::apply_physics(unsigned i) {
 		status = 0; // out of simulation region
 	}
 	else if (pos.z >= water_matrix[ypos][xpos]) {
-		draw_splash(pos.x, pos.y, water_matrix[ypos][xpos], 2.0*radius, color);
+		defer_physics_cmd(physics_cmd_t(physics_cmd_t::CMD_SPLASH, point(pos.x, pos.y, water_matrix[ypos][xpos]), 2.0*radius, 0.0, NO_SOURCE, color));
 		status = 0; // pops at water surface
 	}
 }
@@ -1446,7 +1486,7 @@ void particle_cloud::apply_physics(unsigned i) {
 	vector3d v_flow(get_flow_velocity(pos));
 	int coll(0);
 	dwobject obj(SMOKE, pos, zero_vector, 1, 10000.0); // make a SMOKE object for collision detection
-	object_types[SMOKE].radius = radius;
+	obj.init_dir.x = radius; // see dwobject::get_true_radius()
 	unsigned const steps((czmax > -FAR_DISTANCE && pos.z > czmax) ? 1 : num_smoke_advance);
 
 	for (unsigned j = 0; j < steps; ++j) {
@@ -1458,7 +1498,7 @@ void particle_cloud::apply_physics(unsigned i) {
 		if (obj.check_vert_collision(0, 0, j, &cnorm, all_zeros, 1, 1)) { // skip dynamic, only_drawn
 			// destroy the smoke if it's not damaging and hits the bottom of a static drawn object (excludes trees and scenery)
 			if (cnorm.z < 0.0 && damage == 0.0) { // <= 0.0?
-				if (acc_smoke && time > 0) add_smoke(pos, 1.0);
+				if (acc_smoke && time > 0) {defer_physics_cmd(physics_cmd_t(physics_cmd_t::CMD_SMOKE, pos));}
 				status = 0;
 				return;
 			}
@@ -1476,19 +1516,23 @@ void particle_cloud::apply_physics(unsigned i) {
 	if (darkness < 0.0001) {darkness = 0.0;}
 	
 	if (damage > 0.0) {
-		if (is_fire()) {modify_grass_at(pos, radius, 0, 1);} // burn grass
-		do_area_effect_damage(pos, radius, damage*rscale, i, source, damage_type);
+		physics_cmd_t cmd(physics_cmd_t::CMD_AREA_DAMAGE, pos, radius, damage*rscale, source);
+		cmd.flag        = is_fire(); // burn grass
+		cmd.damage_type = damage_type;
+		cmd.obj_ix      = i;
+		defer_physics_cmd(cmd);
 	}
 	if (is_fire()) {
 		colorRGBA color(base_color);
 		color.G *= rscale;
-		add_dynamic_light(3*radius, pos, color);
-		if (coll && radius >= MAX_PART_CLOUD_RAD && (rand()&7) == 0) {gen_fire(pos, 1.0, source);} // will be destoyed next frame
+		physics_cmd_t cmd(physics_cmd_t::CMD_FIRE_LIGHT, pos, radius, 0.0, source, color);
+		cmd.flag = (coll && radius >= MAX_PART_CLOUD_RAD && (get_obj_physics_rgen(i, 0).rand() & 7) == 0); // spawn a fire; will be destoyed next frame
+		defer_physics_cmd(cmd);
 	}
 	if (damage_type == GASSED) { // check for gas ignition near fire
 		for (unsigned f = 0; f < fires.size(); ++f) {
 			if (fires[f].enabled() && dist_less_than(fires[f].pos, pos, radius)) {
-				create_explosion(pos, source, 0, 10*damage*rscale, 4*radius, BLAST_RADIUS, 0);
+				defer_physics_cmd(physics_cmd_t(physics_cmd_t::CMD_EXPLOSION, pos, radius, 10*damage*rscale, source));
 				status = 0;
 				return;
 			}
@@ -1608,25 +1652,35 @@ void physics_particle_manager::apply_physics(float gravity, float terminal_veloc
 
 	if (parts.empty()) return;
 	//RESET_TIME;
-	unsigned o(0);
+	unsigned const num(parts.size()), num_blocks((num + PART_PHYS_BLOCK_SIZE - 1)/PART_PHYS_BLOCK_SIZE);
 	float const g_acc(base_gravity*GRAVITY*tstep*gravity), xy_damp(pow(0.98f, fticks));
-
-	for (unsigned i = 0; i < parts.size(); ++i) {
-		part_t &part(parts[i]);
-		part.v.z  = max(-terminal_velocity, (part.v.z - g_acc)); // apply gravity + terminal velocity
-		part.v.x *= xy_damp;
-		part.v.y *= xy_damp;
-		//point const p0(part.p);
-		part.p   += tstep*part.v; // add velocity to position
-		if (emissive) {part.c.set_c3(colorRGBA(1.0, 1.0-0.75*max(0.0f, -part.v.z/terminal_velocity), 0.0));} // varies from yellow to red-orange based on vz/vt
-		int cindex;
+	vector<unsigned char> keep(num, 0);
+
+	parallel_for_jobs(0, num_blocks, [&](int b) {
+		unsigned const end(min(num, (b+1)*PART_PHYS_BLOCK_SIZE));
+
+		for (unsigned i = b*PART_PHYS_BLOCK_SIZE; i < end; ++i) {
+			part_t &part(parts[i]);
+			part.v.z  = max(-terminal_velocity, (part.v.z - g_acc)); // apply gravity + terminal velocity
+			part.v.x *= xy_damp;
+			part.v.y *= xy_damp;
+			//point const p0(part.p);
+			part.p   += tstep*part.v; // add velocity to position
+			if (emissive) {part.c.set_c3(colorRGBA(1.0, 1.0-0.75*max(0.0f, -part.v.z/terminal_velocity), 0.0));} // varies from yellow to red-orange based on vz/vt
+			int cindex;
 		
-		//if (check_coll_line(p0, part.p, cindex, -1, 1, 0)) { // skip dynamic
-		if (check_point_contained_tree(part.p, cindex, 0)) { // skip dynamic
-			continue; // destroy particle, don't bounce
-			//part.p = cpos; vector3d bounce_v; calc_reflection_angle(part.v.get_norm(), bounce_v, cnorm); part.v = 0.9*part.v.mag()*bounce_v;
+			//if (check_coll_line(p0, part.p, cindex, -1, 1, 0)) { // skip dynamic
+			if (check_point_contained_tree(part.p, cindex, 0)) { // skip dynamic
+				continue; // destroy particle, don't bounce
+				//part.p = cpos; vector3d bounce_v; calc_reflection_angle(part.v.get_norm(), bounce_v, cnorm); part.v = 0.9*part.v.mag()*bounce_v;
+			}
+			keep[i] = is_pos_valid(part.p); // above water and mesh
 		}
-		if (is_pos_valid(part.p)) {parts[o++] = part;} // above water and mesh - copy/compact
+	}, 1, (mt_object_physics ? 0 : 1));
+	unsigned o(0);
+
+	for (unsigned i = 0; i < num; ++i) { // copy/compact in the original order
+		if (keep[i]) {parts[o++] = parts[i];}
 	}
 	parts.resize(o);
 	//PRINT_TIME("Particle Physics"); // 0.07ms average / 0.24ms with collisions
@@ -1644,10 +1698,49 @@ template<typename T> void shift_objs(vector<T> &objs, vector3d const &vd) {
 	}
 }
 
-template<typename T> void apply_obj_physics(vector<T> &objs) {
+template<typename T> void apply_obj_physics(vector<T> &objs) { // serial, with immediate side effects
 	for (unsigned i = 0; i < objs.size(); ++i) {objs[i].apply_physics(i);}
 }
 
+// objects are processed in fixed size blocks with one command buffer per block, so the order of side effects doesn't depend on the thread count
+template<typename T> void apply_obj_physics(vector<T> &objs, vector<physics_cmd_buffer_t> &cmd_bufs, bool parallel) {
+
+	unsigned const num(objs.size()), num_blocks((num + OBJ_PHYS_BLOCK_SIZE - 1)/OBJ_PHYS_BLOCK_SIZE);
+	if (cmd_bufs.size() < num_blocks) {cmd_bufs.resize(num_blocks);}
+
+	parallel_for_jobs(0, num_blocks, [&](int b) {
+		physics_cmd_scope_t const scope(cmd_bufs[b]);
+		unsigned const end(min(num, (b+1)*OBJ_PHYS_BLOCK_SIZE));
+		for (unsigned i = b*OBJ_PHYS_BLOCK_SIZE; i < end; ++i) {objs[i].apply_physics(i);}
+	}, 1, (parallel ? 0 : 1));
+}
+
+void apply_physics_cmds(vector<physics_cmd_buffer_t> &cmd_bufs) {
+
+	// the smileys hit by each area damage command (damaging smoke and gas clouds) are found with one batch grid query rather than one query per command
+	vector<sphere_t> spheres;
+	vector<vector<obj_grid_ref_t>> smiley_cands;
+	int const smiley_cid(coll_id[SMILEY]);
+
+	if (smiley_cid >= 0 && obj_groups[smiley_cid].enabled) {
+		for (physics_cmd_buffer_t const &buf : cmd_bufs) {
+			for (physics_cmd_t const &cmd : buf.get_cmds()) {
+				if (cmd.type == physics_cmd_t::CMD_AREA_DAMAGE) {spheres.emplace_back(cmd.pos, (object_types[SMILEY].radius + cmd.radius));}
+			}
+		}
+	}
+	bool const use_cands(spheres.size() > 1 && get_objs_in_spheres(spheres, smiley_cands, smiley_cid));
+	unsigned cand_ix(0);
+
+	for (physics_cmd_buffer_t &buf : cmd_bufs) {
+		for (physics_cmd_t const &cmd : buf.get_cmds()) {
+			bool const is_damage(use_cands && cmd.type == physics_cmd_t::CMD_AREA_DAMAGE);
+			cmd.apply(is_damage ? &smiley_cands[cand_ix++] : nullptr);
+		}
+		buf.clear();
+	}
+}
+
 
 void shift_other_objs(vector3d const &vd) {
 
@@ -1658,14 +1751,31 @@ void shift_other_objs(vector3d const &vd) {
 }
 
 
+// groups are updated in the original order, so each group sees the side effects of the groups before it; particle clouds and bubbles are split into
+// blocks that are updated in parallel, and their side effects (damage, lights, new fires, explosions, etc.) are deferred into one command buffer per block
+// and applied in object order right after the group. Within these groups, an object doesn't see the side effects of earlier objects in the same frame.
 void advance_physics_objects() {
 
-	apply_obj_physics(part_clouds);
+	TRACE_ZONE("Object Physics");
+	static vector<physics_cmd_buffer_t> cloud_cmds, bubble_cmds; // reused across frames
+	static vector<unsigned char> cloud_enabled;
+	bool const parallel(mt_object_physics);
+	apply_obj_physics(part_clouds, cloud_cmds, parallel);
+	cloud_enabled.resize(part_clouds.size());
+	for (unsigned i = 0; i < part_clouds.size(); ++i) {cloud_enabled[i] = part_clouds[i].enabled();}
+	apply_physics_cmds(cloud_cmds);
+
+	// advance clouds created by cloud side effects (explosion smoke, etc.) this frame; a cloud that replaced the oldest enabled cloud is advanced next frame
+	for (unsigned i = 0; i < part_clouds.size(); ++i) {
+		if (part_clouds[i].enabled() && (i >= cloud_enabled.size() || !cloud_enabled[i])) {part_clouds[i].apply_physics(i);}
+	}
+	// fires set the shared FIRE object type radius for collisions, and their collision checks can call cobj coll functions
 	apply_obj_physics(fires);
 	for (unsigned d = 0; d < 2; ++d) {explosion_part_man[d].apply_physics(0.5, 4.0, (d == 1));} // gravity=0.5, air_factor=0.25
 
 	if (world_mode == WMODE_GROUND) { // these don't apply to tiled terrain mode
-		apply_obj_physics(bubbles);
+		apply_obj_physics(bubbles, bubble_cmds, parallel);
+		apply_physics_cmds(bubble_cmds);
 		apply_obj_physics(decals);
 		water_part_man.apply_physics();
 		for (unsigned i = 0; i < decals.size(); ++i) {decals[i].check_cobj();}
@@ -7,6 +7,9 @@
 #include "textures.h"
 #include "gl_ext_arb.h"
 #include "shaders.h"
+#include "job_system.h"
+#include <mutex>
+#include <atomic>
 
 
 float const TEXTURE_SMOOTH        = 0.01;
@@ -189,6 +192,9 @@ texture_map_t noise_tex_3ds;
 
 typedef map<string, unsigned> name_map_t;
 name_map_t texture_name_map;
+std::mutex texture_name_mutex; // protects texture_name_map and adding textures by name, which can be done by jobs that generate building room geom
+unsigned const NUM_RESERVED_TEXTURES = 2048; // textures loaded by name after startup; textures can only be added while jobs exist if the vector has spare capacity
+std::atomic<unsigned> num_texture_user_jobs(0); // jobs that may read textures or add them by name; counted from when they're added on the main thread
 
 bool textures_inited(0), def_tex_compress(1);
 int landscape_changed(0), lchanged0(0), skip_regrow(0), ltx1(0), lty1(0), ltx2(0), lty2(0), ls0_invalid(1);
@@ -230,6 +236,7 @@ bool is_tex_disabled(int i) {
 void load_texture_names() {
 
 	if (!texture_name_map.empty()) return; // already loaded
+	textures.reserve(sizeof(def_textures)/sizeof(texture_t) + NUM_RESERVED_TEXTURES); // so that adding textures doesn't move textures other threads are using
 	textures.resize(sizeof(def_textures)/sizeof(texture_t));
 
 	for (unsigned i = 0; i < textures.size(); ++i) {
@@ -256,7 +263,7 @@ void set_landscape_texture_from_file() {
 }
 
 
-void load_textures() {
+void load_textures(bool cpu_only) { // cpu_only: load/generate texture data but don't create any GL textures (for headless benchmarks)
 
 	timer_t timer("Texture Load");
 	cout << "Loading " << textures.size() << " textures" << endl;
@@ -282,13 +289,17 @@ void load_textures() {
 	gen_blur_cent_texture();
 	gen_gradient_texture();
 	gen_noise_texture();
-	load_font_texture_atlas();
+	if (!cpu_only) {load_font_texture_atlas();}
 
 	if (!universe_only) {
 		gen_wind_texture();
 		gen_tree_hemi_texture();
 		gen_tree_end_texture();
 	}
+	if (cpu_only) {
+		textures[TREE_HEMI_TEX].set_color_alpha_to_one();
+		return;
+	}
 	for (unsigned i = 0; i < textures.size(); ++i) {
 		if (is_tex_disabled(i)) continue; // skip
 		if (i == BLDG_WINDOW_TEX || i == BLDG_WIND_TRANS_TEX || i == LANDSCAPE_TEX) continue; // not yet generated
@@ -318,10 +329,31 @@ void print_texture_memory_usage() { // full cities scene: 142MB / 272MB (660MB u
 }
 
 
-int texture_lookup(string const &name) {
+int texture_lookup_no_lock(string const &name) {
 	name_map_t::const_iterator it(texture_name_map.find(name));
 	return ((it != texture_name_map.end()) ? it->second : -1);
 }
+int texture_lookup(string const &name) {
+	std::lock_guard<std::mutex> lock(texture_name_mutex);
+	return texture_lookup_no_lock(name);
+}
+
+void begin_texture_user_job() {++num_texture_user_jobs;} // call on the main thread before adding the job
+void end_texture_user_job  () {--num_texture_user_jobs;} // call at the end of the job
+
+// texture_name_mutex must be held; every add to textures must check this, since reallocating textures would invalidate it for running jobs
+bool can_add_texture_no_lock(string const &name, bool is_job) {
+	if (textures.size() < textures.capacity() || !(is_job || num_texture_user_jobs > 0)) return 1;
+	std::cerr << "Error: Too many textures to add texture " << name << " while jobs are running; increase NUM_RESERVED_TEXTURES" << endl;
+	return 0;
+}
+
+int add_texture(texture_t const &tex) { // for textures that aren't looked up by name, such as screenshots; returns -1 if it can't be added now
+	std::lock_guard<std::mutex> lock(texture_name_mutex);
+	if (!can_add_texture_no_lock(tex.name, (get_job_worker_index() != 0))) return -1;
+	textures.push_back(tex);
+	return (textures.size() - 1);
+}
 
 int get_texture_by_name(string const &name, bool is_normal_map, bool invert_y, int wrap_mir, float aniso, bool allow_compress, int use_mipmaps, unsigned ncolors) {
 
@@ -331,17 +363,23 @@ int get_texture_by_name(string const &name, bool is_normal_map, bool invert_y, i
 	int tid(texture_lookup(name));
 	if (tid >= 0) {assert((unsigned)tid < textures.size()); return tid;}
 	//timer_t timer("Load Texture " + name);
+	bool const is_job(get_job_worker_index() != 0);
 	// try to load/add the texture directly from a file: assume it's RGB with wrap and mipmaps
-	tid = textures.size();
 	bool const do_compress(allow_compress && def_tex_compress && !is_normal_map);
 	// type format width height wrap_mir ncolors use_mipmaps name [invert_y=0 [do_compress=1 [anisotropy=1.0 [mipmap_alpha_weight=1.0 [normal_map=0]]]]]
 	texture_t new_tex(0, 7, 0, 0, wrap_mir, ncolors, use_mipmaps, name, invert_y, do_compress, ((aniso > 0.0) ? aniso : def_tex_aniso), 1.0, is_normal_map);
 
-	if (textures_inited) {
-		new_tex.load(tid);
+	if (textures_inited) { // read and decode the file without holding the lock, so that lookups from other jobs aren't blocked
+		new_tex.load(-1); // the index is only used to special case predefined textures
 		if (ncolors == 1 && new_tex.ncolors == 4) {new_tex.fill_to_grayscale_color(255);} // alpha mask - fill color to white
-		new_tex.init();
 	}
+	std::lock_guard<std::mutex> lock(texture_name_mutex);
+	tid = texture_lookup_no_lock(name);
+	if (tid >= 0) {new_tex.free_data(); return tid;} // loaded by another thread in the meantime
+
+	if (!can_add_texture_no_lock(name, is_job)) {new_tex.free_data(); return -1;}
+	if (textures_inited && !is_job) {new_tex.init();} // jobs can't make GL calls; the texture is initialized when first selected
+	tid = textures.size();
 	textures.push_back(new_tex);
 	texture_name_map[name] = tid;
 	return tid;
@@ -507,34 +545,58 @@ GLenum texture_t::calc_format() const {
 }
 
 
+bool texture_t::uses_custom_compress() const { // compressed RGB or RGBA
+	return (USE_STB_DXT && is_texture_compressed() && (ncolors == 3 || ncolors == 4));
+}
+
 void texture_t::do_gl_init(bool free_after_upload) {
 
 	//cout << "bind texture " << name << " size " << width << "x" << height << endl;
 	//timer_t timer(("Load and Upload Texture " + name), 1, 1);
-	setup_texture(tid, (use_mipmaps != 0 && !defer_load()), wrap, wrap, mirror, mirror, 0, anisotropy);
+	texture_levels_t levels;
+	if (!defer_load()) {calc_gl_levels(levels);}
+	gl_init_from_levels(levels, free_after_upload);
+}
+
+void texture_t::gl_init_from_levels(texture_levels_t const &levels, bool free_after_upload) { // levels come from calc_gl_levels() or the texture cache
+
+	bool const has_mipmaps(use_mipmaps != 0 && (!defer_load() || defer_load_type == DEFER_TYPE_CACHE)); // cache files contain all mipmap levels
+	setup_texture(tid, has_mipmaps, wrap, wrap, mirror, mirror, 0, anisotropy);
 
 	if (SHOW_TEXTURE_MEMORY) {
 		static unsigned tmem(0);
 		tmem += get_gpu_mem();
 		cout << "tex vmem = " << tmem << endl;
 	}
-	if (defer_load()) {deferred_load_and_bind();} // Note: mipmaps are stored in the DDS file and aren't controlled by the use_mipmaps option
-	else {
-		assert(is_allocated());
-		assert(width > 0 && height > 0);
-		bool const compressed(is_texture_compressed()), use_custom_compress(USE_STB_DXT && compressed && (ncolors == 3 || ncolors == 4));
+	// Note: mipmaps are stored in the DDS file and aren't controlled by the use_mipmaps option
+	if (defer_load() && levels.empty()) {deferred_load_and_bind();}
+	else {upload_levels(levels);}
+	if (free_after_upload) {free_client_mem();}
+}
 
-		if (use_custom_compress) {compress_and_send_texture();} // compressed RGB or RGBA
-		else { // font atlas and noise gen texture
-			glTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, calc_format(), get_data_format(), data);
+void texture_t::upload_levels(texture_levels_t const &levels) { // to the currently bound texture
+
+	assert(!levels.empty());
+	GLenum const internal_format(calc_internal_format());
+
+	for (unsigned level = 0; level < levels.size(); ++level) {
+		texture_level_t const &lv(levels[level]);
+
+		if (lv.compressed) {
+			GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, lv.w, lv.h, 0, lv.data.size(), lv.data.data());)
 		}
-		if (use_mipmaps == 1 || use_mipmaps == 2) {
-			if (use_custom_compress) {create_compressed_mipmaps();}
-			else {gen_mipmaps();}
+		else if (lv.data.empty()) { // font atlas and noise gen texture
+			assert(level == 0);
+			assert(is_allocated());
+			glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, calc_format(), get_data_format(), data);
 		}
-		else if (use_mipmaps == 3 || use_mipmaps == 4) {create_custom_mipmaps();}
-	}
-	if (free_after_upload) {free_client_mem();}
+		else { // mipmaps created on the CPU
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // needed for mipmap levels where width*ncolors is not aligned
+			glTexImage2D(GL_TEXTURE_2D, level, internal_format, lv.w, lv.h, 0, calc_format(), get_data_format(), lv.data.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+	} // for level
+	if (levels.size() == 1 && (use_mipmaps == 1 || use_mipmaps == 2) && !uses_custom_compress()) {gen_mipmaps();} // mipmaps weren't created on the CPU
 }
 
 void texture_t::upload_cube_map_face(unsigned ix) {
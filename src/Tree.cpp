@@ -12,6 +12,7 @@
 #include "sinf.h"
 #include "cobj_bsp_tree.h"
 #include "draw_utils.h"
+#include "job_system.h"
 
 float const BURN_RADIUS      = 0.2;
 float const BURN_DAMAGE      = 80.0;
@@ -348,8 +349,7 @@ void tree_cont_t::draw_branches_and_leaves(shader_t &s, tree_lod_render_t &lod_r
 			}
 			tree_data_t::post_leaf_draw();
 			int const num_to_update(to_update_leaves.size());
-#pragma omp parallel for num_threads(max(1, min(4, num_to_update))) schedule(static) if (num_to_update > 1)
-			for (int i = 0; i < num_to_update; ++i) {to_update_leaves[i]->update_leaf_orients_wind();}
+			parallel_for_jobs(0, num_to_update, [&](int i) {to_update_leaves[i]->update_leaf_orients_wind();});
 		}
 	}
 }
@@ -2212,11 +2212,10 @@ void tree_cont_t::gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, poi
 	mesh_xy_grid_cache_t density_gen[NUM_TREE_TYPES+1];
 
 	if (NONUNIFORM_TREE_DEN) { // i==0 is the coverage density map, i>0 are the per-tree type coverage maps
-#pragma omp parallel for schedule(dynamic) num_threads(2)
-		for (int i = (use_density ? 0 : 1); i <= NUM_TREE_TYPES; ++i) { // Note: i should be signed
+		parallel_for_jobs((use_density ? 0 : 1), (NUM_TREE_TYPES+1), [&](int i) {
 			float const tds(TREE_DIST_SCALE*(XY_MULT_SIZE/16384.0)*(i==0 ? 1.0 : 0.1)), xscale(tds*DX_VAL*DX_VAL), yscale(tds*DY_VAL*DY_VAL);
 			density_gen[i].build_arrays(xscale*(x1 + xoff2 + 1000*i), yscale*(y1 + yoff2 - 1500*i), xscale, yscale, (x2-x1), (y2-y1), 0, 1); // force_sine_mode=1
-		}
+		});
 	}
 	for (int i = y1; i < y2; i += skip_val) {
 		float const yval(get_yval(i));
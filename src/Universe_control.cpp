@@ -8,6 +8,7 @@
 #include "asteroid.h"
 #include "timetest.h"
 #include "openal_wrap.h"
+#include "job_system.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -62,9 +63,12 @@ void add_player_ship_engine_light();
 
 
 #ifdef _OPENMP
-int omp_get_thread_num_3dw() {return omp_get_thread_num();} // where does this belong?
+int omp_get_thread_num_3dw() { // where does this belong?
+	int const job_worker_ix(get_job_worker_index());
+	return (job_worker_ix ? job_worker_ix : omp_get_thread_num()); // job system workers are never thread 0
+}
 #else
-int omp_get_thread_num_3dw() {return 0;}
+int omp_get_thread_num_3dw() {return get_job_worker_index();}
 #endif
 
 void init_universe_display() {
@@ -286,21 +290,16 @@ void draw_universe(bool static_only, bool skip_closest, bool no_move, int no_dis
 		player_ship().try_fire_weapon(); // must be before process_univ_objects(), on master thread, since this can destroy objects and free VBOs
 	}
 	// clobj0 will not be set - need to draw cells before there are any sobjs
-#ifdef _OPENMP
 	// disable multiple threads when the player is away from the starting galaxy center to avoid crashing when allocating/freeing galaxies, systems, and clusters
 	bool const near_init_galaxy(dist_less_than(get_player_pos2(), universe_origin, GALAXY_MIN_SIZE));
 
 	if (inited && !static_only && NUM_THREADS > 1 && !(display_mode & 0x40) && near_init_galaxy) {
 		// is this legal when a query object that tries to access a planet/moon/star through clobj as the uobject is being deleted?
-		#pragma omp parallel num_threads(2)
-		{
-			if (omp_get_thread_num_3dw() == 1) {process_ships(timer1);}
-			else {draw_universe_all(static_only, skip_closest, no_move, no_distant, gen_only, no_asteroid_dust);} // *must* be done by master thread
-		}
+		job_handle_t const ships_job(add_job([&]() {process_ships(timer1);}, vector<job_handle_t>(), "Process Ships"));
+		draw_universe_all(static_only, skip_closest, no_move, no_distant, gen_only, no_asteroid_dust); // *must* be done by the main thread
+		wait_for_job(ships_job);
 	}
-	else
-#endif
-	{
+	else {
 		if (!static_only) {process_ships(timer1);}
 		draw_universe_all(static_only, skip_closest, no_move, no_distant, gen_only, no_asteroid_dust);
 	}
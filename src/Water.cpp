@@ -8,6 +8,7 @@
 #include "openal_wrap.h"
 #include "shaders.h"
 #include "gl_ext_arb.h"
+#include "job_system.h"
 
 
 float    const RIPPLE_DAMP1        = 0.95;
@@ -363,11 +364,10 @@ public:
 		bool const use_threads(!fast_water_reflect && !draw_fast && !(display_mode & 0x20) /*&& frame_counter > 100*/);
 
 		// run on multiple threads when we have the slow ray-traced per-vertex water reflections enabled (assumes a quad core machine)
-#pragma omp parallel for num_threads(4) schedule(dynamic,8) if (use_threads)
-		for (int i = 0; i < (int)verts.size(); ++i) {
+		parallel_for_jobs(0, (int)verts.size(), [&](int i) {
 			vert_norm_color &vnc(verts[i]);
 			calc_vertex_cn(vnc, get_ypos(vnc.v.y), get_xpos(vnc.v.x), color_in);
-		}
+		}, 8, (use_threads ? 0 : 1));
 	}
 	void draw_outside_water_range(int x1, int y1, int x2, int y2, int dx, int dy) {
 		if (x1 == x2 || y1 == y2) return; // empty range
@@ -938,8 +938,7 @@ void add_waves() { // add waves due to wind
 	wave_time += fticks_clamped;
 	if (wave_time > 4000.0) {wave_time = 0.0;} // reset at 4000 ticks (2 min. or so) to avoid FP error
 	
-#pragma omp parallel for schedule(static,8) num_threads(2)
-	for (int y = 0; y < MESH_Y_SIZE; ++y) {
+	parallel_for_jobs(0, MESH_Y_SIZE, [&](int y) {
 		for (int x = 0; x < MESH_X_SIZE; ++x) {
 			if (!wminside[y][x] || !get_water_enabled(x, y)) continue; // only in water
 			float const wh(water_matrix[y][x]), depth(wh - mesh_height[y][x]);
@@ -959,7 +958,7 @@ void add_waves() { // add waves due to wind
 			}
 			start_ripple = 1;
 		}
-	}
+	}, 8);
 	//PRINT_TIME("Add Waves");
 }
 
@@ -0,0 +1,263 @@
+// 3D World - Benchmark Mode: Camera Path Replay and Per-Subsystem Timing Reports
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "mesh.h"
+#include "tree_3dw.h"
+#include "physics_objects.h"
+#include "file_utils.h"
+#include "u_event.h"
+#include "lightmap.h"
+#include <fstream>
+#include <chrono>
+
+using std::string;
+using std::cerr;
+using namespace std::chrono;
+
+
+extern bool enable_timing_profiler;
+extern int camera_mode, world_mode, frame_counter, iticks, num_trees;
+extern unsigned cur_display_iter;
+extern float fticks, tstep, TIMESTEP;
+extern double up_theta, camera_y;
+extern point camera_origin, surface_pos;
+extern vector3d cview_dir, up_vector;
+extern coll_obj_group coll_objects;
+extern tree_cont_t t_trees;
+extern lmap_manager_t lmap_manager;
+
+void set_camera_pos_dir(point const &pos, vector3d const &dir);
+void calc_theta_phi_from_cview_dir();
+void init_lights();
+void reset_planet_defaults();
+void quit_3dworld();
+void run_obj_reader_benchmark(string const &filename, unsigned num_iters);
+void run_physics_batch_benchmark(unsigned num_objs, unsigned num_iters);
+void run_obj_grid_benchmark(unsigned num_queries);
+
+
+struct camera_keyframe_t {
+	unsigned frame;
+	point pos;
+	vector3d dir;
+	camera_keyframe_t(unsigned f=0, point const &p=all_zeros, vector3d const &d=plus_x) : frame(f), pos(p), dir(d) {}
+	bool operator<(camera_keyframe_t const &k) const {return (frame < k.frame);}
+};
+
+
+class benchmark_t {
+
+	typedef high_resolution_clock::time_point time_pt;
+	vector<camera_keyframe_t> path;
+	unsigned frame_ix=0;
+	time_pt frame_start_time, stage_start_time;
+	std::ofstream record_out;
+
+	static float get_elapsed_ms(time_pt const &t1, time_pt const &t2) {return 1000.0f*duration_cast<duration<float>>(t2 - t1).count();}
+
+	bool is_recording() const {return (frame_ix >= warmup_frames);}
+	unsigned get_path_frame() const {return (is_recording() ? (frame_ix - warmup_frames) : 0);}
+
+	bool read_camera_path() { // format: <frame> <pos.x pos.y pos.z> <dir.x dir.y dir.z> per line, '#' comments
+		FILE *fp(nullptr);
+		if (!open_file(fp, path_fn.c_str(), "benchmark camera path")) return 0;
+		char line[MAX_CHARS];
+
+		while (fgets(line, MAX_CHARS, fp)) {
+			if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+			camera_keyframe_t k;
+			if (sscanf(line, "%u%f%f%f%f%f%f", &k.frame, &k.pos.x, &k.pos.y, &k.pos.z, &k.dir.x, &k.dir.y, &k.dir.z) != 7 || k.dir == zero_vector) {
+				cerr << "Error reading benchmark camera path line: " << line << endl;
+				checked_fclose(fp);
+				return 0;
+			}
+			k.dir.normalize();
+			path.push_back(k);
+		}
+		checked_fclose(fp);
+		if (path.empty()) {cerr << "Error: benchmark camera path " << path_fn << " contains no keyframes" << endl; return 0;}
+		std::stable_sort(path.begin(), path.end());
+		return 1;
+	}
+	camera_keyframe_t get_camera_at_frame(unsigned frame) const { // linear interpolation between keyframes
+		assert(!path.empty());
+		auto it(std::upper_bound(path.begin(), path.end(), camera_keyframe_t(frame)));
+		if (it == path.begin()) return path.front();
+		if (it == path.end  ()) return path.back ();
+		camera_keyframe_t const &k1(*(it-1)), &k2(*it);
+		float const t(float(frame - k1.frame)/float(k2.frame - k1.frame));
+		vector3d dir(k1.dir*(1.0 - t) + k2.dir*t);
+		if (dir == zero_vector) {dir = k2.dir;} // opposite directions, snap to next keyframe
+		return camera_keyframe_t(frame, (k1.pos*(1.0 - t) + k2.pos*t), dir.get_norm());
+	}
+public:
+	string path_fn, report_fn, record_fn, obj_reader_fn;
+	unsigned num_frames=0, warmup_frames=0, obj_reader_iters=4, physics_objs=0, physics_iters=10, obj_grid_queries=0, noise_samples=0;
+	bool cpu_only=0;
+
+	bool enabled() const {return (!path_fn.empty() && !report_fn.empty());}
+
+	bool init() {
+		if (!record_fn.empty()) {
+			record_out.open(record_fn);
+			if (!record_out.good()) {cerr << "Error: Failed to open benchmark camera path " << record_fn << " for write" << endl; return 0;}
+			record_out << "# frame pos.x pos.y pos.z dir.x dir.y dir.z" << endl;
+		}
+		if (!obj_reader_fn.empty()) {run_obj_reader_benchmark(obj_reader_fn, obj_reader_iters);}
+		if (!enabled()) return 1;
+		if (!read_camera_path()) return 0;
+		if (num_frames == 0) {num_frames = path.back().frame + 1;} // default to the length of the path
+		cout << "Benchmark: replaying " << path.size() << " keyframes from " << path_fn << " for " << num_frames << " frames";
+		if (warmup_frames > 0) {cout << " after " << warmup_frames << " warmup frames";}
+		cout << (cpu_only ? " (CPU only)" : "") << endl;
+		return 1;
+	}
+	void update_camera() const {
+		if (!enabled()) return;
+		camera_keyframe_t const k(get_camera_at_frame(get_path_frame()));
+		if (camera_mode == 1 && !cpu_only) {set_camera_pos_dir(k.pos, k.dir); return;} // walking: sets surface_pos
+		camera_origin = k.pos;
+		cview_dir     = k.dir;
+		calc_theta_phi_from_cview_dir();
+	}
+	void record_camera() {
+		if (!record_out.is_open()) return;
+		point const pos((camera_mode == 1) ? surface_pos : camera_origin); // same value update_camera() sets
+		record_out << frame_counter << " " << pos.x << " " << pos.y << " " << pos.z << " " << cview_dir.x << " " << cview_dir.y << " " << cview_dir.z << endl;
+	}
+	void frame_start() {
+		if (enabled() && frame_ix == warmup_frames) {
+			if (!enable_timing_profiler) {toggle_timing_profiler();} // accumulate into the profiler rather than printing every timer
+			set_timing_sample_recording(1); // start recording samples after warmup
+		}
+		frame_start_time = stage_start_time = high_resolution_clock::now();
+	}
+	void end_stage(char const *const name) {
+		if (!enabled()) return;
+		time_pt const now(high_resolution_clock::now());
+		if (is_recording()) {add_timing_sample((string("Frame: ") + name).c_str(), get_elapsed_ms(stage_start_time, now));}
+		stage_start_time = now;
+	}
+	bool frame_end() { // returns true when the benchmark is complete
+		if (physics_objs > 0) { // run once the scene has been created
+			run_physics_batch_benchmark(physics_objs, physics_iters);
+			physics_objs = 0;
+		}
+		if (obj_grid_queries > 0) {
+			run_obj_grid_benchmark(obj_grid_queries);
+			obj_grid_queries = 0;
+		}
+		if (noise_samples > 0) {
+			run_noise_simd_benchmark(noise_samples);
+			noise_samples = 0;
+		}
+		record_camera();
+		if (!enabled()) return 0;
+		if (is_recording()) {add_timing_sample("Frame", get_elapsed_ms(frame_start_time, high_resolution_clock::now()));}
+		++frame_ix;
+		if (get_path_frame() < num_frames) return 0;
+		bool const ret(write_timing_sample_report(report_fn, num_frames));
+		cout << "Benchmark complete: " << num_frames << " frames; " << (ret ? "wrote" : "failed to write") << " report " << report_fn << endl;
+		set_timing_sample_recording(0);
+		print_cobj_tree_refit_stats();
+		print_obj_grid_stats();
+		print_tile_stream_stats();
+		print_building_room_geom_stats();
+		return 1;
+	}
+};
+
+benchmark_t benchmark;
+
+
+bool parse_benchmark_option(FILE *fp) {
+
+	char strc[MAX_CHARS] = {0};
+	if (!read_str(fp, strc)) return 0;
+	string const str(strc);
+
+	if      (str == "camera_path"  ) {return read_string(fp, benchmark.path_fn  );} // file of camera keyframes to replay
+	else if (str == "report"       ) {return read_string(fp, benchmark.report_fn);} // *.json or *.csv
+	else if (str == "record_path"  ) {return read_string(fp, benchmark.record_fn);} // write the camera path of an interactive session for later replay
+	else if (str == "num_frames"   ) {return read_uint  (fp, benchmark.num_frames);} // 0 = length of camera path
+	else if (str == "warmup_frames") {return read_uint  (fp, benchmark.warmup_frames);}
+	else if (str == "cpu_only"     ) {return read_bool  (fp, benchmark.cpu_only);}
+	else if (str == "obj_reader"   ) {return read_string(fp, benchmark.obj_reader_fn);} // compare serial and multithreaded OBJ file readers on this file
+	else if (str == "obj_reader_iters") {return read_uint(fp, benchmark.obj_reader_iters);}
+	else if (str == "physics_objs" ) {return read_uint  (fp, benchmark.physics_objs);} // compare per-object and batched physics on this many objects in free fall
+	else if (str == "physics_iters") {return read_uint  (fp, benchmark.physics_iters);}
+	else if (str == "obj_grid_queries") {return read_uint(fp, benchmark.obj_grid_queries);} // compare object grid queries with brute force on the current scene
+	else if (str == "noise_samples") {return read_uint  (fp, benchmark.noise_samples);} // compare scalar and SIMD CPU simplex noise on this many samples
+	cout << "Unrecognized benchmark keyword in input file: " << str << endl;
+	return 0;
+}
+
+bool benchmark_active() {return benchmark.enabled();}
+bool benchmark_cpu_only() {return (benchmark.enabled() && benchmark.cpu_only);}
+bool init_benchmark() {return benchmark.init();}
+void benchmark_frame_start() {benchmark.frame_start();}
+void benchmark_update_camera() {benchmark.update_camera();}
+void benchmark_end_stage(char const *const name) {benchmark.end_stage(name);}
+
+void benchmark_frame_end() {
+	if (benchmark.frame_end()) {quit_3dworld();}
+}
+
+
+unsigned count_visible_cobjs() { // the CPU part of cobj culling: VFC + occlusion
+	unsigned num_visible(0);
+
+	for (coll_obj const &c : coll_objects) {
+		if (!c.disabled() && c.is_cobj_visible()) {++num_visible;}
+	}
+	return num_visible;
+}
+
+void run_cpu_only_benchmark() { // ground mode simulation and culling without creating a window or GL context
+
+	if (world_mode != WMODE_GROUND) {
+		cout << "Warning: CPU only benchmark only supports ground mode; switching to ground mode" << endl;
+		world_mode = WMODE_GROUND;
+	}
+	load_textures(1); // texture data is needed by scene generation, but not uploaded
+	reset_planet_defaults();
+	init_objects();
+	alloc_matrices();
+	t_trees.resize(num_trees);
+	init_terrain_mesh();
+	init_lights();
+	gen_scene(1, 1, 0, 0, 0);
+	create_object_groups();
+	init_game_state();
+	build_lightmap(1);
+	finish_progressive_lighting(); // normally traced in the background during drawing
+	lmap_manager.finish_pending_reads(); // normally decoded incrementally during drawing
+	uint64_t tot_visible(0);
+
+	for (unsigned frame = 0; ; ++frame) {
+		benchmark.frame_start();
+		++cur_display_iter;
+		fticks = 1.0; // fixed timestep for repeatable simulation
+		iticks = 1;
+		tstep  = TIMESTEP;
+		uevent_advance_frame();
+		up_vector.assign(0.0, sinf(up_theta), camera_y*cosf(up_theta));
+		benchmark.update_camera();
+		update_cpos();
+		set_camera_pdu();
+		benchmark.end_stage("Camera");
+		process_platforms_falling_moving_and_light_triggers();
+		benchmark.end_stage("Platforms");
+		process_groups(); // physics and dynamic cobj tree update
+		benchmark.end_stage("Physics");
+		tot_visible += count_visible_cobjs();
+		benchmark.end_stage("Culling");
+
+		if (benchmark.frame_end()) {
+			cout << "Average visible cobjs: " << tot_visible/max(frame+1, 1U) << " of " << coll_objects.size() << endl;
+			exit(0);
+		}
+	} // for frame
+}
@@ -0,0 +1,66 @@
+// 3D World - Memory Mapped File Reader
+// by Frank Gennari
+// 10/18/26
+
+#include "function_registry.h"
+#include "binary_file_io.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else // linux
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+mapped_file_t::mapped_file_t() : data(nullptr), sz(0), file_handle(nullptr), map_handle(nullptr) {}
+#else
+mapped_file_t::mapped_file_t() : data(nullptr), sz(0), fd(-1) {}
+#endif
+
+bool mapped_file_t::open(string const &filename) {
+
+	close();
+	if (filename.empty()) return 0;
+#ifdef _WIN32
+	HANDLE const fh(CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL));
+	if (fh == INVALID_HANDLE_VALUE) return 0;
+	file_handle = fh;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(fh, &file_size) || file_size.QuadPart == 0) {close(); return 0;}
+	map_handle = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map_handle == NULL) {close(); return 0;}
+	void *const ptr(MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0));
+	if (ptr == NULL) {close(); return 0;}
+	sz = (size_t)file_size.QuadPart;
+#else // linux
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {close(); return 0;}
+	void *const ptr(mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+	if (ptr == MAP_FAILED) {close(); return 0;}
+	sz = (size_t)st.st_size;
+#endif
+	data = (unsigned char const *)ptr;
+	return 1;
+}
+
+void mapped_file_t::close() {
+
+#ifdef _WIN32
+	if (data       != nullptr) {UnmapViewOfFile(data);}
+	if (map_handle != nullptr) {CloseHandle(map_handle);}
+	if (file_handle!= nullptr) {CloseHandle(file_handle);}
+	file_handle = map_handle = nullptr;
+#else // linux
+	if (data != nullptr) {munmap((void *)data, sz);}
+	if (fd >= 0) {::close(fd);}
+	fd = -1;
+#endif
+	data = nullptr;
+	sz   = 0;
+}
@@ -52,6 +52,34 @@ struct binary_file_reader : public binary_file_io {
 		return 0;
 	}
 };
+
+// read-only memory mapped file; pages are only read from disk when they're first accessed
+class mapped_file_t {
+	unsigned char const *data;
+	size_t sz;
+#ifdef _WIN32
+	void *file_handle, *map_handle;
+#else
+	int fd;
+#endif
+	mapped_file_t(mapped_file_t const &) = delete; // forbidden
+	void operator=(mapped_file_t const &) = delete; // forbidden
+public:
+	mapped_file_t();
+	~mapped_file_t() {close();}
+	bool open(string const &filename);
+	void close();
+	bool is_open() const {return (data != nullptr);}
+	size_t size() const {return sz;}
+	unsigned char const *get_data() const {return data;}
+
+	template<typename T> bool read_at(size_t pos, T &val) const { // for reading unaligned headers
+		if (pos + sizeof(T) > sz) return 0;
+		memcpy(&val, data+pos, sizeof(T));
+		return 1;
+	}
+};
+
 struct binary_file_writer : public binary_file_io {
 	bool open(string const &filename) {return binary_file_io::open(filename, "wb", "writing");}
 
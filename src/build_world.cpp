@@ -308,6 +308,18 @@ void set_global_state() {
 }
 
 
+unsigned get_obj_steps_per_frame(dwobject const &obj, int type, bool large_radius, bool precip) { // for airborne objects over the mesh
+
+	if (obj.flags & CAMERA_VIEW) return 4*LG_STEPS_PER_FRAME; // smaller timesteps if camera view
+	if (type == PLASMA || type == BALL || type == SAWBLADE) return 3*LG_STEPS_PER_FRAME;
+	if (is_rocket_type(type)) return 2*LG_STEPS_PER_FRAME;
+	if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) return LG_STEPS_PER_FRAME;
+	if (type == SHRAPNEL) return max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));
+	if (type == PRECIP || precip) return 1;
+	return SM_STEPS_PER_FRAME;
+}
+
+
 void process_groups() {
 
 	if (animate2) {advance_physics_objects();}
@@ -327,6 +339,7 @@ void process_groups() {
 	++scounter;
 	camera_follow = 0;
 	build_cobj_tree(1, 0); // could also do after group processing
+	build_obj_grid(); // from the positions at the start of the frame, like the dynamic cobj tree
 	cur_frame_explosions.clear();
 	
 	for (int i = 0; i < num_groups; ++i) {
@@ -389,6 +402,7 @@ void process_groups() {
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
 		bool defer_remove_cobj(0);
+		unsigned const num_batched(objg.batch_advance_free_fall(iter_count, large_radius)); // objects in free fall, advanced before the per-object loop
 
 		for (size_t jj = 0; jj < iter_count; ++jj) {
 			unsigned const j(unsigned((type == SMILEY) ? (jj + scounter)%max_objs : jj)); // handle smiley permutation
@@ -444,6 +458,7 @@ void process_groups() {
 					obj.init_dir = vector3d(signed_rand_float(), signed_rand_float(), 0.0).get_norm();
 				}
 				if (type == SNOW) {obj.angle = rand_uniform(0.7, 1.3);} // used as radius
+				obj_grid_add_new_obj(i, j);
 			} // end obj.status == 0
 			if (precip) {obj.update_precip_type();}
 			unsigned char const obj_flags(obj.flags);
@@ -457,6 +472,7 @@ void process_groups() {
 			else {
 				if (obj.time >= 0) {
 					if (type == PLASMA && obj.velocity.mag_sq() < 1.0) {obj.disable();} // plasma dies when it stops
+					else if (num_batched > 0 && objg.was_batch_advanced(j)) {} // already advanced by the batched step
 					else {
 						if ((large_radius || type == STAR5) && type != KEYCARD) { // teleport large objects, except for keycards (so they don't get lost)
 							maybe_teleport_object(obj.pos, radius, NO_SOURCE, type, !large_radius); // teleport!
@@ -471,19 +487,13 @@ void process_groups() {
 
 						// What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
 						if (obj.status == 1 && is_over_mesh(pos) && !((obj_flags & XY_STOPPED) && (obj_flags & Z_STOPPED))) {
-							if (obj.flags & CAMERA_VIEW) {spf = 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
-							else if (type == PLASMA || type == BALL || type == SAWBLADE) {spf = 3*LG_STEPS_PER_FRAME;}
-							else if (is_rocket_type(type)) {spf = 2*LG_STEPS_PER_FRAME;}
-							else if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {spf = LG_STEPS_PER_FRAME;}
-							else if (type == SHRAPNEL) {spf = max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
-							else if (type == PRECIP || (flags & PRECIPITATION)) {spf = 1;}
-							else {spf = SM_STEPS_PER_FRAME;}
+							spf = get_obj_steps_per_frame(obj, type, large_radius, precip);
 
 							if (MORE_COLL_TSTEPS && obj.status == 1 && spf < LG_STEPS_PER_FRAME && pos.z < czmax && pos.z > czmin) {
 								point pos2(pos + obj.velocity*time); // makes precipitation slower, but collision detection is more correct
 								pos2.z -= grav_dz; // maybe want to try with and without this?
 								// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
-								// Note: could also test pos.z > v_collision_matrix[y][x].zmax
+								// Note: could also test pos.z > v_collision_grid.get_zmax(x, y)
 								if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
 							}
 							assert(spf > 0);
@@ -515,6 +525,7 @@ void process_groups() {
 				else {obj.time = 0;}
 			} // not smiley
 			if (!obj.disabled()) {
+				obj_grid_check_moved_obj(i, j, pos); // after any teleport, jump pad, or advance with a velocity changed by a blast
 				update_deformation(obj);
 				
 				if (type == SHELLC || type == SHRAPNEL || type == STAR5 || type == LEAF || type == SAWBLADE || obj.is_flat()) {
@@ -718,6 +729,7 @@ void shift_all_objs(vector3d const &vd) {
 
 	if (begin_motion) {
 		for (int i = 0; i < num_groups; ++i) {obj_groups[i].shift(vd);}
+		invalidate_obj_grid(); // rebuilt next frame
 	}
 }
 
@@ -884,6 +896,7 @@ void add_all_coll_objects(const char *filename, bool re_add) {
 	pre_rt_bvh_build_hook(); // required for light ray tracing so that BVH nodes are properly expanded
 	build_cobj_tree(0, verbose);
 	post_rt_bvh_build_hook(); // required for light ray tracing (unexpand cobjs but leave BVH nodes expanded)
+	if (verbose) {run_cobj_tree_benchmark();} // if enabled
 	check_contained_cube_sides();
 	flag_cobjs_indoors_outdoors();
 }
@@ -495,6 +495,7 @@ class building_indir_light_mgr_t {
 #pragma omp parallel for schedule(dynamic) num_threads(num_rt_threads)
 		for (int n = 0; n < num_rays; ++n) {
 			if (kill_thread) continue;
+			TRACE_COUNTER_ADD("Building Light Rays", NUM_PRI_SPLITS);
 			rand_gen_t rgen;
 			rgen.set_state(n+1, cur_light); // should be deterministic, though add_path_to_lmcs() is not (due to thread races)
 			vector3d pri_dir(rgen.signed_rand_vector_spherical(1.0).get_norm()); // should this be cosine weighted for windows?
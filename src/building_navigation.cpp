@@ -1792,7 +1792,5 @@ void building_t::register_person_hit(unsigned person_ix, room_object_t const &ob
 }
 
 // these must be here to handle deletion of building_nav_graph_t, which is only defined in this file
-building_interior_t::building_interior_t() :
-	garage_room(-1), ext_basement_hallway_room_id(-1), ext_basement_door_stack_ix(-1), furnace_type(FTYPE_NONE), attic_type(ATTIC_TYPE_RAFTERS),
-	door_state_updated(0), is_unconnected(0), ignore_ramp_placement(0), placed_people(0), elevators_disabled(0), attic_access_open(0) {}
+building_interior_t::building_interior_t() {}
 building_interior_t::~building_interior_t() {}
@@ -38,18 +38,18 @@ public:
 		set_camera_pos_dir((si.cpos - get_global_camera_space_offset()), si.cdir); // convert back to local camera space
 	}
 	void add_screenshot() {
-		print_text_onscreen("Screenshot Saved as Texture", WHITE, 1.0, 2*TICKS_PER_SECOND, 0);
 		unsigned tid(0);
 		frame_buffer_to_texture(tid, 0);
-		unsigned const tex_ix(textures.size());
 		std::ostringstream oss;
 		oss << "screenshot_" << screenshots.size();
 		std::string const name(oss.str());
 		// type format width height wrap_mir ncolors use_mipmaps name [invert_y=0 [do_compress=1 [anisotropy=1.0 [mipmap_alpha_weight=1.0 [normal_map=0]]]]]
 		texture_t new_tex(0, 9, window_width, window_height, 0, 3, 0, name, 0, def_tex_compress, def_tex_aniso, 1.0, 0);
 		new_tex.set_existing_tid(tid, WHITE); // not sure what to set the color to
-		textures.push_back(new_tex);
+		int const tex_ix(add_texture(new_tex)); // room geom jobs may be reading textures
+		if (tex_ix < 0) {free_texture(tid); return;}
 		screenshots.emplace_back(tex_ix);
+		print_text_onscreen("Screenshot Saved as Texture", WHITE, 1.0, 2*TICKS_PER_SECOND, 0);
 	}
 };
 
@@ -6,6 +6,7 @@
 #include "buildings.h"
 #include "scenery.h" // for s_plant
 #include "shaders.h"
+#include <mutex>
 
 using std::swap;
 
@@ -2811,11 +2812,13 @@ void building_room_geom_t::add_cubicle(room_object_t const &c, float tscale) {
 	surf_mat.add_cube_to_verts(surf3, surf_color, tex_origin, get_skip_mask_for_xy(!c.dim));
 }
 
-class sign_helper_t {
+class sign_helper_t { // thread safe, since room geom may be generated by jobs
 	map<string, unsigned> txt_to_id;
-	vector<string> text;
+	deque<string> text; // deque so that references returned by get_text() aren't invalidated by register_text()
+	mutable std::mutex mutex;
 public:
 	unsigned register_text(string const &t) {
+		std::lock_guard<std::mutex> lock(mutex);
 		auto it(txt_to_id.find(t));
 		if (it != txt_to_id.end()) return it->second; // found
 		unsigned const id(text.size());
@@ -2825,6 +2828,7 @@ public:
 		return id;
 	}
 	string const &get_text(unsigned id) const {
+		std::lock_guard<std::mutex> lock(mutex);
 		assert(id < text.size());
 		return text[id];
 	}
@@ -3059,7 +3063,7 @@ void get_cabinet_or_counter_doors(room_object_t const &c, vect_cube_t &doors) {
 
 void building_room_geom_t::add_cabinet(room_object_t const &c, float tscale) { // for kitchens
 	assert(c.is_strictly_normalized());
-	static vect_cube_t doors;
+	thread_local vect_cube_t doors;
 	doors.clear();
 	float const door_width(get_cabinet_doors(c, doors)), dir_sign(c.dir ? 1.0 : -1.0);
 	rgeom_mat_t &wood_mat(get_wood_material(tscale));
@@ -3270,7 +3274,7 @@ void building_room_geom_t::add_potted_plant(room_object_t const &c, bool inc_pot
 		// draw plant leaves
 		s_plant plant;
 		plant.create_no_verts(base_pos, (c.z2() - base_pos.z), stem_radius, c.obj_id, 0, 1); // land_plants_only=1
-		static vector<vert_norm_comp> points;
+		thread_local vector<vert_norm_comp> points;
 		points.clear();
 		plant.create_leaf_points(points, 10.0, 1.5, 4); // plant_scale=10.0 seems to work well; more levels and rings
 		auto &leaf_verts(mats_amask.get_material(tid_nm_pair_t(plant.get_leaf_tid()), 1).quad_verts);
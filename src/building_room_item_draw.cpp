@@ -7,6 +7,7 @@
 #include "city.h" // for object_model_loader_t
 #include "subdiv.h" // for sd_sphere_d
 #include "profiler.h"
+#include "job_system.h"
 
 unsigned const MAX_ROOM_GEOM_GEN_PER_FRAME = 1;
 colorRGBA const rat_color(GRAY); // make the rat's fur darker
@@ -30,9 +31,22 @@ template< typename T > void gen_quad_ixs(vector<T> &ixs, unsigned size, unsigned
 void draw_car_in_pspace(car_t &car, shader_t &s, vector3d const &xlate, bool shadow_only);
 void set_car_model_color(car_t &car);
 bldg_obj_type_t get_taken_obj_type(room_object_t const &obj);
+void setup_bldg_obj_types();
 
 bool has_key_3d_model() {return building_obj_model_loader.is_model_valid(OBJ_MODEL_KEY);}
 
+void setup_for_async_room_geom_gen() { // lazily initialized state that room geom generation reads must be set up on the main thread before starting jobs
+	static bool was_setup(0);
+	if (was_setup) return;
+	was_setup = 1;
+	setup_bldg_obj_types();
+	building_obj_model_loader.is_model_valid(0); // loads all models
+	get_rect_panel_tid();
+	get_bath_wind_tid ();
+	get_int_door_tid  ();
+	get_concrete_tid  ();
+}
+
 colorRGBA room_object_t::get_model_color() const {return building_obj_model_loader.get_avg_color(get_model_id());}
 
 // skip_faces: 1=Z1, 2=Z2, 4=Y1, 8=Y2, 16=X1, 32=X2 to match CSG cube flags
@@ -228,9 +242,9 @@ unsigned get_rgeom_sphere_ndiv(bool low_detail) {return (low_detail ? N_SPHERE_D
 void rgeom_mat_t::add_sphere_to_verts(point const &center, vector3d const &size, colorRGBA const &color, bool low_detail,
 	vector3d const &skip_hemi_dir, xform_matrix const *const matrix)
 {
-	static vector<vert_norm_tc> cached_verts[2]; // high/low detail, reused across all calls
-	static vector<vert_norm_comp_tc> cached_vncs[2];
-	static vector<unsigned> cached_ixs[2];
+	thread_local vector<vert_norm_tc> cached_verts[2]; // high/low detail, reused across all calls on this thread
+	thread_local vector<vert_norm_comp_tc> cached_vncs[2];
+	thread_local vector<unsigned> cached_ixs[2];
 	vector<vert_norm_tc> &verts(cached_verts[low_detail]);
 	vector<vert_norm_comp_tc> &vncs(cached_vncs[low_detail]);
 	vector<unsigned> &ixs(cached_ixs[low_detail]);
@@ -335,6 +349,10 @@ public:
 #pragma omp critical(rgeom_alloc)
 		alloc(s);
 	}
+	void free_safe(rgeom_storage_t &s) { // room geom vertex data can be generated by jobs while the main thread is creating VBOs
+#pragma omp critical(rgeom_alloc)
+		free(s);
+	}
 	void alloc(rgeom_storage_t &s) { // attempt to use free_list entry to reuse existing capacity
 		if (free_list.empty()) return; // no pre-alloc
 		//cout << TXT(free_list.size()) << TXT(free_list.back().get_tot_vert_capacity()) << endl; // total mem usage is 913/1045
@@ -364,7 +382,7 @@ public:
 	}
 	unsigned size() const {return free_list.size();}
 };
-rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; not thread safe
+rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; use the *_safe() functions when jobs may be generating room geom
 
 
 vbo_cache_t::vbo_cache_entry_t vbo_cache_t::alloc(unsigned size, bool is_index) {
@@ -413,6 +431,129 @@ void vbo_cache_t::print_stats() const {
 		 << "  SZ: A " << (s_alloc>>20) << " U " << (s_used>>20) << " R " << (s_reuse>>20) << " F " << (s_free>>20) << endl; // in MB
 }
 
+// Room geom of buildings that went out of the room geom draw distance, so that it doesn't need to be regenerated when the player comes back.
+// Entries keep their VBOs until the GPU budget is exceeded; then the least recently used entries are reduced to their objects, which are much faster to
+// create vertex data from than regenerating the rooms; when the CPU budget is exceeded, the least recently used entries are deleted.
+// The rest of the interior that room geom generation modifies (rooms, occluders, etc.) is left in place when room geom is cleared, so it still matches.
+// Entries are keyed by interior, which doesn't move when the buildings vector is reallocated; the weak_ptr detects an interior that was deleted
+// and whose address was reused by a new interior.
+class room_geom_cache_t {
+	typedef building_interior_t const *key_t;
+	struct entry_t {
+		std::unique_ptr<building_room_geom_t> room_geom;
+		std::weak_ptr<building_interior_t> owner;
+		unsigned cpu_mem=0, gpu_mem=0, last_use=0;
+	};
+	map<key_t, entry_t> entries;
+	uint64_t cpu_mem=0, gpu_mem=0;
+	unsigned use_count=0, v_hit=0, v_hit_gpu=0, v_miss=0, v_demote=0, v_evict=0;
+
+	static uint64_t get_budget(float mb) {return uint64_t(max(mb, 0.0f)*(1<<20));}
+
+	void remove_mem(entry_t const &e) {
+		assert(cpu_mem >= e.cpu_mem && gpu_mem >= e.gpu_mem);
+		cpu_mem -= e.cpu_mem; gpu_mem -= e.gpu_mem;
+	}
+	void delete_entry(map<key_t, entry_t>::iterator it) {
+		remove_mem(it->second);
+		it->second.room_geom->clear(); // free VBO data before deleting the room_geom object
+		entries.erase(it);
+	}
+	map<key_t, entry_t>::iterator find_lru(bool with_gpu_mem) {
+		auto lru(entries.end());
+
+		for (auto i = entries.begin(); i != entries.end(); ++i) { // linear search; there shouldn't be too many entries
+			if (with_gpu_mem && i->second.gpu_mem == 0) continue;
+			if (lru == entries.end() || i->second.last_use < lru->second.last_use) {lru = i;}
+		}
+		return lru;
+	}
+	map<key_t, entry_t>::iterator find(building_t const &b) { // returns end() if not found; deletes the entry of a deleted interior at the same address
+		if (!b.interior) return entries.end();
+		auto it(entries.find(b.interior.get()));
+		if (it != entries.end() && it->second.owner.lock() != b.interior) {delete_entry(it); return entries.end();} // stale
+		return it;
+	}
+	void remove_expired() { // entries for buildings that were deleted or had their interiors replaced
+		for (auto i = entries.begin(); i != entries.end();) {
+			if (i->second.owner.expired()) {delete_entry(i++);} else {++i;}
+		}
+	}
+	void enforce_budgets() {
+		remove_expired();
+		uint64_t const gpu_budget(get_budget(global_building_params.room_geom_cache_gpu_mb)), cpu_budget(get_budget(global_building_params.room_geom_cache_cpu_mb));
+
+		while (gpu_mem > gpu_budget) { // free the VBOs and vertex data of the LRU entry, keeping its objects
+			auto it(find_lru(1));
+			if (it == entries.end()) break; // shouldn't get here
+			entry_t &e(it->second);
+			remove_mem(e);
+			e.room_geom->clear_materials();
+			e.cpu_mem = e.room_geom->get_cpu_mem_usage();
+			e.gpu_mem = 0;
+			cpu_mem  += e.cpu_mem;
+			++v_demote;
+		}
+		while (cpu_mem > cpu_budget && !entries.empty()) { // delete the LRU entry
+			delete_entry(find_lru(0));
+			++v_evict;
+		}
+	}
+public:
+	bool add(building_t const &b, std::unique_ptr<building_room_geom_t> &room_geom) { // takes ownership of room_geom and returns true if cached
+		if (global_building_params.room_geom_cache_cpu_mb <= 0.0) return 0; // disabled
+		assert(room_geom && b.interior);
+		auto it(find(b));
+		if (it != entries.end()) {delete_entry(it);} // shouldn't get here
+		entry_t &e(entries[b.interior.get()]);
+		e.room_geom.swap(room_geom);
+		e.owner = b.interior;
+		if (global_building_params.room_geom_cache_gpu_mb <= 0.0) {e.room_geom->clear_materials();} // keep only objects
+		e.cpu_mem  = e.room_geom->get_cpu_mem_usage();
+		e.gpu_mem  = e.room_geom->get_gpu_mem_usage();
+		e.last_use = ++use_count;
+		cpu_mem   += e.cpu_mem;
+		gpu_mem   += e.gpu_mem;
+		enforce_budgets(); // may evict this entry if it's larger than the budget
+		return 1;
+	}
+	bool restore(building_t &b) { // moves cached room geom into b and returns true if found
+		assert(b.interior && !b.interior->room_geom);
+		auto it(find(b));
+		if (it == entries.end()) {++v_miss; return 0;}
+		++v_hit;
+		if (it->second.gpu_mem > 0) {++v_hit_gpu;}
+		remove_mem(it->second);
+		b.interior->room_geom.swap(it->second.room_geom);
+		entries.erase(it);
+		return 1;
+	}
+	bool contains(building_t const &b) {return (find(b) != entries.end());}
+
+	void remove(building_t const &b) {
+		auto it(find(b));
+		if (it != entries.end()) {delete_entry(it);}
+	}
+	void remove_range(building_t const *const begin, building_t const *const end) { // for buildings that are about to be deleted
+		for (building_t const *b = begin; b != end; ++b) {remove(*b);}
+		remove_expired();
+	}
+	void print_stats() const {
+		cout << "Room Geom Cache: E " << entries.size() << " H " << v_hit << " (GPU " << v_hit_gpu << ") M " << v_miss << " D " << v_demote << " V " << v_evict
+			 << "  SZ: CPU " << (cpu_mem>>20) << " GPU " << (gpu_mem>>20) << endl; // in MB
+	}
+};
+
+room_geom_cache_t room_geom_cache;
+
+bool has_cached_room_geom(building_t const &b) {return room_geom_cache.contains(b);}
+void remove_cached_room_geom(building_t const *const begin, building_t const *const end) {room_geom_cache.remove_range(begin, end);}
+
+void print_building_room_geom_stats() {
+	rgeom_mat_t::print_vbo_cache_stats();
+	room_geom_cache.print_stats();
+}
+
 /*static*/ vbo_cache_t rgeom_mat_t::vbo_cache;
 
 void rgeom_storage_t::clear(bool free_memory) {
@@ -458,7 +599,7 @@ void rgeom_mat_t::create_vbo(building_t const &building) {
 		rotate_verts(itri_verts, building);
 	}
 	create_vbo_inner();
-	rgeom_alloc.free(*this); // vertex and index data is no longer needed and can be cleared
+	rgeom_alloc.free_safe(*this); // vertex and index data is no longer needed and can be cleared
 }
 void rgeom_mat_t::create_vbo_inner() {
 	assert(itri_verts.empty() == indices.empty());
@@ -590,6 +731,16 @@ void building_materials_t::clear() {
 	for (iterator m = begin(); m != end(); ++m) {m->clear();}
 	vector<rgeom_mat_t>::clear();
 }
+unsigned building_materials_t::get_cpu_mem_usage() const {
+	unsigned mem(capacity()*sizeof(rgeom_mat_t));
+	for (const_iterator m = begin(); m != end(); ++m) {mem += m->get_mem_usage();}
+	return mem;
+}
+unsigned building_materials_t::get_gpu_mem_usage() const {
+	unsigned mem(0);
+	for (const_iterator m = begin(); m != end(); ++m) {mem += m->vert_vbo_sz + m->ixs_vbo_sz;}
+	return mem;
+}
 unsigned building_materials_t::count_all_verts() const {
 	unsigned num_verts(0);
 	for (const_iterator m = begin(); m != end(); ++m) {num_verts += m->num_verts;}
@@ -649,6 +800,20 @@ void building_room_geom_t::clear_materials() { // clears all materials
 	mats_lights .clear();
 	mats_detail .clear();
 	obj_model_insts.clear(); // these are associated with static VBOs
+	static_verts_ready = 0;
+}
+unsigned building_room_geom_t::get_cpu_mem_usage() const {
+	unsigned mem(sizeof(building_room_geom_t) + get_cont_mem_usage(objs) + get_cont_mem_usage(expanded_objs) + get_cont_mem_usage(model_objs) +
+		get_cont_mem_usage(trim_objs) + get_cont_mem_usage(obj_dstate) + get_cont_mem_usage(obj_model_insts) + get_cont_mem_usage(light_bcubes));
+	building_materials_t const *const mats[] = {&mats_static, &mats_small, &mats_text, &mats_detail, &mats_dynamic, &mats_lights, &mats_amask, &mats_alpha, &mats_doors};
+	for (building_materials_t const *m : mats) {mem += m->get_cpu_mem_usage();}
+	return mem;
+}
+unsigned building_room_geom_t::get_gpu_mem_usage() const {
+	building_materials_t const *const mats[] = {&mats_static, &mats_small, &mats_text, &mats_detail, &mats_dynamic, &mats_lights, &mats_amask, &mats_alpha, &mats_doors};
+	unsigned mem(0);
+	for (building_materials_t const *m : mats) {mem += m->get_gpu_mem_usage();}
+	return mem;
 }
 // Note: used for room lighting changes; detail object changes are not supported
 void building_room_geom_t::check_invalid_draw_data() {
@@ -661,6 +826,12 @@ void building_room_geom_t::check_invalid_draw_data() {
 		mats_static.invalidate();
 		mats_alpha .invalidate();
 		obj_model_insts.clear();
+
+		if (static_verts_ready) { // drop vertex data generated in the background; it will be regenerated from the current objects
+			for (rgeom_mat_t &m : mats_static) {m.clear_vectors();}
+			for (rgeom_mat_t &m : mats_alpha ) {m.clear_vectors();}
+			static_verts_ready = 0;
+		}
 	}
 	//if (invalidate_mats_mask & (1 << MAT_TYPE_TEXT   )) {mats_text   .invalidate();} // text objects
 	if (invalidate_mats_mask & (1 << MAT_TYPE_DYNAMIC)) {mats_dynamic.invalidate();} // dynamic objects
@@ -704,10 +875,19 @@ void room_object_t::set_as_bottle(unsigned rand_id, unsigned max_type, bool no_e
 }
 
 void building_room_geom_t::create_static_vbos(building_t const &building) {
+	add_static_objs_to_verts(building);
+	upload_static_vbos(building);
+}
+void building_room_geom_t::gen_static_verts(building_t const &building) { // vertex data for drawing, but no VBOs
+	create_obj_model_insts(building);
+	add_static_objs_to_verts(building);
+	static_verts_ready = 1;
+}
+void building_room_geom_t::add_static_objs_to_verts(building_t const &building) {
 	//highres_timer_t timer("Gen Room Geom"); // 2.35ms
 	float const tscale(2.0/obj_scale);
 	tid_nm_pair_t const &wall_tex(building.get_material().wall_tex);
-	static vect_room_object_t rugs;
+	thread_local vect_room_object_t rugs;
 	rugs.clear();
 
 	for (auto i = objs.begin(); i != objs.end(); ++i) {
@@ -756,10 +936,13 @@ void building_room_geom_t::create_static_vbos(building_t const &building) {
 		} // end switch
 	} // for i
 	for (room_object_t &rug : rugs) {add_rug(rug);} // rugs are added last so that alpha blending of their edges works
+}
+void building_room_geom_t::upload_static_vbos(building_t const &building) {
 	// Note: verts are temporary, but cubes are needed for things such as collision detection with the player and ray queries for indir lighting
 	//highres_timer_t timer2("Gen Room Geom VBOs"); // < 2ms
 	mats_static.create_vbos(building);
 	mats_alpha .create_vbos(building);
+	static_verts_ready = 0;
 	//cout << "static: size: " << rgeom_alloc.size() << " mem: " << rgeom_alloc.get_mem_usage() << endl; // start=50MB, peak=76MB
 }
 
@@ -1123,18 +1306,52 @@ void building_t::gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, occl
 		if (!any_part_visible && point_in_attic(camera_pdu.pos - xlate)) {any_part_visible = 1;} // check the attic
 		if (!any_part_visible) return;
 	}
-	if (!has_room_geom()) {
-		rand_gen_t rgen;
-		rgen.set_state(building_ix, parts.size()); // set to something canonical per building
-		gen_room_details(rgen, building_ix); // generate so that we can draw it
-		assert(has_room_geom());
-	}
+	if (!has_room_geom() && !room_geom_cache.restore(*this)) {gen_room_geom(building_ix);} // generate so that we can draw it
 	if (has_room_geom() && inc_small == 2) {add_wall_and_door_trim_if_needed();} // gen trim when close to the player
 	draw_room_geom(bbd, s, oc, xlate, building_ix, shadow_only, reflection_pass, inc_small, player_in_building);
 }
-void building_t::clear_room_geom() {
+void building_t::gen_room_geom(unsigned building_ix) {
+	rand_gen_t rgen;
+	rgen.set_state(building_ix, parts.size()); // set to something canonical per building
+	gen_room_details(rgen, building_ix);
+	assert(has_room_geom());
+}
+
+// Async room geom generation: a job generates room geom and static vertex data on a private copy of the building, then the main thread moves it into the
+// real building with install_room_geom_from(); the seed only depends on building_ix and parts, so the result is the same as with synchronous generation
+std::shared_ptr<building_t> building_t::make_room_geom_gen_copy() const { // must be called on the main thread
+	assert(interior && !interior->room_geom);
+	std::shared_ptr<building_t> copy(new building_t(*this)); // shares interior with this building
+	copy->interior.reset(new building_interior_t);
+	copy->interior->copy_for_room_gen(*interior);
+	return copy;
+}
+bool building_t::install_room_geom_from(building_t &src) { // src is a copy from make_room_geom_gen_copy() after gen_room_geom(); must be called on the main thread
+	if (!interior || has_room_geom() || !src.has_room_geom()) return 0; // room geom was cleared or generated some other way
+	// people, doors, and the nav graph may have been updated by the player or AI since the copy was made; everything else belongs to the new interior
+	building_interior_t &si(*src.interior);
+	si.people.swap(interior->people);
+	si.nav_graph.swap(interior->nav_graph);
+	si.door_state_updated = interior->door_state_updated;
+
+	if (si.doors.size() == interior->doors.size()) { // doors weren't added; keep their current open/locked state
+		for (unsigned i = 0; i < si.doors.size(); ++i) {
+			si.doors[i].open   = interior->doors[i].open;
+			si.doors[i].locked = interior->doors[i].locked;
+		}
+	}
+	room_geom_cache.remove(*this); // shouldn't be cached, but if it is, the cached room geom belongs to the old interior
+	interior = src.interior;
+	src.interior.reset();
+	// building-level state written by room geom generation
+	has_int_fplace = src.has_int_fplace;
+	ext_lights.swap(src.ext_lights); // exterior wall lamps added by add_doorbell_and_lamp()
+	return 1;
+}
+void building_t::clear_room_geom(bool allow_cache) { // allow_cache: the building will likely be drawn again, so keep its room geom if there's space
 	if (!has_room_geom()) return;
 	if (interior->room_geom->modified_by_player) return; // keep the player's modifications and don't delete the room geom
+	if (allow_cache && room_geom_cache.add(*this, interior->room_geom)) {interior->room_geom.reset(); return;}
 	interior->room_geom->clear(); // free VBO data before deleting the room_geom object
 	interior->room_geom.reset();
 }
@@ -1586,6 +1803,9 @@ void building_room_geom_t::draw(brg_batch_draw_t *bbd, shader_t &s, building_t c
 	// generate vertex data in the shadow pass or if we haven't hit our generation limit; must be consistent for static and small geom
 	// Note that the distance cutoff for mats_static and mats_small is different, so we generally won't be creating them both
 	// unless the player just appeared by this building, or we need to update the geometry; in either case this is higher priority and we want to update both
+	// vertex data generated by a background job only needs to be uploaded, which is fast enough that it's not limited
+	if (static_verts_ready && !mats_static.valid) {upload_static_vbos(building);}
+
 	if (shadow_only || num_geom_this_frame < MAX_ROOM_GEOM_GEN_PER_FRAME) {
 		if (!mats_static.valid) { // create static materials if needed
 			create_obj_model_insts(building);
@@ -1596,8 +1816,7 @@ void building_room_geom_t::draw(brg_batch_draw_t *bbd, shader_t &s, building_t c
 		//highres_timer_t timer("Create Small + Text VBOs", (create_small || create_text));
 
 		if (create_small && create_text) {
-#pragma omp parallel num_threads(2)
-			if (omp_get_thread_num_3dw() == 0) {create_small_static_vbos(building);} else {create_text_vbos(building);}
+			run_jobs_in_parallel([&]() {create_small_static_vbos(building);}, [&]() {create_text_vbos(building);});
 		}
 		else if (create_small) {create_small_static_vbos(building);}
 		else if (create_text ) {create_text_vbos        (building);}
@@ -153,7 +153,7 @@ vect_door_stack_t &building_t::get_doorways_for_room(room_t const &room, float z
 	cube_t room_exp(room);
 	room_exp.expand_by_xy(get_wall_thickness());
 	set_cube_zvals(room_exp, (zval + floor_thickness), (zval + get_window_vspace() - floor_thickness)); // clip to z-range of this floor
-	static vect_door_stack_t doorways; // reuse across rooms
+	thread_local vect_door_stack_t doorways; // reuse across rooms; room geom may be generated by jobs
 	doorways.clear();
 
 	for (auto i = interior->door_stacks.begin(); i != interior->door_stacks.end(); ++i) {
@@ -1388,7 +1388,7 @@ bool building_t::add_kitchen_objs(rand_gen_t rgen, room_t const &room, float zva
 		cube_t c;
 		set_cube_zvals(c, zval, zval+height);
 		set_cube_zvals(cabinet_area, zval, (zval + vspace - floor_thickness));
-		static vect_cube_t blockers;
+		thread_local vect_cube_t blockers;
 		int const table_blocker_ix(gather_room_placement_blockers(cabinet_area, objs_start, blockers, 1, 1)); // inc_open_doors=1, ignore_chairs=1
 		bool const have_toaster(building_obj_model_loader.is_model_valid(OBJ_MODEL_TOASTER));
 		vector3d const toaster_sz(have_toaster ? building_obj_model_loader.get_model_world_space_size(OBJ_MODEL_TOASTER) : zero_vector); // L, D, H
@@ -3368,7 +3368,7 @@ void building_t::add_window_trim_and_coverings(bool add_trim, bool add_coverings
 	float const window_offset(0.01*get_window_vspace()); // must match building_draw_t::add_section()
 	colorRGBA const &trim_color(is_house ? WHITE : DK_GRAY);
 	vect_room_object_t &objs(interior->room_geom->trim_objs);
-	static vect_vnctcc_t wall_quad_verts;
+	thread_local vect_vnctcc_t wall_quad_verts;
 	wall_quad_verts.clear();
 	get_all_drawn_window_verts_as_quads(wall_quad_verts);
 
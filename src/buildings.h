@@ -339,9 +339,10 @@ struct building_mat_t : public building_tex_params_t {
 struct building_params_t {
 
 	bool flatten_mesh=0, has_normal_map=0, tex_mirror=0, tex_inv_y=0, tt_only=0, infinite_buildings=0, dome_roof=0, onion_roof=0, enable_people_ai=0;
-	bool gen_building_interiors=1, add_city_interiors=0, enable_rotated_room_geom=0, add_secondary_buildings=0, add_office_basements=0;
+	bool gen_building_interiors=1, add_city_interiors=0, enable_rotated_room_geom=0, add_secondary_buildings=0, add_office_basements=0, async_room_geom_gen=1;
 	unsigned num_place=0, num_tries=10, cur_prob=1, max_shadow_maps=32, buildings_rand_seed=0, max_ext_basement_hall_branches=4, max_ext_basement_room_depth=4;
-	float ao_factor=0.0, sec_extra_spacing=0.0, player_coll_radius_scale=1.0, interior_view_dist_scale=1.0;
+	float ao_factor=0.0, sec_extra_spacing=0.0, player_coll_radius_scale=1.0, interior_view_dist_scale=1.0, room_geom_prefetch_dist_scale=1.4;
+	float room_geom_cache_cpu_mb=256.0, room_geom_cache_gpu_mb=128.0; // budgets for room geom of buildings that are no longer drawn; 0 disables
 	float window_width=0.0, window_height=0.0, window_xspace=0.0, window_yspace=0.0; // windows
 	float wall_split_thresh=4.0, max_fp_wind_xscale=0.0, max_fp_wind_yscale=0.0; // interiors
 	float open_door_prob=1.0, locked_door_prob=0.0, basement_prob_house=0.5, basement_prob_office=0.5, ball_prob=0.3; // interior probabilities
@@ -704,6 +705,7 @@ public:
 
 	rgeom_mat_t(tid_nm_pair_t const &tex_=tid_nm_pair_t()) : rgeom_storage_t(tex_), num_verts(0), num_ixs(0), vert_vbo_sz(0), ixs_vbo_sz(0), dir_mask(0), en_shadows(0) {}
 	//~rgeom_mat_t() {assert(vbo_mgr.vbo == 0); assert(vbo_mgr.ivbo == 0);} // VBOs should be freed before destruction
+	static void print_vbo_cache_stats() {vbo_cache.print_stats();}
 	void enable_shadows() {en_shadows = 1;}
 	void clear();
 	void clear_vbos();
@@ -744,6 +746,8 @@ struct building_materials_t : public vector<rgeom_mat_t> {
 	void clear();
 	void invalidate() {valid = 0;}
 	unsigned count_all_verts() const;
+	unsigned get_cpu_mem_usage() const;
+	unsigned get_gpu_mem_usage() const;
 	rgeom_mat_t &get_material(tid_nm_pair_t const &tex, bool inc_shadows);
 	void create_vbos(building_t const &building);
 	void draw(brg_batch_draw_t *bbd, shader_t &s, int shadow_only, bool reflection_pass);
@@ -805,7 +809,7 @@ struct building_decal_manager_t {
 
 struct building_room_geom_t {
 
-	bool has_elevators, has_pictures, has_garage_car, modified_by_player;
+	bool has_elevators, has_pictures, has_garage_car, modified_by_player, static_verts_ready;
 	unsigned char num_pic_tids, invalidate_mats_mask;
 	float obj_scale;
 	unsigned wall_ps_start, buttons_start, stairs_start; // index of first object of {TYPE_PG_WALL|TYPE_PSPACE, TYPE_BUTTON, TYPE_STAIR}
@@ -825,7 +829,7 @@ struct building_room_geom_t {
 	building_decal_manager_t decal_manager;
 
 	building_room_geom_t(point const &tex_origin_=all_zeros) : has_elevators(0), has_pictures(0), has_garage_car(0), modified_by_player(0),
-		num_pic_tids(0), invalidate_mats_mask(0), obj_scale(1.0), wall_ps_start(0), buttons_start(0), stairs_start(0), tex_origin(tex_origin_), wood_color(WHITE) {}
+		static_verts_ready(0), num_pic_tids(0), invalidate_mats_mask(0), obj_scale(1.0), wall_ps_start(0), buttons_start(0), stairs_start(0), tex_origin(tex_origin_), wood_color(WHITE) {}
 	bool empty() const {return objs.empty();}
 	void clear();
 	void clear_materials();
@@ -836,6 +840,8 @@ struct building_room_geom_t {
 	void update_dynamic_draw_data() {invalidate_mats_mask |= (1 << MAT_TYPE_DYNAMIC);}
 	void check_invalid_draw_data();
 	void invalidate_draw_data_for_obj(room_object_t const &obj, bool was_taken=0);
+	unsigned get_cpu_mem_usage() const;
+	unsigned get_gpu_mem_usage() const;
 	unsigned get_num_verts() const {return (mats_static.count_all_verts() + mats_small.count_all_verts() + mats_text.count_all_verts() + mats_detail.count_all_verts() +
 		mats_dynamic.count_all_verts() + mats_lights.count_all_verts() + mats_amask.count_all_verts() + mats_alpha.count_all_verts() + mats_doors.count_all_verts());}
 	rgeom_mat_t &get_material(tid_nm_pair_t const &tex, bool inc_shadows=0, bool dynamic=0, unsigned small=0, bool transparent=0);
@@ -970,8 +976,11 @@ struct building_room_geom_t {
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building);
 	unsigned allocate_dynamic_state();
 	room_obj_dstate_t &get_dstate(room_object_t const &obj);
+	void gen_static_verts(building_t const &building); // CPU only; may be called from a job
 private:
 	void create_static_vbos(building_t const &building);
+	void add_static_objs_to_verts(building_t const &building);
+	void upload_static_vbos(building_t const &building);
 	void create_small_static_vbos(building_t const &building);
 	void create_text_vbos(building_t const &building);
 	void create_detail_vbos(building_t const &building);
@@ -1159,7 +1168,7 @@ struct building_dest_t : public building_loc_t {
 struct ext_basement_room_params_t;
 
 
-struct building_interior_t {
+struct building_interior_data_t { // all copyable interior members; copied for async room geom generation, so new members should be added here
 	vect_cube_t floors, ceilings, fc_occluders, exclusion;
 	vect_cube_t walls[2]; // walls are split by dim, which is the separating dimension of the wall
 	vect_stairwell_t stairwells;
@@ -1169,15 +1178,18 @@ struct building_interior_t {
 	vector<room_t> rooms;
 	vector<elevator_t> elevators;
 	vector<person_t> people;
-	std::unique_ptr<building_room_geom_t> room_geom;
-	std::unique_ptr<building_nav_graph_t> nav_graph;
 	cube_with_ix_t pg_ramp, attic_access; // ix stores {dim, dir}
 	cube_t basement_ext_bcube;
 	draw_range_t draw_range;
 	unsigned extb_walls_start[2] = {0,0};
-	int garage_room, ext_basement_hallway_room_id, ext_basement_door_stack_ix;
-	uint8_t furnace_type, attic_type;
-	bool door_state_updated, is_unconnected, ignore_ramp_placement, placed_people, elevators_disabled, attic_access_open;
+	int garage_room=-1, ext_basement_hallway_room_id=-1, ext_basement_door_stack_ix=-1;
+	uint8_t furnace_type=FTYPE_NONE, attic_type=ATTIC_TYPE_RAFTERS;
+	bool door_state_updated=0, is_unconnected=0, ignore_ramp_placement=0, placed_people=0, elevators_disabled=0, attic_access_open=0;
+};
+
+struct building_interior_t : public building_interior_data_t {
+	std::unique_ptr<building_room_geom_t> room_geom; // not copyable, and created later
+	std::unique_ptr<building_nav_graph_t> nav_graph;
 
 	building_interior_t();
 	~building_interior_t();
@@ -1187,6 +1199,7 @@ struct building_interior_t {
 	void get_stairs_and_elevators_bcubes_intersecting_cube(cube_t const &c, vect_cube_t &bcubes, float ends_clearance=0.0, float sides_clearance=0.0) const;
 	void sort_for_optimal_culling();
 	void remove_excess_capacity();
+	void copy_for_room_gen(building_interior_t const &src) {building_interior_data_t::operator=(src);} // copies everything except room_geom and nav_graph
 	void finalize();
 	bool update_elevators(building_t const &building, point const &player_pos);
 	bool check_sphere_coll(building_t const &building, point &pos, point const &p_last, float radius,
@@ -1209,6 +1222,7 @@ struct building_interior_t {
 	door_t const &get_ext_basement_door() const;
 	void assign_master_bedroom(float window_vspacing, float floor_thickness);
 };
+static_assert(sizeof(building_interior_t) == sizeof(building_interior_data_t) + 2*sizeof(void *), "building_interior_t data members must go in building_interior_data_t");
 
 struct building_stats_t {
 	unsigned nbuildings, nparts, ndetails, ntquads, ndoors, ninterior, nrooms, nceils, nfloors, nwalls, nrgeom, nobjs, nverts;
@@ -1410,10 +1424,13 @@ struct building_t : public building_geom_t {
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building);
 	void gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, occlusion_checker_noncity_t &oc, vector3d const &xlate,
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building);
+	void gen_room_geom(unsigned building_ix);
+	std::shared_ptr<building_t> make_room_geom_gen_copy() const;
+	bool install_room_geom_from(building_t &src);
 	bool has_cars_to_draw(bool player_in_building) const;
 	void draw_cars_in_building(shader_t &s, vector3d const &xlate, bool player_in_building, bool shadow_only) const;
 	void add_split_roof_shadow_quads(building_draw_t &bdraw) const;
-	void clear_room_geom();
+	void clear_room_geom(bool allow_cache=0);
 	void update_grass_exclude_at_pos(point const &pos, vector3d const &xlate, bool camera_in_building) const;
 	void update_stats(building_stats_t &s) const;
 	bool are_rooms_connected_without_using_room(unsigned room1, unsigned room2, unsigned room_exclude) const;
@@ -1838,6 +1855,8 @@ bool get_building_door_pos_closest_to(unsigned building_id, point const &target_
 void register_achievement(std::string const &str);
 bool enable_building_indir_lighting_no_cib();
 bool enable_building_indir_lighting();
+bool has_cached_room_geom(building_t const &b);
+void remove_cached_room_geom(building_t const *const begin, building_t const *const end);
 // functions in building_room_obj_expand.cc
 point gen_xy_pos_in_area(cube_t const &S, vector3d const &sz, rand_gen_t &rgen, float zval=0.0);
 point gen_xy_pos_in_area(cube_t const &S, float radius, rand_gen_t &rgen, float zval=0.0);
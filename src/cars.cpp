@@ -987,18 +987,36 @@ bool car_manager_t::check_car_for_ped_colls(car_t &car) const {
 	return 0;
 }
 
-void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed) {
+// cars only move a short distance each frame, so they're nearly sorted and insertion sort is close to linear time;
+// if there are too many moves (first frame, or after many cars change roads), fall back to a full sort
+template<typename T, typename C> void sort_nearly_sorted(vector<T> &v, C const &comp) {
+	size_t const max_moves(8*v.size() + 64);
+	size_t num_moves(0);
+
+	for (size_t i = 1; i < v.size(); ++i) {
+		if (!comp(v[i], v[i-1])) continue; // already in order
+		T val(std::move(v[i]));
+		size_t j(i);
+		do {v[j] = std::move(v[j-1]); --j; ++num_moves;} while (j > 0 && comp(val, v[j-1]));
+		v[j] = std::move(val);
+		if (num_moves > max_moves) {sort(v.begin(), v.end(), comp); return;} // not nearly sorted
+	}
+}
+
+// exchanges this frame's car snapshot for the peds' previous snapshot, and takes the peds' snapshot for use in car updates;
+// must be called while neither cars nor peds are being updated, after which both can be updated in parallel without locks
+void car_manager_t::swap_snapshots(vector<car_city_vect_t> &cars_by_city, ped_city_vect_t &peds_crossing) {
+	cars_by_city.swap(cars_by_city_next);
+	peds_crossing_roads.peds.swap(peds_crossing.peds);
+}
+
+void car_manager_t::next_frame(float car_speed) {
 	if (!animate2) return;
 	helicopters_next_frame(car_speed);
 	if (cars.empty()) return;
-	// Warning: not really thread safe, but should be okay; the ped state should valid at all points (thought maybe inconsistent) and we don't need it to be exact every frame
-	ped_manager.get_peds_crossing_roads(peds_crossing_roads);
 	//timer_t timer("Update Cars"); // 4K cars = 0.7ms / 2.1ms with destinations + navigation
-#pragma omp critical(modify_car_data)
-	{
-		if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
-		sort(cars.begin(), cars.end(), comp_car_road_then_pos(camera_pdu.pos - dstate.xlate)); // sort by city/road/position for intersection tests and tile shadow map binds
-	}
+	if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
+	sort_nearly_sorted(cars, comp_car_road_then_pos(camera_pdu.pos - dstate.xlate)); // sort by city/road/position for intersection tests and tile shadow map binds
 	entering_city.clear();
 	car_blocks.clear();
 	float const speed(CAR_SPEED_SCALE*car_speed*get_clamped_fticks());
@@ -1082,6 +1100,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 		car_blocks_by_road.emplace_back(cars_by_road.size(), 0); // add terminator
 		cars_by_road.emplace_back(cube_t(), cars.size()); // add terminator
 	}
+	extract_car_data(cars_by_city_next); // snapshot for peds to use next frame
 	//cout << TXT(cars.size()) << TXT(entering_city.size()) << TXT(in_isects.size()) << endl; // TESTING
 }
 
@@ -730,7 +730,8 @@ class car_manager_t { // and trucks and helicopters
 	vector<cube_with_ix_t> cars_by_road;
 	vector<helicopter_t> helicopters;
 	vector<helipad_t> helipads;
-	ped_city_vect_t peds_crossing_roads;
+	ped_city_vect_t peds_crossing_roads; // snapshot of peds from the previous frame
+	vector<car_city_vect_t> cars_by_city_next; // snapshot of cars written at the end of next_frame() for use by peds in the next frame
 	car_draw_state_t dstate;
 	rand_gen_t rgen;
 	vector<unsigned> entering_city;
@@ -773,7 +774,8 @@ public:
 	cube_t const &get_car_bcube(unsigned car_id) const {assert(car_id < cars.size()); return cars[car_id].bcube;}
 	bool line_intersect_cars(point const &p1, point const &p2, float &t) const;
 	bool check_car_for_ped_colls(car_t &car) const;
-	void next_frame(ped_manager_t const &ped_manager, float car_speed);
+	void swap_snapshots(vector<car_city_vect_t> &cars_by_city, ped_city_vect_t &peds_crossing);
+	void next_frame(float car_speed);
 	void helicopters_next_frame(float car_speed);
 	bool check_helicopter_coll(cube_t const &bc) const;
 	void draw(int trans_op_mask, vector3d const &xlate, bool use_dlights, bool shadow_only, bool is_dlight_shadows);
@@ -834,7 +836,8 @@ class ped_manager_t { // pedestrians
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
 	car_city_vect_t empty_cars_vect;
-	vector<car_city_vect_t> cars_by_city;
+	vector<car_city_vect_t> cars_by_city; // snapshot of cars from the previous frame
+	ped_city_vect_t peds_crossing_roads_next; // snapshot of peds written at the end of next_frame() for use by cars in the next frame
 	vector<point> bldg_ppl_pos;
 	rand_gen_t rgen;
 	ao_draw_state_t dstate;
@@ -890,6 +893,7 @@ public:
 	bool proc_sphere_coll(point &pos, float radius, vector3d *cnorm) const;
 	bool line_intersect_peds(point const &p1, point const &p2, float &t) const;
 	void destroy_peds_in_radius(point const &pos_in, float radius);
+	void swap_snapshots(car_manager_t &car_manager_) {car_manager_.swap_snapshots(cars_by_city, peds_crossing_roads_next);}
 	void next_frame();
 	pedestrian_t const *get_ped_at(point const &p1, point const &p2) const;
 	unsigned get_first_ped_at_plot(unsigned plot) const {assert(plot < by_plot.size()); return by_plot[plot];}
@@ -169,6 +169,9 @@ void building_params_t::init_kw_maps() {
 	kwmf.add("max_floorplan_window_xscale", max_fp_wind_xscale);
 	kwmf.add("max_floorplan_window_yscale", max_fp_wind_yscale);
 	kwmf.add("interior_view_dist_scale", interior_view_dist_scale);
+	kwmf.add("room_geom_prefetch_dist_scale", room_geom_prefetch_dist_scale); // relative to the room geom draw distance
+	kwmf.add("room_geom_cache_cpu_mb", room_geom_cache_cpu_mb); // 0 disables the cache
+	kwmf.add("room_geom_cache_gpu_mb", room_geom_cache_gpu_mb);
 	kwmb.add("tt_only", tt_only);
 	kwmb.add("infinite_buildings", infinite_buildings);
 	kwmb.add("add_secondary_buildings", add_secondary_buildings);
@@ -273,6 +276,7 @@ void building_params_t::init_kw_maps() {
 	kwmb.add("add_city_interiors",       add_city_interiors);
 	kwmb.add("gen_building_interiors",   gen_building_interiors);
 	kwmb.add("enable_rotated_room_geom", enable_rotated_room_geom);
+	kwmb.add("async_room_geom_gen",      async_room_geom_gen);
 }
 bool building_params_t::parse_buildings_option(FILE *fp) {
 
@@ -9,6 +9,7 @@
 #include "lightmap.h"
 #include "buildings.h"
 #include "profiler.h"
+#include "job_system.h"
 #include <cfloat> // for FLT_MAX
 
 bool const CHECK_HEIGHT_BORDER_ONLY = 1; // choose building site to minimize edge discontinuity rather than amount of land that needs to be modified
@@ -3004,14 +3005,22 @@ public:
 		car_manager.get_color_at_xy(pos, color, int_ret); // check cars next, but override the color
 		return 1;
 	}
-	void next_frame(bool use_threads_2_3) { // Note: threads: 0=draw, 1=roads and cars, 2=pedestrians
+	void next_frame_cars() {
+		road_gen.next_frame(); // update stoplights; must be before car_manager next_frame() call
+		car_manager.next_frame(city_params.car_speed);
+	}
+	void next_frame() {
 		if (!city_params.enabled()) return;
-
-		if (!use_threads_2_3 || omp_get_thread_num_3dw() == 1) { // thread 1
-			road_gen.next_frame(); // update stoplights; must be before car_manager next_frame() call
-			car_manager.next_frame(ped_manager, city_params.car_speed);
-		}
-		if (!use_threads_2_3 || omp_get_thread_num_3dw() == 2) {ped_manager.next_frame();} // thread=2
+		ped_manager.swap_snapshots(car_manager);
+		next_frame_cars();
+		ped_manager.next_frame();
+	}
+	job_handle_t add_next_frame_jobs() { // roads/cars and pedestrians/building AI are updated in parallel; returns a job that finishes when both are done
+		if (!city_params.enabled()) return nullptr;
+		ped_manager.swap_snapshots(car_manager); // cars and peds each read the other's snapshot from the previous frame, so they don't need locks
+		job_handle_t const cars(add_job([this]() {next_frame_cars();}, vector<job_handle_t>(), "City Cars Update"));
+		job_handle_t const peds(add_job([this]() {ped_manager.next_frame();}, vector<job_handle_t>(), "City Peds Update"));
+		return add_job([]() {}, {cars, peds}, "City Update");
 	}
 	void draw(int shadow_only, int reflection_pass, int trans_op_mask, vector3d const &xlate) { // shadow_only: 0=non-shadow pass, 1=sun/moon shadow, 2=dynamic shadow
 		if (player_in_basement >= 2) return; // player is fully in the basement, not on stairs - don't draw anything
@@ -3076,7 +3085,8 @@ cube_t get_city_bcube_at_pt(point const &pos) {return city_gen.get_city_bcube_at
 void get_city_bcubes(vect_cube_t &bcubes) {city_gen.get_city_bcubes(bcubes);}
 void get_city_road_bcubes(vect_cube_t &bcubes, bool connector_only) {city_gen.get_all_road_bcubes(bcubes, connector_only);}
 void get_city_plot_zones(vect_city_zone_t &zones) {city_gen.get_all_plot_zones(zones);}
-void next_city_frame(bool use_threads_2_3) {city_gen.next_frame(use_threads_2_3);}
+void next_city_frame() {city_gen.next_frame();}
+job_handle_t add_next_city_frame_jobs() {return city_gen.add_next_frame_jobs();}
 void draw_cities(int shadow_only, int reflection_pass, int trans_op_mask, vector3d const &xlate) {city_gen.draw(shadow_only, reflection_pass, trans_op_mask, xlate);}
 void draw_city_roads(int trans_op_mask, vector3d const &xlate) {city_gen.draw_roads(trans_op_mask, xlate);}
 void setup_city_lights(vector3d const &xlate) {city_gen.setup_city_lights(xlate);}
@@ -4,14 +4,29 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include "profiler.h"
+#include <cfloat> // for FLT_MAX
+#include <xmmintrin.h> // for SSE line_packet_t node tests
 
 
 unsigned const MAX_LEAF_SIZE = 2;
 float const POLY_TOLER       = 1.0E-6;
 float const OVERLAP_AMT      = 0.02;
 
+// SAH build
+unsigned const SAH_NUM_BINS      = 16;
+unsigned const SAH_MAX_LEAF_SIZE = 8; // larger leaves are split even if the SAH cost doesn't improve
+unsigned const SAH_MT_MIN_COBJS  = 4096; // with mt_cobj_tree_build, use multiple threads for SAH trees at least this large
+unsigned const SAH_MT_SUBTREES   = 64; // number of subtrees to split into before building each one on a single thread
+unsigned const SAH_MT_MIN_BIN    = 65536; // nodes with at least this many cobjs are binned in parallel
+unsigned const SAH_MT_BIN_CHUNKS = 64;
+float const SAH_TRAVERSAL_COST   = 1.0; // relative to the cost of one cobj intersection test
 
-extern bool mt_cobj_tree_build, begin_motion;
+float cobj_tree_refit_max_area_ratio = 1.5; // rebuild rather than refit when total node area increases by more than this; 0 = always rebuild
+
+
+extern bool mt_cobj_tree_build, sah_cobj_tree_build, begin_motion;
+extern unsigned cobj_tree_bench_queries;
 extern int display_mode, frame_counter, cobj_counter;
 extern coll_obj_group coll_objects;
 extern vector<unsigned> falling_cobjs;
@@ -124,6 +139,81 @@ bool cobj_tree_base::node_ix_mgr::check_node(unsigned &nix) const {
 }
 
 
+// *** line_packet_t ***
+
+
+// one dim of the SSE version of get_line_clip() for all lines in the packet; lo and hi are the near and far planes
+inline void clip_packet_dim(__m128 const lo, __m128 const hi, float const *const p1, float const *const dinv, __m128 &tmin, __m128 &tmax) {
+	__m128 const p(_mm_load_ps(p1)), di(_mm_load_ps(dinv));
+	// Note: argument order matches the comparisons in get_line_clip() so that NaNs keep the previous tmin/tmax
+	tmin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(lo, p), di), tmin);
+	tmax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(hi, p), di), tmax);
+}
+
+// performance critical; used when all lines in the packet have the same direction signs, which is the common case for coherent rays
+template<bool xneg, bool yneg, bool zneg> unsigned get_line_clip_packet(line_packet_t const &lp, float const d[3][2]) {
+
+	__m128 tmin(_mm_setzero_ps()), tmax(_mm_load_ps(lp.tmax));
+	clip_packet_dim(_mm_set1_ps(d[0][xneg]), _mm_set1_ps(d[0][!xneg]), lp.p1[0], lp.dinv[0], tmin, tmax);
+	clip_packet_dim(_mm_set1_ps(d[1][yneg]), _mm_set1_ps(d[1][!yneg]), lp.p1[1], lp.dinv[1], tmin, tmax);
+	clip_packet_dim(_mm_set1_ps(d[2][zneg]), _mm_set1_ps(d[2][!zneg]), lp.p1[2], lp.dinv[2], tmin, tmax);
+	return _mm_movemask_ps(_mm_cmplt_ps(tmin, tmax));
+}
+
+unsigned get_line_clip_packet_mixed(line_packet_t const &lp, float const d[3][2]) { // lines with different direction signs
+
+	__m128 tmin(_mm_setzero_ps()), tmax(_mm_load_ps(lp.tmax));
+
+	for (unsigned dim = 0; dim < 3; ++dim) {
+		__m128 const p(_mm_load_ps(lp.p1[dim])), di(_mm_load_ps(lp.dinv[dim]));
+		__m128 const t1(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[dim][0]), p), di)), t2(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(d[dim][1]), p), di));
+		tmin = _mm_max_ps(_mm_min_ps(t1, t2), tmin);
+		tmax = _mm_min_ps(_mm_max_ps(t1, t2), tmax);
+	}
+	return _mm_movemask_ps(_mm_cmplt_ps(tmin, tmax));
+}
+
+void line_packet_t::clear() {
+
+	num = 0;
+
+	for (unsigned i = 0; i < SIZE; ++i) { // unused lanes have an empty [0, -1] range and never intersect
+		UNROLL_3X(p1[i_][i] = dinv[i_][i] = 0.0;)
+		tmax[i]   = -1.0;
+		cindex[i] = -1;
+		skip_init_colls[i] = 0;
+	}
+}
+
+void line_packet_t::add(point const &p1_, point const &p2_, bool skip_init_colls_) {
+
+	assert(num < SIZE);
+	vector3d di(p2_ - p1_);
+	di.invert();
+	UNROLL_3X(p1[i_][num] = p1_[i_]; dinv[i_][num] = di[i_];)
+	tmax[num]   = 1.0;
+	start[num]  = p1_;
+	end  [num]  = cpos[num] = p2_;
+	cindex[num] = -1;
+	skip_init_colls[num] = skip_init_colls_;
+	++num;
+}
+
+line_packet_t::clip_func_t line_packet_t::get_clip_func() const {
+
+	static clip_func_t const clip_funcs[8] = {get_line_clip_packet<0,0,0>, get_line_clip_packet<0,0,1>, get_line_clip_packet<0,1,0>, get_line_clip_packet<0,1,1>,
+											  get_line_clip_packet<1,0,0>, get_line_clip_packet<1,0,1>, get_line_clip_packet<1,1,0>, get_line_clip_packet<1,1,1>};
+	assert(num > 0);
+	unsigned signs[3] = {0, 0, 0}; // bit 0 = has positive dir, bit 1 = has negative dir
+
+	for (unsigned i = 0; i < num; ++i) {
+		UNROLL_3X(signs[i_] |= ((dinv[i_][i] < 0.0) ? 2 : 1);)
+	}
+	if (signs[0] == 3 || signs[1] == 3 || signs[2] == 3) return get_line_clip_packet_mixed;
+	return clip_funcs[4*(signs[0] == 2) + 2*(signs[1] == 2) + (signs[2] == 2)];
+}
+
+
 // *** cobj_tree_simple_type_t ***
 
 
@@ -344,21 +434,21 @@ void cobj_tree_sphere_t::get_ids_int_sphere(point const &center, float radius, v
 // *** cobj_bvh_tree ***
 
 
-bool cobj_bvh_tree::create_cixs() {
+bool cobj_bvh_tree::create_cixs(vector<unsigned> &ids) const { // Note: ids are sorted
 
 	if (is_dynamic && !is_static) { // use dynamic_ids
 		for (cobj_id_set_t::const_iterator i = cobjs->dynamic_ids.begin(); i != cobjs->dynamic_ids.end(); ++i) {
 			assert(*i < cobjs->size());
 			assert((*cobjs)[*i].status == COLL_DYNAMIC);
-			add_cobj(*i);
+			add_cobj(*i, ids);
 		}
 	}
 	else {
-		if (is_static && !occluders_only && !cubes_only) {cixs.reserve(cobjs->size());} // normal static mode
-		for (unsigned i = 0; i < cobjs->size(); ++i) {add_cobj(i);}
+		if (is_static && !occluders_only && !cubes_only) {ids.reserve(cobjs->size());} // normal static mode
+		for (unsigned i = 0; i < cobjs->size(); ++i) {add_cobj(i, ids);}
 	}
-	assert(cixs.size() < (1 << 29));
-	return !cixs.empty();
+	assert(ids.size() < (1 << 29));
+	return !ids.empty();
 }
 
 
@@ -375,6 +465,7 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	built_cids.clear();
 }
 
 
@@ -382,9 +473,14 @@ void cobj_bvh_tree::add_cobjs(bool verbose) {
 
 	RESET_TIME;
 	clear();
-	if (!create_cixs()) return; // nothing to be done
-	bool const do_mt_build(mt_cobj_tree_build && cixs.size() > 10000);
-	build_tree_from_cixs(do_mt_build);
+	if (!create_cixs(cixs)) return; // nothing to be done
+	built_cids = cixs;
+	// the dynamic tree can be rebuilt every frame, where a serial SAH build costs several times more than a midpoint build,
+	// so it only uses SAH when the SAH build is multithreaded
+	bool const mt_sah(mt_cobj_tree_build && cixs.size() > SAH_MT_MIN_COBJS);
+	bool const use_sah(sah_cobj_tree_build && (!is_dynamic || mt_sah));
+	bool const do_mt_build(use_sah ? mt_sah : (mt_cobj_tree_build && cixs.size() > 10000));
+	build_tree_from_cixs(do_mt_build, use_sah);
 
 	if (verbose) {
 		PRINT_TIME(" Cobj Tree Create");
@@ -395,8 +491,19 @@ void cobj_bvh_tree::add_cobjs(bool verbose) {
 
 
 // to be called from within add_cobjs() or after a call to add_cobj_ids()
-void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
+void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {build_tree_from_cixs(do_mt_build, 0);} // midpoint build, for incremental/per-frame trees
 
+void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build, bool use_sah) {
+
+	build_tree_from_cixs_int(do_mt_build, use_sah);
+	has_node_gaps = (do_mt_build && !use_sah); // midpoint MT build leaves unused nodes between subtrees
+	built_area    = get_total_node_area();
+	++num_builds;
+}
+
+void cobj_bvh_tree::build_tree_from_cixs_int(bool do_mt_build, bool use_sah) {
+
+	if (use_sah) {build_tree_sah(do_mt_build); return;}
 	max_depth = max_leaf_count = num_leaf_nodes = 0;
 	nodes.resize(get_conservative_num_nodes(cixs.size()) + 64*do_mt_build); // add 8 extra nodes for each of 8 top level splits
 	unsigned const root(0);
@@ -423,6 +530,7 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 	float t(0.0), tmin(0.0), tmax(1.0), max_alpha(0.0);
 	node_ix_mgr nixm(nodes, p1, p2);
 	unsigned const num_nodes((unsigned)nodes.size());
+	unsigned num_tested(0); // for tracing
 
 	for (unsigned nix = 0; nix < num_nodes;) {
 		tree_node const &n(nodes[nix]);
@@ -440,11 +548,12 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 			if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             continue; // lower alpha than an earlier object
 			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       continue; // less than min alpha
 			if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) continue;
+			++num_tested;
 			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax))              continue;
 			cindex = cixs[i];
 			cpos   = p1 + (p2 - p1)*t;
 			//if (c.type == COLL_POLYGON && dot_product((p2 - p1), c.norm) < 0.0) {} // back-facing polygon test
-			if (!exact && test_alpha != 2) return 1; // return first hit
+			if (!exact && test_alpha != 2) {TRACE_COUNTER_ADD("Cobjs Tested", num_tested); return 1;} // return first hit
 			max_alpha = c.cp.color.alpha; // we need all intersections to find the max alpha
 			nixm.dinv = vector3d(cpos - p1);
 			nixm.dinv.invert();
@@ -452,10 +561,60 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 			ret  = 1;
 		}
 	}
+	TRACE_COUNTER_ADD("Cobjs Tested", num_tested);
 	return ret;
 }
 
 
+// exact closest hit version of check_coll_line() for a packet of lines; lines that already have a closer hit in lp (from another tree) keep it
+void cobj_bvh_tree::check_coll_line_packet(line_packet_t &lp, int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_movable) const {
+
+	if (nodes.empty() || lp.num == 0) return;
+	line_packet_t::clip_func_t const clip_func(lp.get_clip_func());
+	float max_alpha[line_packet_t::SIZE] = {0.0};
+	unsigned const num_nodes((unsigned)nodes.size());
+	unsigned num_tested(0); // for tracing
+
+	for (unsigned nix = 0; nix < num_nodes;) {
+		tree_node const &n(nodes[nix]);
+		unsigned const mask(clip_func(lp, n.d)); // lines that intersect this node
+
+		if (mask == 0) {
+			assert(n.next_node_id > nix);
+			nix = n.next_node_id; // failed the bbox test for all lines
+			continue;
+		}
+		++nix;
+
+		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			if ((int)cixs[i] == ignore_cobj) continue;
+			coll_obj const &c(get_cobj(i));
+			if (!obj_ok(c))                  continue;
+			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
+			if (skip_movable    && c.is_movable())                            continue;
+			if (test_alpha == 1 && c.is_semi_trans())                         continue;
+			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       continue;
+
+			for (unsigned r = 0; r < lp.num; ++r) {
+				if (!(mask & (1 << r))) continue;
+				if (test_alpha == 2 && c.cp.color.alpha <= max_alpha[r]) continue;
+				if (lp.skip_init_colls[r] && c.contains_pt(lp.start[r]) && c.contains_point(lp.start[r])) continue;
+				++num_tested;
+				float t(0.0);
+				vector3d cnorm;
+				if (!c.line_int_exact(lp.start[r], lp.end[r], t, cnorm, 0.0, lp.tmax[r])) continue;
+				lp.cindex[r] = cixs[i];
+				lp.cnorm [r] = cnorm;
+				lp.cpos  [r] = lp.start[r] + (lp.end[r] - lp.start[r])*t;
+				lp.tmax  [r] = t; // only closer hits from here on
+				max_alpha[r] = c.cp.color.alpha;
+			}
+		}
+	}
+	TRACE_COUNTER_ADD("Cobjs Tested", num_tested);
+}
+
+
 bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 
 	unsigned const num_nodes((unsigned)nodes.size());
@@ -570,6 +729,7 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 	unsigned const num_nodes((unsigned)nodes.size());
 	cube_t bcube(center, center);
 	bcube.expand_by(radius);
+	unsigned num_tested(0); // for tracing
 
 	for (unsigned nix = 0; nix < num_nodes;) {
 		tree_node const &n(nodes[nix]);
@@ -582,9 +742,10 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 		++nix;
 		
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
+			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) {vcd.check_cobj(cixs[i]); ++num_tested;}
 		}
 	}
+	TRACE_COUNTER_ADD("Cobjs Tested", num_tested);
 }
 
 
@@ -729,6 +890,291 @@ void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth,
 }
 
 
+struct sah_bin_t { // Note: not initialized by default because this is performance critical; call init()
+	float lo[3], hi[3];
+	unsigned count;
+
+	void init() {
+		UNROLL_3X(lo[i_] = FLT_MAX; hi[i_] = -FLT_MAX;)
+		count = 0;
+	}
+	void add(cube_t const &c) {
+		UNROLL_3X(min_eq(lo[i_], c.d[i_][0]); max_eq(hi[i_], c.d[i_][1]);)
+		++count;
+	}
+	void add(sah_bin_t const &b) {
+		UNROLL_3X(min_eq(lo[i_], b.lo[i_]); max_eq(hi[i_], b.hi[i_]);)
+		count += b.count;
+	}
+	float get_cost() const { // count * half surface area; valid for empty bins
+		if (count == 0) return 0.0;
+		float const dx(hi[0] - lo[0]), dy(hi[1] - lo[1]), dz(hi[2] - lo[2]);
+		return count*(dx*dy + dy*dz + dz*dx);
+	}
+	cube_t get_cube() const {return cube_t(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);}
+};
+
+struct sah_bins_t {
+	unsigned num_bins;
+	sah_bin_t bins[3][SAH_NUM_BINS];
+
+	sah_bins_t(unsigned nb) : num_bins(nb) {
+		assert(num_bins <= SAH_NUM_BINS);
+		for (unsigned d = 0; d < 3; ++d) {for (unsigned i = 0; i < num_bins; ++i) {bins[d][i].init();}}
+	}
+	void add(sah_bins_t const &b) {
+		for (unsigned d = 0; d < 3; ++d) {for (unsigned i = 0; i < num_bins; ++i) {bins[d][i].add(b.bins[d][i]);}}
+	}
+};
+
+inline float get_half_area(cube_t const &c) {return 0.5f*c.get_area();}
+
+inline unsigned get_sah_bin(float center, float lo, float scale, unsigned num_bins) { // scale = num_bins/extent
+	return min(num_bins-1, unsigned(max(0.0f, (center - lo)*scale)));
+}
+
+// partitions the refs of node ix using binned SAH and sets the bounds of its kids; returns true if the node was split
+bool cobj_bvh_tree::split_node_sah(vector<sah_node_t> &snodes, vector<sah_ref_t> &refs, unsigned ix, bool mt_binning) const {
+
+	sah_node_t &n(snodes[ix]); // Note: bounds were set by the parent
+	unsigned const num(n.get_num());
+	assert(num > 0);
+	cube_t const &cent_bc(n.cent_bc);
+	n.is_leaf = 1;
+	if (num <= MAX_LEAF_SIZE) return 0; // base case
+	// bin refs by centroid along each dim
+	unsigned const num_bins(min(SAH_NUM_BINS, num)); // small nodes use fewer bins
+	float scale[3] = {0.0f, 0.0f, 0.0f};
+	bool any_splittable(0);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		float const extent(cent_bc.d[d][1] - cent_bc.d[d][0]);
+		if (extent > 0.0) {scale[d] = num_bins/extent; any_splittable = 1;}
+	}
+	if (!any_splittable) return 0; // all centroids are the same; can't split
+	// large nodes are binned in fixed size chunks so that the result doesn't depend on the number of threads
+	unsigned const num_chunks(mt_binning ? min(SAH_MT_BIN_CHUNKS, num) : 1);
+	auto get_chunk_start([&](unsigned chunk) {return unsigned(n.start + (unsigned long long)chunk*num/num_chunks);});
+	sah_bins_t bins(num_bins);
+
+	auto calc_bins([&](unsigned start, unsigned end, sah_bins_t &b) {
+		for (unsigned i = start; i < end; ++i) {
+			for (unsigned d = 0; d < 3; ++d) {
+				if (scale[d] > 0.0) {b.bins[d][get_sah_bin(refs[i].center[d], cent_bc.d[d][0], scale[d], num_bins)].add(refs[i].bc);}
+			}
+		}
+	});
+	if (num_chunks > 1) {
+		vector<sah_bins_t> chunk_bins(num_chunks, sah_bins_t(num_bins));
+#pragma omp parallel for schedule(dynamic)
+		for (int c = 0; c < (int)num_chunks; ++c) {calc_bins(get_chunk_start(c), get_chunk_start(c+1), chunk_bins[c]);}
+		for (sah_bins_t const &b : chunk_bins) {bins.add(b);}
+	}
+	else {calc_bins(n.start, n.end, bins);}
+	// sweep bins to find the min cost split; costs are scaled by node area
+	float const node_area(get_half_area(n));
+	float best_cost(0.0);
+	unsigned best_dim(3), best_split(0);
+	cube_t best_bc[2]; // {left, right}
+
+	for (unsigned d = 0; d < 3; ++d) {
+		if (scale[d] == 0.0) continue;
+		sah_bin_t right_acc[SAH_NUM_BINS], acc;
+		acc.init();
+
+		for (unsigned b = num_bins-1; b > 0; --b) { // right sides of splits 1..num_bins-1
+			acc.add(bins.bins[d][b]);
+			right_acc[b] = acc;
+		}
+		acc.init();
+
+		for (unsigned b = 1; b < num_bins; ++b) { // split between bins b-1 and b
+			acc.add(bins.bins[d][b-1]);
+			if (acc.count == 0 || acc.count == num) continue; // must have refs on both sides
+			float const cost(acc.get_cost() + right_acc[b].get_cost());
+			if (best_dim < 3 && cost >= best_cost) continue;
+			best_cost  = cost;
+			best_dim   = d;
+			best_split = b;
+			best_bc[0] = acc.get_cube();
+			best_bc[1] = right_acc[b].get_cube();
+		}
+	} // for d
+	assert(best_dim < 3); // must have a valid split in a dim with nonzero centroid extent
+	if (num <= SAH_MAX_LEAF_SIZE && (SAH_TRAVERSAL_COST*node_area + best_cost) >= num*node_area) return 0; // cheaper as a leaf
+	// partition refs by split bin, using the same bin calculation so that the sides match the counts above, and calculate kid centroid bounds
+	float const lo(cent_bc.d[best_dim][0]), sc(scale[best_dim]);
+	cube_t cent_bcs[2];
+	for (unsigned s = 0; s < 2; ++s) {cent_bcs[s] = cube_t(FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX);}
+	unsigned i(n.start), j(n.end);
+
+	while (i < j) { // each ref is tested once
+		if (get_sah_bin(refs[i].center[best_dim], lo, sc, num_bins) < best_split) {cent_bcs[0].union_with_pt(refs[i].center); ++i;}
+		else {--j; std::swap(refs[i], refs[j]); cent_bcs[1].union_with_pt(refs[j].center);}
+	}
+	unsigned const num_left(i - n.start);
+	assert(num_left > 0 && num_left < num);
+	n.is_leaf = 0;
+	sah_node_t &left(snodes[ix+1]), &right(snodes[ix+2*num_left]);
+	left .start = n.start; left .end = n.start + num_left;
+	right.start = left.end; right.end = n.end;
+	left .copy_from(best_bc[0]); left .cent_bc = cent_bcs[0];
+	right.copy_from(best_bc[1]); right.cent_bc = cent_bcs[1];
+	return 1;
+}
+
+void cobj_bvh_tree::build_tree_sah_rec(vector<sah_node_t> &snodes, vector<sah_ref_t> &refs, unsigned ix) const {
+
+	while (split_node_sah(snodes, refs, ix, 0)) { // recurse on the smaller kid and iterate on the larger one to bound stack depth
+		unsigned const left(ix+1), right(ix+2*snodes[left].get_num());
+		bool const left_smaller(snodes[left].get_num() < snodes[right].get_num());
+		build_tree_sah_rec(snodes, refs, (left_smaller ? left : right));
+		ix = (left_smaller ? right : left);
+	}
+}
+
+// binned SAH build with binary splits; top levels are split breadth first, with parallel binning of large nodes,
+// then the resulting subtrees are built in parallel; the tree is then flattened into depth first order in nodes
+void cobj_bvh_tree::build_tree_sah(bool do_mt_build) {
+
+	unsigned const num(cixs.size());
+	assert(num > 0);
+	vector<sah_node_t> snodes(2*num);
+	vector<sah_ref_t> refs(num); // compact copy of cobj bcubes so that we don't need to access cobjs while building
+	snodes[0].end = num;
+
+#pragma omp parallel for schedule(static) if (do_mt_build)
+	for (int i = 0; i < (int)num; ++i) {
+		sah_ref_t &r(refs[i]);
+		r.bc     = get_cobj(i);
+		r.center = r.bc.get_cube_center();
+		r.cix    = cixs[i];
+	}
+	sah_node_t &root(snodes[0]);
+	root.copy_from(refs[0].bc);
+	root.cent_bc.set_from_point(refs[0].center);
+
+	for (unsigned i = 1; i < num; ++i) { // calculate root bounds; kid bounds are calculated when splitting their parents
+		root.union_with_cube(refs[i].bc);
+		root.cent_bc.union_with_pt(refs[i].center);
+	}
+	if (do_mt_build) {
+		vector<unsigned> level(1, 0), next_level;
+		vector<unsigned char> was_split;
+
+		while (!level.empty() && level.size() < SAH_MT_SUBTREES) {
+			was_split.resize(level.size());
+
+			if (snodes[level.front()].get_num() >= SAH_MT_MIN_BIN) { // large nodes: split nodes serially with parallel binning
+				for (unsigned i = 0; i < level.size(); ++i) {was_split[i] = split_node_sah(snodes, refs, level[i], (snodes[level[i]].get_num() >= SAH_MT_MIN_BIN));}
+			}
+			else { // split nodes in parallel
+#pragma omp parallel for schedule(dynamic)
+				for (int i = 0; i < (int)level.size(); ++i) {was_split[i] = split_node_sah(snodes, refs, level[i], 0);}
+			}
+			next_level.clear();
+
+			for (unsigned i = 0; i < level.size(); ++i) {
+				if (!was_split[i]) continue; // leaf
+				unsigned const left(level[i]+1), right(level[i]+2*snodes[left].get_num());
+				next_level.push_back(left);
+				next_level.push_back(right);
+			}
+			level.swap(next_level);
+			sort(level.begin(), level.end(), [&](unsigned a, unsigned b) {return (snodes[a].get_num() > snodes[b].get_num());}); // largest first
+		} // while
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)level.size(); ++i) {build_tree_sah_rec(snodes, refs, level[i]);}
+	}
+	else {
+		build_tree_sah_rec(snodes, refs, 0);
+	}
+	for (unsigned i = 0; i < num; ++i) {cixs[i] = refs[i].cix;}
+	// calculate subtree sizes; kids always have higher indices than their parents
+	vector<unsigned> subtree_sz(snodes.size(), 0);
+
+	for (unsigned ix = snodes.size(); ix-- > 0;) {
+		sah_node_t const &n(snodes[ix]);
+		if (n.get_num() == 0) continue; // unused
+		subtree_sz[ix] = (n.is_leaf ? 1 : (1 + subtree_sz[ix+1] + subtree_sz[ix+2*snodes[ix+1].get_num()]));
+	}
+	// flatten into depth first order with next_node_id skip links
+	max_depth = max_leaf_count = num_leaf_nodes = 0;
+	nodes.clear();
+	nodes.reserve(subtree_sz[0]);
+	vector<pair<unsigned, unsigned>> stack; // {snode index, depth}
+	stack.emplace_back(0, 0);
+
+	while (!stack.empty()) {
+		unsigned const ix(stack.back().first), depth(stack.back().second);
+		stack.pop_back();
+		sah_node_t const &n(snodes[ix]);
+		unsigned const nix(nodes.size());
+		max_depth = max(max_depth, depth);
+
+		if (n.is_leaf) {
+			nodes.push_back(tree_node(n.start, n.end, n));
+			register_leaf(n.get_num());
+		}
+		else {
+			nodes.push_back(tree_node(0, 0, n)); // branch node has no leaves
+			stack.emplace_back(ix+2*snodes[ix+1].get_num(), depth+1); // right, processed second
+			stack.emplace_back(ix+1, depth+1); // left, processed first
+		}
+		nodes[nix].next_node_id = nix + subtree_sz[ix];
+	} // while
+	assert(nodes.size() == subtree_sz[0]);
+}
+
+
+float cobj_bvh_tree::get_total_node_area() const { // used as a tree quality metric
+	float area(0.0);
+	for (tree_node const &n : nodes) {area += get_half_area(n);}
+	return area;
+}
+
+// updates node bcubes bottom up for the current cobj positions; returns false if tree quality has degraded enough that it should be rebuilt
+bool cobj_bvh_tree::refit_tree() {
+
+	assert(!has_node_gaps);
+	float area(0.0);
+
+	for (unsigned nix = nodes.size(); nix-- > 0;) { // kids always have higher indices than their parents
+		tree_node &n(nodes[nix]);
+
+		if (n.start < n.end) {calc_node_bbox(n);} // leaf
+		else { // branch: union of kids
+			assert(nix+1 < n.next_node_id);
+			n.copy_from(nodes[nix+1]);
+			for (unsigned kid = nodes[nix+1].next_node_id; kid < n.next_node_id; kid = nodes[kid].next_node_id) {n.union_with_cube(nodes[kid]);}
+		}
+		area += get_half_area(n);
+	}
+	++num_refits;
+	return (area <= cobj_tree_refit_max_area_ratio*built_area);
+}
+
+// cids must be sorted; refits the tree if it contains the same cobjs as the last build and the refit tree is good enough, otherwise returns false
+bool cobj_bvh_tree::refit_cobj_ids(vector<unsigned> const &cids) {
+
+	if (nodes.empty() || has_node_gaps || cobj_tree_refit_max_area_ratio == 0.0) return 0; // can't refit
+	if (cids != built_cids) return 0; // added or removed cobjs
+	return refit_tree();
+}
+
+void cobj_bvh_tree::add_or_refit_cobjs(bool verbose) {
+
+	temp_cids.clear();
+	create_cixs(temp_cids);
+	if (refit_cobj_ids(temp_cids)) return; // done
+	add_cobjs(verbose);
+}
+
+void cobj_bvh_tree::print_refit_stats() const {
+	cout << "builds: " << num_builds << ", refits: " << num_refits << ", node area: " << get_total_node_area() << ", built node area: " << built_area << endl;
+}
+
+
 // is_static is_dynamic occluders_only cubes_only inc_voxel_cobjs
 cobj_bvh_tree cobj_tree_static (&coll_objects, 1, 0, 0, 0, 0); // does not include voxels
 cobj_bvh_tree cobj_tree_dynamic(&coll_objects, 0, 1, 0, 0, 0);
@@ -741,10 +1187,19 @@ cobj_bvh_tree &get_tree(bool dynamic) {
 	return (dynamic ? cobj_tree_dynamic : cobj_tree_static);
 }
 
+float get_moving_cobjs_zmax() { // dynamic and moving static cobjs may be above czmax
+	float zmax(-FAR_DISTANCE);
+	cube_t bc;
+	if (cobj_tree_dynamic      .get_root_bcube(bc)) {zmax = max(zmax, bc.z2());}
+	if (cobj_tree_static_moving.get_root_bcube(bc)) {zmax = max(zmax, bc.z2());}
+	return zmax;
+}
+
 void build_static_moving_cobj_tree() {
 
-	cobj_tree_static_moving.clear();
-	vector<unsigned> moving_cids(falling_cobjs);
+	TRACE_ZONE("Static Moving Cobj Tree Update");
+	static vector<unsigned> moving_cids; // reused across frames
+	moving_cids = falling_cobjs;
 		
 	for (auto i = moving_cobjs.begin(); i != moving_cobjs.end(); ++i) {
 		if (coll_objects.get_cobj(*i).status == COLL_STATIC) {moving_cids.push_back(*i);}
@@ -752,6 +1207,10 @@ void build_static_moving_cobj_tree() {
 	for (platform_cont::const_iterator i = platforms.begin(); i != platforms.end(); ++i) {
 		copy(i->cobjs.begin(), i->cobjs.end(), back_inserter(moving_cids));
 	}
+	sort(moving_cids.begin(), moving_cids.end()); // required for refit check
+	if (cobj_tree_static_moving.refit_cobj_ids(moving_cids)) return; // same cobjs, moved: refit rather than rebuild
+	cobj_tree_static_moving.clear();
+
 	if (!moving_cids.empty()) {
 		cobj_tree_static_moving.add_cobj_ids(moving_cids);
 		cobj_tree_static_moving.build_tree_from_cixs(0);
@@ -767,11 +1226,19 @@ void build_cobj_tree(bool dynamic, bool verbose) {
 		//cobj_tree_triangles.add_cobjs(coll_objects, verbose);
 	}
 	else { // dynamic
-		if (begin_motion) {get_tree(1).add_cobjs(verbose);}
+		TRACE_ZONE("Dynamic Cobj Tree Update");
+		if (begin_motion) {get_tree(1).add_or_refit_cobjs(verbose);}
 		//build_static_moving_cobj_tree();
 	}
 }
 
+void print_cobj_tree_refit_stats() {
+	cout << "Dynamic cobj tree: ";
+	get_tree(1).print_refit_stats();
+	cout << "Static moving cobj tree: ";
+	cobj_tree_static_moving.print_refit_stats();
+}
+
 // can use with ray trace lighting, snow collision?, maybe water reflections
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic, int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable, bool no_stat_moving)
@@ -784,6 +1251,20 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// packet version of check_coll_line_exact_tree() for static cobjs, used for coherent lighting rays
+void check_coll_line_exact_tree_packet(line_packet_t &lp, int ignore_cobj, int test_alpha, bool include_voxels, bool no_stat_moving) {
+
+	cobj_tree_static.check_coll_line_packet(lp, ignore_cobj, test_alpha, 0, 0);
+	if (!no_stat_moving) {cobj_tree_static_moving.check_coll_line_packet(lp, ignore_cobj, test_alpha, 0, 0);}
+	if (!include_voxels) return;
+
+	for (unsigned r = 0; r < lp.num; ++r) { // voxels have their own traversal, so do these one at a time
+		point const p2(lp.cpos[r]); // closest hit so far, or end point
+		int cindex(-1);
+		if (check_voxel_coll_line(lp.start[r], p2, lp.cpos[r], lp.cnorm[r], cindex, ignore_cobj, 1)) {lp.cindex[r] = cindex;}
+	}
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
@@ -837,3 +1318,98 @@ bool have_occluders() {
 }
 
 
+// compares build time, size, and query time of the midpoint and SAH builders on the static cobjs of the current scene
+void run_cobj_tree_benchmark() {
+
+	if (cobj_tree_bench_queries == 0) return;
+	unsigned const num_queries(cobj_tree_bench_queries);
+	cobj_tree_bench_queries = 0; // only run once
+	cube_t scene_bc;
+	if (!cobj_tree_static.get_root_bcube(scene_bc)) return; // no static cobjs
+	float const query_radius(0.01*scene_bc.get_size().get_max_val());
+	rand_gen_t rgen;
+	vector<point> pts(2*num_queries);
+
+	for (point &p : pts) {
+		for (unsigned d = 0; d < 3; ++d) {p[d] = rgen.rand_uniform(scene_bc.d[d][0], scene_bc.d[d][1]);}
+	}
+	// coherent rays similar to sky lighting: groups of rays from a point above the scene with sorted directions, for comparing single rays vs. packets
+	unsigned const coherent_group_size = 64;
+	vector<point> coh_pts(2*num_queries);
+
+	for (unsigned i = 0; i < num_queries; i += coherent_group_size) {
+		unsigned const end_i(min(num_queries, i+coherent_group_size));
+		point const start(rgen.rand_uniform(scene_bc.x1(), scene_bc.x2()), rgen.rand_uniform(scene_bc.y1(), scene_bc.y2()), scene_bc.z2());
+		vector<vector3d> dirs;
+
+		for (unsigned j = i; j < end_i; ++j) {
+			point const target(rgen.rand_uniform(scene_bc.x1(), scene_bc.x2()), rgen.rand_uniform(scene_bc.y1(), scene_bc.y2()), scene_bc.z1());
+			dirs.push_back(target - start);
+		}
+		sort(dirs.begin(), dirs.end());
+
+		for (unsigned j = i; j < end_i; ++j) {
+			coh_pts[2*j] = start;
+			coh_pts[2*j+1] = start + dirs[j-i];
+		}
+	}
+	cout << "Cobj tree benchmark with " << num_queries << " ray and sphere queries:" << endl;
+	cout << "builder          build_ms  nodes  depth  ray_ms  rays_per_s  hits  sphere_ms  sphere_cobjs  coh_ray_ms  packet_ms  packet_rays_per_s" << endl;
+	char const *const names[4] = {"midpoint", "midpoint MT", "SAH", "SAH MT"};
+	vector<unsigned> cids;
+	int prev_hits(-1);
+
+	for (unsigned mode = 0; mode < 4; ++mode) {
+		cobj_bvh_tree tree(&coll_objects, 1, 0, 0, 0, 0); // same options as cobj_tree_static
+		tree.add_cobj_ids(cobj_tree_static.get_cixs());
+		auto const t0(high_resolution_clock::now());
+		tree.build_tree_from_cixs((mode & 1), (mode >= 2));
+		auto const t1(high_resolution_clock::now());
+		unsigned num_hits(0);
+
+		for (unsigned i = 0; i < num_queries; ++i) {
+			point cpos;
+			vector3d cnorm;
+			int cindex(-1);
+			num_hits += tree.check_coll_line(pts[2*i], pts[2*i+1], cpos, cnorm, cindex, -1, 1, 0, 0, 0, 0);
+		}
+		auto const t2(high_resolution_clock::now());
+		unsigned num_sphere_cobjs(0);
+
+		for (unsigned i = 0; i < num_queries; ++i) {
+			cube_t bcube(pts[2*i], pts[2*i]);
+			bcube.expand_by(query_radius);
+			cids.clear();
+			tree.get_intersecting_cobjs(bcube, cids, -1, 0.0, 0, -1);
+			num_sphere_cobjs += cids.size();
+		}
+		auto const t3(high_resolution_clock::now());
+		vector<int> coh_cixs(num_queries, -1);
+
+		for (unsigned i = 0; i < num_queries; ++i) {
+			point cpos;
+			vector3d cnorm;
+			tree.check_coll_line(coh_pts[2*i], coh_pts[2*i+1], cpos, cnorm, coh_cixs[i], -1, 1, 0, 0, 0, 0);
+		}
+		auto const t4(high_resolution_clock::now());
+		unsigned num_packet_diffs(0);
+
+		for (unsigned i = 0; i < num_queries; i += line_packet_t::SIZE) {
+			line_packet_t lp;
+			for (unsigned j = i; j < min(num_queries, i+line_packet_t::SIZE); ++j) {lp.add(coh_pts[2*j], coh_pts[2*j+1], 0);}
+			tree.check_coll_line_packet(lp, -1, 0, 0, 0);
+			for (unsigned j = 0; j < lp.num; ++j) {num_packet_diffs += (lp.cindex[j] != coh_cixs[i+j]);}
+		}
+		auto const t5(high_resolution_clock::now());
+		float const build_ms(1000.0f*duration_cast<duration<float>>(t1 - t0).count()), ray_ms(1000.0f*duration_cast<duration<float>>(t2 - t1).count());
+		float const sphere_ms(1000.0f*duration_cast<duration<float>>(t3 - t2).count()), coh_ray_ms(1000.0f*duration_cast<duration<float>>(t4 - t3).count());
+		float const packet_ms(1000.0f*duration_cast<duration<float>>(t5 - t4).count());
+		cout << names[mode] << std::string(17 - strlen(names[mode]), ' ') << build_ms << "\t" << tree.get_num_nodes() << "\t" << tree.get_max_depth() << "\t" << ray_ms << "\t"
+			 << unsigned(1000.0f*num_queries/max(ray_ms, 0.001f)) << "\t" << num_hits << "\t" << sphere_ms << "\t" << num_sphere_cobjs << "\t" << coh_ray_ms << "\t"
+			 << packet_ms << "\t" << unsigned(1000.0f*num_queries/max(packet_ms, 0.001f)) << endl;
+		if (num_packet_diffs > 0) {cout << "Note: " << num_packet_diffs << " packet rays hit a different cobj than single rays (ties or precision)" << endl;}
+		if (prev_hits >= 0 && (int)num_hits != prev_hits) {cout << "Warning: cobj tree benchmark ray hit counts differ between builders" << endl;}
+		prev_hits = num_hits;
+	} // for mode
+}
+
@@ -104,11 +104,40 @@ public:
 };
 
 
+// up to SIZE line segments tested together against each node of a cobj_bvh_tree; the node tests use SIMD, so coordinates are stored SoA
+struct line_packet_t {
+	static unsigned const SIZE = 4;
+	typedef unsigned (*clip_func_t)(line_packet_t const &lp, float const d[3][2]); // returns a bitmask of lines that intersect cube d
+
+	alignas(16) float p1[3][SIZE], dinv[3][SIZE], tmax[SIZE]; // tmax is the parametric distance of the closest hit, or 1.0 for no hit
+	point start[SIZE], end[SIZE], cpos[SIZE];
+	vector3d cnorm[SIZE];
+	int cindex[SIZE];
+	bool skip_init_colls[SIZE];
+	unsigned num;
+
+	line_packet_t() {clear();}
+	void clear();
+	bool is_full() const {return (num == SIZE);}
+	void add(point const &p1_, point const &p2_, bool skip_init_colls_);
+	clip_func_t get_clip_func() const;
+
+	bool get_hit(unsigned ix, point &cpos_, vector3d &cnorm_, int &cindex_) const {
+		assert(ix < num);
+		if (cindex[ix] < 0) return 0;
+		cpos_ = cpos[ix]; cnorm_ = cnorm[ix]; cindex_ = cindex[ix];
+		return 1;
+	}
+};
+
+
 class cobj_bvh_tree : public cobj_tree_base {
 
 	coll_obj_group const *cobjs;
-	vector<unsigned> cixs;
-	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs;
+	vector<unsigned> cixs, built_cids, temp_cids; // built_cids: sorted cobj IDs from the last build, for checking if a refit is possible
+	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs, has_node_gaps;
+	float built_area; // sum of node surface areas after the last build, for checking refit quality
+	unsigned num_builds, num_refits;
 
 	struct per_thread_data {
 		vector<unsigned> temp_bins[3];
@@ -121,13 +150,31 @@ class cobj_bvh_tree : public cobj_tree_base {
 		unsigned get_next_node_ix() const {assert(cur_nix < end_nix); return cur_nix;}
 		void increment_node_ix() {assert(cur_nix >= start_nix); cur_nix++;}
 	};
+	struct sah_node_t : public cube_t { // binary temp node; a subtree with N cobjs rooted at ix occupies [ix, ix+2N-1), left kid = ix+1, right kid = ix+2*num_left
+		cube_t cent_bc; // bounds of cobj centers
+		unsigned start, end;
+		bool is_leaf;
+		sah_node_t() : start(0), end(0), is_leaf(0) {}
+		unsigned get_num() const {return (end - start);}
+	};
+	struct sah_ref_t {
+		cube_t bc;
+		point center;
+		unsigned cix;
+	};
 
-	void add_cobj(unsigned ix) {if (obj_ok((*cobjs)[ix])) {cixs.push_back(ix);}}
+	void add_cobj(unsigned ix, vector<unsigned> &ids) const {if (obj_ok((*cobjs)[ix])) {ids.push_back(ix);}}
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
-	bool create_cixs();
+	bool create_cixs(vector<unsigned> &ids) const;
 	void calc_node_bbox(tree_node &n) const;
+	void build_tree_from_cixs_int(bool do_mt_build, bool use_sah);
+	float get_total_node_area() const;
+	bool refit_tree();
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
+	bool split_node_sah(vector<sah_node_t> &snodes, vector<sah_ref_t> &refs, unsigned ix, bool mt_binning) const;
+	void build_tree_sah_rec(vector<sah_node_t> &snodes, vector<sah_ref_t> &refs, unsigned ix) const;
+	void build_tree_sah(bool do_mt_build);
 
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
@@ -136,16 +183,24 @@ class cobj_bvh_tree : public cobj_tree_base {
 	}
 
 public:
-	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v)
-		: cobjs(cobjs_), is_static(s), is_dynamic(d), occluders_only(o), cubes_only(c), inc_voxel_cobjs(v) {assert(cobjs);}
+	cobj_bvh_tree(coll_obj_group const *cobjs_, bool s, bool d, bool o, bool c, bool v) : cobjs(cobjs_), is_static(s), is_dynamic(d),
+		occluders_only(o), cubes_only(c), inc_voxel_cobjs(v), has_node_gaps(0), built_area(0.0), num_builds(0), num_refits(0) {assert(cobjs);}
 
 	unsigned get_num_objs() const {return cixs.size();}
+	vector<unsigned> const &get_cixs() const {return cixs;}
 	void clear();
-	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = cids;}
+	void add_cobj_ids(vector<unsigned> const &cids) {assert(cixs.empty() && !cids.empty()); cixs = built_cids = cids;}
 	void add_cobjs(bool verbose);
+	void add_or_refit_cobjs(bool verbose);
+	bool refit_cobj_ids(vector<unsigned> const &cids);
+	void print_refit_stats() const;
 	void build_tree_from_cixs(bool do_mt_build);
+	void build_tree_from_cixs(bool do_mt_build, bool use_sah);
+	unsigned get_num_nodes() const {return nodes.size();}
+	unsigned get_max_depth() const {return max_depth;}
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	void check_coll_line_packet(line_packet_t &lp, int ignore_cobj, int test_alpha, bool skip_non_drawn, bool skip_movable) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
@@ -0,0 +1,275 @@
+// 3D World - Sparse Compressed Sparse Row Mesh Cell to Cobj Mapping
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "collision_detect.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+unsigned const LOG_END = coll_cell_cobjs_t::LOG_END;
+
+coll_cell_grid_t v_collision_grid;
+
+
+inline unsigned popcount64(uint64_t v) {
+#ifdef _MSC_VER
+	return (unsigned)__popcnt64(v);
+#else
+	return (unsigned)__builtin_popcountll(v);
+#endif
+}
+
+
+void coll_cell_grid_t::init(int xsize_, int ysize_) {
+
+	assert(xsize_ >= 0 && ysize_ >= 0);
+	xsize = xsize_;
+	ysize = ysize_;
+	unsigned const num_words((unsigned(xsize*ysize) + 63)/64);
+	occupied.clear(); occupied.resize(num_words, 0); occupied.shrink_to_fit();
+	in_log  .clear(); in_log  .resize(num_words, 0); in_log  .shrink_to_fit();
+	rank    .clear(); rank    .resize(num_words, 0); rank    .shrink_to_fit();
+	start.assign(1, 0);
+	zmin.clear(); zmax.clear(); cell_ix.clear(); cobjs.clear();
+	log_cells.clear();
+	log.clear();
+	num_removed = num_log_removed = 0;
+}
+
+void coll_cell_grid_t::clear() {init(xsize, ysize);} // keep the size
+
+int coll_cell_grid_t::get_occupied_ix(unsigned cix) const {
+
+	uint64_t const word(occupied[cix>>6]), bit(1ULL << (cix&63));
+	if (!(word & bit)) return -1;
+	return int(rank[cix>>6] + popcount64(word & (bit - 1)));
+}
+
+coll_cell_grid_t::log_cell_t const *coll_cell_grid_t::get_log_cell(unsigned cix) const {
+
+	if (log_cells.empty() || !test_bit(in_log, cix)) return nullptr; // avoid the hash map lookup for most cells
+	auto it(log_cells.find(cix));
+	return ((it == log_cells.end()) ? nullptr : &it->second);
+}
+
+void coll_cell_grid_t::add_entry(int x, int y, int index) {
+
+	unsigned const cix(get_cix(x, y)), lix((unsigned)log.size());
+	log_cell_t &lc(log_cells[cix]);
+	in_log[cix>>6] |= (1ULL << (cix&63));
+	log.push_back(coll_cell_log_entry_t({index, LOG_END}));
+	if (lc.tail == LOG_END) {lc.head = lix;} else {log[lc.tail].next = lix;}
+	lc.tail = lix;
+}
+
+bool coll_cell_grid_t::remove_entry(int x, int y, int index) {
+
+	unsigned const cix(get_cix(x, y));
+	log_cell_t const *const lc(get_log_cell(cix));
+
+	if (lc != nullptr) { // check the log first, since dynamic cobjs are usually removed soon after being added
+		for (unsigned lix = lc->head; lix != LOG_END; lix = log[lix].next) {
+			if (log[lix].cobj == index) {log[lix].cobj = -1; ++num_log_removed; return 1;}
+		}
+	}
+	int const o(get_occupied_ix(cix));
+	if (o < 0) return 0;
+
+	for (unsigned i = start[o]; i < start[o+1]; ++i) {
+		if (cobjs[i] == index) {cobjs[i] = -1; ++num_removed; return 1;} // can't change zmin or zmax
+	}
+	return 0;
+}
+
+void coll_cell_grid_t::update_zmm(int x, int y, float zmin_, float zmax_) {
+
+	assert(zmin_ <= zmax_);
+	unsigned const cix(get_cix(x, y));
+	int const o(get_occupied_ix(cix));
+
+	if (o >= 0) {
+		zmin[o] = min(zmin[o], zmin_);
+		zmax[o] = max(zmax[o], zmax_);
+		return;
+	}
+	log_cell_t &lc(log_cells[cix]);
+	in_log[cix>>6] |= (1ULL << (cix&63));
+	lc.zmin = min(lc.zmin, zmin_);
+	lc.zmax = max(lc.zmax, zmax_);
+}
+
+void coll_cell_grid_t::set_zmm(int x, int y, float zmin_, float zmax_) {
+
+	unsigned const cix(get_cix(x, y));
+	int const o(get_occupied_ix(cix));
+
+	if (o >= 0) {
+		zmin[o] = zmin_;
+		zmax[o] = zmax_;
+		if (get_log_cell(cix) == nullptr) return;
+		zmin_ =  FAR_DISTANCE; // reset the log cell so that it doesn't affect the result
+		zmax_ = -FAR_DISTANCE;
+	}
+	log_cell_t &lc(log_cells[cix]);
+	in_log[cix>>6] |= (1ULL << (cix&63));
+	lc.zmin = zmin_;
+	lc.zmax = zmax_;
+}
+
+coll_cell_cobjs_t coll_cell_grid_t::get_cobjs(int x, int y) const {
+
+	unsigned const cix(get_cix(x, y));
+	int const o(get_occupied_ix(cix));
+	log_cell_t const *const lc(get_log_cell(cix));
+	int const *const b((o >= 0) ? (cobjs.data() + start[o  ]) : nullptr);
+	int const *const e((o >= 0) ? (cobjs.data() + start[o+1]) : nullptr);
+	return coll_cell_cobjs_t(b, e, &log, (lc ? lc->head : LOG_END));
+}
+
+void coll_cell_grid_t::get_zmm(int x, int y, float &zmin_, float &zmax_) const {
+
+	unsigned const cix(get_cix(x, y));
+	int const o(get_occupied_ix(cix));
+	log_cell_t const *const lc(get_log_cell(cix));
+	zmin_ =  FAR_DISTANCE;
+	zmax_ = -FAR_DISTANCE;
+	if (o >= 0) {zmin_ = zmin[o]; zmax_ = zmax[o];}
+	if (lc != nullptr) {zmin_ = min(zmin_, lc->zmin); zmax_ = max(zmax_, lc->zmax);}
+}
+
+void coll_cell_grid_t::remove_entries_if(std::function<bool(int)> const &pred, vector<unsigned> &changed_cells) {
+
+	changed_cells.clear();
+
+	for (unsigned o = 0; o+1 < start.size(); ++o) {
+		bool changed(0);
+
+		for (unsigned i = start[o]; i < start[o+1]; ++i) {
+			if (cobjs[i] >= 0 && pred(cobjs[i])) {cobjs[i] = -1; ++num_removed; changed = 1;}
+		}
+		if (changed) {changed_cells.push_back(cell_ix[o]);}
+	}
+	for (auto const &c : log_cells) {
+		bool changed(0);
+
+		for (unsigned lix = c.second.head; lix != LOG_END; lix = log[lix].next) {
+			if (log[lix].cobj >= 0 && pred(log[lix].cobj)) {log[lix].cobj = -1; ++num_log_removed; changed = 1;}
+		}
+		if (changed) {changed_cells.push_back(c.first);}
+	}
+	sort(changed_cells.begin(), changed_cells.end());
+	changed_cells.erase(std::unique(changed_cells.begin(), changed_cells.end()), changed_cells.end());
+}
+
+void coll_cell_grid_t::compact_log() { // remove deleted entries from the log, keeping the order of each cell's entries
+
+	vector<coll_cell_log_entry_t> new_log;
+	new_log.reserve(log.size() - num_log_removed);
+	std::fill(in_log.begin(), in_log.end(), 0);
+
+	for (auto c = log_cells.begin(); c != log_cells.end();) {
+		log_cell_t &lc(c->second);
+		unsigned const old_head(lc.head);
+		lc.head = lc.tail = LOG_END;
+
+		for (unsigned lix = old_head; lix != LOG_END; lix = log[lix].next) {
+			if (log[lix].cobj < 0) continue;
+			unsigned const nix((unsigned)new_log.size());
+			new_log.push_back(coll_cell_log_entry_t({log[lix].cobj, LOG_END}));
+			if (lc.tail == LOG_END) {lc.head = nix;} else {new_log[lc.tail].next = nix;}
+			lc.tail = nix;
+		}
+		if (lc.head == LOG_END && get_occupied_ix(c->first) < 0) {c = log_cells.erase(c); continue;} // empty cell with no compacted entries
+		in_log[c->first>>6] |= (1ULL << (c->first&63));
+		++c;
+	}
+	log.swap(new_log);
+	num_log_removed = 0;
+}
+
+void coll_cell_grid_t::merge_log() { // merge the log into the compacted arrays and remove deleted entries; cells left with no cobjs are dropped
+
+	vector<unsigned> lcells;
+	lcells.reserve(log_cells.size());
+	for (auto const &c : log_cells) {lcells.push_back(c.first);}
+	sort(lcells.begin(), lcells.end()); // merge in cell order
+	vector<unsigned> new_start(1, 0), new_cell_ix;
+	vector<float> new_zmin, new_zmax;
+	vector<int> new_cobjs;
+	new_cobjs.reserve(cobjs.size() - num_removed + log.size() - num_log_removed);
+	std::fill(occupied.begin(), occupied.end(), 0);
+	unsigned o(0), l(0);
+	unsigned const num_occupied((unsigned)cell_ix.size());
+
+	while (o < num_occupied || l < lcells.size()) {
+		unsigned const cix((l == lcells.size() || (o < num_occupied && cell_ix[o] < lcells[l])) ? cell_ix[o] : lcells[l]);
+		float zmin_(FAR_DISTANCE), zmax_(-FAR_DISTANCE);
+
+		if (o < num_occupied && cell_ix[o] == cix) { // compacted entries first
+			for (unsigned i = start[o]; i < start[o+1]; ++i) {
+				if (cobjs[i] >= 0) {new_cobjs.push_back(cobjs[i]);}
+			}
+			zmin_ = zmin[o];
+			zmax_ = zmax[o];
+			++o;
+		}
+		if (l < lcells.size() && lcells[l] == cix) { // then logged entries, in the order they were added
+			log_cell_t const &lc(log_cells[cix]);
+
+			for (unsigned lix = lc.head; lix != LOG_END; lix = log[lix].next) {
+				if (log[lix].cobj >= 0) {new_cobjs.push_back(log[lix].cobj);}
+			}
+			zmin_ = min(zmin_, lc.zmin);
+			zmax_ = max(zmax_, lc.zmax);
+			++l;
+		}
+		if (new_cobjs.size() == new_start.back()) continue; // no cobjs
+		new_start.push_back((unsigned)new_cobjs.size());
+		new_cell_ix.push_back(cix);
+		new_zmin.push_back(zmin_);
+		new_zmax.push_back(zmax_);
+		occupied[cix>>6] |= (1ULL << (cix&63));
+	} // while
+	for (unsigned w = 0, n = 0; w < occupied.size(); ++w) { // exclusive prefix count of occupied cells
+		rank[w] = n;
+		n += popcount64(occupied[w]);
+	}
+	start.swap(new_start);
+	cell_ix.swap(new_cell_ix);
+	zmin.swap(new_zmin);
+	zmax.swap(new_zmax);
+	cobjs.swap(new_cobjs);
+	log_cells.clear();
+	log.clear();
+	std::fill(in_log.begin(), in_log.end(), 0);
+	num_removed = num_log_removed = 0;
+}
+
+void coll_cell_grid_t::maybe_compact() {
+
+	unsigned const thresh(max(4096U, unsigned(cobjs.size()/4)));
+	if ((log.size() - num_log_removed) > thresh || num_removed > thresh) {merge_log();} // too many logged or deleted entries
+	else if (num_log_removed > 1024 && 2*num_log_removed > log.size()) {compact_log();} // mostly dynamic cobjs that were added and removed
+}
+
+void coll_cell_grid_t::get_stats(unsigned &num_cells, unsigned &num_entries) const {
+
+	num_cells = num_entries = 0;
+
+	for (int y = 0; y < ysize; ++y) {
+		for (int x = 0; x < xsize; ++x) {
+			unsigned n(0);
+			for (int c : get_cobjs(x, y)) {++n; (void)c;}
+			num_entries += n;
+			num_cells   += (n > 0);
+		}
+	}
+}
+
+size_t coll_cell_grid_t::get_mem_usage() const {
+	return (get_cont_mem_usage(occupied) + get_cont_mem_usage(in_log) + get_cont_mem_usage(rank) + get_cont_mem_usage(start) + get_cont_mem_usage(zmin) +
+		get_cont_mem_usage(zmax) + get_cont_mem_usage(cell_ix) + get_cont_mem_usage(cobjs) + get_cont_mem_usage(log) +
+		log_cells.size()*(sizeof(unsigned) + sizeof(log_cell_t) + 2*sizeof(void *))); // estimate of hash map node size
+}
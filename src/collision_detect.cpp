@@ -90,6 +90,17 @@ bool decal_obj::is_on_cobj(int cobj, vector3d *delta) const {
 }
 
 
+// the cobjs of a mesh cell in the order of the old per-cell lists: static cobjs before dynamic cobjs, each in insertion order;
+// the old lists also moved static cobjs added after a dynamic cobj to the front, reversing those among the statics, which isn't tracked here
+void get_cell_cobjs_static_first(int x, int y, vector<int> &cids, bool reverse_order) {
+
+	cids.clear();
+	for (int c : v_collision_grid.get_cobjs(x, y)) {cids.push_back(c);}
+	std::stable_partition(cids.begin(), cids.end(), [](int c) {return (coll_objects[c].status == COLL_STATIC);});
+	if (reverse_order) {std::reverse(cids.begin(), cids.end());} // dynamic cobjs first, newest first
+}
+
+
 void decal_obj::check_cobj() {
 
 	if (!status || cid < 0) return; // already disabled, or no bound cobj
@@ -101,11 +112,12 @@ void decal_obj::check_cobj() {
 	else {
 		int const xpos(get_xpos(ipos.x)), ypos(get_ypos(ipos.y));
 		if (point_outside_mesh(xpos, ypos)) {status = 0; return;}
-		vector<int> const &cvals(v_collision_matrix[ypos][xpos].cvals);
 		cid = -1;
+		static thread_local vector<int> cids;
+		get_cell_cobjs_static_first(xpos, ypos, cids, 0); // first match wins, so keep the static cobjs first
 
-		for (unsigned i = 0; i < cvals.size(); ++i) {
-			if (is_on_cobj(cvals[i])) {cid = cvals[i]; break;}
+		for (int c : cids) {
+			if (is_on_cobj(c)) {cid = c; break;}
 		}
 		if (cid >= 0) {cobj_cent_mass = coll_objects.get_cobj(cid).get_center_of_mass();}
 	}
@@ -637,32 +649,18 @@ void coll_obj::re_add_coll_cobj(int index, int remove_old) {
 	id        = index;
 }
 
-void coll_cell::clear(bool clear_vectors) {
-
-	if (clear_vectors) {cvals.clear();}
-	zmin =  FAR_DISTANCE;
-	zmax = -FAR_DISTANCE;
-}
-
-
 void cobj_stats() {
 
 	unsigned ncv(0), nonempty(0), ncobj(0);
 	unsigned const csize((unsigned)coll_objects.size());
+	v_collision_grid.get_stats(nonempty, ncv);
 
-	for (int y = 0; y < MESH_Y_SIZE; ++y) {
-		for (int x = 0; x < MESH_X_SIZE; ++x) {
-			unsigned const sz((unsigned)v_collision_matrix[y][x].cvals.size());
-			ncv += sz;
-			nonempty += (sz > 0);
-		}
-	}
 	for (unsigned i = 0; i < csize; ++i) {
 		if (coll_objects[i].status == COLL_STATIC) ++ncobj;
 	}
 	if (ncobj > 0) {
-		cout << "bins = " << XY_MULT_SIZE << ", ne = " << nonempty << ", cobjs = " << ncobj
-			 << ", ent = " << ncv << ", per c = " << ncv/ncobj << ", per bin = " << ncv/XY_MULT_SIZE << endl;
+		cout << "bins = " << XY_MULT_SIZE << ", ne = " << nonempty << ", cobjs = " << ncobj << ", ent = " << ncv << ", per c = " << ncv/ncobj
+			 << ", per bin = " << ncv/XY_MULT_SIZE << ", mem = " << v_collision_grid.get_mem_usage()/1024 << "KB" << endl;
 	}
 }
 
@@ -670,14 +668,8 @@ void cobj_stats() {
 void add_coll_point(int i, int j, int index, float zminv, float zmaxv, int add_to_hcm, int is_dynamic, int dhcm) {
 
 	assert(!point_outside_mesh(j, i));
-	coll_cell &vcm(v_collision_matrix[i][j]);
-	vcm.add_entry(index);
+	v_collision_grid.add_entry(j, i, index);
 	coll_obj const &cobj(coll_objects.get_cobj(index));
-	unsigned const size((unsigned)vcm.cvals.size());
-
-	if (size > 1 && cobj.status == COLL_STATIC && coll_objects[vcm.cvals[size-2]].status == COLL_DYNAMIC) {
-		std::rotate(vcm.cvals.begin(), vcm.cvals.begin()+size-1, vcm.cvals.end()); // rotate last point to first point???
-	}
 	if (is_dynamic) return;
 
 	// update the z values if this cobj is part of a vertically moving platform
@@ -703,7 +695,7 @@ void add_coll_point(int i, int j, int index, float zminv, float zmaxv, int add_t
 		h_collision_matrix[i][j] = zmaxv;
 	}
 	if (add_to_hcm || ALWAYS_ADD_TO_HCM) {
-		vcm.update_zmm(zminv, zmaxv);
+		v_collision_grid.update_zmm(j, i, zminv, zmaxv);
 
 		if (!lm_alloc) { // if the lighting has already been computed, we can't change czmin/czmax/get_zval()/get_zpos()
 			czmin = min(zminv, czmin);
@@ -737,17 +729,7 @@ int remove_coll_object(int index, bool reset_draw) {
 	get_params(x1, y1, x2, y2, c.d);
 
 	for (int i = y1; i <= y2; ++i) {
-		for (int j = x1; j <= x2; ++j) {
-			vector<int> &cvals(v_collision_matrix[i][j].cvals);
-			unsigned const num_cvals(cvals.size());
-			
-			for (unsigned k = 0; k < num_cvals; ++k) {
-				if (cvals[k] == index) {
-					cvals.erase(cvals.begin()+k); // can't change zmin or zmax (I think)
-					break; // should only be in here once
-				}
-			}
-		}
+		for (int j = x1; j <= x2; ++j) {v_collision_grid.remove_entry(j, i, index);} // should only be in here once; can't change zmin or zmax (I think)
 	}
 	cobj_manager.free_index(index);
 	return 1;
@@ -764,37 +746,27 @@ int remove_reset_coll_obj(int &index) {
 
 void purge_coll_freed(bool force) {
 
-	if (!force && cobj_manager.cobjs_removed < PURGE_THRESH) return;
+	if (!force && cobj_manager.cobjs_removed < PURGE_THRESH) {
+		v_collision_grid.maybe_compact(); // merge the update log once it gets large
+		return;
+	}
 	//RESET_TIME;
+	vector<unsigned> changed;
+	v_collision_grid.remove_entries_if([](int cid) {return coll_objects[cid].freed_unused();}, changed);
 
-	for (int i = 0; i < MESH_Y_SIZE; ++i) {
-		for (int j = 0; j < MESH_X_SIZE; ++j) {
-			bool changed(0);
-			coll_cell &vcm(v_collision_matrix[i][j]);
-			unsigned const size((unsigned)vcm.cvals.size());
+	for (unsigned cix : changed) {
+		// Note: don't actually have to recalculate zmin/zmax unless a removed object was on the top or bottom of the coll cell
+		int const i(cix/MESH_X_SIZE), j(cix%MESH_X_SIZE);
+		float cell_zmin(mesh_height[i][j]), cell_zmax(zmin);
 
-			for (unsigned k = 0; k < size && !changed; ++k) {
-				if (coll_objects[vcm.cvals[k]].freed_unused()) changed = 1;
-			}
-			// Note: don't actually have to recalculate zmin/zmax unless a removed object was on the top or bottom of the coll cell
-			if (!changed) continue;
-			vcm.zmin = mesh_height[i][j];
-			vcm.zmax = zmin;
-			vector<int>::const_iterator in(vcm.cvals.begin());
-			vector<int>::iterator o(vcm.cvals.begin());
-
-			for (; in != vcm.cvals.end(); ++in) {
-				coll_obj &cobj(coll_objects[*in]);
-
-				if (!cobj.freed_unused()) {
-					if (cobj.status == COLL_STATIC) {vcm.update_zmm(cobj.d[2][0], cobj.d[2][1]);}
-					*o++ = *in;
-				}
-			}
-			vcm.cvals.erase(o, vcm.cvals.end()); // excess capacity?
-			h_collision_matrix[i][j] = vcm.zmax; // need to think about add_to_hcm...
+		for (int cid : v_collision_grid.get_cobjs(j, i)) {
+			coll_obj const &cobj(coll_objects[cid]);
+			if (cobj.status == COLL_STATIC) {cell_zmin = min(cell_zmin, cobj.d[2][0]); cell_zmax = max(cell_zmax, cobj.d[2][1]);}
 		}
+		v_collision_grid.set_zmm(j, i, cell_zmin, cell_zmax);
+		h_collision_matrix[i][j] = cell_zmax; // need to think about add_to_hcm...
 	}
+	v_collision_grid.merge_log(); // drop removed entries and empty cells
 	unsigned const ncobjs((unsigned)coll_objects.size());
 
 	for (unsigned i = 0; i < ncobjs; ++i) {
@@ -809,11 +781,10 @@ void remove_all_coll_obj() {
 
 	camera_coll_id = -1; // camera is special - keeps state
 
+	v_collision_grid.clear();
+
 	for (int i = 0; i < MESH_Y_SIZE; ++i) {
-		for (int j = 0; j < MESH_X_SIZE; ++j) {
-			v_collision_matrix[i][j].clear(1);
-			h_collision_matrix[i][j] = mesh_height[i][j];
-		}
+		for (int j = 0; j < MESH_X_SIZE; ++j) {h_collision_matrix[i][j] = mesh_height[i][j];}
 	}
 	for (unsigned i = 0; i < coll_objects.size(); ++i) {
 		if (coll_objects[i].status != COLL_UNUSED) {
@@ -914,18 +885,19 @@ int collision_detect_large_sphere(point &pos, float radius, unsigned flags) {
 int check_legal_move(int x_new, int y_new, float zval, float radius, int &cindex) { // not dynamically updated
 
 	if (point_outside_mesh(x_new, y_new)) return 0; // object out of simulation region
-	coll_cell const &cell(v_collision_matrix[y_new][x_new]);
-	if (cell.cvals.empty()) return 1;
+	static thread_local vector<int> cobjs;
+	get_cell_cobjs_static_first(x_new, y_new, cobjs, 1); // iterate backwards, as this returns early on the first static cobj
+	if (cobjs.empty()) return 1;
 	float const xval(get_xval(x_new)), yval(get_yval(y_new)), z1(zval - radius), z2(zval + radius);
 	point const pval(xval, yval, zval);
+	float cell_zmin, cell_zmax;
+	v_collision_grid.get_zmm(x_new, y_new, cell_zmin, cell_zmax);
 
-	for (int k = (int)cell.cvals.size()-1; k >= 0; --k) { // iterate backwards
-		int const index(cell.cvals[k]);
-		if (index < 0) continue;
+	for (int index : cobjs) {
 		coll_obj &cobj(coll_objects.get_cobj(index));
 		if (cobj.no_collision()) continue;
 		if (cobj.status == COLL_STATIC) {
-			if (z1 > cell.zmax || z2 < cell.zmin) return 1; // should be OK here since this is approximate, not quite right with, but not quite right without
+			if (z1 > cell_zmax || z2 < cell_zmin) return 1; // should be OK here since this is approximate, not quite right with, but not quite right without
 		}
 		else continue; // smileys collision with dynamic objects can be handled by check_vert_collision()
 		if (z1 > cobj.d[2][1] || z2 < cobj.d[2][0]) continue;
@@ -1061,9 +1033,9 @@ void vert_coll_detector::check_cobj(int index) {
 		case COLL_CYLINDER:
 		case COLL_CYLINDER_ROT:
 		case COLL_TORUS:
-			if (cobj.radius2 < 0.25*object_types[type].radius) return;
+			if (cobj.radius2 < 0.25*o_radius) return;
 		case COLL_SPHERE: // fallthrough from above
-			if (cobj.radius  < 0.25*object_types[type].radius) return;
+			if (cobj.radius  < 0.25*o_radius) return;
 			break;
 		}
 	}
@@ -1908,13 +1880,13 @@ int set_true_obj_height(point &pos, point const &lpos, float step_height, float
 	}
 	float zmu(mh), z1(pos.z - radius), z2(pos.z + radius);
 	if (is_camera /*|| type == WAYPOINT*/) {z2 += get_player_height();} // add camera height
-	coll_cell const &cell(v_collision_matrix[ypos][xpos]);
 	int any_coll(0), moved(0);
 	float zceil(0.0), zfloor(0.0);
 
-	for (int k = (int)cell.cvals.size()-1; k >= 0; --k) { // iterate backwards
-		int const index(cell.cvals[k]);
-		if (index < 0) continue;
+	static thread_local vector<int> cids;
+	get_cell_cobjs_static_first(xpos, ypos, cids, 1); // iterate backwards; the floor pruning below depends on the order
+
+	for (int index : cids) {
 		coll_obj const &cobj(coll_objects.get_cobj(index));
 		if (cobj.d[2][0] > z2)         continue; // above the top of the object - can't affect it
 		if (any_coll && cobj.d[2][1] < min(z1, min(zmu, zfloor))) continue; // top below a previously seen floor
@@ -7,6 +7,8 @@
 #include "trigger.h"
 #include "allocators.h"
 #include <cstring> // for memcmp()
+#include <unordered_map>
+#include <functional>
 
 typedef bool (*collision_func)(int, int, vector3d const &, point const &, float, int);
 
@@ -432,23 +434,88 @@ void copy_polygon_to_cobj(polygon_t const &poly, coll_obj &cobj);
 void copy_tquad_to_cobj(coll_tquad const &tquad, coll_obj &cobj);
 
 
-struct coll_cell { // size = 52
+struct coll_cell_log_entry_t {
+	int cobj; // -1 if removed
+	unsigned next;
+};
 
-	float zmin, zmax;
-	vector<int> cvals;
 
-	coll_cell() : zmin(FAR_DISTANCE), zmax(-FAR_DISTANCE) {}
-	void clear(bool clear_vectors);
+class coll_cell_cobjs_t { // the cobj indices of one mesh cell: compacted entries followed by logged entries, skipping removed entries
 
-	void update_zmm(float zmin_, float zmax_) {
-		assert(zmin_ <= zmax_);
-		zmin = min(zmin_, zmin);
-		zmax = max(zmax_, zmax);
-	}
-	void add_entry(int index) {
-		if (INIT_CCELL_SIZE > 0 && cvals.capacity() == 0) {cvals.reserve(INIT_CCELL_SIZE);}
-		cvals.push_back(index);
-	}
+	int const *cbegin_=nullptr, *cend_=nullptr;
+	vector<coll_cell_log_entry_t> const *log=nullptr; // indexed rather than by pointer, so that entries can be added while iterating
+	unsigned log_head;
+
+public:
+	static unsigned const LOG_END = ~0U;
+
+	class const_iterator {
+		coll_cell_cobjs_t const *v;
+		int const *p; // into the compacted entries, or nullptr when in the log
+		unsigned lix;
+
+		void skip_removed() {
+			while (p != nullptr && p != v->cend_ && *p < 0) {++p;}
+			if (p == v->cend_) {p = nullptr;} // start of log
+			while (p == nullptr && lix != LOG_END && (*v->log)[lix].cobj < 0) {lix = (*v->log)[lix].next;}
+		}
+	public:
+		const_iterator(coll_cell_cobjs_t const *v_, int const *p_, unsigned lix_) : v(v_), p(p_), lix(lix_) {skip_removed();}
+		int operator*() const {return ((p != nullptr) ? *p : (*v->log)[lix].cobj);}
+		const_iterator &operator++() {if (p != nullptr) {++p;} else {lix = (*v->log)[lix].next;} skip_removed(); return *this;}
+		bool operator==(const_iterator const &i) const {return (p == i.p && lix == i.lix);}
+		bool operator!=(const_iterator const &i) const {return !operator==(i);}
+	};
+	coll_cell_cobjs_t(int const *b=nullptr, int const *e=nullptr, vector<coll_cell_log_entry_t> const *log_=nullptr, unsigned head=LOG_END) :
+		cbegin_(b), cend_(e), log(log_), log_head(head) {}
+	const_iterator begin() const {return const_iterator(this, ((cbegin_ == cend_) ? nullptr : cbegin_), log_head);}
+	const_iterator end  () const {return const_iterator(this, nullptr, LOG_END);}
+	bool empty() const {return (begin() == end());}
+};
+
+
+// sparse replacement for a dense matrix of per-mesh-cell cobj lists, in compressed sparse row form: one bit per cell, plus offsets and
+// zmin/zmax for cells with cobjs only, and a flat array of cobj indices; cobjs added since the last compaction go into an update log
+// of per-cell linked lists, and removed cobjs are marked with -1 until the next compaction
+class coll_cell_grid_t {
+
+	struct log_cell_t {
+		unsigned head=coll_cell_cobjs_t::LOG_END, tail=coll_cell_cobjs_t::LOG_END;
+		float zmin=FAR_DISTANCE, zmax=-FAR_DISTANCE;
+	};
+	int xsize=0, ysize=0;
+	vector<uint64_t> occupied, in_log; // one bit per cell: has compacted entries, has a log_cells entry
+	vector<unsigned> rank; // number of occupied cells before each word of occupied
+	vector<unsigned> start; // first entry of each occupied cell, plus the end
+	vector<float> zmin, zmax; // per occupied cell
+	vector<unsigned> cell_ix; // per occupied cell
+	vector<int> cobjs; // compacted entries
+	std::unordered_map<unsigned, log_cell_t> log_cells;
+	vector<coll_cell_log_entry_t> log;
+	unsigned num_removed=0, num_log_removed=0; // in cobjs and in log
+
+	unsigned get_cix(int x, int y) const {assert(x >= 0 && y >= 0 && x < xsize && y < ysize); return unsigned(y*xsize + x);}
+	static bool test_bit(vector<uint64_t> const &bits, unsigned cix) {return ((bits[cix>>6] >> (cix&63)) & 1);}
+	int get_occupied_ix(unsigned cix) const;
+	log_cell_t const *get_log_cell(unsigned cix) const;
+	void compact_log();
+public:
+	void init(int xsize_, int ysize_);
+	void clear();
+	void add_entry(int x, int y, int index);
+	bool remove_entry(int x, int y, int index);
+	void update_zmm(int x, int y, float zmin_, float zmax_);
+	void set_zmm(int x, int y, float zmin_, float zmax_);
+	coll_cell_cobjs_t get_cobjs(int x, int y) const;
+	bool has_cobjs(int x, int y) const {return !get_cobjs(x, y).empty();}
+	void get_zmm(int x, int y, float &zmin_, float &zmax_) const; // FAR_DISTANCE, -FAR_DISTANCE if no cobjs have been added
+	float get_zmin(int x, int y) const {float zmin_, zmax_; get_zmm(x, y, zmin_, zmax_); return zmin_;}
+	float get_zmax(int x, int y) const {float zmin_, zmax_; get_zmm(x, y, zmin_, zmax_); return zmax_;}
+	void remove_entries_if(std::function<bool(int)> const &pred, vector<unsigned> &changed_cells); // returns cell indices y*xsize+x
+	void merge_log();
+	void maybe_compact();
+	void get_stats(unsigned &num_cells, unsigned &num_entries) const;
+	size_t get_mem_usage() const;
 };
 
 
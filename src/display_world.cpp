@@ -7,6 +7,8 @@
 #include "timetest.h"
 #include "physics_objects.h"
 #include "model3d.h"
+#include "profiler.h"
+#include "job_system.h"
 #include <fstream>
 
 
@@ -67,6 +69,7 @@ void display_inf_terrain();
 void update_temperature(bool verbose);
 void update_sound_loops();
 bool indir_lighting_updated();
+job_handle_t add_next_city_frame_jobs();
 point get_universe_display_camera_pos();
 colorRGBA get_inf_terrain_mod_color();
 void run_postproc_effects();
@@ -794,6 +797,8 @@ void display() {
 		return;
 	}
 	RESET_TIME;
+	benchmark_frame_start();
+	TRACE_ZONE("Frame");
 	static int init(0), frame_index(0), time_index(0), global_time(0), tticks(0);
 	static point old_spos(0.0, 0.0, 0.0);
 	++cur_display_iter;
@@ -805,7 +810,7 @@ void display() {
 		time0  = timer1;
 		begin_loading_screen(); // for the !start_maximized case
 	}
-	else if (animate && !DETERMINISTIC_TIME) {
+	else if (animate && !DETERMINISTIC_TIME && !benchmark_active()) { // benchmarks use a fixed timestep so that the simulation is repeatable
 		double ftick(0.0);
 		static float carry(0.0);
 		double const time_delta((TICKS_PER_SECOND*(timer1 - time0))/1000.0f);
@@ -849,7 +854,7 @@ void display() {
 			update_cpos();
 			apply_camera_offsets(get_camera_pos());
 			check_xy_offsets();
-			next_city_frame(0); // make sure the cars animate
+			next_city_frame(); // make sure the cars animate
 		}
 		else if (world_mode == WMODE_GROUND) {
 			process_groups();
@@ -876,6 +881,7 @@ void display() {
 	if (world_mode == WMODE_UNIVERSE) {
 		in_loading_screen = 0; // if we got here, loading is done
 		display_universe(); // infinite universe
+		benchmark_end_stage("Universe");
 	}
 	else {
 		if (!pause_frame) {uevent_advance_frame();}
@@ -914,6 +920,7 @@ void display() {
 
 		// camera position code
 		auto_advance_camera();
+		benchmark_update_camera();
 		if (world_mode == WMODE_GROUND && camera_mode == 1 && !spectate) {check_popup_text();}
 
 		if (camera_mode == 1 && camera_surf_collide && !spectate) {
@@ -962,8 +969,11 @@ void display() {
 			check_gl_error(4);
 			if (TIMETEST) PRINT_TIME("B");
 		}
+		benchmark_end_stage("Camera and Lighting");
+
 		if (world_mode == WMODE_INF_TERRAIN) { // infinite terrain mode
 			display_inf_terrain();
+			benchmark_end_stage("Tiled Terrain");
 		}
 		else { // finite terrain mode
 			if (mesh_invalidated) {
@@ -980,12 +990,14 @@ void display() {
 			process_groups();
 			check_gl_error(12);
 			if (TIMETEST) PRINT_TIME("E");
+			benchmark_end_stage("Physics");
 			if (b2down) {fire_weapon();}
 			update_weapon_cobjs(); // and update cblade
 			setup_dynamic_teleporters();
 			check_gl_error(6);
 			proc_voxel_updates(); // with the update here, we avoid making the voxels and shadows out of sync
 			if (TIMETEST) PRINT_TIME("F");
+			benchmark_end_stage("Object Updates");
 
 			//proc_voxel_updates(); // with the update here, we avoid uploading the modified voxel VBOs during shadow map rendering
 
@@ -998,8 +1010,9 @@ void display() {
 			if (combined_gu) {do_look_at();}
 			create_shadow_map(); // where should this go? must be after draw_universe_bkg()
 			if (TIMETEST) PRINT_TIME("G");
-
+			benchmark_end_stage("Shadow Maps");
 			create_reflection_and_portal_textures();
+			benchmark_end_stage("Reflections");
 
 			// draw background
 			if (combined_gu) {draw_universe_bkg(0);} // infinite universe as background
@@ -1010,6 +1023,7 @@ void display() {
 			draw_sky_and_clouds(0); // Note: depth test is disabled, so must be drawn first
 			check_gl_error(5);
 			if (TIMETEST) PRINT_TIME("G2");
+			benchmark_end_stage("Sky");
 
 			if (underwater) {
 				colorRGBA fog_color(((water_is_lava ? LAVA_COLOR : (temperature <= W_FREEZE_POINT) ? ICE_C : WATER_C)), 1.0); // under ice/water, alpha = 1.0
@@ -1025,18 +1039,22 @@ void display() {
 
 			draw_coll_surfaces(0, 0);
 			if (TIMETEST) PRINT_TIME("I");
+			benchmark_end_stage("Draw Cobjs");
 			
 			if (display_mode & 0x01) {display_mesh();} // draw mesh
 			check_gl_error(7);
 			if (TIMETEST) PRINT_TIME("J");
+			benchmark_end_stage("Draw Mesh");
 
 			draw_grass();
 			draw_scenery();
 			if (TIMETEST) PRINT_TIME("K");
+			benchmark_end_stage("Draw Grass and Scenery");
 
 			draw_solid_object_groups();
 			check_gl_error(8);
 			if (TIMETEST) PRINT_TIME("L");
+			benchmark_end_stage("Draw Objects");
 
 			draw_stuff(!underwater, timer1);
 			if (TIMETEST) PRINT_TIME("M");
@@ -1046,6 +1064,7 @@ void display() {
 			if (TIMETEST) PRINT_TIME("N");
 			draw_stuff(underwater, timer1);
 			if (TIMETEST) PRINT_TIME("T");
+			benchmark_end_stage("Draw Water and Transparent");
 
 			if (show_lightning && l_strike.is_enabled() && animate2) {
 				if ((rand()&1) == 0) {gen_smoke(l_strike.get_hit_pos());}
@@ -1108,9 +1127,13 @@ void display() {
 	gpu_timer.show();
 #endif
 	draw_enabled_ui_menus();
+	benchmark_end_stage("Effects and Overlays");
 	swap_buffers_and_redraw();
 	check_gl_error(11);
 	if (TIMETEST) PRINT_TIME("Y");
+	benchmark_end_stage("Swap Buffers"); // includes waiting on the GPU
+	trace_frame_end();
+	benchmark_frame_end();
 }
 
 
@@ -1313,18 +1336,18 @@ void display_inf_terrain() { // infinite terrain mode (Note: uses light params f
 	render_tt_models(0, 0); // opaque pass; draws city buildings, cars, etc.
 	if (TIMETEST) PRINT_TIME("3.27");
 
-	// threads: 0=draw tiled terrain (2.5ms) + transparent (0.3), 1=update roads and cars (2.3ms), 2=pedestrians (3.8ms) + building AI (0.85ms)
+	// main thread: draw tiled terrain (2.5ms) + transparent (0.3); jobs: update roads and cars (2.3ms), pedestrians (3.8ms) + building AI (0.85ms)
 	// Note: it's questionable to update (move) cars between the opaque and transparent pass because the parts will be out of sync;
 	// however, only the headlight flares are drawn in the transparent pass, and it doesn't seem to be a problem, so we allow it
 	if (have_city_models()) {
 		//timer_t timer("City Update MT"); // 4.65ms
-#pragma omp parallel num_threads(3)
-		if (omp_get_thread_num_3dw() == 0) {draw_tiled_terrain_and_transparent_geom(terrain_zmin, tt_reflection_tid, draw_water, camera_above_clouds);} // drawing must be on thread 0
-		else {next_city_frame(1);} // other threads (if threads enabled, else serial)
+		job_handle_t const city_job(add_next_city_frame_jobs());
+		draw_tiled_terrain_and_transparent_geom(terrain_zmin, tt_reflection_tid, draw_water, camera_above_clouds); // drawing must be on the main thread
+		wait_for_job(city_job); // runs the city jobs here if there are no worker threads
 	}
 	else { // serial version
 		//timer_t timer("City Update"); // 10.0ms
-		next_city_frame(0);
+		next_city_frame();
 		draw_tiled_terrain_and_transparent_geom(terrain_zmin, tt_reflection_tid, draw_water, camera_above_clouds);
 	}
 	camera_pdu.valid = prev_pdu_valid; // restore previous value
@@ -480,9 +480,12 @@ void display_mesh(bool shadow_pass, bool reflection_pass) { // fast array versio
 
 			for (int i = 0; i < MESH_Y_SIZE-1; ++i) {
 				for (int j = 0; j < MESH_X_SIZE; ++j) {
-					if (v_collision_matrix[i][j].zmin < v_collision_matrix[i][j].zmax) {
-						point const p1(get_xval(j+0), get_yval(i+0),v_collision_matrix[i][j].zmin);
-						point const p2(get_xval(j+1), get_yval(i+1),v_collision_matrix[i][j].zmax);
+					float cell_zmin, cell_zmax;
+					v_collision_grid.get_zmm(j, i, cell_zmin, cell_zmax);
+
+					if (cell_zmin < cell_zmax) {
+						point const p1(get_xval(j+0), get_yval(i+0), cell_zmin);
+						point const p2(get_xval(j+1), get_yval(i+1), cell_zmax);
 						draw_cube((p1 + p2)*0.5, (p2.x - p1.x), (p2.y - p1.y), (p2.z - p1.z), 0);
 					}
 				}
@@ -497,7 +500,7 @@ void display_mesh(bool shadow_pass, bool reflection_pass) { // fast array versio
 			for (int i = 0; i < MESH_Y_SIZE-1; ++i) {			
 				for (int j = 0; j < MESH_X_SIZE; ++j) {
 					for (unsigned d = 0; d < 2; ++d) {
-						verts.push_back(point(get_xval(j), get_yval(i+d), max(czmin, v_collision_matrix[i+d][j].zmax)));
+						verts.push_back(point(get_xval(j), get_yval(i+d), max(czmin, v_collision_grid.get_zmax(j, i+d))));
 					}
 				}
 				draw_and_clear_verts(verts, GL_TRIANGLE_STRIP);
@@ -10,6 +10,7 @@
 #include "shaders.h"
 #include "draw_utils.h"
 #include "transform_obj.h"
+#include "job_system.h"
 #include <glm/vec4.hpp>
 
 
@@ -803,11 +804,10 @@ void draw_coll_surfaces(bool draw_trans, int reflection_pass) {
 		if (reflection_pass != 2) { // create to_draw vector
 			coll_objects.set_cur_draw_stream_from_drawn_ids();
 
-#pragma omp parallel for schedule(static,64) num_threads(2)
-			for (int i = 0; i < (int)to_draw.size(); ++i) {
+			parallel_for_jobs(0, (int)to_draw.size(), [&](int i) {
 				coll_obj const &c(coll_objects.get_cobj(to_draw[i]));
 				if (!check_cobj_vis_occlude(c, camera_pdu, reflection_pass, ref_plane_z)) {to_draw[i] = TO_DRAW_SKIP_VAL;} // mark as skip
-			}
+			}, 64);
 		}
 		for (auto i = to_draw.begin(); i != to_draw.end(); ++i) {
 			if (*i == TO_DRAW_SKIP_VAL) continue; // skipped
@@ -4,16 +4,86 @@
 
 #include "3DWorld.h"
 #include "mesh.h"
+#include "job_system.h"
 #include <cfloat> // for FLT_EPSILON
+#include <omp.h>
 
 
+// droplets in a batch all see the heightmap from the start of the batch, and their changes are merged in droplet order at the end of the batch;
+// the batch size depends only on the heightmap size, not the number of threads, so that the results are identical for any thread count
+unsigned const MAX_EROSION_BATCH_SIZE = 4096;
+bool const CHECK_EROSION_DETERMINISM = 0; // debugging: also run erosion on a single thread and assert that the results are bit identical
+
 extern float erode_amount, water_plane_z;
 
 
+struct erosion_delta_t {
+	unsigned ix;
+	float dh;
+};
+
+class droplet_deltas_t { // sparse 2D array of height changes made by the current droplet, allocated in 8x8 tiles as needed
+public:
+	static unsigned const TILE_BITS = 3, TILE_SZ = (1 << TILE_BITS), TILE_MASK = TILE_SZ-1;
+private:
+	struct tile_t {
+		float dh[TILE_SZ*TILE_SZ];
+		uint64_t written; // one bit per value
+	};
+	int nx=0, tiles_x=0;
+	vector<int> tile_ix; // per tile: index into tiles, or -1 if not allocated
+	vector<tile_t> tiles;
+	vector<unsigned> used_tiles;
+
+	unsigned get_tile(int x, int y) const {return ((y >> TILE_BITS)*tiles_x + (x >> TILE_BITS));}
+	static unsigned get_tile_off(int x, int y) {return (((y & TILE_MASK) << TILE_BITS) + (x & TILE_MASK));}
+public:
+	droplet_deltas_t(int nx_, int ny) : nx(nx_), tiles_x((nx_ + TILE_MASK) >> TILE_BITS) {tile_ix.resize(tiles_x*((ny + TILE_MASK) >> TILE_BITS), -1);}
+
+	float get(int x, int y) const {
+		int const tix(tile_ix[get_tile(x, y)]);
+		if (tix < 0) return 0.0;
+		unsigned const off(get_tile_off(x, y));
+		tile_t const &t(tiles[tix]);
+		return (((t.written >> off) & 1) ? t.dh[off] : 0.0f);
+	}
+	void add(int x, int y, float dh) {
+		unsigned const tile(get_tile(x, y)), off(get_tile_off(x, y));
+		int &tix(tile_ix[tile]);
+
+		if (tix < 0) {
+			tix = (int)tiles.size();
+			tiles.emplace_back();
+			tiles.back().written = 0;
+			used_tiles.push_back(tile);
+		}
+		tile_t &t(tiles[tix]);
+		if ((t.written >> off) & 1) {t.dh[off] += dh;} else {t.dh[off] = dh; t.written |= (1ULL << off);}
+	}
+	// entries are grouped by tile in tile order, so all entries of a tile row come before those of later tile rows;
+	// they're not sorted by index within a tile row, since each tile's entries span 8 rows of the heightmap
+	void export_and_clear(vector<erosion_delta_t> &deltas) {
+		deltas.clear();
+		sort(used_tiles.begin(), used_tiles.end());
+
+		for (unsigned tile : used_tiles) {
+			int const tx((tile % tiles_x) << TILE_BITS), ty((tile / tiles_x) << TILE_BITS);
+			tile_t const &t(tiles[tile_ix[tile]]);
+
+			for (unsigned i = 0; i < TILE_SZ*TILE_SZ; ++i) {
+				if ((t.written >> i) & 1) {deltas.push_back(erosion_delta_t({unsigned((ty + (i >> TILE_BITS))*nx + tx + (i & TILE_MASK)), t.dh[i]}));}
+			}
+			tile_ix[tile] = -1;
+		}
+		used_tiles.clear();
+		tiles.clear();
+	}
+};
+
+
 // see http://ranmantaru.com/blog/2011/10/08/water-erosion-on-heightmap-terrain/
-void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
+void apply_erosion_batches(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
 
-	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
 	RESET_TIME;
 	// Kq and minSlope are for soil carry capacity.
 	// Kw is water evaporation speed.
@@ -24,8 +94,9 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	float const Kq=10, Kw=0.001f, Kr=0.9f, Kd=0.02f, Ki=0.1f, minSlope=0.05f, g=20, Kg=g*2;
 	int const PAD(4), NX(xsize+2*PAD), NY(ysize+2*PAD);
 	unsigned const MAX_PATH_LEN(4*NX*NY);
-	vector<vector2d> erosion(NX*NY, vector2d(0.0, 0.0));
 	vector<float> mh_padded(NX*NY);
+	unsigned const batch_size(max(256U, min(MAX_EROSION_BATCH_SIZE, unsigned(xsize*ysize)/64))); // one droplet per 64 texels so that few droplets interact; maps under 128x128 use 256 for enough parallel work
+	vector<vector<erosion_delta_t>> batch_deltas(min(num_iters, batch_size)); // one per droplet in the batch
 
 	// pad mesh by 1 unit on each side to create a buffer of trash around the edges that can be discarded
 	for (int y = 0; y < NY; ++y) {
@@ -36,14 +107,12 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 		}
 	}
 
-#define HMAP_INDEX(x, y) (NX*max(min(y, NY-1), 0) + max(min(x, NX-1), 0))
-#define HMAP(x, y) mh_padded[HMAP_INDEX(x, y)]
+#define CLAMP_X(x) max(min((x), NX-1), 0)
+#define CLAMP_Y(y) max(min((y), NY-1), 0)
+#define HMAP(x, y) get_height(CLAMP_X(x), CLAMP_Y(y))
 
 #define DEPOSIT_AT(X, Z, W) { \
-	float const delta = ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	erosion[ix].y += delta; \
-	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {mh_padded[ix] += delta;} \
+	if (!(X < 0 || Z < 0 || X >= NX || Z >= NY)) {deltas.add((X), (Z), ds*erode_amount*(W));} \
 }
 
 #define DEPOSIT(H) \
@@ -54,105 +123,126 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	(H)+=ds;
 
 #define ERODE(X, Z, W) { \
-	float const delta=ds*erode_amount*(W); \
-	unsigned const ix(HMAP_INDEX((X), (Z))); \
-	mh_padded[ix]-=delta; \
-	vector2d &e=erosion[ix]; \
-	float r=e.x, d=e.y; \
-	if (delta<=d) {d-=delta;} else {r+=delta-d; d=0;} \
-	e.x=r; e.y=d; \
+	deltas.add(CLAMP_X(X), CLAMP_Y(Z), -ds*erode_amount*(W)); \
 }
 
-#pragma omp parallel for schedule(dynamic,1)
-	for (int iter=0; iter < (int)num_iters; ++iter) {
-		rand_gen_t rgen;
-		rgen.set_state(iter+11, 79*iter+121);
-		int xi = PAD + (rgen.rand()%xsize);
-		int zi = PAD + (rgen.rand()%ysize);
-		float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
-		float h=HMAP(xi, zi), h00=h, h10=HMAP(xi+1, zi), h01=HMAP(xi, zi+1), h11=HMAP(xi+1, zi+1);
-
-		unsigned numMoves=0;
-		for (; numMoves<MAX_PATH_LEN; ++numMoves) {
-			// calc gradient
-			float gx=h00+h01-h10-h11, gz=h00+h10-h01-h11;
-			// calc next pos
-			dx=(dx-gx)*Ki+gx;
-			dz=(dz-gz)*Ki+gz;
-
-			float dl=sqrtf(dx*dx+dz*dz);
-			if (dl<=FLT_EPSILON) { // pick random dir
-				float a=rgen.rand_float()*TWO_PI;
-				dx=cosf(a); dz=sinf(a);
-			}
-			else {
-				dx/=dl; dz/=dl;
-			}
-			float nxp=xp+dx, nzp=zp+dz;
-			// sample next height
-			int nxi=floor(nxp), nzi=floor(nzp);
-			float nxf=nxp-nxi, nzf=nzp-nzi;
-			float nh00=HMAP(nxi, nzi), nh10=HMAP(nxi+1, nzi), nh01=HMAP(nxi, nzi+1), nh11=HMAP(nxi+1, nzi+1);
-			float nh=(nh00*(1-nxf)+nh10*nxf)*(1-nzf)+(nh01*(1-nxf)+nh11*nxf)*nzf;
-			// adjust by HALF_DXY = average mesh texel size - this is river depth
-			if (max(max(nh00, nh10), max(nh01, nh11)) < water_plane_z - HALF_DXY) break; // reached ocean water, stop and ignore sediment
-
-			// if higher than current, try to deposit sediment up to neighbour height
-			bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY);
-			if (nh>=h || outside) {
-				float ds=(nh-h)+0.001f;
-
-				if (ds>=s || outside) {
-					ds=s;
-					DEPOSIT(h) // deposit all sediment
-					s=0;
-					break; // stop
-				}
-				DEPOSIT(h)
-				s-=ds;
-				v=0;
-			}
-			// compute transport capacity
-			float dh=h-nh;
-			float slope=dh;
-			//float slope=dh/sqrtf(dh*dh+1);
-			float q=max(slope, minSlope)*v*w*Kq;
-
-			// deposit/erode (don't erode more than dh)
-			float ds=s-q;
-			if (ds>=0) { // deposit
-				ds*=Kd;
-				//ds=minval(ds, 1.0f);
-				DEPOSIT(dh)
-				s-=ds;
-			}
-			else { // erode
-				ds*=-Kr;
-				ds=min(ds, dh*0.99f);
-				ds*=((get_bare_ls_tid(nh) == ROCK_TEX) ? 0.5 : 2.0); // rock erodes slower than dirt/sand
-
-				for (int z=zi-1; z<=zi+2; ++z) {
-					float zo=z-zp, zo2=zo*zo;
-
-					for (int x=xi-1; x<=xi+2; ++x) {
-						float xo=x-xp;
-						float w=1-(xo*xo+zo2)*0.25f;
-						if (w<=0) continue;
-						w*=0.1591549430918953f;
-						ERODE(x, z, w)
+	bool const use_omp(get_job_worker_index() == 0); // job workers (tile generation) run one heightmap each, as in tile_t::create_zvals()
+
+	for (unsigned batch_start = 0; batch_start < num_iters; batch_start += batch_size) {
+		int const batch_end(min(num_iters, batch_start + batch_size));
+
+#pragma omp parallel if (use_omp)
+		{
+			droplet_deltas_t deltas(NX, NY); // per-thread; the droplet sees its own changes on top of the heightmap at the start of the batch
+			auto get_height = [&](int x, int y) {return mh_padded[y*NX + x] + deltas.get(x, y);};
+
+#pragma omp for schedule(dynamic,16)
+			for (int iter=batch_start; iter < batch_end; ++iter) {
+				rand_gen_t rgen;
+				rgen.set_state(iter+11, 79*iter+121);
+				int xi = PAD + (rgen.rand()%xsize);
+				int zi = PAD + (rgen.rand()%ysize);
+				float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
+				float h=HMAP(xi, zi), h00=h, h10=HMAP(xi+1, zi), h01=HMAP(xi, zi+1), h11=HMAP(xi+1, zi+1);
+
+				unsigned numMoves=0;
+				for (; numMoves<MAX_PATH_LEN; ++numMoves) {
+					// calc gradient
+					float gx=h00+h01-h10-h11, gz=h00+h10-h01-h11;
+					// calc next pos
+					dx=(dx-gx)*Ki+gx;
+					dz=(dz-gz)*Ki+gz;
+
+					float dl=sqrtf(dx*dx+dz*dz);
+					if (dl<=FLT_EPSILON) { // pick random dir
+						float a=rgen.rand_float()*TWO_PI;
+						dx=cosf(a); dz=sinf(a);
+					}
+					else {
+						dx/=dl; dz/=dl;
 					}
-				}
-				dh-=ds;
-				s+=ds;
+					float nxp=xp+dx, nzp=zp+dz;
+					// sample next height
+					int nxi=floor(nxp), nzi=floor(nzp);
+					float nxf=nxp-nxi, nzf=nzp-nzi;
+					float nh00=HMAP(nxi, nzi), nh10=HMAP(nxi+1, nzi), nh01=HMAP(nxi, nzi+1), nh11=HMAP(nxi+1, nzi+1);
+					float nh=(nh00*(1-nxf)+nh10*nxf)*(1-nzf)+(nh01*(1-nxf)+nh11*nxf)*nzf;
+					// adjust by HALF_DXY = average mesh texel size - this is river depth
+					if (max(max(nh00, nh10), max(nh01, nh11)) < water_plane_z - HALF_DXY) break; // reached ocean water, stop and ignore sediment
+
+					// if higher than current, try to deposit sediment up to neighbour height
+					bool const outside(xi < 0 || zi < 0 || xi >= NX || zi >= NY);
+					if (nh>=h || outside) {
+						float ds=(nh-h)+0.001f;
+
+						if (ds>=s || outside) {
+							ds=s;
+							DEPOSIT(h) // deposit all sediment
+							s=0;
+							break; // stop
+						}
+						DEPOSIT(h)
+						s-=ds;
+						v=0;
+					}
+					// compute transport capacity
+					float dh=h-nh;
+					float slope=dh;
+					//float slope=dh/sqrtf(dh*dh+1);
+					float q=max(slope, minSlope)*v*w*Kq;
+
+					// deposit/erode (don't erode more than dh)
+					float ds=s-q;
+					if (ds>=0) { // deposit
+						ds*=Kd;
+						//ds=minval(ds, 1.0f);
+						DEPOSIT(dh)
+						s-=ds;
+					}
+					else { // erode
+						ds*=-Kr;
+						ds=min(ds, dh*0.99f);
+						ds*=((get_bare_ls_tid(nh) == ROCK_TEX) ? 0.5 : 2.0); // rock erodes slower than dirt/sand
+
+						for (int z=zi-1; z<=zi+2; ++z) {
+							float zo=z-zp, zo2=zo*zo;
+
+							for (int x=xi-1; x<=xi+2; ++x) {
+								float xo=x-xp;
+								float w=1-(xo*xo+zo2)*0.25f;
+								if (w<=0) continue;
+								w*=0.1591549430918953f;
+								ERODE(x, z, w)
+							}
+						}
+						dh-=ds;
+						s+=ds;
+					}
+					// move to the neighbor
+					v=sqrtf(v*v+Kg*dh);
+					w*=1-Kw;
+					xp=nxp; zp=nzp; xi=nxi; zi=nzi; xf=nxf; zf=nzf;
+					h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
+				} // for numMoves
+				if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
+				deltas.export_and_clear(batch_deltas[iter - batch_start]);
+			} // for iter
+		} // omp parallel
+
+		// merge height changes into the heightmap; each thread owns a range of tile rows and adds the changes for each index in droplet order
+		int const num_droplets(batch_end - batch_start), tile_rows((NY + droplet_deltas_t::TILE_MASK) >> droplet_deltas_t::TILE_BITS), num_ranges(min(tile_rows, 64));
+
+#pragma omp parallel for schedule(dynamic,1) if (use_omp)
+		for (int r = 0; r < num_ranges; ++r) {
+			unsigned const ix_start(NX*((r*tile_rows/num_ranges) << droplet_deltas_t::TILE_BITS)), ix_end(min(NX*NY, NX*(((r+1)*tile_rows/num_ranges) << droplet_deltas_t::TILE_BITS)));
+
+			for (int d = 0; d < num_droplets; ++d) {
+				vector<erosion_delta_t> const &deltas(batch_deltas[d]);
+				auto i(std::partition_point(deltas.begin(), deltas.end(), [ix_start](erosion_delta_t const &v) {return (v.ix < ix_start);}));
+				for (; i != deltas.end() && i->ix < ix_end; ++i) {mh_padded[i->ix] += i->dh;}
 			}
-			// move to the neighbor
-			v=sqrtf(v*v+Kg*dh);
-			w*=1-Kw;
-			xp=nxp; zp=nzp; xi=nxi; zi=nzi; xf=nxf; zf=nzf;
-			h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
-		} // for numMoves
-		if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
-	} // for iter
+		} // for r
+	} // for batch_start
 
 	// remove padding and clamp to min_zval
 	for (int y = 0; y < ysize; ++y) {
@@ -163,3 +253,20 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	PRINT_TIME("Erosion");
 }
 
+void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters) {
+
+	if (num_iters == 0 || erode_amount <= 0.0) return; // erosion disabled
+	int const num_threads(omp_get_max_threads());
+	if (!CHECK_EROSION_DETERMINISM || num_threads == 1) {apply_erosion_batches(heightmap, xsize, ysize, min_zval, num_iters); return;}
+	unsigned const num(xsize*ysize);
+	vector<float> ref(heightmap, heightmap+num);
+	omp_set_num_threads(1);
+	apply_erosion_batches(ref.data(), xsize, ysize, min_zval, num_iters);
+	omp_set_num_threads(num_threads);
+	apply_erosion_batches(heightmap, xsize, ysize, min_zval, num_iters);
+	unsigned num_diff(0);
+	for (unsigned i = 0; i < num; ++i) {num_diff += (heightmap[i] != ref[i]);}
+	cout << "Erosion determinism check: " << num_diff << " of " << num << " heights differ between " << num_threads << " threads and 1 thread" << endl;
+	assert(num_diff == 0);
+}
+
@@ -7,6 +7,8 @@
 
 struct xform_matrix;
 class tree_cont_t;
+struct line_packet_t;
+struct obj_grid_ref_t;
 
 // glGetError wrappers
 bool get_gl_error(unsigned loc_id=0, const char* stmt=nullptr, const char* fname=nullptr);
@@ -283,6 +285,7 @@ void draw_tiled_terrain_decid_tree_shadows();
 void clear_tiled_terrain(bool no_regen_buildings=0);
 void reset_tiled_terrain_state();
 void clear_tiled_terrain_shaders();
+void print_tile_stream_stats();
 float get_tiled_terrain_water_level();
 bool try_bind_tile_smap_at_point(point const &pos, shader_t &s, bool check_only=0);
 void invalidate_tile_smap_at_pt(point const &pos, float radius, bool repeat_next_frame=0);
@@ -351,6 +354,11 @@ bool save_state(const char *filename);
 // function prototypes - erosion
 void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsigned num_iters);
 
+// function prototypes - noise_simd
+void gen_simplex_height_row_simd(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp);
+void gen_simplex_fbm_3d_line_simd(float *vals, unsigned num, point const &pos, vector3d const &step, float mag, float freq, float rx, float ry, unsigned num_octaves);
+void run_noise_simd_benchmark(unsigned num_samples);
+
 // function prototypes - city_gen
 template<typename T> bool check_bcubes_sphere_coll(vector<T> const &bcubes, point const &sc, float radius, bool xy_only);
 bool is_night(float adj=0.0);
@@ -364,7 +372,7 @@ void gen_cities(float *heightmap, unsigned xsize, unsigned ysize);
 void gen_city_details();
 void get_city_bcubes(vect_cube_t &bcubes);
 void get_city_road_bcubes(vect_cube_t &bcubes, bool connector_only);
-void next_city_frame(bool use_threads_2_3);
+void next_city_frame();
 void draw_cities(int shadow_only, int reflection_pass, int trans_op_mask, vector3d const &xlate);
 unsigned check_city_sphere_coll(point const &pos, float radius, bool exclude_bridges_and_tunnels, bool ret_first_coll=1, unsigned check_mask=3);
 void get_city_sphere_coll_cubes(point const &pos, float radius, bool include_intersections, bool xy_only, vect_cube_t &out, vect_cube_t *out_bt=nullptr);
@@ -460,6 +468,7 @@ void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+void check_coll_line_exact_tree_packet(line_packet_t &lp, int ignore_cobj, int test_alpha=0, bool include_voxels=1, bool no_stat_moving=0);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -468,6 +477,8 @@ void get_coll_line_cobjs_tree(point const &pos1, point const &pos2, int ignore_c
 void get_coll_sphere_cobjs_tree(point const &center, float radius, int cobj, vert_coll_detector &vcd, bool dynamic);
 bool check_point_contained_tree(point const &p, int &cindex, bool dynamic);
 bool have_occluders();
+void run_cobj_tree_benchmark();
+void print_cobj_tree_refit_stats();
 void get_intersecting_cobjs_tree(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler,
 	bool dynamic, bool check_ccounter, int id_for_cobj_int=-1);
 bool check_coll_line(point const &pos1, point const &pos2, int &cindex, int c_obj, int skip_dynamic, int test_alpha,
@@ -607,10 +618,13 @@ void update_water_zval(int x, int y, float old_mh);
 
 // function prototypes - textures
 void load_texture_names();
-void load_textures();
+void load_textures(bool cpu_only=0);
 unsigned get_loaded_textures_cpu_mem();
 unsigned get_loaded_textures_gpu_mem();
 int texture_lookup(std::string const &name);
+void begin_texture_user_job();
+void end_texture_user_job();
+int add_texture(texture_t const &tex);
 int get_texture_by_name(std::string const &name, bool is_normal_map=0, bool invert_y=0, int wrap_mir=1, float aniso=0.0, bool allow_compress=1, int use_mipmaps=1, unsigned ncolors=3);
 unsigned load_cube_map_texture(std::string const &name);
 bool select_texture(int id);
@@ -689,7 +703,7 @@ void gen_landmine_scorch(point const &pos);
 int get_smiley_hit(vector3d &hdir, int index);
 void blast_radius(point const &pos, int type, int obj_index, int shooter, int chain_level);
 void create_explosion(point const &pos, int shooter, int chain_level, float damage, float size, int type, bool cview);
-void do_area_effect_damage(point const &pos, float effect_radius, float damage, int index, int source, int type);
+void do_area_effect_damage(point const &pos, float effect_radius, float damage, int index, int source, int type, vector<obj_grid_ref_t> const *smiley_cands=nullptr);
 void switch_player_weapon(int val, bool mouse_wheel);
 void draw_beams(bool clear_at_end);
 void show_blood_on_camera();
@@ -919,6 +933,17 @@ void change_voxel_editing_mode(int val);
 void undo_voxel_brush();
 void modify_voxels();
 
+// function prototypes - benchmark
+bool parse_benchmark_option(FILE *fp);
+bool init_benchmark();
+bool benchmark_active();
+bool benchmark_cpu_only();
+void benchmark_frame_start();
+void benchmark_update_camera();
+void benchmark_end_stage(char const *const name);
+void benchmark_frame_end();
+void run_cpu_only_benchmark();
+
 // function prototypes - screenshot
 void read_depth_buffer(unsigned window_width, unsigned window_height, vector<float> &depth, bool normalize=0);
 void read_pixels(unsigned window_width, unsigned window_height, vector<unsigned char> &buf);
@@ -1027,6 +1052,7 @@ void get_building_bcubes(cube_t const &xy_range, vect_cube_with_ix_t &bcubes);
 void get_building_power_points(cube_t const &xy_range, vector<point> &ppts);
 bool get_buildings_line_hit_color(point const &p1, point const &p2, colorRGBA &color);
 bool have_buildings();
+void print_building_room_geom_stats();
 unsigned get_buildings_gpu_mem_usage();
 vector3d get_buildings_max_extent();
 void clear_building_vbos();
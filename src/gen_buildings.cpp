@@ -11,6 +11,7 @@
 #include "subdiv.h" // for sd_sphere_d
 #include "tree_3dw.h" // for tree_placer_t
 #include "profiler.h"
+#include "job_system.h"
 #include "shadow_map.h" // for get_empty_smap_tid
 #include "lightmap.h" // for light_source
 
@@ -1949,6 +1950,59 @@ void building_t::write_basement_entrance_depth_pass(shader_t &s) const {
 }
 
 
+void setup_for_async_room_geom_gen();
+
+// generates room geom for buildings near the camera in jobs, out to a prefetch distance beyond the room geom draw distance, so that it's usually ready before
+// the building is drawn; each job generates into a private copy of its building, and the main thread moves the result into the building when it's drawn
+class room_geom_gen_queue_t {
+	struct pending_t {
+		std::shared_ptr<building_t> copy; // owned by both this and the job
+		building_interior_t const *interior=nullptr; // interior of the building when the copy was made, to detect that the building was regenerated
+		job_handle_t job;
+	};
+	map<unsigned, pending_t> pending; // by building index
+public:
+	bool is_pending(unsigned bix) const {return (pending.find(bix) != pending.end());}
+
+	unsigned num_running() const { // finished jobs wait here until their building is drawn or the camera moves away
+		unsigned num(0);
+		for (auto const &p : pending) {num += !job_is_done(p.second.job);}
+		return num;
+	}
+	void clear() {pending.clear();} // jobs keep their building copies alive, so they don't need to be waited on
+
+	void add(building_t const &b, unsigned bix) {
+		assert(!is_pending(bix));
+		setup_for_async_room_geom_gen();
+		pending_t &p(pending[bix]);
+		p.copy     = b.make_room_geom_gen_copy();
+		p.interior = b.interior.get();
+		std::shared_ptr<building_t> const copy(p.copy);
+		begin_texture_user_job(); // generation reads textures and may load them by name
+
+		p.job = add_background_job([copy, bix]() {
+			copy->gen_room_geom(bix); // same seed as synchronous generation
+			copy->interior->room_geom->gen_static_verts(*copy);
+			end_texture_user_job();
+		}, vector<job_handle_t>(), "Gen Room Geom");
+		TRACE_COUNTER_ADD("Room Geom Jobs", 1);
+	}
+	bool finish(building_t &b, unsigned bix) { // waits if needed; returns true if room geom was moved into b
+		auto it(pending.find(bix));
+		if (it == pending.end()) return 0;
+		wait_for_job(it->second.job); // runs the job here if it hasn't been started
+		bool const ret(b.interior.get() == it->second.interior && b.install_room_geom_from(*it->second.copy));
+		pending.erase(it);
+		return ret;
+	}
+	template<typename F> void remove_if(F const &f) { // f(bix) returns true to remove
+		for (auto i = pending.begin(); i != pending.end();) {
+			if (f(i->first)) {i = pending.erase(i);} else {++i;}
+		}
+	}
+};
+
+
 class building_creator_t {
 
 	unsigned grid_sz, gpu_mem_usage;
@@ -1961,6 +2015,8 @@ class building_creator_t {
 	building_draw_t building_draw, building_draw_vbo, building_draw_windows, building_draw_wind_lights, building_draw_interior, building_draw_int_ext_walls;
 	point_sprite_drawer_sized building_lights;
 	vector<point> points; // reused temporary
+	vector<pair<float, unsigned>> room_geom_cands; // reused temporary
+	room_geom_gen_queue_t room_geom_gen;
 	bool use_smap_this_frame, has_interior_geom;
 
 	struct grid_elem_t {
@@ -2125,11 +2181,12 @@ public:
 	bool has_interior_to_draw() const {return (has_interior_geom && !building_draw_interior.empty());}
 
 	void clear() {
+		room_geom_gen.clear();
+		clear_vbos(); // before clearing buildings so that their cached room geom is removed
 		buildings.clear();
 		grid.clear();
 		grid_by_tile.clear();
 		bix_by_plot.clear();
-		clear_vbos();
 		buildings_bcube = cube_t();
 		gpu_mem_usage = 0;
 	}
@@ -2387,8 +2444,10 @@ public:
 		{ // open a scope
 			timer_t timer2("Gen Building Geometry", !is_tile);
 			bool const use_mt(!is_tile || global_building_params.gen_building_interiors); // only single threaded for tiles with no interiors, which is a fast case anyway
-#pragma omp parallel for schedule(static,1) num_threads(2) if (use_mt)
-			for (int i = 0; i < (int)buildings.size(); ++i) {buildings[i].gen_geometry(i, 1337*i+rseed);}
+			parallel_for_jobs(0, (int)buildings.size(), [&](int i) {
+				TRACE_ZONE("Building Gen Geometry");
+				buildings[i].gen_geometry(i, 1337*i+rseed);
+			}, 1, (use_mt ? 0 : 1));
 		} // close the scope
 		if (0 && non_city_only) { // perform room graph analysis
 			timer_t timer3("Building Room Graph Analysis");
@@ -2582,6 +2641,38 @@ public:
 		} // for g
 	}
 
+	// start jobs to generate room geom for buildings within prefetch_dist that don't have it yet, closest first, preferring buildings in front of the camera
+	void prefetch_room_geom(point const &camera_bs, vector3d const &view_dir, float prefetch_dist) {
+		float const drop_dist(1.1*prefetch_dist); // hysteresis
+		room_geom_gen.remove_if([&](unsigned bix) {return !get_building(bix).bcube.closest_dist_less_than(camera_bs, drop_dist);}); // camera moved away
+		unsigned const max_running(2*get_num_job_threads()), num_running(room_geom_gen.num_running());
+		if (num_running >= max_running) return;
+		vector3d view_dir_xy(view_dir.x, view_dir.y, 0.0);
+		if (view_dir_xy != zero_vector) {view_dir_xy.normalize();}
+		room_geom_cands.clear();
+
+		for (auto g = grid_by_tile.begin(); g != grid_by_tile.end(); ++g) {
+			if (!g->bcube.closest_dist_xy_less_than(camera_bs, prefetch_dist)) continue;
+
+			for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {
+				building_t const &b(get_building(bi->ix));
+				if (!b.interior || b.has_room_geom() || room_geom_gen.is_pending(bi->ix) || has_cached_room_geom(b)) continue;
+				if (!b.has_windows()) continue; // the interior isn't visible until the player is near the building; generate when drawn
+				if (!global_building_params.enable_rotated_room_geom && b.is_rotated()) continue; // not drawn
+				float const dist(p2p_dist(camera_bs, b.bcube.closest_pt(camera_bs)));
+				if (dist > prefetch_dist) continue;
+				vector3d dir(b.bcube.get_cube_center() - camera_bs);
+				dir.z = 0.0;
+				float const cos_view((dir == zero_vector) ? 1.0 : dot_product(view_dir_xy, dir.get_norm()));
+				room_geom_cands.emplace_back(dist*(1.5 - 0.5*cos_view), bi->ix); // buildings behind the camera count as twice as far away
+			}
+		} // for g
+		unsigned const num_add(min((unsigned)room_geom_cands.size(), (max_running - num_running)));
+		std::partial_sort(room_geom_cands.begin(), room_geom_cands.begin()+num_add, room_geom_cands.end());
+		// jobs are started in priority order, and workers take the oldest job first
+		for (unsigned n = 0; n < num_add; ++n) {room_geom_gen.add(get_building(room_geom_cands[n].second), room_geom_cands[n].second);}
+	}
+
 	void add_exterior_lights(vector3d const &xlate, cube_t &lights_bcube) const {
 		for (auto g = grid_by_tile.begin(); g != grid_by_tile.end(); ++g) { // Note: all grids should be nonempty
 			if (!lights_bcube.intersects_xy(g->bcube)) continue; // not within light volume (too far from camera)
@@ -2728,7 +2819,7 @@ public:
 
 					if (gdist_sq > rgeom_clear_dist_sq && g->has_room_geom) { // need to clear room geom
 						//highres_timer_t timer("Clear Room Geom");
-						for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {(*i)->get_building(bi->ix).clear_room_geom();}
+						for (auto bi = g->bc_ixs.begin(); bi != g->bc_ixs.end(); ++bi) {(*i)->get_building(bi->ix).clear_room_geom(1);} // allow caching
 						g->has_room_geom = 0;
 					}
 					if (gdist_sq > int_draw_dist_sq) continue; // too far
@@ -2756,6 +2847,7 @@ public:
 						// draw ddetail objects if player is in the building (inc ext basement), even if far from the building center
 						unsigned inc_small(player_in_building_bcube ? 2 : (bdist_sq < rgeom_sm_draw_dist_sq));
 						if (inc_small && bdist_sq < rgeom_detail_dist_sq) {inc_small = 2;} // include detail objects
+						if (!b.has_room_geom()) {(*i)->room_geom_gen.finish(b, bi->ix);} // use room geom from a job if there is one
 						b.gen_and_draw_room_geom(&bbd, s, oc, xlate, bi->ix, 0, reflection_pass, inc_small, player_in_building_bcube); // shadow_only=0
 						g->has_room_geom = 1;
 						if (!draw_interior) continue;
@@ -2800,6 +2892,15 @@ public:
 			} // for i
 			bbd.draw_and_clear(s);
 			set_std_depth_func(); // restore
+
+			if (!reflection_pass && global_building_params.async_room_geom_gen && get_num_job_threads() > 1) { // generate room geom ahead of the camera
+				float const prefetch_dist(max(global_building_params.room_geom_prefetch_dist_scale, 1.0f)*room_geom_draw_dist);
+
+				for (auto i = bcs.begin(); i != bcs.end(); ++i) {
+					if ((*i)->building_draw_windows.empty()) continue; // no windows, so interiors are only drawn when the player is very close
+					(*i)->prefetch_room_geom(camera_xlated, cview_dir, prefetch_dist);
+				}
+			}
 			glDisable(GL_CULL_FACE);
 
 			if (!reflection_pass) { // update once; non-interior buildings (such as city buildings) won't update this
@@ -3137,6 +3238,7 @@ public:
 
 #pragma omp parallel for schedule(static) num_threads(num_passes)
 		for (int pass = 0; pass < num_passes; ++pass) { // parallel loop doesn't help much because pass 0 takes most of the time
+			TRACE_ZONE((pass == 0) ? "Building Exterior Verts" : ((pass == 1) ? "Building Window Verts" : "Building Interior Verts"));
 			if (pass == 0) { // exterior pass
 				building_draw_vbo.clear();
 
@@ -3203,6 +3305,7 @@ public:
 		building_draw_interior.clear_vbos();
 		building_draw_int_ext_walls.clear_vbos();
 		for (auto i = buildings.begin(); i != buildings.end(); ++i) {i->clear_room_geom();} // likely required for tiled buildings
+		if (!buildings.empty()) {remove_cached_room_geom(buildings.data(), buildings.data()+buildings.size());} // buildings may be deleted or regenerated
 		gpu_mem_usage = 0;
 	}
 	bool check_sphere_coll(point &pos, point const &p_last, float radius, bool xy_only=0, vector3d *cnorm=nullptr, bool check_interior=0) const { // Note: pos is in camera space
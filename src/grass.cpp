@@ -346,13 +346,10 @@ public:
 				//if (create_voxel_landscape) {
 				if (coll_objects.has_voxel_cobjs) {
 					float const blades_per_area(grass_density/dxdy);
-					coll_cell const &cell(v_collision_matrix[y][x]);
 					cube_t const test_cube(xval-0.5*DX_VAL, xval+0.5*DX_VAL, yval-0.5*DY_VAL, yval+0.5*DY_VAL, mesh_height[y][x], czmax+grass_length);
 					float const nz_thresh = 0.4;
 
-					for (unsigned k = 0; k < cell.cvals.size(); ++k) {
-						int const index(cell.cvals[k]);
-						if (index < 0) continue;
+					for (int index : v_collision_grid.get_cobjs(x, y)) {
 						coll_obj const &cobj(coll_objects.get_cobj(index));
 						if (cobj.type != COLL_POLYGON || cobj.cp.cobj_type != COBJ_TYPE_VOX_TERRAIN) continue;
 						if (cobj.norm.z < nz_thresh)     continue; // not oriented upward
@@ -697,6 +697,7 @@ void texture_t::deferred_load_and_bind() {
 
 	switch (defer_load_type) {
 	case DEFER_TYPE_DDS:  deferred_load_dds (); break;
+	case DEFER_TYPE_CACHE: deferred_load_cache(); break;
 	default:
 		cerr << "Unhandled texture defer type " << defer_load_type << endl;
 		exit(1);
@@ -0,0 +1,202 @@
+// 3D World - Work-Stealing Job System
+// by Frank Gennari
+// 10/18/26
+#include "function_registry.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+extern unsigned NUM_THREADS;
+
+
+struct job_t {
+	std::function<void()> func;
+	char const *name;
+	std::atomic<int> num_deps; // unfinished dependencies, plus one while the job is being added
+	std::atomic<bool> started, done;
+	bool background;
+	std::mutex succ_mutex; // protects successors and the transition to done
+	vector<job_handle_t> successors;
+
+	job_t(std::function<void()> &&func_, char const *const name_, bool background_) :
+		func(std::move(func_)), name(name_), num_deps(1), started(0), done(0), background(background_) {}
+};
+
+thread_local int cur_job_worker_ix(0); // 0 = main/non-worker thread
+thread_local bool in_background_job(0); // jobs added by background jobs are also background jobs
+
+
+class job_system_t {
+
+	struct job_queue_t {
+		std::mutex mutex;
+		std::deque<job_handle_t> jobs;
+	};
+	vector<std::thread> workers;
+	std::unique_ptr<job_queue_t[]> queues; // one per thread; queue 0 is shared by all non-worker threads
+	job_queue_t bg_queue; // background jobs, run in FIFO order by idle workers
+	unsigned num_queues=0;
+	std::atomic<int> num_queued{0};
+	std::atomic<bool> exiting{0};
+	std::mutex sleep_mutex;
+	std::condition_variable wake_cv;
+	std::once_flag init_flag;
+
+	void ensure_init() {
+		std::call_once(init_flag, [this]() {
+			num_queues = max(NUM_THREADS, 1U); // the thread that waits on jobs counts as one of the threads
+			queues.reset(new job_queue_t[num_queues]);
+			for (unsigned i = 1; i < num_queues; ++i) {workers.emplace_back(&job_system_t::worker_loop, this, i);}
+		});
+	}
+	void push(job_handle_t const &job) {
+		job_queue_t &q(job->background ? bg_queue : queues[cur_job_worker_ix]);
+		{
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.jobs.push_back(job);
+		}
+		++num_queued;
+		{std::lock_guard<std::mutex> lock(sleep_mutex);} // a worker is either before its wait predicate check or waiting, so the notify can't be lost
+		wake_cv.notify_one();
+	}
+	void release_dep(job_handle_t const &job) {
+		if (--job->num_deps == 0) {push(job);}
+	}
+	job_handle_t try_get_job(bool allow_background) {
+		unsigned const ix(cur_job_worker_ix);
+
+		while (num_queued > 0) {
+			job_handle_t job;
+
+			for (unsigned n = 0; n <= num_queues && !job; ++n) {
+				bool const is_bg(n == num_queues);
+				if (is_bg && !allow_background) break;
+				job_queue_t &q(is_bg ? bg_queue : queues[(ix + n) % num_queues]);
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (q.jobs.empty()) continue;
+				if (n == 0) {job = std::move(q.jobs.back ()); q.jobs.pop_back ();} // own queue: newest job, which is likely to have its data in cache
+				else        {job = std::move(q.jobs.front()); q.jobs.pop_front();} // steal the oldest job, which is likely the largest
+				--num_queued;
+			}
+			if (!job) return nullptr;
+			if (!job->started.exchange(1)) return job; // else already run by a thread waiting on it; drop it
+		}
+		return nullptr;
+	}
+	void run_job(job_handle_t const &job) { // job->started must already be set by the caller
+		{
+			TRACE_ZONE(job->name ? job->name : "Job");
+			bool const was_background(in_background_job);
+			in_background_job = job->background;
+			job->func();
+			in_background_job = was_background;
+		}
+		job->func = nullptr; // free any captured data
+		vector<job_handle_t> successors;
+		{
+			std::lock_guard<std::mutex> lock(job->succ_mutex);
+			job->done = 1;
+			successors.swap(job->successors);
+		}
+		for (job_handle_t const &s : successors) {release_dep(s);}
+	}
+	void worker_loop(unsigned ix) {
+		cur_job_worker_ix = ix;
+
+		while (1) {
+			job_handle_t const job(try_get_job(1)); // idle workers run background jobs once there are no other jobs
+			if (job) {run_job(job); continue;}
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			wake_cv.wait(lock, [this]() {return (exiting || num_queued > 0);});
+			if (exiting) return;
+		}
+	}
+public:
+	~job_system_t() {
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			exiting = 1;
+		}
+		wake_cv.notify_all();
+		for (std::thread &w : workers) {w.join();}
+	}
+	unsigned get_num_threads() {
+		ensure_init();
+		return num_queues;
+	}
+	job_handle_t add(std::function<void()> &&func, vector<job_handle_t> const &deps, char const *const name, bool background) {
+		ensure_init();
+		job_handle_t const job(std::make_shared<job_t>(std::move(func), name, (background || in_background_job)));
+
+		for (job_handle_t const &d : deps) {
+			if (!d) continue;
+			std::lock_guard<std::mutex> lock(d->succ_mutex);
+			if (d->done) continue; // already finished
+			d->successors.push_back(job);
+			++job->num_deps;
+		}
+		release_dep(job); // remove the extra dependency from the constructor; queues the job if all deps are done
+		return job;
+	}
+	// run the job if it's ready and hasn't been started, otherwise help run other jobs while waiting; with no workers, this is where jobs run;
+	// threads that aren't in a background job only help with foreground jobs, so that waiting in a frame never runs a long background job inline
+	void wait(job_handle_t const &job) {
+		bool const allow_background(in_background_job || num_queues == 1);
+
+		while (job && !job->done) {
+			if (job->num_deps == 0 && !job->started.exchange(1)) {run_job(job); continue;} // run it here; the queued entry will be dropped
+			job_handle_t const other(try_get_job(allow_background));
+			if (other) {run_job(other);} else {std::this_thread::yield();}
+		}
+	}
+};
+
+job_system_t job_system;
+
+
+job_handle_t add_job(std::function<void()> func, vector<job_handle_t> const &deps, char const *const name) {return job_system.add(std::move(func), deps, name, 0);}
+job_handle_t add_background_job(std::function<void()> func, vector<job_handle_t> const &deps, char const *const name) {return job_system.add(std::move(func), deps, name, 1);}
+bool job_is_done(job_handle_t const &job) {return (!job || job->done);}
+void wait_for_job(job_handle_t const &job) {job_system.wait(job);}
+
+void wait_for_jobs(vector<job_handle_t> const &jobs) {
+	for (job_handle_t const &job : jobs) {job_system.wait(job);}
+}
+
+unsigned get_num_job_threads() {return job_system.get_num_threads();}
+int get_job_worker_index() {return cur_job_worker_ix;}
+
+
+void parallel_for_jobs(int begin, int end, std::function<void(int)> const &func, int grain, unsigned max_threads) {
+
+	if (end <= begin) return; // empty range
+	grain = max(grain, 1);
+	unsigned const num_blocks((end - begin + grain - 1)/grain), num_threads(max_threads ? min(max_threads, get_num_job_threads()) : get_num_job_threads());
+	unsigned const num_jobs(min(num_blocks, num_threads) - 1); // the caller is one of the threads
+
+	if (num_jobs == 0) { // serial
+		for (int i = begin; i < end; ++i) {func(i);}
+		return;
+	}
+	std::atomic<int> next_start(begin);
+	auto run_blocks([&]() { // claim blocks until all have been claimed; jobs that start after that return immediately
+		for (int start = next_start.fetch_add(grain); start < end; start = next_start.fetch_add(grain)) {
+			int const block_end(min(start + grain, end));
+			for (int i = start; i < block_end; ++i) {func(i);}
+		}
+	});
+	vector<job_handle_t> jobs;
+	jobs.reserve(num_jobs);
+	for (unsigned n = 0; n < num_jobs; ++n) {jobs.push_back(add_job(run_blocks, vector<job_handle_t>(), "Parallel For"));}
+	run_blocks();
+	wait_for_jobs(jobs); // captures refer to this stack frame, so all jobs must finish before returning
+}
+
+void run_jobs_in_parallel(std::function<void()> const &f1, std::function<void()> const &f2) {
+	job_handle_t const job(add_job(f2));
+	f1();
+	wait_for_job(job);
+}
@@ -0,0 +1,31 @@
+// 3D World - Work-Stealing Job System
+// by Frank Gennari
+// 10/18/26
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A single pool of NUM_THREADS-1 worker threads plus the calling thread, with one job deque per thread.
+// Threads run the newest job from their own deque first and steal the oldest job from other deques when theirs is empty.
+// Jobs can depend on other jobs; a job is queued once all of its dependencies have finished.
+// Waiting threads help run queued jobs, so jobs can add and wait on other jobs (for example nested parallel loops).
+// Background jobs (and the jobs they add) go in a separate low priority queue that only idle workers take jobs from; a waiting thread
+// only runs a background job if it's waiting on that job or is itself in a background job. Use these for work that spans frames.
+// Jobs must not make OpenGL calls, since they may run on worker threads; keep drawing on the main thread and wait on the job afterward.
+
+struct job_t;
+typedef std::shared_ptr<job_t> job_handle_t;
+
+job_handle_t add_job(std::function<void()> func, std::vector<job_handle_t> const &deps=std::vector<job_handle_t>(), char const *const name=nullptr); // name must be persistent
+job_handle_t add_background_job(std::function<void()> func, std::vector<job_handle_t> const &deps=std::vector<job_handle_t>(), char const *const name=nullptr);
+bool job_is_done(job_handle_t const &job);
+void wait_for_job (job_handle_t const &job);
+void wait_for_jobs(std::vector<job_handle_t> const &jobs);
+// replacement for "omp parallel for schedule(dynamic,grain)": iterations are claimed in blocks of grain by the caller and up to max_threads-1 workers;
+// max_threads=0 uses all threads, and max_threads=1 runs serially on the caller
+void parallel_for_jobs(int begin, int end, std::function<void(int)> const &func, int grain=1, unsigned max_threads=0);
+void run_jobs_in_parallel(std::function<void()> const &f1, std::function<void()> const &f2); // f1 runs on the calling thread
+unsigned get_num_job_threads(); // workers + the calling thread
+int get_job_worker_index(); // 0 for non-worker threads, [1, num_threads) for worker threads
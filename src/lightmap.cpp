@@ -36,7 +36,7 @@ indir_dlight_group_manager_t indir_dlight_group_manager;
 
 extern int animate2, display_mode, frame_counter, camera_coll_id, scrolling, read_light_files[], write_light_files[];
 extern unsigned create_voxel_landscape;
-extern bool disable_dlights;
+extern bool disable_dlights, compress_lighting_files;
 extern float czmin, czmax, fticks, zbottom, ztop, XY_SCENE_SIZE, FAR_CLIP, CAMERA_RADIUS, indir_light_exp, light_int_scale[], force_czmin, force_czmax;
 extern colorRGB cur_ambient, cur_diffuse;
 extern coll_obj_group coll_objects;
@@ -218,11 +218,13 @@ lmcell *lmap_manager_t::get_lmcell(point const &p) { // round to center
 }
 
 void lmap_manager_t::reset_all(lmcell const &init_lmcell) {
+	pending_reads.clear(); // values are overwritten
 	for (auto i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {*i = init_lmcell;}
 }
 
 template<typename T> void lmap_manager_t::alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell) {
 
+	pending_reads.clear(); // cell data is reset, so any files being read must be read again
 	lm_xsize = xsize; lm_ysize = ysize; lm_zsize = zsize;
 	if (vlmap == NULL) {matrix_gen_2d(vlmap, lm_xsize, lm_ysize);} // create column headers once
 	vldata_alloc.resize(max(nbins, 1U), init_lmcell); // make size at least 1, even if there are no bins, so we can test on emptiness
@@ -250,6 +252,7 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 
 	//assert(!is_allocated());
 	//clear_cells(); // probably unnecessary
+	assert(!src.has_pending_reads()); // caller should have finished reading src
 	alloc(src.vldata_alloc.size(), src.lm_xsize, src.lm_ysize, src.lm_zsize, src.vlmap, lmcell());
 	copy_data(src);
 }
@@ -281,6 +284,30 @@ void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
 }
 
 
+// *this = scale*src for ltype values only; returns the RMS change relative to the RMS of the new values
+float lmap_manager_t::copy_scaled_lighting_values(lmap_manager_t const &src, int ltype, float scale) {
+
+	assert(src.vldata_alloc.size() == vldata_alloc.size());
+	assert(!has_pending_reads());
+	unsigned const sz(lmcell::get_dsz(ltype));
+	double diff_sq(0.0), val_sq(0.0);
+
+#pragma omp parallel for schedule(static) reduction(+:diff_sq, val_sq)
+	for (int i = 0; i < (int)vldata_alloc.size(); ++i) {
+		float *dest(vldata_alloc[i].get_offset(ltype));
+		float const *vals(src.vldata_alloc[i].get_offset(ltype));
+
+		for (unsigned n = 0; n < sz; ++n) {
+			float const val(scale*vals[n]);
+			diff_sq += (val - dest[n])*(val - dest[n]);
+			val_sq  += val*val;
+			dest[n]  = val;
+		}
+	}
+	return ((val_sq > 0.0) ? sqrt(diff_sq/val_sq) : 0.0);
+}
+
+
 // *this = val*lmc + (1.0 - val)*(*this)
 void lmcell::mix_lighting_with(lmcell const &lmc, float val) {
 
@@ -329,6 +356,7 @@ void light_volume_local::add_lighting(colorRGB &color, int x, int y, int z) cons
 bool light_volume_local::read(string const &filename) {
 
 	assert(!is_allocated());
+	if (is_lighting_cache_file(filename, 1)) {return read_cache(filename);}
 	binary_file_reader reader;
 	if (!reader.open(filename)) return 0;
 
@@ -353,6 +381,7 @@ bool light_volume_local::write(string const &filename) const {
 
 	assert(is_allocated());
 	assert(compressed); // llvols are always written compressed
+	if (compress_lighting_files) {return write_cache(filename);}
 	binary_file_writer writer;
 	if (!writer.open(filename)) return 0;
 
@@ -504,10 +533,8 @@ void create_dlight_volumes() {indir_dlight_group_manager.create_needed_llvols();
 bool has_fixed_cobjs(int x, int y) {
 
 	assert(!point_outside_mesh(x, y));
-	vector<int> const &cvals(v_collision_matrix[y][x].cvals);
-
-	for (vector<int>::const_iterator i = cvals.begin(); i != cvals.end(); ++i) {
-		if (coll_objects[*i].fixed && coll_objects[*i].status == COLL_STATIC) {return 1;}
+	for (int c : v_collision_grid.get_cobjs(x, y)) {
+		if (coll_objects[c].fixed && coll_objects[c].status == COLL_STATIC) {return 1;}
 	}
 	return 0;
 }
@@ -543,11 +570,7 @@ void calc_flow_profile(r_profile flow_prof[3], int i, int j, bool proc_cobjs, fl
 	vector<pair<float, unsigned> > cobj_z;
 
 	if (proc_cobjs) {
-		coll_cell const &cell(v_collision_matrix[i][j]);
-		unsigned const ncv((unsigned)cell.cvals.size());
-
-		for (unsigned q = 0; q < ncv; ++q) {
-			unsigned const cid(cell.cvals[q]);
+		for (int const cid : v_collision_grid.get_cobjs(j, i)) {
 			coll_obj const &cobj(coll_objects.get_cobj(cid));
 			if (cobj.status != COLL_STATIC) continue;
 			if (cobj.d[2][1] < zbottom)     continue; // below the mesh
@@ -1252,7 +1275,7 @@ void add_dynamic_lights_ground(float &dlight_add_thresh) {
 					float const px(get_xval(x << DL_GRID_BS)), py(get_yval(y << DL_GRID_BS));
 					if (!pdu.cube_visible_for_light_cone(cube_t(px-grid_dx, px+grid_dx, py-grid_dy, py+grid_dy, z1, z2))) continue; // tile not in spotlight cylinder
 				}
-				//if (DL_GRID_BS == 0 && bcube.z1() > v_collision_matrix[y << DL_GRID_BS][x << DL_GRID_BS].zmax) continue; // should be legal, but doesn't seem to help
+				//if (DL_GRID_BS == 0 && bcube.z1() > v_collision_grid.get_zmax(x << DL_GRID_BS, y << DL_GRID_BS)) continue; // should be legal, but doesn't seem to help
 				ldynamic[offset + x].add_light(ix, ldynamic_enabled[offset + x]); // could do flow clipping here?
 			} // for x
 		} // for y
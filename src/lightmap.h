@@ -9,6 +9,8 @@
 
 extern int MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[3];
 
+bool is_lighting_cache_file(std::string const &filename, bool is_llvol);
+
 #define ADD_LIGHT_CONTRIB(c, C) {C[0] += c[0]; C[1] += c[1]; C[2] += c[2];}
 
 unsigned const FLASHLIGHT_LIGHT_ID = 0;
@@ -46,12 +48,16 @@ struct lmcell { // size = 52
 
 class lmap_manager_t {
 
+	struct pending_read_t; // lighting cache file that's decoded in chunks over several frames
 	vector<lmcell> vldata_alloc;
 	unsigned lm_xsize, lm_ysize, lm_zsize;
 	lmcell ***vlmap; // y, x, z (size is determined by {MESH_Y_SIZE, MESH_X_SIZE, MESH_Z_SIZE}
+	vector<std::shared_ptr<pending_read_t>> pending_reads;
 
 	lmap_manager_t(lmap_manager_t const &) = delete; // forbidden
 	void operator=(lmap_manager_t const &) = delete; // forbidden
+	bool read_cache_file(char const *const fn, int ltype);
+	bool write_cache_file(char const *const fn, int ltype) const;
 
 public:
 	bool was_updated;
@@ -62,7 +68,10 @@ public:
 	bool is_allocated() const {return (vlmap != NULL && !vldata_alloc.empty());}
 	size_t size() const {return vldata_alloc.size();}
 	bool read_data_from_file(char const *const fn, int ltype);
-	bool write_data_to_file(char const *const fn, int ltype) const;
+	bool write_data_to_file(char const *const fn, int ltype);
+	bool has_pending_reads() const {return !pending_reads.empty();}
+	unsigned decode_pending_reads(unsigned max_chunks, unsigned y_range[2]=nullptr); // max_chunks=0 => decode all; returns the rows decoded in y_range
+	void finish_pending_reads() {decode_pending_reads(0);}
 	void clear_lighting_values(int ltype);
 	bool is_valid_cell(int x, int y, int z) const;
 	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking
@@ -74,6 +83,7 @@ public:
 	template<typename T> void alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell);
 	void init_from(lmap_manager_t const &src);
 	void copy_data(lmap_manager_t const &src, float blend_weight=1.0);
+	float copy_scaled_lighting_values(lmap_manager_t const &src, int ltype, float scale);
 };
 
 
@@ -94,6 +104,8 @@ class light_volume_local : public light_grid_base {
 	unsigned get_num_data() const {return (bounds[0][1] - bounds[0][0])*(bounds[1][1] - bounds[1][0])*(bounds[2][1] - bounds[2][0]);}
 	bool read(std::string const &filename);
 	bool write(std::string const &filename) const;
+	bool read_cache(std::string const &filename);
+	bool write_cache(std::string const &filename) const;
 	void compress(bool verbose);
 public:
 
@@ -330,6 +342,7 @@ public:
 
 // from ray_trace.cpp
 void check_for_lighting_finished();
+void finish_progressive_lighting();
 void compute_ray_trace_lighting(unsigned ltype, bool verbose);
 unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const &p2, float weight, colorRGBA const &color, int ltype, bool first_pt);
 // from lightmap.cpp
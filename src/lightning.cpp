@@ -40,7 +40,7 @@ void do_lightning_damage(point &pos, float damage, int hit_water);
 
 inline float get_lit_h(int xpos, int ypos) {
 	float h(h_collision_matrix[ypos][xpos]);
-	if (!v_collision_matrix[ypos][xpos].cvals.empty()) {h = max(h, v_collision_matrix[ypos][xpos].zmax);}
+	if (v_collision_grid.has_cobjs(xpos, ypos)) {h = max(h, v_collision_grid.get_zmax(xpos, ypos));}
 	return h;
 }
 
@@ -0,0 +1,338 @@
+// 3D World - Compressed Lightmap Cache Files
+// by Frank Gennari
+// 10/18/26
+
+#include "function_registry.h"
+#include "lightmap.h"
+#include "binary_file_io.h"
+#include <glm/gtc/packing.hpp> // for packHalf1x16()/unpackHalf1x16()
+
+// Lightmap cache file layout: lmap_cache_header_t, num_chunks lmap_cache_chunk_t entries, then chunk data.
+// Each chunk covers a square block of lightmap columns and starts with a bitmask of the columns that were stored;
+// unallocated columns and columns where this lighting type is all zeros are omitted.
+// Each stored column is dsz float channel scales followed by zsize*dsz half floats of value/scale.
+// Files are memory mapped and decoded a few chunks per frame, so only the pages that have been decoded are read from disk.
+// Local light volume files use the same column encoding after a llvol_cache_header_t, with one bit per column in the volume bounds.
+
+unsigned const LMAP_CACHE_VERSION    = 1;
+unsigned const LMAP_CACHE_CHUNK_SIZE = 16; // in columns
+unsigned const LMAP_CACHE_MASK_BYTES = LMAP_CACHE_CHUNK_SIZE*LMAP_CACHE_CHUNK_SIZE/8;
+char const lmap_cache_magic [4] = {'3', 'D', 'L', 'M'};
+char const llvol_cache_magic[4] = {'3', 'D', 'L', 'V'};
+
+bool compress_lighting_files(0);
+unsigned lighting_cache_chunks_per_frame(64); // 0 = decode the entire file on load
+
+using std::string;
+using std::cerr;
+
+
+struct lmap_cache_header_t {
+	char magic[4];
+	unsigned version, ltype, dsz, xsize, ysize, zsize, num_cells, chunk_size, num_chunks;
+};
+
+struct lmap_cache_chunk_t {
+	uint64_t offset; // from the start of the file
+	unsigned num_cols, data_size;
+};
+
+struct llvol_cache_header_t {
+	char magic[4];
+	unsigned version;
+	int bounds[3][2];
+};
+
+struct lmap_manager_t::pending_read_t {
+	mapped_file_t file;
+	string filename;
+	int ltype;
+	unsigned nx, next_chunk, num_chunks, num_errors;
+	pending_read_t() : ltype(0), nx(0), next_chunk(0), num_chunks(0), num_errors(0) {}
+};
+
+
+bool is_lighting_cache_file(string const &filename, bool is_llvol) {
+
+	FILE *fp(fopen(filename.c_str(), "rb"));
+	if (fp == nullptr) return 0;
+	char magic[4] = {0};
+	bool const ret(fread(magic, 1, 4, fp) == 4 && memcmp(magic, (is_llvol ? llvol_cache_magic : lmap_cache_magic), 4) == 0);
+	fclose(fp);
+	return ret;
+}
+
+unsigned get_encoded_column_size(unsigned dsz, unsigned zsize) {return dsz*(sizeof(float) + zsize*sizeof(uint16_t));}
+
+// cells points to the first channel of the first cell, and stride is the number of bytes between cells;
+// returns false and writes nothing if all values are zero
+bool encode_lmap_column(unsigned char const *const cells, unsigned stride, unsigned dsz, unsigned zsize, vector<unsigned char> &out) {
+
+	assert(dsz <= 4);
+	float scales[4] = {0.0, 0.0, 0.0, 0.0};
+
+	for (unsigned z = 0; z < zsize; ++z) {
+		float const *const vals((float const *)(cells + z*stride));
+		for (unsigned n = 0; n < dsz; ++n) {scales[n] = max(scales[n], fabs(vals[n]));}
+	}
+	if (scales[0] == 0.0 && scales[1] == 0.0 && scales[2] == 0.0 && scales[3] == 0.0) return 0;
+	size_t pos(out.size());
+	out.resize(pos + get_encoded_column_size(dsz, zsize));
+	memcpy(&out[pos], scales, dsz*sizeof(float));
+	pos += dsz*sizeof(float);
+
+	for (unsigned z = 0; z < zsize; ++z) {
+		float const *const vals((float const *)(cells + z*stride));
+
+		for (unsigned n = 0; n < dsz; ++n) {
+			uint16_t const h((scales[n] == 0.0) ? 0 : glm::packHalf1x16(vals[n]/scales[n])); // scaled to [-1, 1] to avoid half float overflow
+			memcpy(&out[pos], &h, sizeof(uint16_t));
+			pos += sizeof(uint16_t);
+		}
+	}
+	assert(pos == out.size());
+	return 1;
+}
+
+void decode_lmap_column(unsigned char const *ptr, unsigned char *const cells, unsigned stride, unsigned dsz, unsigned zsize) {
+
+	assert(dsz <= 4);
+	float scales[4] = {0.0, 0.0, 0.0, 0.0};
+	memcpy(scales, ptr, dsz*sizeof(float)); // may be unaligned
+	ptr += dsz*sizeof(float);
+
+	for (unsigned z = 0; z < zsize; ++z) {
+		float *const vals((float *)(cells + z*stride));
+
+		for (unsigned n = 0; n < dsz; ++n) {
+			uint16_t h(0);
+			memcpy(&h, ptr, sizeof(uint16_t));
+			ptr += sizeof(uint16_t);
+			vals[n] = scales[n]*glm::unpackHalf1x16(h);
+		}
+	}
+}
+
+void zero_lmap_column(unsigned char *const cells, unsigned stride, unsigned dsz, unsigned zsize) {
+	for (unsigned z = 0; z < zsize; ++z) {
+		float *const vals((float *)(cells + z*stride));
+		for (unsigned n = 0; n < dsz; ++n) {vals[n] = 0.0;}
+	}
+}
+
+
+// *** lmap_manager_t ***
+
+
+bool lmap_manager_t::write_cache_file(char const *const fn, int ltype) const {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return 0;
+	cout << "Writing lighting cache file to " << fn << endl;
+	unsigned const dsz(lmcell::get_dsz(ltype)), cs(LMAP_CACHE_CHUNK_SIZE), nx((lm_xsize + cs - 1)/cs), ny((lm_ysize + cs - 1)/cs);
+	lmap_cache_header_t header;
+	memcpy(header.magic, lmap_cache_magic, 4);
+	header.version    = LMAP_CACHE_VERSION;
+	header.ltype      = ltype;
+	header.dsz        = dsz;
+	header.xsize      = lm_xsize;
+	header.ysize      = lm_ysize;
+	header.zsize      = lm_zsize;
+	header.num_cells  = (unsigned)vldata_alloc.size();
+	header.chunk_size = cs;
+	header.num_chunks = nx*ny;
+	vector<lmap_cache_chunk_t> chunks(header.num_chunks);
+	vector<vector<unsigned char>> chunk_data(header.num_chunks);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < (int)chunks.size(); ++c) { // chunks are independent
+		unsigned const x1((c%nx)*cs), y1((c/nx)*cs), x2(min(x1+cs, lm_xsize)), y2(min(y1+cs, lm_ysize));
+		vector<unsigned char> &data(chunk_data[c]);
+		data.resize(LMAP_CACHE_MASK_BYTES, 0);
+		chunks[c].num_cols = 0;
+
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = x1; x < x2; ++x) {
+				lmcell const *const col(vlmap[y][x]);
+				if (col == NULL) continue; // not allocated
+				if (!encode_lmap_column((unsigned char const *)col->get_offset(ltype), sizeof(lmcell), dsz, lm_zsize, data)) continue; // all zeros
+				unsigned const bit((y - y1)*cs + (x - x1));
+				data[bit >> 3] |= (1 << (bit & 7));
+				++chunks[c].num_cols;
+			}
+		}
+		chunks[c].data_size = (unsigned)data.size();
+	} // for c
+	uint64_t offset(sizeof(lmap_cache_header_t) + chunks.size()*sizeof(lmap_cache_chunk_t));
+	unsigned num_cols(0);
+
+	for (unsigned c = 0; c < chunks.size(); ++c) {
+		chunks[c].offset = offset;
+		offset   += chunks[c].data_size;
+		num_cols += chunks[c].num_cols;
+	}
+	if (!writer.write(&header, sizeof(lmap_cache_header_t), 1) || !writer.write(chunks.data(), sizeof(lmap_cache_chunk_t), chunks.size())) {
+		cerr << "Error writing header to lighting cache file " << fn << endl;
+		return 0;
+	}
+	for (vector<unsigned char> const &data : chunk_data) {
+		if (!writer.write(data.data(), 1, data.size())) {
+			cerr << "Error writing data to lighting cache file " << fn << endl;
+			return 0;
+		}
+	}
+	cout << "Wrote " << num_cols << " of " << vldata_alloc.size()/max(lm_zsize, 1U) << " columns, " << offset << " bytes vs. "
+		 << vldata_alloc.size()*dsz*sizeof(float) << " uncompressed" << endl;
+	return 1;
+}
+
+
+bool lmap_manager_t::read_cache_file(char const *const fn, int ltype) {
+
+	auto pr(std::make_shared<pending_read_t>());
+	mapped_file_t &file(pr->file);
+
+	if (!file.open(fn)) {
+		cerr << "Error: Failed to open lighting cache file " << fn << endl;
+		return 0;
+	}
+	unsigned const dsz(lmcell::get_dsz(ltype)), cs(LMAP_CACHE_CHUNK_SIZE), nx((lm_xsize + cs - 1)/cs), ny((lm_ysize + cs - 1)/cs);
+	lmap_cache_header_t header;
+
+	if (!file.read_at(0, header) || memcmp(header.magic, lmap_cache_magic, 4) != 0 || header.version != LMAP_CACHE_VERSION) {
+		cerr << "Error: Lighting cache file " << fn << " has an invalid header or unsupported version. Ignoring file." << endl;
+		return 0;
+	}
+	if (header.ltype != (unsigned)ltype || header.dsz != dsz || header.xsize != lm_xsize || header.ysize != lm_ysize || header.zsize != lm_zsize ||
+		header.num_cells != vldata_alloc.size() || header.chunk_size != cs || header.num_chunks != nx*ny)
+	{
+		cerr << "Error: Lighting cache file " << fn << " was written for a different lighting type or lightmap size. Ignoring file." << endl;
+		return 0;
+	}
+	if (sizeof(lmap_cache_header_t) + header.num_chunks*sizeof(lmap_cache_chunk_t) > file.size()) {
+		cerr << "Error: Lighting cache file " << fn << " is truncated. Ignoring file." << endl;
+		return 0;
+	}
+	cout << "Reading lighting cache file from " << fn << endl;
+	pr->filename   = fn;
+	pr->ltype      = ltype;
+	pr->nx         = nx;
+	pr->num_chunks = header.num_chunks;
+
+	for (auto i = pending_reads.begin(); i != pending_reads.end(); ++i) { // replace any previous read of this ltype
+		if ((*i)->ltype == ltype) {pending_reads.erase(i); break;}
+	}
+	pending_reads.push_back(pr);
+	if (lighting_cache_chunks_per_frame == 0) {finish_pending_reads();}
+	return 1;
+}
+
+
+unsigned lmap_manager_t::decode_pending_reads(unsigned max_chunks, unsigned y_range[2]) {
+
+	unsigned num_decoded(0);
+	if (y_range) {y_range[0] = lm_ysize; y_range[1] = 0;}
+
+	while (!pending_reads.empty() && (max_chunks == 0 || num_decoded < max_chunks)) {
+		pending_read_t &pr(*pending_reads.front());
+		unsigned const dsz(lmcell::get_dsz(pr.ltype)), cs(LMAP_CACHE_CHUNK_SIZE);
+		unsigned const num(min((pr.num_chunks - pr.next_chunk), ((max_chunks == 0) ? pr.num_chunks : (max_chunks - num_decoded))));
+		size_t const file_size(pr.file.size());
+		unsigned char const *const file_data(pr.file.get_data());
+		unsigned num_errors(0);
+
+#pragma omp parallel for schedule(dynamic) reduction(+:num_errors) if (num > 1)
+		for (int i = 0; i < (int)num; ++i) { // chunks write to disjoint columns
+			unsigned const c(pr.next_chunk + i), x1((c%pr.nx)*cs), y1((c/pr.nx)*cs), x2(min(x1+cs, lm_xsize)), y2(min(y1+cs, lm_ysize));
+			lmap_cache_chunk_t chunk;
+			if (!pr.file.read_at(sizeof(lmap_cache_header_t) + c*sizeof(lmap_cache_chunk_t), chunk) ||
+				chunk.data_size < LMAP_CACHE_MASK_BYTES || chunk.offset + chunk.data_size > file_size) {++num_errors; continue;}
+			unsigned char const *const mask(file_data + chunk.offset), *const end(mask + chunk.data_size);
+			unsigned char const *ptr(mask + LMAP_CACHE_MASK_BYTES);
+			unsigned const col_sz(get_encoded_column_size(dsz, lm_zsize));
+
+			for (unsigned y = y1; y < y2; ++y) {
+				for (unsigned x = x1; x < x2; ++x) {
+					unsigned const bit((y - y1)*cs + (x - x1));
+					bool const is_stored((mask[bit >> 3] & (1 << (bit & 7))) != 0);
+					lmcell *const col(vlmap[y][x]);
+					if (col == NULL) {num_errors += is_stored; continue;} // stored column should have been allocated
+					unsigned char *const cells((unsigned char *)col->get_offset(pr.ltype));
+					if (!is_stored) {zero_lmap_column(cells, sizeof(lmcell), dsz, lm_zsize); continue;} // all zeros
+					if (ptr + col_sz > end) {++num_errors; continue;}
+					decode_lmap_column(ptr, cells, sizeof(lmcell), dsz, lm_zsize);
+					ptr += col_sz;
+				}
+			}
+		} // for i
+		if (y_range && num > 0) {
+			y_range[0] = min(y_range[0], (pr.next_chunk/pr.nx)*cs);
+			y_range[1] = max(y_range[1], min(((pr.next_chunk + num - 1)/pr.nx + 1)*cs, lm_ysize));
+		}
+		pr.next_chunk += num;
+		pr.num_errors += num_errors;
+		num_decoded   += num;
+		if (pr.next_chunk < pr.num_chunks) continue; // more chunks remain
+		if (pr.num_errors > 0) {cerr << "Error: Lighting cache file " << pr.filename << " is corrupt; " << pr.num_errors << " chunks or columns were not read." << endl;}
+		pending_reads.erase(pending_reads.begin()); // done, unmap the file
+	} // while
+	return num_decoded;
+}
+
+
+// *** light_volume_local ***
+
+
+bool light_volume_local::read_cache(string const &filename) {
+
+	assert(!is_allocated());
+	mapped_file_t file;
+	llvol_cache_header_t header;
+
+	if (!file.open(filename) || !file.read_at(0, header) || memcmp(header.magic, llvol_cache_magic, 4) != 0 || header.version != LMAP_CACHE_VERSION) {
+		cerr << "Error: Failed to read header from light volume file '" << filename << "'." << endl;
+		return 0;
+	}
+	memcpy(bounds, header.bounds, sizeof(bounds));
+	unsigned const xsize(bounds[0][1] - bounds[0][0]), ysize(bounds[1][1] - bounds[1][0]), zsize(bounds[2][1] - bounds[2][0]), dsz(3);
+	unsigned const num_cols(xsize*ysize), col_sz(get_encoded_column_size(dsz, zsize));
+	data.resize(get_num_data()); // init to all zeros
+	unsigned char const *const mask(file.get_data() + sizeof(llvol_cache_header_t)), *const end(file.get_data() + file.size());
+	unsigned char const *ptr(mask + (num_cols + 7)/8);
+	if (ptr > end) {cerr << "Error: Failed to read data from light volume file '" << filename << "'." << endl; data.clear(); return 0;}
+
+	for (unsigned c = 0; c < num_cols; ++c) { // columns are in the same {y, x} order as data
+		if (!(mask[c >> 3] & (1 << (c & 7)))) continue; // all zeros
+		if (ptr + col_sz > end) {cerr << "Error: Failed to read data from light volume file '" << filename << "'." << endl; data.clear(); return 0;}
+		decode_lmap_column(ptr, (unsigned char *)data[c*zsize].lc, sizeof(lmcell_local), dsz, zsize);
+		ptr += col_sz;
+	}
+	compressed = 1; // llvols are always written compressed
+	changed    = 1;
+	cout << "Read light volume cache file '" << filename << "'." << endl;
+	return 1;
+}
+
+bool light_volume_local::write_cache(string const &filename) const {
+
+	assert(is_allocated());
+	assert(compressed); // llvols are always written compressed
+	binary_file_writer writer;
+	if (!writer.open(filename)) return 0;
+	llvol_cache_header_t header;
+	memcpy(header.magic, llvol_cache_magic, 4);
+	header.version = LMAP_CACHE_VERSION;
+	memcpy(header.bounds, bounds, sizeof(bounds));
+	unsigned const xsize(bounds[0][1] - bounds[0][0]), ysize(bounds[1][1] - bounds[1][0]), zsize(bounds[2][1] - bounds[2][0]), num_cols(xsize*ysize);
+	vector<unsigned char> out((num_cols + 7)/8, 0); // column mask followed by column data
+
+	for (unsigned c = 0; c < num_cols; ++c) {
+		if (encode_lmap_column((unsigned char const *)data[c*zsize].lc, sizeof(lmcell_local), 3, zsize, out)) {out[c >> 3] |= (1 << (c & 7));}
+	}
+	if (!writer.write(&header, sizeof(llvol_cache_header_t), 1) || !writer.write(out.data(), 1, out.size())) {
+		cerr << "Error: Failed to write light volume file '" << filename << "'." << endl;
+		return 0;
+	}
+	cout << "Wrote light volume cache file '" << filename << "' of " << (sizeof(llvol_cache_header_t) + out.size()) << " bytes." << endl;
+	return 1;
+}
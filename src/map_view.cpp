@@ -232,7 +232,7 @@ void draw_overhead_map() {
 						if (over_mesh && czmin < czmax) { // check cobjs
 							// Note: as an optimization, can skip the cobj test if no cobjs at this pos, but it makes little difference and will miss dynamic objects
 							//int const xpos(get_xpos(xval)), ypos(get_ypos(yval));
-							//if (point_outside_mesh(xpos, ypos) || v_collision_matrix[ypos][xpos].zmin == v_collision_matrix[ypos][xpos].zmax) {}
+							//if (point_outside_mesh(xpos, ypos) || v_collision_grid.get_zmin(xpos, ypos) == v_collision_grid.get_zmax(xpos, ypos)) {}
 							point p2(xval, yval, max(mh, czmin));
 							float t;
 							int cindex0(-1);
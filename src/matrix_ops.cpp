@@ -33,7 +33,6 @@ float     **mesh_height = NULL;
 float     **z_min_matrix = NULL;
 float     **accumulation_matrix = NULL;
 float     **h_collision_matrix = NULL;
-coll_cell **v_collision_matrix = NULL; // *** should use 3X 1D arrays ***
 float     **water_matrix = NULL;
 short     **spillway_matrix = NULL;
 surf_adv  **w_motion_matrix = NULL;
@@ -101,7 +100,7 @@ void alloc_matrices() { // called at the beginning of main()
 	matrix_gen_2d(z_min_matrix);
 	matrix_gen_2d(accumulation_matrix);
 	matrix_gen_2d(h_collision_matrix);
-	matrix_gen_2d(v_collision_matrix);
+	v_collision_grid.init(MESH_X_SIZE, MESH_Y_SIZE);
 	matrix_gen_2d(water_matrix);
 	matrix_gen_2d(spillway_matrix);
 	matrix_gen_2d(w_motion_matrix);
@@ -125,7 +124,7 @@ void delete_matrices() { // called at the end of main()
 	matrix_delete_2d(z_min_matrix);
 	matrix_delete_2d(accumulation_matrix);
 	matrix_delete_2d(h_collision_matrix);
-	matrix_delete_2d(v_collision_matrix);
+	v_collision_grid.init(0, 0);
 	matrix_delete_2d(water_matrix);
 	matrix_delete_2d(spillway_matrix);
 	matrix_delete_2d(w_motion_matrix);
@@ -34,6 +34,7 @@ class mesh_xy_grid_cache_t {
 
 	void run_gpu_simplex();
 	void cache_gpu_simplex_vals();
+	void gen_cpu_simplex_vals(unsigned num_octaves);
 
 public:
 	mesh_xy_grid_cache_t() : cur_nx(0), cur_ny(0), yterms_start(0), tid(0), mx0(0.0), my0(0.0), mdx(0.0), mdy(0.0), sine_offset(0.0),
@@ -114,7 +115,7 @@ extern float     **mesh_height;
 extern float     **z_min_matrix;
 extern float     **accumulation_matrix;
 extern float     **h_collision_matrix;
-extern coll_cell **v_collision_matrix;
+extern coll_cell_grid_t v_collision_grid;
 extern float     **water_matrix;
 extern short     **spillway_matrix;
 extern surf_adv  **w_motion_matrix;
@@ -48,7 +48,7 @@ vector<float> height_histogram;
 hmap_params_t hmap_params;
 
 
-extern bool combined_gu;
+extern bool combined_gu, cpu_noise_gen;
 extern int xoff, yoff, xoff2, yoff2, world_mode, rand_gen_index, mesh_rgen_index, mesh_scale_change, display_mode;
 extern int read_heightmap, read_landscape, do_read_mesh, mesh_seed, scrolling, camera_mode, invert_mh_image;
 extern unsigned erosion_iters;
@@ -599,6 +599,10 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	cached_vals.clear();
 
 	if (gen_mode >= MGEN_SIMPLEX_GPU) { // GPU simplex noise - always cache values
+		if (cpu_noise_gen || benchmark_cpu_only()) { // same results as the shader, but computed on the CPU
+			gen_cpu_simplex_vals(9); // 9 octaves, to match the shader
+			return 1;
+		}
 		bool const is_running(cshader && cshader->get_is_running());
 		if (!is_running) {run_gpu_simplex();} // launch the job
 		if (no_wait && !is_running) return 0; // just started, results not yet available
@@ -626,7 +630,7 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 			y_ptr[i*F_TABLE_SIZE] = y_scale*sin_val;
 		}
 	}
-	if (cache_values) {
+	if (cache_values) { // Note: MGEN_SIMPLEX doesn't use gen_cpu_simplex_vals() here because its results differ slightly from get_noise_zval()
 		cached_vals.resize(cur_nx*cur_ny);
 		
 #pragma omp parallel for schedule(static,1)
@@ -697,6 +701,26 @@ void mesh_xy_grid_cache_t::cache_gpu_simplex_vals() {
 	}
 }
 
+void mesh_xy_grid_cache_t::gen_cpu_simplex_vals(unsigned num_octaves) {
+
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), xscale(xy_scale*DX_VAL_INV), yscale(xy_scale*DY_VAL_INV), zscale(get_hmap_scale(gen_mode));
+	bool const postproc(hmap_params.need_postproc());
+	float rx, ry;
+	gen_rx_ry(rx, ry);
+	cached_vals.resize(cur_nx*cur_ny);
+
+#pragma omp parallel for schedule(static,1)
+	for (int y = 0; y < (int)cur_ny; ++y) {
+		float *const row(cached_vals.data() + y*cur_nx);
+		gen_simplex_height_row_simd(row, cur_nx, mx0*xscale, mdx*xscale, (y*mdy + my0)*yscale, rx, ry, num_octaves, gen_shape, (gen_mode == MGEN_DWARP_GPU));
+
+		for (unsigned x = 0; x < cur_nx; ++x) {
+			if (postproc) {postproc_noise_zval(row[x]);}
+			row[x] *= zscale;
+		}
+	}
+}
+
 void mesh_xy_grid_cache_t::clear_context() { // for GPU-mode cached state
 	free_texture(tid);
 	if (cshader != nullptr) {cshader->end_shader(); free_cshader();}
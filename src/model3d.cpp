@@ -10,7 +10,9 @@
 #include "voxels.h" // for get_cur_model_edges_as_cubes
 #include "csg.h" // for clip_polygon_to_cube
 #include "lightmap.h" // for lmap_manager_t
+#include "profiler.h"
 #include <fstream>
+#include <chrono>
 #include <queue>
 #include "meshoptimizer.h"
 
@@ -27,13 +29,15 @@ unsigned const BONE_IDS_LOC     = 4;
 unsigned const BONE_WEIGHTS_LOC = 5;
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
+bool async_model_texture_load(1); // decode model textures in parallel, and compress/create mipmaps in background jobs while drawing with placeholders
+float model_tex_upload_budget_ms(4.0); // main thread time for uploading model textures prepared in background jobs per frame; 0 = unlimited
 
 extern bool group_back_face_cull, enable_model3d_tex_comp, disable_shader_effects, texture_alpha_in_red_comp, use_model2d_tex_mipmaps, enable_model3d_bump_maps;
 extern bool two_sided_lighting, have_indir_smoke_tex, use_core_context, model3d_wn_normal, invert_model_nmap_bscale, use_z_prepass, all_model3d_ref_update;
 extern bool use_interior_cube_map_refl, enable_model3d_custom_mipmaps, enable_tt_model_indir, no_subdiv_model, auto_calc_tt_model_zvals, use_model_lod_blocks;
 extern bool flatten_tt_mesh_under_models, no_store_model_textures_in_memory, disable_model_textures, allow_model3d_quads, merge_model_objects;
 extern unsigned shadow_map_sz, reflection_tid;
-extern int display_mode;
+extern int display_mode, frame_counter;
 extern float model3d_alpha_thresh, model3d_texture_anisotropy, model_triplanar_tc_scale, model_mat_lod_thresh, cobj_z_bias, model_hemi_lighting_scale, light_int_scale[];
 extern double tfticks;
 extern pos_dir_up orig_camera_pdu;
@@ -75,23 +79,32 @@ unsigned texture_manager::create_texture(string const &fn, bool is_alpha_mask, b
 	// always RGB wrapped+mipmap (normal map flag set later)
 	textures.push_back(texture_t(0, 7, 0, 0, (mirror ? 2 : (wrap ? 1 : 0)), ncolors, use_mipmaps, fn, invert_y, compress, model3d_texture_anisotropy, 1.0, is_nm));
 	textures.back().invert_alpha = invert_alpha;
+	tex_create_args_t args;
+	args.is_alpha_mask = is_alpha_mask; args.invert_alpha = invert_alpha; args.wrap = wrap; args.mirror = mirror;
+	args.force_grayscale = force_grayscale; args.is_nm = is_nm; args.invert_y = invert_y;
+	create_args.push_back(args);
 	return tid; // can't fail
 }
 
 void texture_manager::clear() {
 
+	cancel_pending_uploads();
 	free_textures();
 	textures.clear();
+	create_args.clear();
 	tex_map.clear();
 }
 
 void texture_manager::free_tids() {
+	cancel_pending_uploads(); // textures will be uploaded synchronously if they're still needed
 	for (auto &t : textures) {t.gl_delete();}
 }
 void texture_manager::free_textures() {
+	cancel_pending_uploads();
 	for (auto &t : textures) {t.free_data();}
 }
 void texture_manager::free_client_mem() { // Note: should not be called if model textures can overlap with predefined textures
+	upload_all_pending(); // the data is still needed
 	for (auto &t : textures) {t.free_client_mem();}
 }
 
@@ -104,10 +117,13 @@ bool texture_manager::ensure_texture_loaded(int tid, bool is_bump) {
 	// Note: it's incorrect to call t.has_alpha() here because that uses color, which hasn't been computed yet (t.init() is called later);
 	// but that's okay, do_gl_init() will disable custom mipmaps for textures with color.A == 1.0
 	if (use_model2d_tex_mipmaps && enable_model3d_custom_mipmaps /*&& t.has_alpha()*/) {t.use_mipmaps = 4;}
+	texture_levels_t levels;
+	if (try_load_from_cache(tid, is_bump, levels)) {pending_uploads[tid].levels.swap(levels); return 1;} // uploaded by ensure_tid_bound()
 	t.load(-1);
 		
 	if (t.alpha_tid >= 0 && t.alpha_tid != tid) { // if alpha is the same texture then the alpha channel should already be set
 		ensure_tid_loaded(t.alpha_tid, 0);
+		get_texture(t.alpha_tid).ensure_data_loaded();
 		t.copy_alpha_from_texture(get_texture(t.alpha_tid), texture_alpha_in_red_comp);
 	}
 	if (is_bump) {t.make_normal_map();}
@@ -136,12 +152,152 @@ void texture_manager::add_work_item(int tid, bool is_nm) {
 	if (get_texture(tid).is_loaded() || get_texture(tid).is_bound()) return; // already loaded or bound, nothing to do
 	to_load.emplace_back(tid, is_nm);
 }
-void texture_manager::load_work_items_mt() {
+void texture_manager::load_work_items_mt() { // same result as calling ensure_texture_loaded() on each work item
+
 	if (to_load.empty()) return; // nothing to do
 	sort_and_unique(to_load);
-#pragma omp parallel for schedule(dynamic)
-	for (int i = 0; i < (int)to_load.size(); ++i) {ensure_texture_loaded(to_load[i].tid, to_load[i].is_nm);}
+	vector<tex_work_item_t> work;
+
+	for (tex_work_item_t const &w : to_load) {
+		if (!work.empty() && work.back().tid == w.tid) continue; // each texture must only be loaded once; the first is_nm value is used, as in the serial flow
+		texture_t &t(get_texture(w.tid));
+		if (t.is_loaded() || t.is_bound()) continue; // loaded by an earlier work item
+		if (use_model2d_tex_mipmaps && enable_model3d_custom_mipmaps) {t.use_mipmaps = 4;}
+		work.push_back(w);
+	}
 	to_load.clear();
+	// read texture cache files in parallel; cached textures have their final mipmap levels and need no other processing
+	vector<texture_levels_t> cached(work.size());
+	parallel_for_jobs(0, work.size(), [&](int i) {try_load_from_cache(work[i].tid, work[i].is_nm, cached[i]);});
+	unsigned num_to_decode(0);
+
+	for (unsigned i = 0; i < work.size(); ++i) {
+		if (cached[i].empty()) {work[num_to_decode++] = work[i];} // not cached
+		else {pending_uploads[work[i].tid].levels.swap(cached[i]);}
+	}
+	work.erase(work.begin()+num_to_decode, work.end());
+	// read and decode files in parallel; word alignment is fixed later because resize() makes GL calls
+	parallel_for_jobs(0, work.size(), [&](int i) {get_texture(work[i].tid).load(-1, 0, 0, 1);});
+	// serial steps that may resize textures
+	for (tex_work_item_t const &w : work) {get_texture(w.tid).fix_word_alignment();}
+
+	for (tex_work_item_t const &w : work) {
+		texture_t &t(get_texture(w.tid));
+		if (t.alpha_tid < 0 || t.alpha_tid == (int)w.tid) continue; // if alpha is the same texture then the alpha channel should already be set
+		ensure_tid_loaded(t.alpha_tid, 0);
+		get_texture(t.alpha_tid).ensure_data_loaded();
+		t.copy_alpha_from_texture(get_texture(t.alpha_tid), texture_alpha_in_red_comp);
+	}
+	// normal maps and average colors in parallel; must be after alpha copy
+	parallel_for_jobs(0, work.size(), [&](int i) {
+		texture_t &t(get_texture(work[i].tid));
+		if (work[i].is_nm) {t.make_normal_map();}
+		t.init();
+	});
+}
+
+// Model texture upload pipeline: textures are read and decoded in parallel by load_work_items_mt(), compressed and mipmapped in background jobs
+// started by prepare_uploads_async(), then uploaded by the main thread in upload_ready_textures(), up to model_tex_upload_budget_ms per frame.
+// Until then, bind_texture() binds a 1x1 texture of the texture's average color. Textures read from the texture cache skip directly to the upload.
+void texture_manager::prepare_uploads_async() {
+
+	vector<uint8_t> is_alpha_src(textures.size(), 0);
+
+	for (unsigned tid = 0; tid < textures.size(); ++tid) {
+		int const alpha_tid(textures[tid].alpha_tid);
+		if (alpha_tid >= 0 && alpha_tid != (int)tid) {is_alpha_src[alpha_tid] = 1;}
+	}
+	for (unsigned tid = 0; tid < textures.size(); ++tid) {
+		texture_t const &t(textures[tid]);
+		if (!t.is_allocated() || t.is_bound() || t.defer_load() || is_upload_pending(tid)) continue; // DDS textures are uploaded directly
+		// textures whose alpha was copied into another texture are never bound for that use; if also used directly, ensure_tid_bound() handles them
+		if (is_alpha_src[tid]) continue;
+		pending_upload_t &pu(pending_uploads[tid]); // map entries and deque elements aren't moved by insertions
+		bool const cache(can_cache_texture(tid));
+
+		pu.job = add_background_job([this, tid, cache, &t, &pu]() {
+			t.calc_gl_levels(pu.levels, cache);
+			if (cache) {maybe_write_to_cache(tid, pu.levels);}
+		}, vector<job_handle_t>(), "Texture Mipmaps");
+	}
+}
+
+void texture_manager::ensure_tid_bound(int tid) { // if allocated
+
+	if (tid < 0) return;
+	auto it(pending_uploads.find(tid));
+
+	if (it != pending_uploads.end()) { // read from the texture cache, or being prepared in a background job
+		if (async_model_texture_load) return; // uploaded later by upload_ready_textures()
+		upload_texture(tid, it->second);
+		pending_uploads.erase(it);
+		return;
+	}
+	texture_t &t(get_texture(tid));
+	if (t.is_bound()) return;
+	if (!t.is_allocated() || !can_cache_texture(tid)) {t.check_init(); return;}
+	texture_levels_t levels;
+	t.calc_gl_levels(levels, 1); // full_mip_chain=1
+	maybe_write_to_cache(tid, levels);
+	t.gl_init_from_levels(levels);
+}
+
+void texture_manager::upload_texture(unsigned tid, pending_upload_t &pu) {
+	wait_for_job(pu.job);
+	free_texture(pu.placeholder_tid);
+	get_texture(tid).gl_init_from_levels(pu.levels, no_store_model_textures_in_memory); // free client memory early if requested
+}
+
+void texture_manager::upload_ready_textures() { // called for each model drawn; the budget is shared by all texture managers
+
+	if (pending_uploads.empty()) return;
+	static int budget_frame(-1);
+	static float budget_used(0.0);
+	if (frame_counter != budget_frame) {budget_frame = frame_counter; budget_used = 0.0;}
+	unsigned num_uploaded(0);
+
+	for (unsigned pass = 0; pass < 2; ++pass) { // textures that were drawn with placeholders first, then the rest
+		for (auto i = pending_uploads.begin(); i != pending_uploads.end();) { // Note: no ++i
+			if (model_tex_upload_budget_ms > 0.0 && budget_used > model_tex_upload_budget_ms) break; // over budget, upload in a later frame
+			pending_upload_t &pu(i->second);
+			if ((pass == 0) != (pu.last_bind_frame >= 0) || !job_is_done(pu.job)) {++i; continue;}
+			auto const start(std::chrono::high_resolution_clock::now());
+			upload_texture(i->first, pu);
+			budget_used += 1000.0f*std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start).count();
+			pending_uploads.erase(i++);
+			++num_uploaded;
+		}
+	} // for pass
+	TRACE_COUNTER_ADD("Model Textures Uploaded", num_uploaded);
+}
+
+void texture_manager::upload_all_pending() {
+	for (auto &i : pending_uploads) {upload_texture(i.first, i.second);}
+	pending_uploads.clear();
+}
+
+void texture_manager::cancel_pending_uploads() {
+
+	for (auto &i : pending_uploads) {
+		wait_for_job(i.second.job); // the job references the texture
+		free_texture(i.second.placeholder_tid);
+	}
+	pending_uploads.clear();
+}
+
+void texture_manager::bind_texture(int tid) const {
+
+	auto it(pending_uploads.find(tid));
+	if (it == pending_uploads.end()) {get_texture(tid).bind_gl(); return;} // common case
+	pending_upload_t &pu(it->second);
+	pu.last_bind_frame = frame_counter;
+
+	if (pu.placeholder_tid == 0) { // create on first use
+		color_wrapper const cw(get_tex_avg_color(tid));
+		setup_texture(pu.placeholder_tid, 0, 0, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, cw.c);
+	}
+	else {bind_2d_texture(pu.placeholder_tid);}
 }
 
 texture_t &get_builtin_texture(int tid) {
@@ -1218,7 +1374,8 @@ void material_t::init_textures(texture_manager &tmgr) {
 	ensure_textures_loaded(tmgr);
 	might_have_alpha_comp |= tmgr.might_have_alpha_comp(tid);
 	
-	if (no_store_model_textures_in_memory) { // now that textures have been loaded, send the data to the GPU so that they can be freed early
+	// now that textures have been loaded, send the data to the GPU so that they can be freed early; async uploads free the data themselves
+	if (no_store_model_textures_in_memory && !async_model_texture_load) {
 		maybe_upload_and_free(tmgr, get_render_texture());
 		if (use_bump_map()) {maybe_upload_and_free(tmgr, bump_tid);}
 		if (use_spec_map()) {maybe_upload_and_free(tmgr, s_tid);}
@@ -1232,6 +1389,7 @@ void material_t::queue_textures_to_load(texture_manager &tmgr) {
 	int const tid(get_render_texture());
 	tmgr.bind_alpha_channel_to_texture(tid, alpha_tid);
 	tmgr.add_work_item(tid, 0);
+	if (tid >= 0 && alpha_tid != tid) {tmgr.add_work_item(alpha_tid, 0);} // loaded before its alpha channel is copied into tid
 	if (use_bump_map()) {tmgr.add_work_item(bump_tid, 1);} else {bump_tid = -1;}
 	if (use_spec_map()) {tmgr.add_work_item( s_tid,   0);} else {s_tid    = -1;}
 	if (use_spec_map()) {tmgr.add_work_item(ns_tid,   0);} else {ns_tid   = -1;}
@@ -1818,24 +1976,26 @@ void model3d::load_all_used_tids() {
 
 	if (textures_loaded) return; // is this safe to skip?
 	timer_t timer("Model3d Texture Load", !tmgr.empty());
-#if 0
-	// MT loading flow; will fail with an error if any textures require calling texture_t::resize() due to nested OpenGL calls;
-	// while this mostly works, it's only ~1s faster because of poor load balancing, and there's a lot of time taken later to compress, build mipmaps, and send to the GPU
-	// build a worklist of files to load from disk
-	for (auto &m : materials) {m.queue_textures_to_load(tmgr);}
-	// load the textures from disk in parallel; requires sorting and uniquing textures, which may be shared across multiple materials
-	tmgr.load_work_items_mt();
-	// run serial post load steps and make any required OpenGL calls
-#endif
+
+	if (async_model_texture_load) {
+		// build a worklist of files to load from disk
+		for (auto &m : materials) {m.queue_textures_to_load(tmgr);}
+		// load the textures from disk in parallel; requires sorting and uniquing textures, which may be shared across multiple materials
+		tmgr.load_work_items_mt();
+	}
+	// run serial post load steps
 	for (auto &m : materials) {m.init_textures(tmgr);}
 	textures_loaded = 1;
-	if (no_store_model_textures_in_memory) {tmgr.free_client_mem();}
+	// compression and mipmap creation is slower than loading, so do it in the background rather than blocking in the first bind_all_used_tids() call
+	if (async_model_texture_load) {tmgr.prepare_uploads_async();}
+	else if (no_store_model_textures_in_memory) {tmgr.free_client_mem();}
 }
 
 
 void model3d::bind_all_used_tids() {
 
 	load_all_used_tids();
+	tmgr.upload_ready_textures();
 		
 	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
 		if (!m->mat_is_used()) continue;
@@ -2488,6 +2648,87 @@ bool model3d::read_from_disk(string const &fn) { // as model3d file; Note: trans
 	return in.good();
 }
 
+// texture IDs are assigned at load time, so model cache data references textures by name and creation arguments instead
+int material_t::*const mat_tid_ptrs[7] = {&material_t::a_tid, &material_t::d_tid, &material_t::s_tid, &material_t::ns_tid, &material_t::alpha_tid, &material_t::bump_tid, &material_t::refl_tid};
+
+bool model3d::write_cache_data(ostream &out) const { // Note: transforms and animations not written
+
+	vector<int> tids;
+	map<int, unsigned> tid_to_ix;
+
+	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
+		for (unsigned n = 0; n < 7; ++n) {
+			int const tid((*m).*mat_tid_ptrs[n]);
+			if (tid >= 0 && tid_to_ix.insert(make_pair(tid, (unsigned)tids.size())).second) {tids.push_back(tid);}
+		}
+	}
+	write_uint(out, (unsigned)tids.size());
+
+	for (int tid : tids) {
+		bool const is_builtin(tid >= (int)BUILTIN_TID_START);
+		texture_manager::tex_create_args_t const args(is_builtin ? texture_manager::tex_create_args_t() : tmgr.get_create_args(tid));
+		write_uint(out, is_builtin);
+		write_vector(out, tmgr.get_texture(tid).name);
+		out.write((char const *)&args, sizeof(args));
+	}
+	out.write((char const *)&bcube, sizeof(cube_t));
+	if (!unbound_geom.write(out)) return 0;
+	write_uint(out, (unsigned)materials.size());
+
+	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
+		if (!m->write(out)) return 0;
+
+		for (unsigned n = 0; n < 7; ++n) {
+			int const tid((*m).*mat_tid_ptrs[n]);
+			write_uint(out, ((tid >= 0) ? tid_to_ix[tid] : ~0U));
+		}
+		out.write((char const *)&m->metalness, sizeof(float));
+		write_uint(out, m->might_have_alpha_comp);
+	}
+	return out.good();
+}
+
+bool model3d::read_cache_data(istream &in) { // returns false if the data is invalid or references textures that no longer exist
+
+	clear();
+	vector<int> tids(read_uint(in), -1);
+	string name;
+
+	for (int &tid : tids) {
+		bool const is_builtin(read_uint(in) != 0);
+		texture_manager::tex_create_args_t args;
+		read_vector(in, name);
+		in.read((char *)&args, sizeof(args));
+		if (!in.good()) return 0;
+
+		if (is_builtin) {
+			int const builtin_tid(texture_lookup(name));
+			if (builtin_tid < 0) {cerr << "Error: Texture " << name << " used by model cache file was not found" << endl; return 0;}
+			tid = BUILTIN_TID_START + builtin_tid;
+		}
+		else {
+			tid = tmgr.create_texture(name, args.is_alpha_mask, 0, args.invert_alpha, args.wrap, args.mirror, args.force_grayscale, args.is_nm, args.invert_y);
+		}
+	} // for tid
+	in.read((char *)&bcube, sizeof(cube_t));
+	if (!unbound_geom.read(in)) return 0;
+	materials.resize(read_uint(in));
+
+	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
+		if (!m->read(in)) return 0;
+
+		for (unsigned n = 0; n < 7; ++n) {
+			unsigned const ix(read_uint(in));
+			if (ix != ~0U && ix >= tids.size()) return 0; // invalid
+			(*m).*mat_tid_ptrs[n] = ((ix == ~0U) ? -1 : tids[ix]);
+		}
+		in.read((char *)&m->metalness, sizeof(float));
+		m->might_have_alpha_comp = (read_uint(in) != 0);
+		mat_map[m->name] = (m - materials.begin());
+	}
+	return in.good();
+}
+
 bool model3d::write_as_obj_file(string const &fn) {
 
 	ofstream out(fn, ios::out);
@@ -8,6 +8,7 @@
 #include "cobj_bsp_tree.h" // for cobj_tree_tquads_t
 #include "shadow_map.h" // for smap_data_t and rotation_t
 #include "gl_ext_arb.h"
+#include "job_system.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
@@ -428,11 +429,31 @@ class texture_manager {
 		bool operator< (tex_work_item_t const &w) const {return ((tid == w.tid) ? (is_nm < w.is_nm) : (tid < w.tid));}
 		bool operator==(tex_work_item_t const &w) const {return (tid == w.tid && is_nm == w.is_nm);}
 	};
+	struct pending_upload_t { // compressed data and mipmaps created in a background job, waiting to be uploaded by the main thread
+		job_handle_t job;
+		texture_levels_t levels;
+		unsigned placeholder_tid=0; // 1x1 texture of the average color that's bound until the texture is uploaded
+		int last_bind_frame=-1;
+	};
+public:
+	struct tex_create_args_t { // arguments passed to create_texture(), so that textures can be recreated from model cache files
+		bool is_alpha_mask=0, invert_alpha=0, wrap=1, mirror=0, force_grayscale=0, is_nm=0, invert_y=0, unused=0;
+	};
 protected:
 	deque<texture_t> textures;
+	vector<tex_create_args_t> create_args; // one per texture
 	string_map_t tex_map; // maps texture filenames to texture indexes
 	vector<tex_work_item_t> to_load;
+	mutable map<unsigned, pending_upload_t> pending_uploads; // by tid; mutable because placeholders are created in bind_texture()
+
+	void upload_texture(unsigned tid, pending_upload_t &pu);
+	void cancel_pending_uploads();
+	bool can_cache_texture(unsigned tid) const;
+	uint64_t get_cache_params_hash(unsigned tid, bool normal_map) const;
+	bool try_load_from_cache(unsigned tid, bool is_bump, texture_levels_t &levels);
+	void maybe_write_to_cache(unsigned tid, texture_levels_t const &levels) const;
 public:
+	~texture_manager() {cancel_pending_uploads();} // background jobs reference the textures
 	unsigned create_texture(string const &fn, bool is_alpha_mask, bool verbose,
 		bool invert_alpha=0, bool wrap=1, bool mirror=0, bool force_grayscale=0, bool is_nm=0, bool invert_y=0);
 	bool empty() const {return textures.empty();}
@@ -443,15 +464,20 @@ public:
 	bool ensure_texture_loaded(int tid, bool is_bump);
 	void bind_alpha_channel_to_texture(int tid, int alpha_tid);
 	bool ensure_tid_loaded(int tid, bool is_bump) {return ((tid >= 0) ? ensure_texture_loaded(tid, is_bump) : 0);}
-	void ensure_tid_bound(int tid) {if (tid >= 0) {get_texture(tid).check_init();}} // if allocated
+	void ensure_tid_bound(int tid);
 	void add_work_item(int tid, bool is_nm);
 	void load_work_items_mt();
-	void bind_texture(int tid) const {get_texture(tid).bind_gl();}
+	void prepare_uploads_async();
+	void upload_ready_textures();
+	void upload_all_pending();
+	bool is_upload_pending(int tid) const {return (pending_uploads.find(tid) != pending_uploads.end());}
+	void bind_texture(int tid) const;
 	colorRGBA get_tex_avg_color(int tid) const {return get_texture(tid).get_avg_color();}
 	bool has_binary_alpha(int tid) const {return get_texture(tid).has_binary_alpha;}
 	bool might_have_alpha_comp(int tid) const {return (tid >= 0 && get_texture(tid).ncolors == 4);}
 	texture_t const &get_texture(int tid) const;
 	texture_t &get_texture(int tid);
+	tex_create_args_t const &get_create_args(int tid) const {assert(tid >= 0 && (unsigned)tid < create_args.size()); return create_args[tid];}
 	unsigned get_cpu_mem() const;
 	unsigned get_gpu_mem() const;
 };
@@ -656,6 +682,8 @@ public:
 	void get_all_mat_lib_fns(set<std::string> &mat_lib_fns) const;
 	bool write_to_disk (string const &fn) const;
 	bool read_from_disk(string const &fn);
+	bool write_cache_data(ostream &out) const;
+	bool read_cache_data (istream &in);
 	bool write_as_obj_file(string const &fn);
 	static void proc_model_normals(vector<counted_normal> &cn, int recalc_normals, float nmag_thresh=0.7);
 	static void proc_model_normals(vector<weighted_normal> &wn, int recalc_normals, float nmag_thresh=0.7);
@@ -0,0 +1,399 @@
+// 3D World - Binary Model and Texture Cache Files
+// by Frank Gennari
+// 10/18/26
+
+#include "function_registry.h"
+#include "model3d.h"
+#include "binary_file_io.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+
+// Model cache file layout: model_cache_header_t, num_sources model_cache_source_t entries each followed by its filename, then model3d::write_cache_data().
+// The sources are the model file and the material libraries it uses. The cache is only used if every source has the same size and either the same mtime
+// or the same content hash (sources are only read and hashed when their mtime changed), and the load parameters that affect the generated geometry are the same. Cache files are memory mapped, and vertex, index, and tangent data
+// is copied directly from the mapped pages into the model's vectors with no parsing.
+// Models with animations are not cached because bone data isn't part of the model3d format.
+
+// Texture cache file layout: texture_cache_header_t, then num_levels texture_cache_level_t entries each followed by its data.
+// Cache files are written next to the source image and contain the final mipmap levels in the format sent to the GPU, after decoding, alpha inversion,
+// normal map conversion, mipmap creation, and stb_dxt compression, so a cached texture is loaded with a single memory map.
+// The cache is only used if the image has the same size and mtime and the texture was created with the same parameters.
+// Both caches are disabled by default because they write files into the model and texture directories. Cache files are written to a temporary file
+// that's renamed into place when complete, so that a crash or another process never leaves a partial cache file that would be read later.
+
+unsigned const MODEL_CACHE_VERSION = 1, TEXTURE_CACHE_VERSION = 1;
+char const model_cache_magic[4] = {'3', 'D', 'M', 'C'}, texture_cache_magic[4] = {'3', 'D', 'T', 'C'};
+uint64_t const FNV64_BASIS = 0xcbf29ce484222325ULL, FNV64_PRIME = 0x100000001b3ULL;
+
+bool use_model_cache(0), use_texture_cache(0);
+
+extern bool model_calc_tan_vect, use_obj_file_bump_grayscale, reverse_3ds_vert_winding_order, allow_model3d_quads, disable_model_textures, merge_model_objects;
+extern bool enable_model3d_tex_comp, use_model2d_tex_mipmaps, enable_model3d_custom_mipmaps, invert_bump_maps;
+extern float model_auto_tc_scale;
+
+bool enable_bump_map();
+bool enable_spec_map();
+string append_texture_dir(string const &filename);
+
+using std::string;
+using std::cerr;
+
+
+struct model_cache_header_t {
+	char magic[4];
+	unsigned version;
+	uint64_t params_hash;
+	unsigned num_sources, unused;
+};
+
+struct model_cache_source_t {
+	uint64_t size, mtime, hash;
+	unsigned name_len, unused;
+	model_cache_source_t() : size(0), mtime(0), hash(0), name_len(0), unused(0) {}
+};
+
+// memory mapped file contents as an istream; reads are memcpy()s from the mapped pages
+class mapped_streambuf_t : public std::streambuf {
+public:
+	mapped_streambuf_t(unsigned char const *const data, size_t sz) {
+		char *const ptr((char *)data); // streambuf requires a non-const pointer, but the data is never written
+		setg(ptr, ptr, ptr+sz);
+	}
+};
+
+
+uint64_t hash_bytes(void const *const data, size_t sz, uint64_t hash=FNV64_BASIS) { // FNV-1a on 8-byte words, then on the trailing bytes
+	unsigned char const *const ptr((unsigned char const *)data);
+	size_t const num_words(sz/8);
+
+	for (size_t i = 0; i < num_words; ++i) {
+		uint64_t word;
+		memcpy(&word, ptr+8*i, 8); // unaligned read
+		hash = (hash ^ word)*FNV64_PRIME;
+	}
+	for (size_t i = 8*num_words; i < sz; ++i) {hash = (hash ^ ptr[i])*FNV64_PRIME;}
+	return hash;
+}
+template<typename T> void hash_val(uint64_t &hash, T const &val) {hash = hash_bytes(&val, sizeof(T), hash);}
+
+bool get_source_file_info(string const &filename, model_cache_source_t &src, bool calc_hash) {
+
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) return 0;
+	src.size  = (uint64_t)st.st_size;
+	src.mtime = (uint64_t)st.st_mtime;
+	src.hash  = FNV64_BASIS;
+	if (!calc_hash || src.size == 0) return 1; // empty files can't be mapped
+	mapped_file_t file;
+	if (!file.open(filename)) return 0;
+	src.hash = hash_bytes(file.get_data(), file.size());
+	return 1;
+}
+
+bool source_file_unchanged(string const &filename, model_cache_source_t const &src) { // only reads the file if its mtime changed
+	model_cache_source_t cur;
+	if (!get_source_file_info(filename, cur, 0) || cur.size != src.size) return 0;
+	if (cur.mtime == src.mtime) return 1;
+	return (get_source_file_info(filename, cur, 1) && cur.hash == src.hash); // touched or copied, but possibly with the same contents
+}
+
+// cache files are written to a unique temp file, then renamed into place
+string get_temp_cache_filename(string const &cache_fn) {
+	std::ostringstream oss;
+	oss << cache_fn << "." << std::this_thread::get_id() << "." << std::chrono::high_resolution_clock::now().time_since_epoch().count() << ".tmp";
+	return oss.str();
+}
+
+bool move_cache_file_into_place(string const &tmp_fn, string const &cache_fn) {
+#ifdef _WIN32
+	remove(cache_fn.c_str()); // rename() fails if the file exists; readers see a missing cache file until the rename
+#endif
+	if (rename(tmp_fn.c_str(), cache_fn.c_str()) == 0) return 1;
+	remove(tmp_fn.c_str());
+	return 0;
+}
+
+uint64_t get_model_cache_params_hash(geom_xform_t const &xf, int recalc_normals) { // load parameters that affect the model's geometry or materials
+
+	uint64_t hash(FNV64_BASIS);
+	hash_val(hash, xf.tv);
+	hash_val(hash, xf.scale);
+	hash_val(hash, xf.mirror);
+	hash_val(hash, xf.swap_dim);
+	int const vals[9] = {recalc_normals, model_calc_tan_vect, use_obj_file_bump_grayscale, reverse_3ds_vert_winding_order, allow_model3d_quads,
+		disable_model_textures, enable_bump_map(), enable_spec_map(), (int)sizeof(vert_norm_tc_tan)};
+	hash_val(hash, vals);
+	hash_val(hash, model_auto_tc_scale);
+	return hash;
+}
+
+string get_model_cache_filename(string const &filename) {return (filename + ".3dmc");}
+
+bool can_use_model_cache(string const &filename) {
+	return (use_model_cache && !merge_model_objects && !filename.empty() && get_file_extension(filename, 0, 1) != "model3d");
+}
+
+
+bool read_model_cache(string const &filename, model3d &model, geom_xform_t const &xf, int recalc_normals, bool verbose) {
+
+	if (!can_use_model_cache(filename)) return 0;
+	string const cache_fn(get_model_cache_filename(filename));
+	mapped_file_t file;
+	if (!file.open(cache_fn)) return 0; // not yet cached
+	timer_t timer("Model Cache Load");
+	model_cache_header_t header;
+
+	if (!file.read_at(0, header) || memcmp(header.magic, model_cache_magic, 4) != 0) {
+		cerr << "Error: Invalid model cache file " << cache_fn << "; ignoring" << endl;
+		return 0;
+	}
+	if (header.version != MODEL_CACHE_VERSION || header.params_hash != get_model_cache_params_hash(xf, recalc_normals)) return 0; // out of date
+	size_t pos(sizeof(model_cache_header_t));
+
+	for (unsigned n = 0; n < header.num_sources; ++n) {
+		model_cache_source_t src;
+		if (!file.read_at(pos, src) || pos + sizeof(src) + src.name_len > file.size()) return 0; // truncated
+		pos += sizeof(src);
+		string const src_fn((char const *)file.get_data() + pos, src.name_len);
+		pos += src.name_len;
+		if (!source_file_unchanged(src_fn, src)) return 0; // source file was modified or removed
+	}
+	mapped_streambuf_t buf(file.get_data() + pos, file.size() - pos);
+	std::istream in(&buf);
+
+	if (!model.read_cache_data(in)) {
+		cerr << "Error reading model cache file " << cache_fn << "; reloading " << filename << endl;
+		model.clear();
+		return 0;
+	}
+	if (verbose) {cout << "Read model cache file " << cache_fn << endl;}
+	model.load_all_used_tids();
+	if (verbose) {model.show_stats();}
+	return 1;
+}
+
+bool write_model_cache(string const &filename, model3d &model, geom_xform_t const &xf, int recalc_normals) {
+
+	if (!can_use_model_cache(filename) || model.num_animations() > 0) return 0;
+	set<string> mat_lib_fns, source_fns;
+	model.get_all_mat_lib_fns(mat_lib_fns);
+	mat_lib_fns.erase(string()); // materials without a material library
+	model_from_file_t const mff(filename, model); // for resolving paths relative to the model file
+
+	for (string const &fn : mat_lib_fns) { // stored as written in the model file; find the file that was read, the same way the reader does
+		ifstream in;
+		string const fn_used(mff.open_include_file(fn, "material library", in));
+		if (fn_used.empty()) return 0; // can't validate the cache later without this file
+		source_fns.insert(fn_used);
+	}
+	source_fns.insert(filename);
+	vector<pair<string, model_cache_source_t>> sources;
+
+	for (string const &fn : source_fns) {
+		model_cache_source_t src;
+		if (!get_source_file_info(fn, src, 1)) return 0; // can't validate the cache later without this file
+		src.name_len = (unsigned)fn.size();
+		sources.emplace_back(fn, src);
+	}
+	string const cache_fn(get_model_cache_filename(filename)), tmp_fn(get_temp_cache_filename(cache_fn));
+	ofstream out(tmp_fn, ios::out | ios::binary);
+	if (!out.good()) {cerr << "Error opening model cache file for write: " << tmp_fn << endl; return 0;}
+	model_cache_header_t header;
+	memcpy(header.magic, model_cache_magic, 4);
+	header.version     = MODEL_CACHE_VERSION;
+	header.params_hash = get_model_cache_params_hash(xf, recalc_normals);
+	header.num_sources = (unsigned)sources.size();
+	header.unused      = 0;
+	out.write((char const *)&header, sizeof(header));
+
+	for (auto const &s : sources) {
+		out.write((char const *)&s.second, sizeof(model_cache_source_t));
+		out.write(s.first.data(), s.first.size());
+	}
+	if (model_calc_tan_vect) {model.calc_tangent_vectors();} // so that tangents don't need to be calculated after loading
+	bool const ret(model.write_cache_data(out) && out.good());
+	out.close();
+	if (!ret) {cerr << "Error writing model cache file " << tmp_fn << endl; remove(tmp_fn.c_str()); return 0;}
+	if (!move_cache_file_into_place(tmp_fn, cache_fn)) {cerr << "Error renaming model cache file to " << cache_fn << endl; return 0;}
+	return 1;
+}
+
+
+struct texture_cache_header_t {
+	char magic[4];
+	unsigned version;
+	uint64_t params_hash, src_size, src_mtime;
+	int width, height, ncolors, num_levels;
+	colorRGBA color;
+	char use_mipmaps;
+	bool has_binary_alpha, normal_map, unused;
+	unsigned unused2;
+};
+
+struct texture_cache_level_t {
+	unsigned w, h, compressed, size;
+};
+
+bool get_texture_source_info(string const &name, string &src_fn, uint64_t &size, uint64_t &mtime) { // looks in the texture directory first, like the image readers
+
+	struct stat st;
+	src_fn = append_texture_dir(name);
+
+	if (stat(src_fn.c_str(), &st) != 0) {
+		src_fn = name;
+		if (stat(src_fn.c_str(), &st) != 0) return 0;
+	}
+	size  = (uint64_t)st.st_size;
+	mtime = (uint64_t)st.st_mtime;
+	return 1;
+}
+
+string get_texture_cache_filename(string const &src_fn) {return (src_fn + ".3dtc");}
+
+// validates the file against the source image, and against params_hash if check_params is set
+bool read_texture_cache_file(string const &name, uint64_t params_hash, bool check_params, texture_cache_header_t &header, texture_levels_t &levels) {
+
+	string src_fn;
+	uint64_t src_size(0), src_mtime(0);
+	if (!get_texture_source_info(name, src_fn, src_size, src_mtime)) return 0;
+	string const cache_fn(get_texture_cache_filename(src_fn));
+	mapped_file_t file;
+	if (!file.open(cache_fn)) return 0; // not yet cached
+
+	if (!file.read_at(0, header) || memcmp(header.magic, texture_cache_magic, 4) != 0) {
+		cerr << "Error: Invalid texture cache file " << cache_fn << "; ignoring" << endl;
+		return 0;
+	}
+	if (header.version != TEXTURE_CACHE_VERSION || header.src_size != src_size || header.src_mtime != src_mtime) return 0; // out of date
+	if (check_params && header.params_hash != params_hash) return 0; // created with different parameters
+	if (header.width <= 0 || header.height <= 0 || header.num_levels <= 0) return 0; // invalid
+	size_t pos(sizeof(texture_cache_header_t));
+	levels.resize(header.num_levels);
+
+	for (texture_level_t &lv : levels) {
+		texture_cache_level_t lh;
+		if (!file.read_at(pos, lh) || pos + sizeof(lh) + lh.size > file.size()) return 0; // truncated
+		pos += sizeof(lh);
+		lv.w = lh.w;
+		lv.h = lh.h;
+		lv.compressed = (lh.compressed != 0);
+		lv.data.assign(file.get_data() + pos, file.get_data() + pos + lh.size);
+		pos += lh.size;
+	}
+	return 1;
+}
+
+bool texture_t::read_from_cache(uint64_t params_hash, texture_levels_t &levels) { // thread safe; on success, the levels must be uploaded with gl_init_from_levels()
+
+	texture_cache_header_t header;
+	if (!read_texture_cache_file(name, params_hash, 1, header, levels)) {levels.clear(); return 0;}
+	width            = header.width;
+	height           = header.height;
+	ncolors          = header.ncolors;
+	color            = header.color;
+	use_mipmaps      = header.use_mipmaps;
+	has_binary_alpha = header.has_binary_alpha;
+	normal_map       = header.normal_map;
+	defer_load_type  = DEFER_TYPE_CACHE; // no image data
+	cache_params_hash = params_hash;
+	return 1;
+}
+
+bool texture_t::write_to_cache(uint64_t params_hash, texture_levels_t const &levels) const { // levels come from calc_gl_levels() with full_mip_chain=1
+
+	assert(is_allocated() && !is_16_bit_gray);
+	assert(!levels.empty());
+	string src_fn;
+	texture_cache_header_t header;
+	if (!get_texture_source_info(name, src_fn, header.src_size, header.src_mtime)) return 0;
+	string const cache_fn(get_texture_cache_filename(src_fn)), tmp_fn(get_temp_cache_filename(cache_fn));
+	ofstream out(tmp_fn, ios::out | ios::binary);
+	if (!out.good()) return 0; // the texture directory may not be writable; not an error
+	memcpy(header.magic, texture_cache_magic, 4);
+	header.version          = TEXTURE_CACHE_VERSION;
+	header.params_hash      = params_hash;
+	header.width            = width;
+	header.height           = height;
+	header.ncolors          = ncolors;
+	header.num_levels       = (int)levels.size();
+	header.color            = color;
+	header.use_mipmaps      = use_mipmaps;
+	header.has_binary_alpha = has_binary_alpha;
+	header.normal_map       = normal_map;
+	header.unused           = 0;
+	header.unused2          = 0;
+	out.write((char const *)&header, sizeof(header));
+
+	for (texture_level_t const &lv : levels) {
+		bool const use_tex_data(lv.data.empty()); // uncompressed base level
+		texture_cache_level_t lh;
+		lh.w          = lv.w;
+		lh.h          = lv.h;
+		lh.compressed = lv.compressed;
+		lh.size       = (use_tex_data ? num_bytes() : (unsigned)lv.data.size());
+		out.write((char const *)&lh, sizeof(lh));
+		out.write((char const *)(use_tex_data ? data : lv.data.data()), lh.size);
+	}
+	bool const ret(out.good());
+	out.close();
+	if (!ret) {cerr << "Error writing texture cache file " << tmp_fn << endl; remove(tmp_fn.c_str()); return 0;}
+	return move_cache_file_into_place(tmp_fn, cache_fn); // may fail if another process is writing the same file; not an error
+}
+
+void texture_t::deferred_load_cache() { // the levels read by read_from_cache() were freed before being uploaded, so read them again
+
+	texture_cache_header_t header;
+	texture_levels_t levels;
+
+	if (read_texture_cache_file(name, cache_params_hash, 1, header, levels) && header.width == width && header.height == height && header.ncolors == ncolors) {
+		upload_levels(levels);
+		return;
+	}
+	cerr << "Warning: Texture cache file for " << name << " was removed or modified after the texture was loaded; reloading the image" << endl;
+	bool const was_normal_map(normal_map);
+	ensure_data_loaded(); // clears defer_load_type, so the levels are created as if the texture had never been cached
+	if (was_normal_map) {make_normal_map();}
+	init();
+	levels.clear();
+	calc_gl_levels(levels);
+	upload_levels(levels);
+}
+
+void texture_t::ensure_data_loaded() { // textures read from the cache have no image data; reload it from the source image
+	if (is_allocated() || defer_load_type != DEFER_TYPE_CACHE) return;
+	defer_load_type = DEFER_TYPE_NONE;
+	load(-1);
+}
+
+
+bool texture_manager::can_cache_texture(unsigned tid) const {
+
+	if (!use_texture_cache || tid >= textures.size()) return 0; // builtin textures aren't cached
+	texture_t const &t(textures[tid]);
+	if (t.type != 0 || t.is_16_bit_gray || get_file_extension(t.name, 0, 1) == "dds") return 0; // not loaded from an image, or already GPU compressed
+	// alpha masks are cheap to load and must have image data to be copied into other textures, and textures with those alpha channels depend on two files
+	return (!get_create_args(tid).is_alpha_mask && (t.alpha_tid < 0 || t.alpha_tid == (int)tid));
+}
+
+uint64_t texture_manager::get_cache_params_hash(unsigned tid, bool normal_map) const { // must not depend on texture fields that are modified by loading
+
+	uint64_t hash(hash_bytes(textures[tid].name.data(), textures[tid].name.size()));
+	hash_val(hash, get_create_args(tid));
+	int const vals[5] = {normal_map, enable_model3d_tex_comp, use_model2d_tex_mipmaps, enable_model3d_custom_mipmaps, invert_bump_maps};
+	hash_val(hash, vals);
+	return hash;
+}
+
+bool texture_manager::try_load_from_cache(unsigned tid, bool is_bump, texture_levels_t &levels) { // thread safe for different tids
+	if (!can_cache_texture(tid)) return 0;
+	texture_t &t(textures[tid]);
+	return t.read_from_cache(get_cache_params_hash(tid, (t.normal_map || is_bump)), levels); // normal_map is set by make_normal_map()
+}
+
+void texture_manager::maybe_write_to_cache(unsigned tid, texture_levels_t const &levels) const { // thread safe
+	if (!can_cache_texture(tid)) return;
+	textures[tid].write_to_cache(get_cache_params_hash(tid, textures[tid].normal_map), levels);
+}
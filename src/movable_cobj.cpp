@@ -773,12 +773,14 @@ void check_moving_cobj_int_with_dynamic_objs(unsigned index, vector3d const &del
 	get_intersecting_cobjs_tree(cobj, cobjs, -1, 0.0, 1, 0, -1); // duplicates are okay
 	if (cobjs.empty()) return;
 
-	// some dynamic object collided, but we can't tell which one, so iterate over the groups and test them all
+	// some dynamic object collided, but we can't tell which one, so test the objects of each group that are near the cobj
+	obj_grid_query_t grid_query(cobj);
+
 	for (int g = 0; g < num_groups; ++g) {
 		obj_group &objg(obj_groups[g]);
 		if (!objg.enabled || !objg.large_radius()) continue;
 		
-		for (unsigned i = 0; i < objg.end_id; ++i) {
+		for (unsigned i : grid_query.get_group_ixs(g, objg.end_id)) {
 			dwobject &obj(objg.get_obj(i));
 			if (obj.status != 4) continue; // not stopped
 			if (!cobj.sphere_intersects(obj.pos, obj.get_true_radius())) continue;
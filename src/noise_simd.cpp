@@ -0,0 +1,184 @@
+// 3D World - Vectorized CPU Simplex Noise Matching the GPU Noise Shaders
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "noise_simd.h"
+#include <glm/gtc/noise.hpp>
+#include <chrono>
+#include <emmintrin.h> // SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace std::chrono;
+
+bool cpu_noise_gen(0); // generate GPU simplex noise modes on the CPU, for systems without a GPU
+
+
+namespace noise_sse2 {
+
+// SIMD float vector with 4 lanes for SSE2, which all x86-64 CPUs support
+struct vfloat {
+	static unsigned const WIDTH = 4;
+	__m128 v;
+	vfloat() {}
+	vfloat(__m128 v_) : v(v_) {}
+	vfloat(float f) : v(_mm_set1_ps(f)) {}
+	static vfloat load(float const *p) {return _mm_loadu_ps(p);}
+	void store(float *p) const {_mm_storeu_ps(p, v);}
+	vfloat operator+(vfloat const &b) const {return _mm_add_ps(v, b.v);}
+	vfloat operator-(vfloat const &b) const {return _mm_sub_ps(v, b.v);}
+	vfloat operator*(vfloat const &b) const {return _mm_mul_ps(v, b.v);}
+	vfloat operator/(vfloat const &b) const {return _mm_div_ps(v, b.v);}
+	vfloat operator-() const {return _mm_sub_ps(_mm_setzero_ps(), v);}
+	friend vfloat vfloor(vfloat const &a) { // SSE2 has no floor; truncate and subtract one where that rounded up; valid for |a| < 2^31
+		__m128 const t(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+	}
+	friend vfloat vabs  (vfloat const &a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+	friend vfloat vmax  (vfloat const &a, vfloat const &b) {return _mm_max_ps(a.v, b.v);}
+	friend vfloat vmin  (vfloat const &a, vfloat const &b) {return _mm_min_ps(a.v, b.v);}
+	friend vfloat select_gt(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {
+		__m128 const m(_mm_cmpgt_ps(a.v, b.v));
+		return _mm_or_ps(_mm_and_ps(m, t.v), _mm_andnot_ps(m, f.v));
+	}
+	friend vfloat select_ge(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {
+		__m128 const m(_mm_cmpge_ps(a.v, b.v));
+		return _mm_or_ps(_mm_and_ps(m, t.v), _mm_andnot_ps(m, f.v));
+	}
+};
+
+void gen_simplex_height_row(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+	noise_simd::gen_simplex_height_row<vfloat>(vals, num, x0, dx, y, rx, ry, num_octaves, shape, domain_warp);
+}
+void gen_simplex_fbm_3d_line(float *vals, unsigned num, float const pos[3], float const step[3], float mag, float freq, float rx, float ry, unsigned num_octaves) {
+	noise_simd::gen_simplex_fbm_3d_line<vfloat>(vals, num, pos, step, mag, freq, rx, ry, num_octaves);
+}
+
+} // end noise_sse2 namespace
+
+
+struct noise_simd_isa_t {
+	char const *name;
+	unsigned width;
+	void (*height_row )(float *, unsigned, float, float, float, float, float, unsigned, int, bool);
+	void (*fbm_3d_line)(float *, unsigned, float const [3], float const [3], float, float, float, float, unsigned);
+};
+
+// in order of increasing width; the widest one the CPU supports is used
+unsigned const NUM_NOISE_ISAS = 3;
+noise_simd_isa_t const noise_isas[NUM_NOISE_ISAS] = {
+	{"SSE2",    noise_sse2  ::WIDTH, noise_sse2  ::gen_simplex_height_row, noise_sse2  ::gen_simplex_fbm_3d_line},
+	{"AVX",     noise_avx   ::WIDTH, noise_avx   ::gen_simplex_height_row, noise_avx   ::gen_simplex_fbm_3d_line},
+	{"AVX-512", noise_avx512::WIDTH, noise_avx512::gen_simplex_height_row, noise_avx512::gen_simplex_fbm_3d_line}};
+
+bool cpu_supports_noise_isa(unsigned ix) { // checks both the CPU and OS support for the AVX registers
+	assert(ix < NUM_NOISE_ISAS);
+	if (ix == 0) return 1; // SSE2
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	int const max_leaf(regs[0]);
+	__cpuid(regs, 1);
+	if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28))) return 0; // no OSXSAVE or no AVX
+	unsigned long long const xcr0(_xgetbv(0));
+	if ((xcr0 & 0x06) != 0x06) return 0; // OS doesn't save the XMM and YMM registers
+	if (ix == 1) return 1; // AVX
+	if (max_leaf < 7 || (xcr0 & 0xE0) != 0xE0) return 0; // OS doesn't save the opmask and ZMM registers
+	__cpuidex(regs, 7, 0);
+	return ((regs[1] & (1 << 16)) != 0); // AVX512F
+#else
+	return ((ix == 1) ? __builtin_cpu_supports("avx") : __builtin_cpu_supports("avx512f"));
+#endif
+}
+
+unsigned select_noise_simd_isa() {
+
+	unsigned ix(0);
+	for (unsigned i = 1; i < NUM_NOISE_ISAS; ++i) {if (cpu_supports_noise_isa(i)) {ix = i;}}
+	return ix;
+}
+noise_simd_isa_t const &get_noise_simd_isa() {
+	static unsigned const isa_ix(select_noise_simd_isa()); // selected once on first use
+	return noise_isas[isa_ix];
+}
+
+// evaluates num samples at (x0 + i*dx, y); see procedural_height_gen shader
+void gen_simplex_height_row_simd(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+	get_noise_simd_isa().height_row(vals, num, x0, dx, y, rx, ry, num_octaves, shape, domain_warp);
+}
+
+// evaluates num samples at pos + i*step; see gen_voxel_weights shader
+void gen_simplex_fbm_3d_line_simd(float *vals, unsigned num, point const &pos, vector3d const &step, float mag, float freq, float rx, float ry, unsigned num_octaves) {
+	float const pos_f[3] = {pos.x, pos.y, pos.z}, step_f[3] = {step.x, step.y, step.z};
+	get_noise_simd_isa().fbm_3d_line(vals, num, pos_f, step_f, mag, freq, rx, ry, num_octaves);
+}
+
+
+// compare with the scalar GLM simplex noise used by the CPU noise modes
+void run_noise_simd_benchmark(noise_simd_isa_t const &isa, unsigned num_samples) {
+
+	unsigned const row_len(1024), num_rows(max(1U, num_samples/row_len)), num_octaves(9), num_octaves_3d(5);
+	float const rx(1.37), ry(1.71), dx(0.0137), mag(1.0), freq(0.25);
+	vector3d const step(0.011, 0.0, 0.0);
+	vector<float> simd_vals(row_len), scalar_vals(row_len);
+	float max_err_2d(0.0), max_err_3d(0.0), max_val_2d(0.0), max_val_3d(0.0);
+	double t_simd_2d(0.0), t_scalar_2d(0.0), t_simd_3d(0.0), t_scalar_3d(0.0);
+	cout << "Noise benchmark: " << num_rows*row_len << " samples, " << isa.name << " with " << isa.width << " lanes" << endl;
+
+	for (unsigned r = 0; r < num_rows; ++r) {
+		float const x0(-7.0 + 0.31*r), y(3.0 - 0.0173*r);
+		// 2D height
+		auto t1(high_resolution_clock::now());
+		isa.height_row(simd_vals.data(), row_len, x0, dx, y, rx, ry, num_octaves, 2, 0); // ridged
+		auto t2(high_resolution_clock::now());
+
+		for (unsigned i = 0; i < row_len; ++i) {
+			float zval(0.0), nmag(1.0), nfreq(1.0), crx(rx), cry(ry);
+
+			for (unsigned n = 0; n < num_octaves; ++n) {
+				zval += nmag*(0.45 - fabs(glm::simplex(glm::vec2((nfreq*(x0 + i*dx) + crx), (nfreq*y + cry)))));
+				nmag *= 0.5; nfreq *= 1.92; crx *= 1.5; cry *= 1.5;
+			}
+			scalar_vals[i] = zval;
+		}
+		auto t3(high_resolution_clock::now());
+		t_simd_2d   += duration_cast<duration<double>>(t2 - t1).count();
+		t_scalar_2d += duration_cast<duration<double>>(t3 - t2).count();
+		for (unsigned i = 0; i < row_len; ++i) {max_err_2d = max(max_err_2d, fabs(simd_vals[i] - scalar_vals[i])); max_val_2d = max(max_val_2d, fabs(scalar_vals[i]));}
+		// 3D voxel weights
+		point const pos(x0, y, 0.5*y);
+		float const pos_f[3] = {pos.x, pos.y, pos.z}, step_f[3] = {step.x, step.y, step.z};
+		t1 = high_resolution_clock::now();
+		isa.fbm_3d_line(simd_vals.data(), row_len, pos_f, step_f, mag, freq, rx, ry, num_octaves_3d);
+		t2 = high_resolution_clock::now();
+
+		for (unsigned i = 0; i < row_len; ++i) {
+			point const p(pos + step*i);
+			float val(0.0), nmag(mag), nfreq(freq), crx(rx), cry(ry);
+
+			for (unsigned n = 0; n < num_octaves_3d; ++n) {
+				val  += nmag*glm::simplex(glm::vec3(nfreq*p.x + crx, nfreq*p.y + cry, nfreq*p.z + (crx - cry)));
+				nmag *= 0.5; nfreq *= 1.92; crx *= 1.5; cry *= 1.5;
+			}
+			scalar_vals[i] = val;
+		}
+		t3 = high_resolution_clock::now();
+		t_simd_3d   += duration_cast<duration<double>>(t2 - t1).count();
+		t_scalar_3d += duration_cast<duration<double>>(t3 - t2).count();
+		for (unsigned i = 0; i < row_len; ++i) {max_err_3d = max(max_err_3d, fabs(simd_vals[i] - scalar_vals[i])); max_val_3d = max(max_val_3d, fabs(scalar_vals[i]));}
+	} // for r
+	cout << "2D height: scalar " << 1000.0*t_scalar_2d << "ms, SIMD " << 1000.0*t_simd_2d << "ms, speedup " << t_scalar_2d/max(t_simd_2d, 1.0E-9)
+		 << ", max error " << max_err_2d << " of " << max_val_2d << endl;
+	cout << "3D voxels: scalar " << 1000.0*t_scalar_3d << "ms, SIMD " << 1000.0*t_simd_3d << "ms, speedup " << t_scalar_3d/max(t_simd_3d, 1.0E-9)
+		 << ", max error " << max_err_3d << " of " << max_val_3d << endl;
+}
+
+void run_noise_simd_benchmark(unsigned num_samples) {
+
+	for (unsigned i = 0; i < NUM_NOISE_ISAS; ++i) {
+		if (cpu_supports_noise_isa(i)) {run_noise_simd_benchmark(noise_isas[i], num_samples);}
+	}
+}
@@ -0,0 +1,203 @@
+// 3D World - SIMD Simplex Noise Kernels Matching the GPU Noise Shaders
+// by Frank Gennari
+// 10/18/26
+#pragma once
+
+// These are templates on a SIMD float type V with WIDTH lanes, load()/store(), arithmetic operators, and vfloor(), vabs(), vmax(), vmin(),
+// select_gt(), and select_ge() found by ADL. Each noise_simd*.cpp file defines V for one instruction set and is compiled with the flags for it,
+// and noise_simd.cpp picks one at runtime based on the CPU. This header must not include or call anything outside of V, since inline functions
+// shared with other translation units could otherwise be compiled with instructions that the CPU doesn't support.
+
+namespace noise_simd {
+
+template<typename V> V vfract (V const &x) {return (x - vfloor(x));}
+template<typename V> V mod289 (V const &x) {return (x - vfloor(x/V(289.0f))*V(289.0f));}
+template<typename V> V permute(V const &x) {return mod289((x*V(34.0f) + V(1.0f))*x);}
+
+template<typename V> V get_lane_ixs() { // {0, 1, 2, ... WIDTH-1}
+	float ixs[V::WIDTH];
+	for (unsigned i = 0; i < V::WIDTH; ++i) {ixs[i] = float(i);}
+	return V::load(ixs);
+}
+
+
+// these are direct translations of simplex() in shaders/noise_2d_3d.part, with each lane evaluating one sample
+template<typename V> V simplex_2d(V const &vx, V const &vy) {
+
+	V const Cx(0.211324865405187f), Cy(0.366025403784439f), Cz(-0.577350269189626f), Cw(0.024390243902439f), zero(0.0f), one(1.0f), half(0.5f);
+	// First corner
+	V const s((vx + vy)*Cy);
+	V ix(vfloor(vx + s)), iy(vfloor(vy + s));
+	V const t((ix + iy)*Cx);
+	V const x0x(vx - ix + t), x0y(vy - iy + t);
+	// Other corners
+	V const i1x(select_gt(x0x, x0y, one, zero)), i1y(one - i1x);
+	V const x12x(x0x + Cx - i1x), x12y(x0y + Cx - i1y), x12z(x0x + Cz), x12w(x0y + Cz);
+	// Permutations
+	ix = mod289(ix); // same as mod(i, 289)
+	iy = mod289(iy);
+	V const p0(permute(permute(iy      ) + ix      ));
+	V const p1(permute(permute(iy + i1y) + ix + i1x));
+	V const p2(permute(permute(iy + one) + ix + one));
+	V m0(vmax(half - (x0x *x0x  + x0y *x0y ), zero));
+	V m1(vmax(half - (x12x*x12x + x12y*x12y), zero));
+	V m2(vmax(half - (x12z*x12z + x12w*x12w), zero));
+	m0 = m0*m0; m0 = m0*m0;
+	m1 = m1*m1; m1 = m1*m1;
+	m2 = m2*m2; m2 = m2*m2;
+	// Gradients: 41 points uniformly over a line, mapped onto a diamond
+	V const two(2.0f), n1(1.79284291400159f), n2(0.85373472095314f);
+	V const x_0(two*vfract(p0*Cw) - one), x_1(two*vfract(p1*Cw) - one), x_2(two*vfract(p2*Cw) - one);
+	V const h0(vabs(x_0) - half), h1(vabs(x_1) - half), h2(vabs(x_2) - half);
+	V const a0(x_0 - vfloor(x_0 + half)), a1(x_1 - vfloor(x_1 + half)), a2(x_2 - vfloor(x_2 + half));
+	// Normalise gradients implicitly by scaling m
+	m0 = m0*(n1 - n2*(a0*a0 + h0*h0));
+	m1 = m1*(n1 - n2*(a1*a1 + h1*h1));
+	m2 = m2*(n1 - n2*(a2*a2 + h2*h2));
+	// Compute final noise value at P
+	V const g0(a0*x0x  + h0*x0y), g1(a1*x12x + h1*x12y), g2(a2*x12z + h2*x12w);
+	return V(130.0f)*(m0*g0 + m1*g1 + m2*g2);
+}
+
+template<typename V> V simplex_3d(V const &vx, V const &vy, V const &vz) {
+
+	V const Cx(1.0f/6.0f), Cy(1.0f/3.0f), zero(0.0f), one(1.0f), half(0.5f);
+	// First corner
+	V const s((vx + vy + vz)*Cy);
+	V ix(vfloor(vx + s)), iy(vfloor(vy + s)), iz(vfloor(vz + s));
+	V const t((ix + iy + iz)*Cx);
+	V const x0x(vx - ix + t), x0y(vy - iy + t), x0z(vz - iz + t);
+	// Other corners
+	V const gx(select_ge(x0x, x0y, one, zero)), gy(select_ge(x0y, x0z, one, zero)), gz(select_ge(x0z, x0x, one, zero)); // step(x0.yzx, x0)
+	V const lx(one - gx), ly(one - gy), lz(one - gz);
+	V const i1x(vmin(gx, lz)), i1y(vmin(gy, lx)), i1z(vmin(gz, ly));
+	V const i2x(vmax(gx, lz)), i2y(vmax(gy, lx)), i2z(vmax(gz, ly));
+	V const x1x(x0x - i1x + Cx), x1y(x0y - i1y + Cx), x1z(x0z - i1z + Cx);
+	V const x2x(x0x - i2x + Cy), x2y(x0y - i2y + Cy), x2z(x0z - i2z + Cy);
+	V const x3x(x0x - half), x3y(x0y - half), x3z(x0z - half);
+	// Permutations
+	ix = mod289(ix);
+	iy = mod289(iy);
+	iz = mod289(iz);
+	V p[4] = {permute(permute(permute(iz      ) + iy      ) + ix      ),
+	               permute(permute(permute(iz + i1z) + iy + i1y) + ix + i1x),
+	               permute(permute(permute(iz + i2z) + iy + i2y) + ix + i2x),
+	               permute(permute(permute(iz + one) + iy + one) + ix + one)};
+	// Gradients: 7x7 points over a square, mapped onto an octahedron
+	float const n_(0.142857142857f); // 1.0/7.0
+	V const nsx(n_*2.0f), nsy(n_*0.5f - 1.0f), nsz(n_);
+	V const x0s[4] = {x0x, x1x, x2x, x3x}, y0s[4] = {x0y, x1y, x2y, x3y}, z0s[4] = {x0z, x1z, x2z, x3z};
+	V const n1(1.79284291400159f), n2(0.85373472095314f);
+	V ret(zero);
+
+	for (unsigned c = 0; c < 4; ++c) { // the shader processes the four corners as the components of a vec4
+		V const j(p[c] - V(49.0f)*vfloor(p[c]*nsz*nsz)); // mod(p,7*7)
+		V const x_(vfloor(j*nsz)), y_(vfloor(j - V(7.0f)*x_)); // mod(j,N)
+		V const x(x_*nsx + nsy), y(y_*nsx + nsy);
+		V const h(one - vabs(x) - vabs(y));
+		V const sx(vfloor(x)*V(2.0f) + one), sy(vfloor(y)*V(2.0f) + one);
+		V const sh(select_ge(zero, h, -one, zero)); // -step(h, 0)
+		V px(x + sx*sh), py(y + sy*sh), pz(h);
+		V const norm(n1 - n2*(px*px + py*py + pz*pz)); // Normalise gradients
+		px = px*norm; py = py*norm; pz = pz*norm;
+		V m(vmax(V(0.6f) - (x0s[c]*x0s[c] + y0s[c]*y0s[c] + z0s[c]*z0s[c]), zero));
+		m = m*m;
+		ret = ret + m*m*(px*x0s[c] + py*y0s[c] + pz*z0s[c]);
+	}
+	return V(42.0f)*ret;
+}
+
+// gen_simplex_noise_raw() in shaders/simplex_noise.part and gen_noise() in mesh_gen.cpp
+template<typename V> V simplex_fbm_2d(V const &xv, V const &yv, float rx, float ry, unsigned num_octaves, int shape) {
+
+	V zval(0.0f);
+	float mag(1.0), freq(1.0);
+	float const lacunarity(1.92), gain(0.5);
+
+	for (unsigned i = 0; i < num_octaves; ++i) {
+		V noise(simplex_2d((V(freq)*xv + V(rx)), (V(freq)*yv + V(ry))));
+		switch (shape) {
+		case 0: break; // linear - do nothing
+		case 1: noise = vabs(noise) - V(0.40f); break; // billowy
+		case 2: noise = V(0.45f) - vabs(noise); break; // ridged
+		}
+		zval  = zval + V(mag)*noise;
+		mag  *= gain;
+		freq *= lacunarity;
+		rx   *= 1.5;
+		ry   *= 1.5;
+	}
+	return zval;
+}
+
+// gen_simplex_noise_height() in shaders/simplex_noise.part
+template<typename V> V simplex_height(V xv, V yv, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+
+	if (domain_warp) {
+		V const scale(0.2f);
+		V const dx1(simplex_fbm_2d(xv+V(0.0f), yv+V(0.0f), rx, ry, num_octaves, shape));
+		V const dy1(simplex_fbm_2d(xv+V(5.2f), yv+V(1.3f), rx, ry, num_octaves, shape));
+		V const dx2(simplex_fbm_2d((xv + scale*dx1 + V(1.7f)), (yv + scale*dy1 + V(9.2f)), rx, ry, num_octaves, shape));
+		V const dy2(simplex_fbm_2d((xv + scale*dx1 + V(8.3f)), (yv + scale*dy1 + V(2.8f)), rx, ry, num_octaves, shape));
+		xv = xv + scale*dx2; yv = yv + scale*dy2;
+	}
+	return simplex_fbm_2d(xv, yv, rx, ry, num_octaves, shape);
+}
+
+// stores the last partial vector of a row
+template<typename V> void store_partial(V const &v, float *vals, unsigned num) {
+	float temp[V::WIDTH];
+	v.store(temp);
+	for (unsigned i = 0; i < num; ++i) {vals[i] = temp[i];}
+}
+
+
+// evaluates num samples at (x0 + i*dx, y); see procedural_height_gen shader
+template<typename V> void gen_simplex_height_row(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+
+	V const lane_ixs(get_lane_ixs<V>()), yv(y);
+
+	for (unsigned i = 0; i < num; i += V::WIDTH) {
+		V const xv(V(x0) + (V(float(i)) + lane_ixs)*V(dx));
+		V const zval(simplex_height(xv, yv, rx, ry, num_octaves, shape, domain_warp));
+		if (i + V::WIDTH <= num) {zval.store(vals + i);} else {store_partial(zval, vals+i, num-i);}
+	}
+}
+
+// evaluates num samples at pos + i*step; see gen_voxel_weights shader
+template<typename V> void gen_simplex_fbm_3d_line(float *vals, unsigned num, float const pos[3], float const step[3], float mag, float freq, float rx, float ry, unsigned num_octaves) {
+
+	V const lane_ixs(get_lane_ixs<V>());
+	float const lacunarity(1.92), gain(0.5);
+
+	for (unsigned i = 0; i < num; i += V::WIDTH) {
+		V const ixs(V(float(i)) + lane_ixs);
+		V const px(V(pos[0]) + ixs*V(step[0])), py(V(pos[1]) + ixs*V(step[1])), pz(V(pos[2]) + ixs*V(step[2]));
+		V val(0.0f);
+		float nmag(mag), nfreq(freq), crx(rx), cry(ry);
+
+		for (unsigned n = 0; n < num_octaves; ++n) {
+			V const f(nfreq);
+			val    = val + V(nmag)*simplex_3d((f*px + V(crx)), (f*py + V(cry)), (f*pz + V(crx-cry)));
+			nmag  *= gain;
+			nfreq *= lacunarity;
+			crx   *= 1.5;
+			cry   *= 1.5;
+		}
+		if (i + V::WIDTH <= num) {val.store(vals + i);} else {store_partial(val, vals+i, num-i);}
+	}
+}
+
+} // end noise_simd namespace
+
+// entry points for each instruction set, defined in noise_simd.cpp (SSE2), noise_simd_avx.cpp, and noise_simd_avx512.cpp
+#define DECLARE_NOISE_SIMD_ISA(ns, width) namespace ns { \
+	unsigned const WIDTH = width; \
+	void gen_simplex_height_row (float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp); \
+	void gen_simplex_fbm_3d_line(float *vals, unsigned num, float const pos[3], float const step[3], float mag, float freq, float rx, float ry, unsigned num_octaves); \
+}
+DECLARE_NOISE_SIMD_ISA(noise_sse2,    4)
+DECLARE_NOISE_SIMD_ISA(noise_avx,     8)
+DECLARE_NOISE_SIMD_ISA(noise_avx512, 16)
+#undef DECLARE_NOISE_SIMD_ISA
+
@@ -0,0 +1,44 @@
+// 3D World - AVX Simplex Noise Kernels
+// by Frank Gennari
+// 10/18/26
+
+// Note: this file is compiled with -mavx or /arch:AVX, and its functions are only called when noise_simd.cpp detects CPU support;
+// it must only include noise_simd.h and intrinsics headers, see the comment there
+#ifndef __AVX__
+#error "noise_simd_avx.cpp must be compiled with AVX enabled"
+#endif
+#include <immintrin.h>
+#include "noise_simd.h"
+
+namespace noise_avx {
+
+// SIMD float vector with 8 lanes for AVX
+struct vfloat {
+	static unsigned const WIDTH = 8;
+	__m256 v;
+	vfloat() {}
+	vfloat(__m256 v_) : v(v_) {}
+	vfloat(float f) : v(_mm256_set1_ps(f)) {}
+	static vfloat load(float const *p) {return _mm256_loadu_ps(p);}
+	void store(float *p) const {_mm256_storeu_ps(p, v);}
+	vfloat operator+(vfloat const &b) const {return _mm256_add_ps(v, b.v);}
+	vfloat operator-(vfloat const &b) const {return _mm256_sub_ps(v, b.v);}
+	vfloat operator*(vfloat const &b) const {return _mm256_mul_ps(v, b.v);}
+	vfloat operator/(vfloat const &b) const {return _mm256_div_ps(v, b.v);}
+	vfloat operator-() const {return _mm256_sub_ps(_mm256_setzero_ps(), v);}
+	friend vfloat vfloor(vfloat const &a) {return _mm256_floor_ps(a.v);}
+	friend vfloat vabs  (vfloat const &a) {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v);}
+	friend vfloat vmax  (vfloat const &a, vfloat const &b) {return _mm256_max_ps(a.v, b.v);}
+	friend vfloat vmin  (vfloat const &a, vfloat const &b) {return _mm256_min_ps(a.v, b.v);}
+	friend vfloat select_gt(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {return _mm256_blendv_ps(f.v, t.v, _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));}
+	friend vfloat select_ge(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {return _mm256_blendv_ps(f.v, t.v, _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ));}
+};
+
+void gen_simplex_height_row(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+	noise_simd::gen_simplex_height_row<vfloat>(vals, num, x0, dx, y, rx, ry, num_octaves, shape, domain_warp);
+}
+void gen_simplex_fbm_3d_line(float *vals, unsigned num, float const pos[3], float const step[3], float mag, float freq, float rx, float ry, unsigned num_octaves) {
+	noise_simd::gen_simplex_fbm_3d_line<vfloat>(vals, num, pos, step, mag, freq, rx, ry, num_octaves);
+}
+
+} // end noise_avx namespace
@@ -0,0 +1,44 @@
+// 3D World - AVX-512 Simplex Noise Kernels
+// by Frank Gennari
+// 10/18/26
+
+// Note: this file is compiled with -mavx512f or /arch:AVX512, and its functions are only called when noise_simd.cpp detects CPU support;
+// it must only include noise_simd.h and intrinsics headers, see the comment there
+#ifndef __AVX512F__
+#error "noise_simd_avx512.cpp must be compiled with AVX-512F enabled"
+#endif
+#include <immintrin.h>
+#include "noise_simd.h"
+
+namespace noise_avx512 {
+
+// SIMD float vector with 16 lanes for AVX-512
+struct vfloat {
+	static unsigned const WIDTH = 16;
+	__m512 v;
+	vfloat() {}
+	vfloat(__m512 v_) : v(v_) {}
+	vfloat(float f) : v(_mm512_set1_ps(f)) {}
+	static vfloat load(float const *p) {return _mm512_loadu_ps(p);}
+	void store(float *p) const {_mm512_storeu_ps(p, v);}
+	vfloat operator+(vfloat const &b) const {return _mm512_add_ps(v, b.v);}
+	vfloat operator-(vfloat const &b) const {return _mm512_sub_ps(v, b.v);}
+	vfloat operator*(vfloat const &b) const {return _mm512_mul_ps(v, b.v);}
+	vfloat operator/(vfloat const &b) const {return _mm512_div_ps(v, b.v);}
+	vfloat operator-() const {return _mm512_sub_ps(_mm512_setzero_ps(), v);}
+	friend vfloat vfloor(vfloat const &a) {return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);}
+	friend vfloat vabs  (vfloat const &a) {return _mm512_abs_ps(a.v);}
+	friend vfloat vmax  (vfloat const &a, vfloat const &b) {return _mm512_max_ps(a.v, b.v);}
+	friend vfloat vmin  (vfloat const &a, vfloat const &b) {return _mm512_min_ps(a.v, b.v);}
+	friend vfloat select_gt(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ), f.v, t.v);} // a > b ? t : f
+	friend vfloat select_ge(vfloat const &a, vfloat const &b, vfloat const &t, vfloat const &f) {return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ), f.v, t.v);} // a >= b ? t : f
+};
+
+void gen_simplex_height_row(float *vals, unsigned num, float x0, float dx, float y, float rx, float ry, unsigned num_octaves, int shape, bool domain_warp) {
+	noise_simd::gen_simplex_height_row<vfloat>(vals, num, x0, dx, y, rx, ry, num_octaves, shape, domain_warp);
+}
+void gen_simplex_fbm_3d_line(float *vals, unsigned num, float const pos[3], float const step[3], float mag, float freq, float rx, float ry, unsigned num_octaves) {
+	noise_simd::gen_simplex_fbm_3d_line<vfloat>(vals, num, pos, step, mag, freq, rx, ry, num_octaves);
+}
+
+} // end noise_avx512 namespace
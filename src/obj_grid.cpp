@@ -0,0 +1,465 @@
+// 3D World - Uniform Grid Spatial Hash Broadphase for Dynamic Objects
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "physics_objects.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <mutex>
+
+
+bool use_obj_grid(1);
+unsigned const OBJ_GRID_BLOCK_SIZE   = 1024; // objects per parallel block
+unsigned const OBJ_GRID_BUCKET_GRAIN = 256;  // buckets per parallel block when sorting buckets
+
+extern int num_groups;
+extern float fticks, TIMESTEP;
+extern obj_group obj_groups[];
+
+
+class obj_spatial_hash_t {
+
+	struct entry_t {
+		point pos; // at build time
+		float radius; // negative for disabled objects
+		int cell[3];
+		obj_grid_ref_t ref;
+	};
+	struct block_t { // a range of objects in one group
+		unsigned group, begin, end, slot; // slot of the first object
+		float max_radius=0.0, max_move=0.0;
+		cube_t bcube;
+		block_t(unsigned g, unsigned b, unsigned e, unsigned s) : group(g), begin(b), end(e), slot(s) {}
+	};
+	struct obj_history_t { // positions at the last build, for bounding object motion between builds
+		vector<point> pos;
+		vector<unsigned char> valid;
+	};
+
+	vector<entry_t> slots, entries; // slots are in group order; entries are sorted by bucket, then by group and index
+	vector<unsigned> slot_bucket, bucket_start;
+	vector<block_t> blocks;
+	std::unique_ptr<std::atomic<unsigned>[]> bucket_count; // counts, then scatter positions
+	unsigned num_buckets=0, bucket_count_cap=0;
+	float inv_cell_size=1.0, max_radius=0.0, pad=0.0; // pad bounds the distance an object moves between the build and a query
+	obj_history_t history[NUM_TOT_OBJS];
+	vector<obj_grid_ref_t> new_objs; // created or moved more than pad since the build, and tested at their current positions
+	std::mutex new_objs_mutex;
+	bool valid=0;
+	std::atomic<unsigned long long> pairs_tested{0};
+	unsigned long long tot_entries=0, tot_pairs_tested=0;
+	unsigned num_builds=0;
+
+	void get_cell(point const &p, int cell[3]) const {UNROLL_3X(cell[i_] = int(floor(p[i_]*inv_cell_size));)}
+
+	unsigned get_bucket(int const cell[3]) const {
+		return (((unsigned)cell[0]*73856093U) ^ ((unsigned)cell[1]*19349663U) ^ ((unsigned)cell[2]*83492791U)) & (num_buckets - 1);
+	}
+	void add_pairs_tested(unsigned num) {
+		pairs_tested.fetch_add(num, std::memory_order_relaxed);
+		TRACE_COUNTER_ADD("Object Grid Pairs Tested", num);
+	}
+	// calls func(ref) for each entry whose cell overlaps range and for which pred(entry) is true
+	template<typename P, typename F> void visit_range(cube_t const &range, int only_group, P const &pred, F const &func) {
+		unsigned num_tested(0);
+		double num_cells(1.0);
+		UNROLL_3X(num_cells *= (range.d[i_][1] - range.d[i_][0])*inv_cell_size + 2.0;)
+
+		if (num_cells > entries.size()) { // large query: faster to test every entry
+			for (entry_t const &e : entries) {
+				if (only_group >= 0 && e.ref.group != (unsigned)only_group) continue;
+				++num_tested;
+				if (pred(e)) {func(e.ref);}
+			}
+		}
+		else {
+			int lo[3], hi[3], c[3];
+			get_cell(range.get_llc(), lo);
+			get_cell(range.get_urc(), hi);
+
+			for (c[2] = lo[2]; c[2] <= hi[2]; ++c[2]) {
+				for (c[1] = lo[1]; c[1] <= hi[1]; ++c[1]) {
+					for (c[0] = lo[0]; c[0] <= hi[0]; ++c[0]) {
+						unsigned const b(get_bucket(c));
+
+						for (unsigned n = bucket_start[b]; n < bucket_start[b+1]; ++n) {
+							entry_t const &e(entries[n]);
+							if (e.cell[0] != c[0] || e.cell[1] != c[1] || e.cell[2] != c[2]) continue; // a different cell in the same bucket
+							if (only_group >= 0 && e.ref.group != (unsigned)only_group) continue;
+							++num_tested;
+							if (pred(e)) {func(e.ref);}
+						}
+					}
+				}
+			}
+		}
+		add_pairs_tested(num_tested);
+	}
+	void get_new_objs(vector<entry_t> &ret, int only_group) { // new objects as entries at their current positions
+		std::lock_guard<std::mutex> lock(new_objs_mutex);
+
+		for (obj_grid_ref_t const &ref : new_objs) {
+			if (only_group >= 0 && ref.group != (unsigned)only_group) continue;
+			obj_group const &objg(obj_groups[ref.group]);
+			if (!objg.enabled || ref.ix >= objg.max_objects()) continue;
+			dwobject const &obj(objg.get_obj(ref.ix));
+			if (obj.disabled()) continue;
+			entry_t e;
+			e.pos    = obj.pos;
+			e.radius = obj.get_true_radius();
+			e.ref    = ref;
+			ret.push_back(e);
+		}
+	}
+	static void sort_and_unique(vector<obj_grid_ref_t> &refs) {
+		sort(refs.begin(), refs.end());
+		refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+	}
+public:
+	bool is_valid() const {return valid;}
+	void invalidate() {valid = 0;}
+
+	void build() {
+		TRACE_ZONE("Object Grid Build");
+		valid = 0;
+		{
+			std::lock_guard<std::mutex> lock(new_objs_mutex);
+			new_objs.clear();
+		}
+		if (!use_obj_grid) return;
+		blocks.clear();
+		unsigned num_slots(0);
+
+		for (int g = 0; g < num_groups; ++g) {
+			obj_group const &objg(obj_groups[g]);
+			obj_history_t &h(history[g]);
+			if (!objg.enabled) {h.valid.clear(); continue;}
+			if (h.valid.size() != objg.max_objects()) {h.pos.resize(objg.max_objects()); h.valid.assign(objg.max_objects(), 0);}
+
+			for (unsigned i = 0; i < objg.end_id; i += OBJ_GRID_BLOCK_SIZE) {
+				unsigned const end(min(objg.end_id, i + OBJ_GRID_BLOCK_SIZE));
+				blocks.emplace_back(g, i, end, num_slots);
+				num_slots += (end - i);
+			}
+		}
+		slots.resize(num_slots);
+		slot_bucket.resize(num_slots);
+		float const frame_time(TIMESTEP*min(4.0f, fticks)); // same clamp as process_groups()
+
+		// pass 1: read object positions and radii, and bound how far each object can move before the next build
+		parallel_for_jobs(0, (int)blocks.size(), [&](int bix) {
+			block_t &b(blocks[bix]);
+			obj_group const &objg(obj_groups[b.group]);
+			obj_history_t &h(history[b.group]);
+			b.max_radius = b.max_move = 0.0;
+			bool bcube_valid(0);
+
+			for (unsigned i = b.begin, s = b.slot; i < b.end; ++i, ++s) {
+				dwobject const &obj(objg.get_obj(i));
+				entry_t &e(slots[s]);
+				e.ref = obj_grid_ref_t(b.group, i);
+				if (obj.disabled()) {e.radius = -1.0; h.valid[i] = 0; continue;}
+				e.pos    = obj.pos;
+				e.radius = obj.get_true_radius();
+				float move(obj.velocity.mag()*frame_time);
+				if (h.valid[i]) {move = max(move, p2p_dist(obj.pos, h.pos[i]));} // catches objects such as smileys that don't move by velocity
+				b.max_radius = max(b.max_radius, e.radius);
+				b.max_move   = max(b.max_move,   move);
+				h.pos[i]   = obj.pos;
+				h.valid[i] = 1;
+				if (bcube_valid) {b.bcube.union_with_pt(obj.pos);} else {b.bcube.set_from_point(obj.pos); bcube_valid = 1;}
+			}
+			if (!bcube_valid) {b.max_radius = -1.0;} // no objects
+		}, 1);
+		float max_move(0.0);
+		unsigned num_entries(0);
+		cube_t bcube;
+		max_radius = 0.0;
+
+		for (block_t const &b : blocks) {
+			if (b.max_radius < 0.0) continue;
+			if (num_entries == 0) {bcube = b.bcube;} else {bcube.union_with_cube(b.bcube);}
+			max_radius = max(max_radius, b.max_radius);
+			max_move   = max(max_move,   b.max_move);
+			num_entries += (b.end - b.begin); // upper bound, used for sizing
+		}
+		pad = 2.0*max_move; // allow for objects speeding up this frame
+		// cells must be at least an object diameter across; for small objects, size them so that there's about one object per cell in XY
+		float const xy_cell_size((num_entries > 0) ? sqrt(bcube.dx()*bcube.dy()/num_entries) : 0.0);
+		float const cell_size(max(max(2.0f*(max_radius + pad), xy_cell_size), TOLERANCE));
+		inv_cell_size = 1.0/cell_size;
+		num_buckets   = 16;
+		while (num_buckets < 2*num_entries) {num_buckets *= 2;}
+
+		if (num_buckets > bucket_count_cap) {
+			bucket_count.reset(new std::atomic<unsigned>[num_buckets]);
+			bucket_count_cap = num_buckets;
+		}
+		for (unsigned i = 0; i < num_buckets; ++i) {bucket_count[i].store(0, std::memory_order_relaxed);}
+
+		// pass 2: count objects per bucket
+		parallel_for_jobs(0, (int)blocks.size(), [&](int bix) {
+			block_t const &b(blocks[bix]);
+
+			for (unsigned s = b.slot; s < b.slot + (b.end - b.begin); ++s) {
+				entry_t &e(slots[s]);
+				if (e.radius < 0.0) continue;
+				get_cell(e.pos, e.cell);
+				slot_bucket[s] = get_bucket(e.cell);
+				bucket_count[slot_bucket[s]].fetch_add(1, std::memory_order_relaxed);
+			}
+		}, 1);
+		bucket_start.resize(num_buckets+1);
+		unsigned sum(0);
+
+		for (unsigned i = 0; i < num_buckets; ++i) { // exclusive prefix sum; counts become scatter positions
+			bucket_start[i] = sum;
+			sum += bucket_count[i].load(std::memory_order_relaxed);
+			bucket_count[i].store(bucket_start[i], std::memory_order_relaxed);
+		}
+		bucket_start[num_buckets] = sum;
+		entries.resize(sum);
+
+		// pass 3: scatter objects into buckets; order within a bucket depends on thread timing until the sort below
+		parallel_for_jobs(0, (int)blocks.size(), [&](int bix) {
+			block_t const &b(blocks[bix]);
+
+			for (unsigned s = b.slot; s < b.slot + (b.end - b.begin); ++s) {
+				if (slots[s].radius >= 0.0) {entries[bucket_count[slot_bucket[s]].fetch_add(1, std::memory_order_relaxed)] = slots[s];}
+			}
+		}, 1);
+		// pass 4: sort each bucket by group and index so that entry order and query results are deterministic
+		parallel_for_jobs(0, (int)num_buckets, [&](int bucket) {
+			if (bucket_start[bucket+1] - bucket_start[bucket] < 2) return;
+			sort(entries.begin()+bucket_start[bucket], entries.begin()+bucket_start[bucket+1], [](entry_t const &a, entry_t const &b) {return (a.ref < b.ref);});
+		}, OBJ_GRID_BUCKET_GRAIN);
+		tot_pairs_tested += pairs_tested.exchange(0);
+		tot_entries += entries.size();
+		++num_builds;
+		valid = 1;
+	}
+
+	void add_new_obj(unsigned group, unsigned ix) {
+		assert(group < NUM_TOT_OBJS);
+		obj_history_t &h(history[group]);
+		if (ix < h.valid.size()) {h.valid[ix] = 0;} // don't count a respawn as motion
+		if (!valid) return;
+		std::lock_guard<std::mutex> lock(new_objs_mutex);
+		new_objs.emplace_back(group, ix);
+	}
+
+	// objects that move further than pad since the build (teleported, launched by a jump pad, knocked by a blast, etc.) are tested at their current positions
+	void check_moved_obj(unsigned group, unsigned ix, point const &pos) {
+		if (!valid) return;
+		assert(group < NUM_TOT_OBJS);
+		obj_history_t const &h(history[group]);
+		if (ix >= h.valid.size() || !h.valid[ix] || dist_less_than(pos, h.pos[ix], pad)) return; // new (already added) or within pad
+		std::lock_guard<std::mutex> lock(new_objs_mutex);
+		new_objs.emplace_back(group, ix);
+	}
+
+	bool get_objs_in_sphere(point const &center, float radius, vector<obj_grid_ref_t> &refs, int only_group) {
+		refs.clear();
+		if (!valid) return 0;
+		float const r(radius + pad);
+		cube_t range(center);
+		range.expand_by(r + max_radius);
+		visit_range(range, only_group, [&](entry_t const &e) {return dist_less_than(e.pos, center, (r + e.radius));}, [&](obj_grid_ref_t const &ref) {refs.push_back(ref);});
+		vector<entry_t> new_entries;
+		get_new_objs(new_entries, only_group);
+
+		for (entry_t const &e : new_entries) {
+			if (dist_less_than(e.pos, center, (radius + e.radius))) {refs.push_back(e.ref);}
+		}
+		add_pairs_tested(new_entries.size());
+		sort_and_unique(refs);
+		return 1;
+	}
+
+	bool get_objs_intersecting_cube(cube_t const &cube, vector<obj_grid_ref_t> &refs, int only_group) {
+		refs.clear();
+		if (!valid) return 0;
+		cube_t range(cube);
+		range.expand_by(max_radius + pad);
+		visit_range(range, only_group, [&](entry_t const &e) {return sphere_cube_intersect(e.pos, (e.radius + pad), cube);}, [&](obj_grid_ref_t const &ref) {refs.push_back(ref);});
+		vector<entry_t> new_entries;
+		get_new_objs(new_entries, only_group);
+
+		for (entry_t const &e : new_entries) {
+			if (sphere_cube_intersect(e.pos, e.radius, cube)) {refs.push_back(e.ref);}
+		}
+		add_pairs_tested(new_entries.size());
+		sort_and_unique(refs);
+		return 1;
+	}
+
+	bool get_overlapping_pairs(vector<obj_grid_pair_t> &pairs, int group1, int group2) {
+		pairs.clear();
+		if (!valid) return 0;
+		bool const same_set(group1 == group2); // report each pair once, with the lower ref first
+		unsigned const num_blocks((entries.size() + OBJ_GRID_BLOCK_SIZE - 1)/OBJ_GRID_BLOCK_SIZE);
+		vector<vector<obj_grid_pair_t>> block_pairs(num_blocks);
+
+		parallel_for_jobs(0, (int)num_blocks, [&](int bix) {
+			unsigned const end(min((unsigned)entries.size(), (bix + 1)*OBJ_GRID_BLOCK_SIZE));
+
+			for (unsigned n = bix*OBJ_GRID_BLOCK_SIZE; n < end; ++n) {
+				entry_t const &a(entries[n]);
+				if (group1 >= 0 && a.ref.group != (unsigned)group1) continue;
+				float const r(a.radius + 2.0*pad);
+				cube_t range(a.pos);
+				range.expand_by(r + max_radius);
+				visit_range(range, group2,
+					[&](entry_t const &e) {return ((same_set ? (a.ref < e.ref) : !(a.ref == e.ref)) && dist_less_than(e.pos, a.pos, (r + e.radius)));},
+					[&](obj_grid_ref_t const &ref) {block_pairs[bix].emplace_back(a.ref, ref);});
+			}
+		}, 1);
+		for (vector<obj_grid_pair_t> const &bp : block_pairs) {pairs.insert(pairs.end(), bp.begin(), bp.end());}
+		vector<entry_t> new_entries;
+		get_new_objs(new_entries, -1);
+		unsigned num_tested(0);
+
+		for (entry_t const &a : new_entries) { // new and moved objects vs. entries and other new objects, at current positions
+			for (unsigned d = 0; d < 2; ++d) { // d=0: new object is first; d=1: new object is second
+				if ((d ? group2 : group1) >= 0 && a.ref.group != (unsigned)(d ? group2 : group1)) continue;
+				int const other_group(d ? group1 : group2);
+				float const r(a.radius + pad);
+				cube_t range(a.pos);
+				range.expand_by(r + max_radius);
+				auto add_pair([&](obj_grid_ref_t const &ref) {
+					if (ref == a.ref) return;
+					obj_grid_pair_t p(d ? obj_grid_pair_t(ref, a.ref) : obj_grid_pair_t(a.ref, ref));
+					if (same_set && p.second < p.first) {std::swap(p.first, p.second);}
+					pairs.push_back(p);
+				});
+				visit_range(range, other_group, [&](entry_t const &e) {return dist_less_than(e.pos, a.pos, (r + e.radius));}, add_pair);
+
+				for (entry_t const &e : new_entries) {
+					if (other_group >= 0 && e.ref.group != (unsigned)other_group) continue;
+					++num_tested;
+					if (dist_less_than(e.pos, a.pos, (a.radius + e.radius))) {add_pair(e.ref);}
+				}
+			} // for d
+		} // for a
+		add_pairs_tested(num_tested);
+		if (!new_entries.empty()) {sort(pairs.begin(), pairs.end()); pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());}
+		return 1;
+	}
+
+	void print_stats() const {
+		cout << "Object grid: " << num_builds << " builds, " << ((num_builds > 0) ? tot_entries/num_builds : 0) << " avg objects, "
+			 << ((num_builds > 0) ? tot_pairs_tested/num_builds : 0) << " avg pairs tested per frame" << endl;
+	}
+};
+
+obj_spatial_hash_t obj_grid;
+
+
+void build_obj_grid() {obj_grid.build();}
+void invalidate_obj_grid() {obj_grid.invalidate();}
+void obj_grid_add_new_obj(unsigned group, unsigned ix) {obj_grid.add_new_obj(group, ix);}
+void obj_grid_check_moved_obj(unsigned group, unsigned ix, point const &pos) {obj_grid.check_moved_obj(group, ix, pos);}
+void print_obj_grid_stats() {obj_grid.print_stats();}
+
+bool get_objs_in_sphere(point const &center, float radius, vector<obj_grid_ref_t> &refs, int only_group) {
+	return obj_grid.get_objs_in_sphere(center, radius, refs, only_group);
+}
+bool get_objs_intersecting_cube(cube_t const &cube, vector<obj_grid_ref_t> &refs, int only_group) {
+	return obj_grid.get_objs_intersecting_cube(cube, refs, only_group);
+}
+bool get_overlapping_obj_pairs(vector<obj_grid_pair_t> &pairs, int group1, int group2) {
+	return obj_grid.get_overlapping_pairs(pairs, group1, group2);
+}
+
+bool get_objs_in_spheres(vector<sphere_t> const &spheres, vector<vector<obj_grid_ref_t>> &refs, int only_group) {
+
+	refs.resize(spheres.size());
+	if (!obj_grid.is_valid()) {for (auto &r : refs) {r.clear();} return 0;}
+	parallel_for_jobs(0, (int)spheres.size(), [&](int i) {obj_grid.get_objs_in_sphere(spheres[i].pos, spheres[i].radius, refs[i], only_group);}, 16);
+	return 1;
+}
+
+
+vector<unsigned> const &obj_grid_query_t::get_group_ixs(unsigned group, unsigned end_id) {
+
+	ixs.clear();
+
+	if (!valid) { // test all objects
+		for (unsigned i = 0; i < end_id; ++i) {ixs.push_back(i);}
+		return ixs;
+	}
+	for (auto i = std::lower_bound(refs.begin(), refs.end(), obj_grid_ref_t(group, 0)); i != refs.end() && i->group == group && i->ix < end_id; ++i) {
+		ixs.push_back(i->ix);
+	}
+	return ixs;
+}
+
+
+// compares grid sphere queries and object pairs against brute force tests over every object in the current scene
+void run_obj_grid_benchmark(unsigned num_queries) {
+
+	build_obj_grid();
+	if (!obj_grid.is_valid()) {cout << "Object grid benchmark: grid is disabled" << endl; return;}
+	vector<obj_grid_ref_t> all_objs;
+
+	for (int g = 0; g < num_groups; ++g) {
+		obj_group const &objg(obj_groups[g]);
+		if (!objg.enabled) continue;
+
+		for (unsigned i = 0; i < objg.end_id; ++i) {
+			if (!objg.get_obj(i).disabled()) {all_objs.emplace_back(g, i);}
+		}
+	}
+	if (all_objs.empty()) {cout << "Object grid benchmark: no objects" << endl; return;}
+	rand_gen_t rgen;
+	vector<sphere_t> queries(num_queries);
+
+	for (sphere_t &q : queries) { // spheres centered near random objects
+		obj_grid_ref_t const &ref(all_objs[rgen.rand()%all_objs.size()]);
+		q.pos    = obj_groups[ref.group].get_obj(ref.ix).pos + rgen.signed_rand_vector(0.1);
+		q.radius = rgen.rand_uniform(0.01, 0.5);
+	}
+	auto get_time([](high_resolution_clock::time_point const &t) {return 1000.0f*duration_cast<duration<float>>(high_resolution_clock::now() - t).count();});
+	high_resolution_clock::time_point t(high_resolution_clock::now());
+	vector<vector<obj_grid_ref_t>> brute_refs(num_queries), grid_refs;
+
+	for (unsigned q = 0; q < num_queries; ++q) {
+		for (obj_grid_ref_t const &ref : all_objs) {
+			dwobject const &obj(obj_groups[ref.group].get_obj(ref.ix));
+			if (dist_less_than(obj.pos, queries[q].pos, (queries[q].radius + obj.get_true_radius()))) {brute_refs[q].push_back(ref);}
+		}
+	}
+	float const brute_time(get_time(t));
+	t = high_resolution_clock::now();
+	get_objs_in_spheres(queries, grid_refs);
+	float const grid_time(get_time(t));
+	unsigned num_missed(0), num_cands(0);
+
+	for (unsigned q = 0; q < num_queries; ++q) {
+		num_cands += grid_refs[q].size();
+		for (obj_grid_ref_t const &ref : brute_refs[q]) {num_missed += !std::binary_search(grid_refs[q].begin(), grid_refs[q].end(), ref);}
+	}
+	cout << "Object grid benchmark: " << all_objs.size() << " objects, " << num_queries << " sphere queries: brute force " << brute_time
+		 << "ms, grid " << grid_time << "ms, " << num_cands << " candidates, " << num_missed << " missed" << endl;
+	if (all_objs.size() > 20000) return; // brute force pairs is too slow
+	t = high_resolution_clock::now();
+	unsigned num_brute_pairs(0);
+
+	for (unsigned i = 0; i < all_objs.size(); ++i) {
+		dwobject const &a(obj_groups[all_objs[i].group].get_obj(all_objs[i].ix));
+		float const ra(a.get_true_radius());
+
+		for (unsigned j = i+1; j < all_objs.size(); ++j) {
+			dwobject const &b(obj_groups[all_objs[j].group].get_obj(all_objs[j].ix));
+			num_brute_pairs += dist_less_than(a.pos, b.pos, (ra + b.get_true_radius()));
+		}
+	}
+	float const brute_pairs_time(get_time(t));
+	t = high_resolution_clock::now();
+	vector<obj_grid_pair_t> pairs;
+	get_overlapping_obj_pairs(pairs);
+	float const grid_pairs_time(get_time(t));
+	cout << "Object grid benchmark: overlapping pairs: brute force " << brute_pairs_time << "ms for " << num_brute_pairs << " pairs, grid "
+		 << grid_pairs_time << "ms for " << pairs.size() << " candidate pairs" << endl;
+}
@@ -10,12 +10,17 @@
 #include <algorithm> // for transform()
 #include <cctype> // for tolower()
 #include "fast_atof.h"
+#include "binary_file_io.h"
+#include "job_system.h"
+#include <chrono>
 
 
 extern bool use_obj_file_bump_grayscale, model_calc_tan_vect;
 extern float model_auto_tc_scale, model_mat_lod_thresh;
 extern model3ds all_models;
 
+bool mt_obj_file_reader(1);
+
 // hack to avoid slow multithreaded locking in getc()/ungetc() in MSVC++
 #ifndef _getc_nolock
 #define _getc_nolock   getc
@@ -80,9 +85,9 @@ bool base_file_reader::read_string(char *s, unsigned max_len) {
 
 class object_file_reader : public base_file_reader {
 
+protected:
 	bool invalid_index_warned;
 
-protected:
 	void handle_invalid_zero_ref_index(int &ix) {
 		if (ix == -1) {
 			if (!invalid_index_warned) {
@@ -242,6 +247,196 @@ void model_from_file_t::check_and_bind(int &tid, string const &tfn, bool is_alph
 
 
 
+// OBJ file data for one chunk of lines, parsed on its own thread by the multithreaded reader.
+// Element indices are stored as read, with the chunk's element counts at each face for relative indices,
+// and are resolved after all chunks have been parsed and the global element offsets are known.
+struct obj_chunk_data_t {
+	enum {CMD_FACE=0, CMD_USEMTL, CMD_MTLLIB, CMD_OBJECT, CMD_GROUP, CMD_SMOOTH, CMD_UNKNOWN};
+	static int const IX_NONE = INT_MIN; // index not specified
+
+	struct cmd_t {
+		unsigned char type;
+		unsigned val, line; // val: face index, string index, or smoothing group; line is within the chunk
+		cmd_t(unsigned char t, unsigned v, unsigned l) : type(t), val(v), line(l) {}
+	};
+	struct face_t {
+		unsigned start, npts, nv, ntc, nn; // nv/ntc/nn: number of elements of each type in this chunk before this face
+		face_t(unsigned s, unsigned nv_, unsigned ntc_, unsigned nn_) : start(s), npts(0), nv(nv_), ntc(ntc_), nn(nn_) {}
+	};
+	vector<point> v;
+	vector<colorRGB> colors; // empty if no vertex in this chunk has a color
+	vector<point2d<float> > tc;
+	vector<vector3d> n, face_normals;
+	vector<int> raw_ixs; // {vix, tix, nix} for each face point, as read
+	vector<vntc_ix_t> pts; // resolved indices for each face point
+	vector<face_t> faces;
+	vector<cmd_t> cmds;
+	vector<string> strs;
+	unsigned num_lines=0, v_start=0, tc_start=0, n_start=0, line_start=0; // starts are global offsets
+	unsigned error_line=0;
+	bool had_zero_ix=0, had_bad_ix=0;
+	string error; // type of data that failed to parse
+};
+
+class obj_chunk_parser_t {
+	char const *pos, *end;
+	obj_chunk_data_t &data;
+	char buffer[1024] = {0};
+
+	static bool is_line_space(char c) {return (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r');}
+	static bool is_space(char c) {return (is_line_space(c) || c == '\n');}
+	static bool is_digit(char c) {return (c >= '0' && c <= '9');}
+
+	void skip_line_space() {while (pos < end && is_line_space(*pos)) {++pos;}}
+	void skip_to_next_line() {
+		while (pos < end && *pos != '\n') {++pos;}
+		if (pos < end) {++pos;} // skip the newline
+		++data.num_lines;
+	}
+	bool read_token(char *s, unsigned max_len) { // reads the next whitespace delimited string on this line
+		skip_line_space();
+		unsigned ix(0);
+		while (pos < end && !is_space(*pos)) {
+			if (ix+1 >= max_len) return 0; // buffer overrun
+			s[ix++] = *(pos++);
+		}
+		s[ix] = 0; // add null terminator
+		return (ix > 0);
+	}
+	// the rest of the functions match the number and string parsing of object_file_reader for well formed files
+	bool read_float(float &val) {
+		skip_line_space();
+		if (pos == end || (!is_digit(*pos) && *pos != '.' && *pos != '-')) return 0; // not a fp number
+		if (!read_token(buffer, sizeof(buffer))) return 0;
+		val = Assimp::fast_atof(buffer);
+		return 1;
+	}
+	bool read_point(point &p, unsigned req_num=3) {
+		for (unsigned i = 0; i < 3; ++i) {
+			if (!read_float(p[i])) {return ((i >= req_num) ? 1 : 0);} // success if we read enough values
+		}
+		return 1;
+	}
+	bool read_int(int &v) {
+		bool first_char(1), is_neg(0);
+		v = 0;
+		skip_line_space();
+		if (pos < end && *pos == '-') {is_neg = 1; first_char = 0; ++pos;} // negative
+		for (; pos < end && is_digit(*pos); ++pos) {v = 10*v + int(*pos - '0'); first_char = 0;}
+		if (first_char) return 0; // no integer characters were read
+		if (is_neg) {v = -v;}
+		return 1;
+	}
+	void read_str_to_newline(string &str) {
+		str.resize(0);
+		for (; pos < end && *pos != '\n'; ++pos) {
+			if (!is_space(*pos) || !str.empty()) {str.push_back(*pos);}
+		}
+		while (!str.empty() && is_space(str.back())) {str.pop_back();}
+	}
+	void add_str_cmd(unsigned char type) {
+		data.strs.push_back(string());
+		read_str_to_newline(data.strs.back());
+		data.cmds.emplace_back(type, unsigned(data.strs.size()-1), data.num_lines);
+	}
+	bool set_error(char const *const type) {
+		data.error      = type;
+		data.error_line = data.num_lines;
+		return 0;
+	}
+public:
+	obj_chunk_parser_t(char const *const start, char const *const end_, obj_chunk_data_t &data_) : pos(start), end(end_), data(data_) {}
+
+	bool parse(geom_xform_t const &xf, int recalc_normals) { // returns false and sets data.error on failure
+		char s[1024];
+		bool has_colors(0);
+
+		for (; pos < end; skip_to_next_line()) {
+			skip_line_space();
+			if (pos < end && *pos == '#') continue; // comment
+			
+			if (!read_token(s, sizeof(s))) { // empty line or token too long
+				skip_line_space();
+				if (pos < end && *pos != '\n') {return set_error("command");}
+				continue;
+			}
+			unsigned const line(data.num_lines);
+
+			if (strcmp(s, "f") == 0) { // face
+				data.cmds.emplace_back(obj_chunk_data_t::CMD_FACE, (unsigned)data.faces.size(), line);
+				data.faces.emplace_back((unsigned)data.raw_ixs.size()/3, (unsigned)data.v.size(), (unsigned)data.tc.size(), (unsigned)data.n.size());
+				int vix(0);
+
+				while (read_int(vix)) { // read vertex index
+					int tix(obj_chunk_data_t::IX_NONE), nix(obj_chunk_data_t::IX_NONE);
+
+					if (pos < end && *pos == '/') {
+						++pos;
+						if (!read_int(tix)) {tix = obj_chunk_data_t::IX_NONE;} // text coord index, optional
+
+						if (pos < end && *pos == '/') {
+							++pos;
+							if (!read_int(nix)) {nix = obj_chunk_data_t::IX_NONE;} // normal index, optional
+						}
+					}
+					data.raw_ixs.push_back(vix);
+					data.raw_ixs.push_back(tix);
+					data.raw_ixs.push_back(nix);
+					++data.faces.back().npts;
+				}
+			}
+			else if (strcmp(s, "v") == 0) { // vertex
+				point p;
+				if (!read_point(p)) {return set_error("vertex");}
+				xf.xform_pos(p);
+				data.v.push_back(p);
+				colorRGB color;
+
+				if (read_float(color.R)) { // optional vertex color
+					if (!read_float(color.G) || !read_float(color.B)) {return set_error("vertex color");}
+					if (!has_colors) {data.colors.resize(data.v.size()-1, WHITE); has_colors = 1;} // pad colors up to this point with white
+					data.colors.push_back(color);
+				}
+				else if (has_colors) {data.colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
+			}
+			else if (strcmp(s, "vt") == 0) { // tex coord
+				point tc3d;
+				if (!read_point(tc3d, 2)) {return set_error("texture coord");}
+				data.tc.emplace_back(tc3d.x, tc3d.y); // discard tc3d.z
+			}
+			else if (strcmp(s, "vn") == 0) { // normal
+				vector3d normal;
+				if (!read_point(normal)) {return set_error("normal");}
+
+				if (!recalc_normals) {
+					xf.xform_pos_rm(normal);
+					data.n.push_back(normal);
+				}
+			}
+			else if (strcmp(s, "l") == 0) {} // line - ignore
+			else if (strcmp(s, "o") == 0) {data.cmds.emplace_back(obj_chunk_data_t::CMD_OBJECT, 0, line);} // object definition; name is unused
+			else if (strcmp(s, "g") == 0) {data.cmds.emplace_back(obj_chunk_data_t::CMD_GROUP,  0, line);} // group; name is unused
+			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
+				int val(0);
+
+				if (!read_int(val) || val < 0) {
+					if (!read_token(s, sizeof(s)) || strcmp(s, "off") != 0) {return set_error("smoothing group");}
+					val = 0;
+				}
+				data.cmds.emplace_back(obj_chunk_data_t::CMD_SMOOTH, val, line);
+			}
+			else if (strcmp(s, "usemtl") == 0) {add_str_cmd(obj_chunk_data_t::CMD_USEMTL);} // use material
+			else if (strcmp(s, "mtllib") == 0) {add_str_cmd(obj_chunk_data_t::CMD_MTLLIB);} // material library
+			else {
+				data.strs.push_back(s);
+				data.cmds.emplace_back(obj_chunk_data_t::CMD_UNKNOWN, unsigned(data.strs.size()-1), line);
+			}
+		} // for pos
+		return 1;
+	}
+};
+
+
 bool endswith(string const &value, string const &ending) {
 	if (ending.size() > value.size()) return 0;
 	return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
@@ -492,13 +687,77 @@ public:
 		return 1;
 	}
 
+	static poly_data_block &get_block_for_face(deque<poly_data_block> &pblocks, unsigned smoothing_group, unsigned &prev_smoothing_group) {
+		unsigned const block_size = (1 << 18); // 256K
+
+		if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
+			if (!pblocks.empty()) {
+				remove_excess_cap(pblocks.back().polys);
+				remove_excess_cap(pblocks.back().pts);
+			}
+			pblocks.push_back(poly_data_block());
+			prev_smoothing_group = smoothing_group;
+		}
+		return pblocks.back();
+	}
+	static vector3d calc_face_normal(vntc_ix_t const *const pts, unsigned npts, vector<point> const &v) {
+		vector3d normal(zero_vector);
+
+		for (unsigned i = 0; i+2 < npts; ++i) { // find a nonzero normal
+			normal = cross_product((v[pts[i+1].vix] - v[pts[i].vix]), (v[pts[i+2].vix] - v[pts[i].vix])); // backwards?
+			// if we disable this normalize() we will weight normal contributions by polygon area,
+			// but we have to change the code below and it causes problems with vertex uniquing
+			normal.normalize();
+			if (normal != zero_vector) break; // got a good normal
+		}
+		return normal;
+	}
+	// called after the face's points have been added starting at pix; sets the face normal (calculated if face_normal is null) and updates vertex normals;
+	// returns false and removes the face if it has too few points
+	bool finish_face(poly_data_block &pb, unsigned pix, vector3d const *const face_normal, vector<point> const &v, vector<counted_normal> &vn,
+		int recalc_normals, bool is_textured, unsigned approx_line, bool &had_npts_error) const
+	{
+		unsigned const npts(pb.polys.back().npts);
+
+		if (npts < 3) {
+			if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
+			pb.pts.resize(pix);
+			pb.polys.pop_back(); // remove pts and polygon
+			return 0; // skip it
+		}
+		vector3d &normal(pb.polys.back().n);
+		normal = (face_normal ? *face_normal : calc_face_normal(&pb.pts[pix], npts, v));
+				
+		if (recalc_normals) {
+			bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
+			float face_area(0.0);
+
+			if (face_weight_avg) {
+				point face_pts[4];
+				for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
+				face_area = polygon_area(face_pts, npts);
+			}
+			for (unsigned i = pix; i < pix+npts; ++i) {
+				unsigned const vix(pb.pts[i].vix);
+				assert((unsigned)vix < vn.size());
+				bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
+
+				if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
+					vn[vix] = zero_vector; // zero it out so that it becomes invalid later
+				}
+				else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
+				else {vn[vix].add_normal(normal);} // unweighted average of normals
+			}
+		}
+		return 1;
+	}
+
 	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
 		RESET_TIME;
 		if (!open_file(1)) return 0; // binary mode is faster
 		cout << "Reading object file " << filename << endl;
-		unsigned const block_size = (1 << 18); // 256K
 		int cur_mat_id(-1);
-		unsigned smoothing_group(0), prev_smoothing_group(0), num_faces(0), num_objects(0), num_groups(0), obj_group_id(0);
+		unsigned smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0);
 		vector<point> v; // vertices
 		vector<vector3d> n; // normals
 		// weighted_normal can also be used, but doesn't work well; see face_weight_avg mode selected by recalc_normals==2
@@ -526,19 +785,10 @@ public:
 			}
 			else if (strcmp(s, "f") == 0) { // face
 				model.mark_mat_as_used(cur_mat_id);
-
-				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
-					if (!pblocks.empty()) {
-						remove_excess_cap(pblocks.back().polys);
-						remove_excess_cap(pblocks.back().pts);
-					}
-					pblocks.push_back(poly_data_block());
-					prev_smoothing_group = smoothing_group;
-				}
-				poly_data_block &pb(pblocks.back());
+				poly_data_block &pb(get_block_for_face(pblocks, smoothing_group, prev_smoothing_group));
 				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
 				unsigned &npts(pb.polys.back().npts);
-				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
+				unsigned const pix((unsigned)pb.pts.size());
 				int vix(0), tix(0), nix(0);
 
 				while (read_int(vix)) { // read vertex index
@@ -565,42 +815,7 @@ public:
 					pb.pts.push_back(vntc_ix);
 					++npts;
 				} // end while vertex
-				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
-					pb.pts.resize(pts_start);
-					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
-				}
-				vector3d &normal(pb.polys.back().n);
-				
-				for (unsigned i = pix; i < pix+npts-2; ++i) { // find a nonzero normal
-					normal = cross_product((v[pb.pts[i+1].vix] - v[pb.pts[i].vix]), (v[pb.pts[i+2].vix] - v[pb.pts[i].vix])); // backwards?
-					// if we disable this normalize() we will weight normal contributions by polygon area,
-					// but we have to change the code below and it causes problems with vertex uniquing
-					normal.normalize();
-					if (normal != zero_vector) break; // got a good normal
-				}
-				if (recalc_normals) {
-					bool const face_weight_avg(recalc_normals == 2 && (npts == 3 || npts == 4)); // only works for quads and triangles
-					float face_area(0.0);
-
-					if (face_weight_avg) {
-						point face_pts[4];
-						for (unsigned i = 0; i < npts; ++i) {face_pts[i] = v[pb.pts[i+pix].vix];}
-						face_area = polygon_area(face_pts, npts);
-					}
-					for (unsigned i = pix; i < pix+npts; ++i) {
-						unsigned const vix(pb.pts[i].vix);
-						assert((unsigned)vix < vn.size());
-						bool const using_texgen(is_textured && model_auto_tc_scale > 0.0 && pb.pts[i].tix == 0);
-
-						if (vn[vix].is_valid() && (using_texgen || dot_product(normal, vn[vix].get_norm()) < 0.25)) { // normals in disagreement (or using texgen)
-							vn[vix] = zero_vector; // zero it out so that it becomes invalid later
-						}
-						else if (face_weight_avg) {vn[vix].add_normal(face_area*normal);} // face weighted average
-						else {vn[vix].add_normal(normal);} // unweighted average of normals
-					}
-				}
+				finish_face(pb, pix, nullptr, v, vn, recalc_normals, is_textured, approx_line, had_npts_error);
 			}
 			else if (strcmp(s, "v") == 0) { // vertex
 				v.push_back(point());
@@ -695,12 +910,162 @@ public:
 				//return 0;
 			}
 		} // while
+		PRINT_TIME("Object File Load");
+		return build_model(v, n, vn, tc, colors, pblocks, recalc_normals, num_objects, num_groups, verbose);
+	}
+
+	static unsigned resolve_index(int ix, unsigned vect_sz, obj_chunk_data_t &c) { // same as normalize_index(), but sets chunk flags instead of asserting
+		if (ix < 0) {ix += vect_sz;} // negative (relative) index
+		else {--ix;} // positive (absolute) index, specified starting from 1
+		if (ix == -1) {c.had_zero_ix = 1; ++ix;}
+		if ((unsigned)ix >= vect_sz) {c.had_bad_ix = 1; return 0;}
+		return ix;
+	}
+
+	// multithreaded version of read(): the memory mapped file is split into chunks at line boundaries, and chunks are parsed in parallel;
+	// then element offsets are accumulated over the chunks, and elements are copied and face indices and normals are resolved in parallel;
+	// materials, groups, and faces are then processed in file order, so the resulting model is the same as with read()
+	bool read_mt(geom_xform_t const &xf, int recalc_normals, bool verbose) {
+		RESET_TIME;
+		mapped_file_t file;
+		if (!file.open(filename)) {cerr << "Error: Could not open object file " << filename << endl; return 0;}
+		cout << "Reading object file " << filename << " with " << get_num_job_threads() << " threads" << endl;
+		char const *const data((char const *)file.get_data()), *const data_end(data + file.size());
+		size_t const min_chunk_size(1 << 20); // 1MB
+		unsigned const num_chunks(max(1U, min(4*get_num_job_threads(), unsigned(file.size()/min_chunk_size))));
+		vector<char const *> chunk_starts(num_chunks+1, data_end);
+		chunk_starts[0] = data;
+
+		for (unsigned i = 1; i < num_chunks; ++i) { // split at line boundaries
+			char const *p(max(chunk_starts[i-1], data + (file.size()*i)/num_chunks));
+			while (p < data_end && *p != '\n') {++p;}
+			chunk_starts[i] = ((p < data_end) ? p+1 : data_end);
+		}
+		vector<obj_chunk_data_t> chunks(num_chunks);
+		parallel_for_jobs(0, num_chunks, [&](int i) {obj_chunk_parser_t(chunk_starts[i], chunk_starts[i+1], chunks[i]).parse(xf, recalc_normals);});
+		unsigned nv(0), ntc(1), nn(1), num_lines(0); // tc[0] and n[0] are the defaults
+		bool has_colors(0);
+
+		for (obj_chunk_data_t &c : chunks) { // prefix sums of element counts
+			c.v_start = nv; c.tc_start = ntc; c.n_start = nn; c.line_start = num_lines;
+			nv  += (unsigned)c.v .size();
+			ntc += (unsigned)c.tc.size();
+			nn  += (unsigned)c.n .size();
+			num_lines  += c.num_lines;
+			has_colors |= !c.colors.empty();
+
+			if (!c.error.empty()) {
+				cerr << "Error reading " << c.error << " from object file " << filename << " near line " << (c.line_start + c.error_line + 1) << endl;
+				return 0;
+			}
+		}
+		vector<point> v(nv);
+		vector<vector3d> n(nn, zero_vector);
+		vector<counted_normal> vn(recalc_normals ? nv : 0); // vertex normals
+		vector<point2d<float> > tc(ntc, point2d<float>(0.0, 0.0));
+		vector<colorRGB> colors((has_colors ? nv : 0), WHITE); // vertices without colors are white
+
+		parallel_for_jobs(0, num_chunks, [&](int i) { // copy elements to their global positions and resolve face indices
+			obj_chunk_data_t &c(chunks[i]);
+			std::copy(c.v .begin(), c.v .end(), v .begin()+c.v_start );
+			std::copy(c.tc.begin(), c.tc.end(), tc.begin()+c.tc_start);
+			std::copy(c.n .begin(), c.n .end(), n .begin()+c.n_start );
+			std::copy(c.colors.begin(), c.colors.end(), colors.begin()+c.v_start);
+			c.pts.resize(c.raw_ixs.size()/3);
+
+			for (obj_chunk_data_t::face_t const &f : c.faces) {
+				for (unsigned p = f.start; p < f.start+f.npts; ++p) {
+					int const *const raw(&c.raw_ixs[3*p]);
+					vntc_ix_t &pt(c.pts[p]);
+					pt.vix = resolve_index(raw[0], c.v_start+f.nv, c);
+					if (raw[1] != obj_chunk_data_t::IX_NONE) {pt.tix = resolve_index(raw[1], c.tc_start-1+f.ntc, c)+1;} // account for tc[0]
+					if (raw[2] != obj_chunk_data_t::IX_NONE && !recalc_normals) {pt.nix = resolve_index(raw[2], c.n_start-1+f.nn, c)+1;} // account for n[0]
+				}
+			}
+			clear_cont(c.v); clear_cont(c.tc); clear_cont(c.n); clear_cont(c.colors); clear_cont(c.raw_ixs);
+		});
+		for (obj_chunk_data_t const &c : chunks) {
+			if (c.had_zero_ix && !invalid_index_warned) {cerr << "Error: Invalid zero index in object file" << endl; invalid_index_warned = 1;}
+			if (c.had_bad_ix) {cerr << "Error: Invalid vertex, normal, or texture coord index in object file " << filename << endl; return 0;}
+		}
+		parallel_for_jobs(0, num_chunks, [&](int i) { // calculate face normals
+			obj_chunk_data_t &c(chunks[i]);
+			c.face_normals.resize(c.faces.size(), zero_vector);
+
+			for (unsigned f = 0; f < c.faces.size(); ++f) {
+				if (c.faces[f].npts >= 3) {c.face_normals[f] = calc_face_normal(&c.pts[c.faces[f].start], c.faces[f].npts, v);}
+			}
+		});
+		int cur_mat_id(-1);
+		unsigned smoothing_group(0), prev_smoothing_group(0), num_objects(0), num_groups(0), obj_group_id(0);
+		deque<poly_data_block> pblocks;
+		set<string> loaded_mat_libs;
+		bool is_textured(0), had_npts_error(0);
+
+		for (obj_chunk_data_t &c : chunks) { // process commands in file order
+			for (obj_chunk_data_t::cmd_t const &cmd : c.cmds) {
+				unsigned const approx_line(c.line_start + cmd.line + 1);
+
+				switch (cmd.type) {
+				case obj_chunk_data_t::CMD_FACE: {
+					obj_chunk_data_t::face_t const &f(c.faces[cmd.val]);
+					model.mark_mat_as_used(cur_mat_id);
+					poly_data_block &pb(get_block_for_face(pblocks, smoothing_group, prev_smoothing_group));
+					pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
+					pb.polys.back().npts = f.npts;
+					unsigned const pix((unsigned)pb.pts.size());
+					pb.pts.insert(pb.pts.end(), c.pts.begin()+f.start, c.pts.begin()+f.start+f.npts);
+					finish_face(pb, pix, &c.face_normals[cmd.val], v, vn, recalc_normals, is_textured, approx_line, had_npts_error);
+					break;
+				}
+				case obj_chunk_data_t::CMD_USEMTL: {
+					string const &material_name(c.strs[cmd.val]);
+
+					if (material_name.empty()) {
+						if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+						had_empty_mat_error = 1;
+						return 0;
+					}
+					cur_mat_id = model.find_material(material_name);
+				
+					if (cur_mat_id >= 0) { // material was valid
+						int const tid(model.get_material(cur_mat_id).d_tid);
+						is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
+					}
+					break;
+				}
+				case obj_chunk_data_t::CMD_MTLLIB:
+					if (c.strs[cmd.val].empty()) {
+						cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+						return 0;
+					}
+					try_load_mat_lib(c.strs[cmd.val], loaded_mat_libs, approx_line); // nonfatal
+					break;
+				case obj_chunk_data_t::CMD_OBJECT: ++num_objects; ++obj_group_id; break;
+				case obj_chunk_data_t::CMD_GROUP : ++num_groups;  ++obj_group_id; break;
+				case obj_chunk_data_t::CMD_SMOOTH: smoothing_group = cmd.val; break;
+				case obj_chunk_data_t::CMD_UNKNOWN:
+					cerr << "Error: Undefined entry '" << c.strs[cmd.val] << "' in object file " << filename << " near line " << approx_line << endl;
+					break;
+				default: assert(0);
+				} // end switch
+			} // for cmd
+			c = obj_chunk_data_t(); // free memory
+		} // for c
+		PRINT_TIME("Object File Load");
+		return build_model(v, n, vn, tc, colors, pblocks, recalc_normals, num_objects, num_groups, verbose);
+	}
+
+	bool build_model(vector<point> &v, vector<vector3d> &n, vector<counted_normal> &vn, vector<point2d<float> > &tc, vector<colorRGB> &colors,
+		deque<poly_data_block> &pblocks, int recalc_normals, unsigned num_objects, unsigned num_groups, bool verbose)
+	{
+		RESET_TIME;
+		unsigned num_faces(0);
 		remove_excess_cap(v);
 		remove_excess_cap(n);
 		remove_excess_cap(tc);
 		remove_excess_cap(vn);
 		remove_excess_cap(colors);
-		PRINT_TIME("Object File Load");
 		model.load_all_used_tids(); // need to load the textures here to get the colors
 		size_t const num_blocks(pblocks.size());
 		model3d::proc_model_normals(vn, recalc_normals); // if recalc_normals
@@ -785,6 +1150,8 @@ bool write_model3d_file(string const &base_fn, model3d &cur_model) {
 bool read_3ds_file_model(string const &filename, model3d &model, geom_xform_t const &xf, int use_vertex_normals, bool verbose);
 bool read_3ds_file_pts(string const &filename, vector<coll_tquad> *ppts, geom_xform_t const &xf, colorRGBA const &def_c, bool verbose);
 bool read_assimp_model(string const &filename, model3d &model, geom_xform_t const &xf, int recalc_normals, bool verbose);
+bool read_model_cache (string const &filename, model3d &model, geom_xform_t const &xf, int recalc_normals, bool verbose);
+bool write_model_cache(string const &filename, model3d &model, geom_xform_t const &xf, int recalc_normals);
 
 bool const ALWAYS_USE_ASSIMP = 0;
 
@@ -796,8 +1163,10 @@ bool load_model_file(string const &filename, model3ds &models, geom_xform_t cons
 	string const ext(get_file_extension(filename, 0, 1));
 	models.push_back(model3d(filename, models.tmgr, def_tid, def_c, reflective, metalness, recalc_normals, group_cobjs_level));
 	model3d &cur_model(models.back());
+	bool from_cache(0);
 
-	if (!ALWAYS_USE_ASSIMP && ext == "3ds") {
+	if (read_model_cache(filename, cur_model, xf, recalc_normals, verbose)) {from_cache = 1;} // cached binary version of the model is up to date
+	else if (!ALWAYS_USE_ASSIMP && ext == "3ds") {
 		if (!read_3ds_file_model(filename, cur_model, xf, recalc_normals, verbose)) {models.pop_back(); return 0;} // recalc_normals is always true
 		//if (write_file && !write_model3d_file(filename, cur_model)) return 0; // Note: doesn't work because there's no mtllib file
 	}
@@ -808,12 +1177,15 @@ bool load_model_file(string const &filename, model3ds &models, geom_xform_t cons
 	else if (!ALWAYS_USE_ASSIMP && ext == "obj") {
 		check_obj_file_ext(filename, ext);
 		//test_other_obj_loader(filename); // placeholder for testing other object file loaders (tinyobjloader, assimp, etc.)
-		if (!object_file_reader_model(filename, cur_model).read(xf, recalc_normals, verbose)) {models.pop_back(); return 0;}
+		object_file_reader_model reader(filename, cur_model);
+		bool const ret(mt_obj_file_reader ? reader.read_mt(xf, recalc_normals, verbose) : reader.read(xf, recalc_normals, verbose));
+		if (!ret) {models.pop_back(); return 0;}
 		if (write_file && !write_model3d_file(filename, cur_model)) return 0; // don't need to pop the model
 	}
 	else { // not a built-in supported format, try using assimp if compiled in
 		if (!read_assimp_model(filename, cur_model, xf, recalc_normals, verbose)) return 0;
 	}
+	if (!from_cache) {write_model_cache(filename, cur_model, xf, recalc_normals);} // failure is okay; the model will be read again next time
 	if (model_mat_lod_thresh > 0.0) {cur_model.compute_area_per_tri();} // used for TT LOD/distance culling
 	return 1;
 }
@@ -841,3 +1213,41 @@ bool read_model_file(string const &filename, vector<coll_tquad> *ppts, geom_xfor
 }
 
 
+
+
+// compares the serial and multithreaded OBJ readers: average load time over num_iters, and whether the resulting models are identical
+void run_obj_reader_benchmark(string const &filename, unsigned num_iters) {
+
+	using namespace std::chrono;
+	model3ds models; // both models use this texture manager, so texture IDs will match
+	geom_xform_t const xf;
+	string model_data[2];
+	float tot_ms[2] = {0.0, 0.0};
+	num_iters = max(num_iters, 1U);
+	cout << "OBJ reader benchmark for " << filename << " with " << num_iters << " iterations" << endl;
+
+	for (unsigned iter = 0; iter <= num_iters; ++iter) { // the first iteration is for warmup and texture loading, and isn't timed
+		for (unsigned mt = 0; mt < 2; ++mt) {
+			models.push_back(model3d(filename, models.tmgr));
+			auto const t0(high_resolution_clock::now());
+			bool ret(0);
+			{
+				object_file_reader_model reader(filename, models.back());
+				ret = (mt ? reader.read_mt(xf, 0, 0) : reader.read(xf, 0, 0));
+			}
+			float const ms(1000.0f*duration_cast<duration<float>>(high_resolution_clock::now() - t0).count());
+			if (!ret) {cerr << "Error: OBJ reader benchmark failed to read " << filename << endl; models.clear(); return;}
+			if (iter > 0) {tot_ms[mt] += ms;}
+
+			if (iter == num_iters) { // compare the last models
+				std::ostringstream oss;
+				models.back().write_cache_data(oss);
+				model_data[mt] = oss.str();
+			}
+			models.pop_back();
+		} // for mt
+	} // for iter
+	models.clear(); // wait for texture jobs and free textures
+	cout << "OBJ reader: serial " << tot_ms[0]/num_iters << " ms, multithreaded " << tot_ms[1]/num_iters << " ms with " << get_num_job_threads()
+		 << " threads, speedup " << tot_ms[0]/max(tot_ms[1], 0.001f) << "x, models " << ((model_data[0] == model_data[1]) ? "match" : "DIFFER") << endl;
+}
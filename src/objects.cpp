@@ -16,7 +16,7 @@ float const NDIV_SCALE = 200.0;
 
 
 extern bool group_back_face_cull, has_any_billboard_coll, begin_motion, fast_transparent_spheres;
-extern int display_mode, destroy_thresh, xoff2, yoff2;
+extern int display_mode, destroy_thresh, xoff2, yoff2, coll_id[];
 extern float temperature, rain_wetness, snow_cov_amt;
 extern double tfticks;
 extern unsigned ALL_LT[];
@@ -1042,6 +1042,7 @@ void obj_group::create_object_at(unsigned i, point const &pos) {
 	if (objects[i].coll_id >= 0) {remove_reset_coll_obj(objects[i].coll_id);} // just in case
 	objects[i]     = def_objects[type];
 	objects[i].pos = pos;
+	if (coll_id[type] >= 0) {obj_grid_add_new_obj(coll_id[type], i);}
 }
 
 
@@ -1024,15 +1024,11 @@ void ped_manager_t::next_frame() {
 	if (!animate2) return; // nothing to do (only applies to moving peds)
 	float const delta_dir(1.2*(1.0 - pow(0.7f, fticks))); // controls pedestrian turning rate
 	// Note: peds and peds_b can be processed in parallel, but that doesn't seem to make a significant difference in framerate
-	// update people in buildings first, so that it can overlap with car sort and spend less time in the modify_car_data critical section
 	update_building_ai_state(delta_dir);
 
 	if (!peds.empty()) {
 		//timer_t timer("Ped Update"); // ~4.2ms for 10K peds; 1ms for sparse per-city update
-		// Note: should make sure this is after sorting cars, so that road_ix values are actually in order; however, that makes things slower, and is unlikely to make a difference
-#pragma omp critical(modify_car_data)
-		car_manager.extract_car_data(cars_by_city);
-
+		// Note: cars_by_city is the car snapshot from the end of the previous car update, so it's sorted and doesn't change while peds are updated
 		if (ped_destroyed) {remove_destroyed_peds();} // at least one ped was destroyed in the previous frame - remove it/them
 		static bool first_frame(1);
 		float const enable_ai_dist(1.0f*(X_SCENE_SIZE + Y_SCENE_SIZE));
@@ -1053,6 +1049,7 @@ void ped_manager_t::next_frame() {
 		if (need_to_sort_peds) {sort_by_city_and_plot();}
 		first_frame = 0;
 	}
+	get_peds_crossing_roads(peds_crossing_roads_next); // snapshot for cars to use next frame
 }
 
 pedestrian_t const *ped_manager_t::get_ped_at(point const &p1, point const &p2) const { // Note: p1/p2 in local TT space
@@ -0,0 +1,250 @@
+// 3D World - Batched Structure-of-Arrays Physics for Free-Falling Objects
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "mesh.h"
+#include "physics_objects.h"
+#include "profiler.h"
+#include <chrono>
+
+using namespace std::chrono;
+
+
+bool soa_object_physics(1);
+
+extern int world_mode, iticks, enable_fsource;
+extern float tstep, fticks, TIMESTEP, orig_timestep, base_gravity, temperature, ztop, czmax, max_water_height, X_SCENE_SIZE, Y_SCENE_SIZE;
+extern obj_type object_types[];
+extern dwobject def_objects[];
+
+unsigned get_obj_steps_per_frame(dwobject const &obj, int type, bool large_radius, bool precip);
+bool have_teleporters();
+float get_moving_cobjs_zmax();
+
+
+// objects above this zval can't collide with the mesh, water, or any cobj this frame
+float get_free_air_zval() {return max(max(ztop, czmax), max(max_water_height, get_moving_cobjs_zmax()));}
+
+bool can_batch_obj_type(int type) { // small objects with no special case physics in the airborne path of advance_object()
+	return (type != CAMERA && type != SMILEY && type != PLASMA && type != BALL && type != SAWBLADE && type != LANDMINE &&
+		type != MAT_SPHERE && type != PARTICLE && type != FRAGMENT && !is_rocket_type(type));
+}
+
+
+void obj_soa_batch_t::clear(unsigned num_group_objs) {
+
+	ix.clear(); px.clear(); py.clear(); pz.clear(); vx.clear(); vy.clear(); vz.clear(); wx.clear(); wy.clear(); wz.clear(); radius.clear(); zmin.clear();
+	time.clear(); flags.clear(); status.clear(); spf.clear(); dt.clear();
+	advanced.assign(num_group_objs, 0);
+}
+
+// returns true if obj is airborne in the open air above the scene, in which case advance_object() reduces to gravity, drag, and integration
+bool obj_soa_batch_t::try_add(dwobject const &obj, unsigned obj_ix, unsigned steps_per_frame, float free_air_z, bool check_teleport) {
+
+	if (obj.status != 1 || obj.time < 0 || obj.health < 0.0) return 0;
+	if (obj.flags & (CAMERA_VIEW | UNDERWATER | FLOATING | IN_WATER | Z_STOPPED | XY_STOPPED | IS_ON_ICE | OBJ_COLLIDED | STATIC_COBJ_COLL)) return 0;
+	obj_type const &otype(object_types[obj.type]);
+	if (otype.lifetime > 0 && obj.time > otype.lifetime) return 0; // expires this frame
+	if (fabs(obj.velocity.z) < 1.0E-6) return 0; // treated as a collision in advance_object()
+	if (check_teleport && (obj.type == BLOOD || obj.type == CHARRED || obj.type == SHRAPNEL || obj.type == STAR5)) return 0; // may be teleported first
+	float const r(obj.get_true_radius());
+	if ((obj.pos.z - r) <= free_air_z || !is_over_mesh(obj.pos)) return 0;
+	assert(steps_per_frame > 0 && steps_per_frame < 256);
+	vector3d const local_wind(get_local_wind(obj.pos)); // sampled once per frame; only depends on the mesh cell above the scene
+	ix.push_back(obj_ix);
+	px.push_back(obj.pos.x); py.push_back(obj.pos.y); pz.push_back(obj.pos.z);
+	vx.push_back(obj.velocity.x); vy.push_back(obj.velocity.y); vz.push_back(obj.velocity.z);
+	wx.push_back(local_wind.x); wy.push_back(local_wind.y); wz.push_back(local_wind.z);
+	radius.push_back(r);
+	zmin.push_back(obj.pos.z);
+	time.push_back(obj.time);
+	flags.push_back(obj.flags);
+	status.push_back(obj.status);
+	spf.push_back((unsigned char)steps_per_frame);
+	dt.push_back(0.0);
+	return 1;
+}
+
+// the non-fsource free fall part of advance_object() for every substep of every object, as loops over the arrays;
+// objects with fewer steps per frame have a zero timestep and air factor in later substeps
+void obj_soa_batch_t::integrate(float dt_frame, float air_factor, float gravity, float terminal_vel, int time_inc) {
+
+	int const num(size());
+	unsigned max_spf(0);
+	dtk.resize(num);
+	afk.resize(num);
+
+	for (int i = 0; i < num; ++i) {
+		max_spf  = max(max_spf, (unsigned)spf[i]);
+		dt[i]    = dt_frame/spf[i];
+		time[i] += time_inc;
+	}
+	float *const px_(px.data()), *const py_(py.data()), *const pz_(pz.data()), *const vx_(vx.data()), *const vy_(vy.data()), *const vz_(vz.data());
+	float const *const wx_(wx.data()), *const wy_(wy.data()), *const wz_(wz.data()), *const dtk_(dtk.data()), *const afk_(afk.data());
+	float *const zmin_(zmin.data());
+
+	for (unsigned k = 0; k < max_spf; ++k) {
+		float const wscale((k == 0) ? 1.0f : 0.0f); // wind is only added to the XY drag target on the first substep
+
+		for (int i = 0; i < num; ++i) {
+			bool const active(k < spf[i]);
+			dtk[i] = (active ? dt[i] : 0.0f);
+			afk[i] = (active ? air_factor : 0.0f);
+		}
+		// conditions are applied by multiplying by 0.0 or 1.0 rather than with branches; otherwise gcc won't vectorize this loop without -fno-trapping-math
+#pragma omp simd
+		for (int i = 0; i < num; ++i) {
+			float const step_dt(dtk_[i]), af(afk_[i]);
+			float vxi(vx_[i]), vyi(vy_[i]), vzi(vz_[i]);
+			vzi += float(-vzi < terminal_vel)*(std::max((vzi - gravity*step_dt), -terminal_vel) - vzi);
+			float const awz(af*wz_[i]);
+			vzi += float((fabs(awz) > fabs(vzi)) | ((wz_[i] < 0.0f) != (vzi < 0.0f)))*awz;
+			float const tx(vxi + wscale*wx_[i]), ty(vyi + wscale*wy_[i]); // drag target velocity
+			vxi += float((fabs(air_factor*tx) > fabs(vxi)) | ((tx < 0.0f) != (vxi < 0.0f)))*af*(tx - vxi);
+			vyi += float((fabs(air_factor*ty) > fabs(vyi)) | ((ty < 0.0f) != (vyi < 0.0f)))*af*(ty - vyi);
+			px_[i] += step_dt*vxi;
+			py_[i] += step_dt*vyi;
+			pz_[i] += step_dt*vzi;
+			vx_[i]  = vxi;
+			vy_[i]  = vyi;
+			vz_[i]  = vzi;
+			zmin_[i] = std::min(zmin_[i], pz_[i]);
+		} // for i
+	} // for k
+}
+
+unsigned obj_soa_batch_t::classify(float free_air_z) { // returns the number of objects still in free fall
+
+	int const num(size());
+	unsigned num_free(0);
+	for (int i = 0; i < num; ++i) {status[i] = ((zmin[i] - radius[i]) > free_air_z);} // the trajectory is above everything the object can collide with
+
+	for (int i = 0; i < num; ++i) {
+		if (status[i] && !is_over_mesh(point(px[i], py[i], pz[i]))) {status[i] = 0;} // left the simulation region
+		num_free += status[i];
+	}
+	return num_free;
+}
+
+void obj_soa_batch_t::apply(unsigned i, dwobject &obj) const {
+
+	assert(i < size() && status[i]);
+	obj.pos.assign(px[i], py[i], pz[i]);
+	obj.velocity.assign(vx[i], vy[i], vz[i]);
+	obj.time   = time[i];
+	obj.flags  = flags[i];
+	obj.status = 1; // still airborne
+	obj.verify_data();
+}
+
+
+// gathers the objects of this group that are in free fall above the scene, advances them all at once, and writes back the ones that stayed
+// in free fall; the rest are left unmodified for the per-object physics and collision path; returns the number of objects advanced
+unsigned obj_group::batch_advance_free_fall(unsigned iter_count, bool large_radius) {
+
+	int const ptype(get_ptype());
+
+	if (!soa_object_physics || world_mode != WMODE_GROUND || enable_fsource || large_radius || !can_batch_obj_type(ptype) || temperature <= ABSOLUTE_ZERO) {
+		if (!batch.advanced.empty()) {batch.clear();}
+		return 0;
+	}
+	TRACE_ZONE("Batched Object Physics");
+	iter_count = min(iter_count, (unsigned)max_objects());
+	batch.clear(iter_count);
+	float const free_air_z(get_free_air_zval());
+	bool const precip((flags & PRECIPITATION) != 0), check_teleport(have_teleporters());
+
+	for (unsigned i = 0; i < iter_count; ++i) {
+		dwobject const &obj(get_obj(i));
+		if (obj.type != ptype) continue; // precipitation type change
+		batch.try_add(obj, i, get_obj_steps_per_frame(obj, ptype, 0, precip), free_air_z, check_teleport);
+	}
+	if (batch.size() == 0) return 0;
+	obj_type const &otype(object_types[ptype]);
+	batch.integrate(tstep, otype.air_factor, base_gravity*GRAVITY*otype.gravity, otype.terminal_vel, iticks);
+	unsigned const num_free(batch.classify(free_air_z));
+
+	for (unsigned i = 0; i < batch.size(); ++i) {
+		if (!batch.status[i]) continue; // needs collision detection; leave it to the per-object path
+		batch.apply(i, get_obj(batch.ix[i]));
+		batch.advanced[batch.ix[i]] = 1;
+	}
+	TRACE_COUNTER_ADD("Batched Physics Objects", num_free);
+	return num_free;
+}
+
+
+// compares the per-object and batched physics steps on shrapnel in free fall above the scene
+void run_physics_batch_benchmark(unsigned num_objs, unsigned num_iters) {
+
+	if (num_objs == 0 || num_iters == 0) return;
+	if (world_mode != WMODE_GROUND) {cout << "Physics benchmark only supports ground mode" << endl; return;}
+	int const type(SHRAPNEL);
+	float const free_air_z(get_free_air_zval()), sim_tstep((tstep > 0.0) ? tstep : TIMESTEP), sim_fticks((fticks > 0.0) ? fticks : 1.0);
+	rand_gen_t rgen;
+	vector<dwobject> objs(num_objs, def_objects[type]), ref_objs, test_objs;
+
+	for (dwobject &obj : objs) {
+		obj.status   = 1;
+		obj.time     = 0;
+		obj.flags    = 0;
+		obj.pos.assign(0.9*X_SCENE_SIZE*rgen.signed_rand_float(), 0.9*Y_SCENE_SIZE*rgen.signed_rand_float(), (free_air_z + rgen.rand_uniform(2.0, 4.0)));
+		obj.velocity = rgen.signed_rand_vector(20.0);
+		obj.velocity.z += 1.0; // not exactly zero
+	}
+	float const tstep_orig(tstep), fticks_orig(fticks);
+	tstep  = sim_tstep;
+	fticks = sim_fticks;
+	double t_obj(0.0), t_batch(0.0);
+	unsigned num_free(0);
+	obj_soa_batch_t batch;
+
+	for (unsigned n = 0; n < num_iters; ++n) {
+		ref_objs = objs;
+		auto const t1(high_resolution_clock::now());
+
+		for (unsigned i = 0; i < num_objs; ++i) { // same as process_groups()
+			dwobject &obj(ref_objs[i]);
+			unsigned const spf(get_obj_steps_per_frame(obj, type, 0, 0));
+
+			if (spf == 1) {obj.advance_object(1, 0, i); continue;}
+			orig_timestep = TIMESTEP;
+			TIMESTEP     /= float(spf);
+			tstep         = TIMESTEP*fticks;
+
+			for (unsigned k = 0; k < spf; ++k) {
+				obj.advance_object(1, k, i);
+				if (obj.status != 1) break;
+			}
+			TIMESTEP = orig_timestep;
+			tstep    = sim_tstep;
+		} // for i
+		auto const t2(high_resolution_clock::now());
+		test_objs = objs;
+		batch.clear(num_objs);
+		for (unsigned i = 0; i < num_objs; ++i) {batch.try_add(test_objs[i], i, get_obj_steps_per_frame(test_objs[i], type, 0, 0), free_air_z, 0);}
+		obj_type const &otype(object_types[type]);
+		batch.integrate(tstep, otype.air_factor, base_gravity*GRAVITY*otype.gravity, otype.terminal_vel, iticks);
+		num_free = batch.classify(free_air_z);
+
+		for (unsigned i = 0; i < batch.size(); ++i) {
+			if (!batch.status[i]) continue;
+			batch.apply(i, test_objs[batch.ix[i]]);
+			batch.advanced[batch.ix[i]] = 1;
+		}
+		auto const t3(high_resolution_clock::now());
+		t_obj   += duration_cast<duration<double>>(t2 - t1).count();
+		t_batch += duration_cast<duration<double>>(t3 - t2).count();
+	} // for n
+	float max_pos_diff(0.0);
+	for (unsigned i = 0; i < num_objs; ++i) { // compare the results of the last iteration
+		if (batch.was_advanced(i)) {max_pos_diff = max(max_pos_diff, p2p_dist(ref_objs[i].pos, test_objs[i].pos));}
+	}
+	tstep  = tstep_orig;
+	fticks = fticks_orig;
+	double const tot_objs(double(num_objs)*num_iters);
+	cout << "Physics benchmark: " << num_objs << " objects, " << num_iters << " iterations: per-object " << 1000.0*t_obj << " ms ("
+		 << tot_objs/max(1000.0*t_obj, 1.0E-6) << " objects/ms), batched SoA " << 1000.0*t_batch << " ms (" << tot_objs/max(1000.0*t_batch, 1.0E-6)
+		 << " objects/ms), speedup " << t_obj/max(t_batch, 1.0E-9) << "x, " << num_free << " in free fall, max position difference " << max_pos_diff << endl;
+}
@@ -5,15 +5,54 @@
 
 #include "3DWorld.h"
 #include "collision_detect.h"
+#include <functional>
 
 float const MAX_PART_CLOUD_RAD = 0.25;
 float const DECAL_OFFSET       = 0.001;
 
 extern float CAMERA_RADIUS, C_STEP_HEIGHT;
 
+struct obj_grid_ref_t;
+
 struct quad_batch_draw;
 
 
+// side effects of object physics (damage, lights, new objects, etc.) that may be generated on job threads are recorded into the command buffer
+// bound to the current thread and applied later in a fixed order; with no buffer bound they run immediately
+struct physics_cmd_t {
+	enum {CMD_SPLASH=0, CMD_SMOKE, CMD_AREA_DAMAGE, CMD_FIRE_LIGHT, CMD_EXPLOSION};
+	unsigned char type;
+	bool flag; // burn grass for CMD_AREA_DAMAGE, spawn a fire for CMD_FIRE_LIGHT
+	int source, damage_type;
+	unsigned obj_ix;
+	float radius, value; // value is the damage for CMD_AREA_DAMAGE and CMD_EXPLOSION
+	point pos;
+	colorRGBA color;
+
+	physics_cmd_t(unsigned char type_, point const &pos_, float radius_=0.0, float value_=0.0, int source_=NO_SOURCE, colorRGBA const &color_=WHITE) :
+		type(type_), flag(0), source(source_), damage_type(0), obj_ix(0), radius(radius_), value(value_), pos(pos_), color(color_) {}
+	void apply(vector<obj_grid_ref_t> const *smiley_cands=nullptr) const; // smiley_cands: precomputed smileys that may be within CMD_AREA_DAMAGE
+};
+
+class physics_cmd_buffer_t {
+	vector<physics_cmd_t> cmds;
+public:
+	void add(physics_cmd_t const &cmd) {cmds.push_back(cmd);}
+	vector<physics_cmd_t> const &get_cmds() const {return cmds;}
+	void clear() {cmds.clear();}
+	bool empty() const {return cmds.empty();}
+};
+
+struct physics_cmd_scope_t { // binds a command buffer to the current thread for its lifetime
+	physics_cmd_buffer_t *prev;
+	physics_cmd_scope_t(physics_cmd_buffer_t &buf);
+	~physics_cmd_scope_t();
+};
+
+void defer_physics_cmd(physics_cmd_t const &cmd);
+rand_gen_t get_obj_physics_rgen(unsigned obj_ix, unsigned group_ix);
+
+
 struct spark_t {
 
 	float s;
@@ -427,7 +466,26 @@ struct predef_obj { // size = 28
 };
 
 
-class obj_group { // size = 36
+struct obj_soa_batch_t { // structure-of-arrays copy of the hot fields of free-falling objects, for the batched airborne physics step
+
+	vector<unsigned> ix; // object index within its group
+	vector<float> px, py, pz, vx, vy, vz, wx, wy, wz, radius, zmin; // position, velocity, local wind, true radius, and lowest zval this frame
+	vector<int> time;
+	vector<unsigned char> flags, status, spf; // status: 1 = still in free fall after the step, 0 = needs the per-object physics and collision path
+	vector<unsigned char> advanced; // indexed by group object index: 1 if that object was advanced by the batch
+	vector<float> dt, dtk, afk; // substep timestep, and timestep and air factor for the current substep (0 if inactive)
+
+	void clear(unsigned num_group_objs=0);
+	unsigned size() const {return (unsigned)ix.size();}
+	bool was_advanced(unsigned obj_ix) const {return (obj_ix < advanced.size() && advanced[obj_ix]);}
+	bool try_add(dwobject const &obj, unsigned obj_ix, unsigned steps_per_frame, float free_air_z, bool check_teleport);
+	void integrate(float dt_frame, float air_factor, float gravity, float terminal_vel, int time_inc);
+	unsigned classify(float free_air_z);
+	void apply(unsigned i, dwobject &obj) const;
+};
+
+
+class obj_group { // size = 584 on 64-bit, mostly the obj_soa_batch_t vectors
 
 	obj_vector_t<dwobject> objects;
 	vector<predef_obj> predef_objs;
@@ -438,6 +496,7 @@ public:
 	bool enabled, reorderable, predef_use_once;
 	short type;
 	unsigned char flags;
+	obj_soa_batch_t batch; // reused across frames
 
 	obj_group() : init_objects(0), max_objs(0), app_rate(0), end_id(0), new_id(0), enabled(0), reorderable(0), predef_use_once(0), type(0), flags(0) {}
 	void create(int obj_type_, unsigned max_objects_, unsigned init_objects_, unsigned app_rate_,
@@ -468,6 +527,8 @@ public:
 	int get_ptype() const;
 	void add_predef_obj(point const &pos, int type, int rtime);
 	int get_next_predef_obj(dwobject &obj, unsigned ix);
+	unsigned batch_advance_free_fall(unsigned iter_count, bool large_radius);
+	bool was_batch_advanced(unsigned i) const {return batch.was_advanced(i);}
 	vector<predef_obj> const &get_predef_objs() const {return predef_objs;}
 };
 
@@ -477,6 +538,41 @@ template<typename T> void reset_status(vector<T> &objs) {
 }
 
 
+struct obj_grid_ref_t { // an object in a group
+	unsigned group, ix;
+	obj_grid_ref_t(unsigned g=0, unsigned i=0) : group(g), ix(i) {}
+	bool operator< (obj_grid_ref_t const &r) const {return ((group == r.group) ? (ix < r.ix) : (group < r.group));}
+	bool operator==(obj_grid_ref_t const &r) const {return (group == r.group && ix == r.ix);}
+};
+typedef pair<obj_grid_ref_t, obj_grid_ref_t> obj_grid_pair_t;
+
+// uniform grid spatial hash broadphase over the objects of all enabled groups, rebuilt at the start of each physics frame (see obj_grid.cpp);
+// queries return candidates sorted by group and index, which may be outside the query volume and must still be tested exactly by the caller;
+// the query functions return false when the grid isn't valid, in which case the caller should test every object;
+// object vs. object contacts that call cobj coll functions (elastic collisions, dodgeballs, projectiles) still go through the dynamic sphere cobjs
+void build_obj_grid();
+void invalidate_obj_grid();
+void obj_grid_add_new_obj(unsigned group, unsigned ix);
+void obj_grid_check_moved_obj(unsigned group, unsigned ix, point const &pos); // call after an object moves; thread safe
+bool get_objs_in_sphere(point const &center, float radius, vector<obj_grid_ref_t> &refs, int only_group=-1);
+bool get_objs_in_spheres(vector<sphere_t> const &spheres, vector<vector<obj_grid_ref_t>> &refs, int only_group=-1); // batch version, in parallel
+bool get_objs_intersecting_cube(cube_t const &cube, vector<obj_grid_ref_t> &refs, int only_group=-1); // for sphere vs. cobj tests
+bool get_overlapping_obj_pairs(vector<obj_grid_pair_t> &pairs, int group1=-1, int group2=-1); // sphere vs. sphere; pairs with group1 first
+void print_obj_grid_stats();
+
+class obj_grid_query_t { // objects of each group that may be within a sphere, for loops over groups; falls back to all objects if the grid isn't valid
+
+	vector<obj_grid_ref_t> refs;
+	vector<unsigned> ixs;
+	bool valid;
+public:
+	obj_grid_query_t(point const &center, float radius, int only_group=-1) : valid(get_objs_in_sphere(center, radius, refs, only_group)) {}
+	obj_grid_query_t(cube_t const &cube, int only_group=-1) : valid(get_objs_intersecting_cube(cube, refs, only_group)) {}
+	obj_grid_query_t(vector<obj_grid_ref_t> const &refs_) : refs(refs_), valid(1) {} // candidates from a batch query
+	vector<unsigned> const &get_group_ixs(unsigned group, unsigned end_id);
+};
+
+
 class reflective_cobjs_t {
 
 	struct map_val_t {
@@ -91,7 +91,7 @@ public:
 				if (splashes != nullptr) {maybe_add_rain_splash(pos, bot_pos, mesh_height[y][x], *splashes, x, y, 0);} // line_intersect_mesh(pos, bot_pos, cpos);
 				return 0;
 			}
-			else if (check_cobj_coll && bot_pos.z < v_collision_matrix[y][x].zmax) { // possible cobj collision
+			else if (check_cobj_coll && bot_pos.z < v_collision_grid.get_zmax(x, y)) { // possible cobj collision
 				if (splashes != nullptr && check_splash_dist(bot_pos)) {
 					point cpos;
 					vector3d cnorm;
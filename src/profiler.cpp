@@ -4,12 +4,78 @@
 
 #include "3DWorld.h"
 #include "profiler.h"
+#include "job_system.h"
+#include <fstream>
+#include <thread>
+#include <mutex>
 
 using std::string;
 
 void maybe_update_loading_screen(const char *str);
 int omp_get_thread_num_3dw();
 
+string escape_json_string(string const &s) { // for names written to JSON reports and traces
+	string ret;
+
+	for (char c : s) {
+		if      (c == '"' || c == '\\') {ret.push_back('\\'); ret.push_back(c);}
+		else if ((unsigned char)c < 32) {ret.push_back(' ');}
+		else {ret.push_back(c);}
+	}
+	return ret;
+}
+
+
+class timing_sample_recorder_t { // records every individual sample for benchmark reports
+
+	map<string, vector<float>> samples;
+
+	static float get_percentile(vector<float> const &v, float p) { // v must be sorted; nearest rank
+		assert(!v.empty());
+		unsigned const rank(unsigned(ceil(p*v.size())));
+		return v[min((unsigned)v.size(), max(rank, 1U)) - 1];
+	}
+public:
+	bool enabled;
+
+	timing_sample_recorder_t() : enabled(0) {}
+	void clear() {samples.clear();}
+	void add(const char *str, float val) {samples[str].push_back(val);} // Note: caller must hold the timer_update critical section
+
+	bool write_report(string const &fn, unsigned num_frames) const {
+		std::ofstream out(fn);
+		if (!out.good()) {std::cerr << "Error: Failed to open benchmark report file " << fn << " for write" << endl; return 0;}
+		bool const json(fn.size() >= 5 && fn.substr(fn.size()-5) == ".json");
+		if (json) {out << "{\n  \"frames\": " << num_frames << ",\n  \"timers\": [";}
+		else      {out << "name,count,min,median,p99,max,mean,total" << endl;}
+		bool first(1);
+
+		for (auto const &i : samples) {
+			if (i.second.empty()) continue;
+			vector<float> v(i.second);
+			sort(v.begin(), v.end());
+			double total(0.0);
+			for (float t : v) {total += t;}
+			float const vmin(v.front()), vmed(get_percentile(v, 0.5)), vp99(get_percentile(v, 0.99)), vmax(v.back()), mean(total/v.size());
+
+			if (json) {
+				out << (first ? "\n" : ",\n") << "    {\"name\": \"" << escape_json_string(i.first) << "\", \"count\": " << v.size() << ", \"min\": " << vmin << ", \"median\": " << vmed
+					<< ", \"p99\": " << vp99 << ", \"max\": " << vmax << ", \"mean\": " << mean << ", \"total\": " << total << "}";
+			}
+			else {
+				string name(i.first);
+				std::replace(name.begin(), name.end(), ',', ' '); // names are free form, so make sure they don't add extra fields
+				out << name << "," << v.size() << "," << vmin << "," << vmed << "," << vp99 << "," << vmax << "," << mean << "," << total << endl;
+			}
+			first = 0;
+		} // for i
+		if (json) {out << "\n  ]\n}" << endl;}
+		return out.good();
+	}
+};
+
+timing_sample_recorder_t sample_recorder;
+
 
 template <typename T> class timing_profiler {
 
@@ -32,6 +98,7 @@ public:
 		{
 			if (enabled) {entries[str].add(delta_time);}
 			else {cout << str << " time = " << delta_time << endl;}
+			if (sample_recorder.enabled) {sample_recorder.add(str, float(delta_time));}
 		}
 		if (!no_loading_screen && delta_time > 0 && omp_get_thread_num_3dw() == 0) {maybe_update_loading_screen(str);} // only call on main thread when time has elapsed
 	}
@@ -52,9 +119,25 @@ public:
 timing_profiler<int> global_profiler;
 timing_profiler<float> global_highres_profiler;
 
-void toggle_timing_profiler() {global_profiler.enabled ^= 1; global_highres_profiler.enabled ^= 1;}
+extern string trace_filename;
+
+void toggle_timing_profiler() {
+	global_profiler.enabled ^= 1; global_highres_profiler.enabled ^= 1;
+	if (trace_filename.empty()) return;
+	if (global_profiler.enabled) {start_trace();} else {stop_trace_and_write(trace_filename);} // trace the same interval as the profiler
+}
 void register_timing_value(const char *str, int delta_time, bool no_loading_screen) {global_profiler.register_time(str, delta_time, no_loading_screen);}
 
+void set_timing_sample_recording(bool enable) {
+	sample_recorder.enabled = enable;
+	if (!enable) {sample_recorder.clear();}
+}
+void add_timing_sample(const char *str, float delta_time_ms) { // doesn't print or update the loading screen
+#pragma omp critical(timer_update)
+	if (sample_recorder.enabled) {sample_recorder.add(str, delta_time_ms);}
+}
+bool write_timing_sample_report(string const &fn, unsigned num_frames) {return sample_recorder.write_report(fn, num_frames);}
+
 void timing_profiler_stats() {
 	global_profiler.stats();
 	global_profiler.clear();
@@ -62,10 +145,173 @@ void timing_profiler_stats() {
 	global_highres_profiler.clear();
 }
 
+highres_timer_t::highres_timer_t(char const *const name_,  bool enabled_, bool nls) :
+	name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()), trace_start(trace_enabled.load(std::memory_order_relaxed) ? get_trace_time_ns() : 0) {}
+highres_timer_t::highres_timer_t(std::string const &name_, bool enabled_, bool nls) :
+	name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()), trace_start(trace_enabled.load(std::memory_order_relaxed) ? get_trace_time_ns() : 0) {}
+
 void highres_timer_t::end() {
 	if (!enabled || name.empty()) return;
+	if (trace_start) {add_trace_zone(name, trace_start);}
 	float const elapsed(duration_cast<duration<float>>(clock.now() - timer1).count());
 	global_highres_profiler.register_time(name.c_str(), 1000.0f*elapsed, no_loading_screen); // print in ms
 	name.clear(); // make sure we don't double count this
 }
 
+
+
+// *** trace zones ***
+
+std::atomic<bool> trace_enabled(0);
+
+class trace_recorder_t {
+
+	struct zone_t {
+		unsigned long long start, end;
+		unsigned name_ix;
+	};
+	struct counter_sample_t {
+		unsigned long long time, value;
+		trace_counter_t const *counter;
+	};
+	struct thread_buf_t { // written by one thread; the mutex is only contended when the trace is written
+		std::mutex mutex;
+		unsigned tid;
+		string label;
+		map<char const *, unsigned> name_ptr_map; // fast path for string literals
+		map<string, unsigned> name_map;
+		vector<string> names;
+		vector<zone_t> zones;
+
+		thread_buf_t(unsigned tid_, string const &label_) : tid(tid_), label(label_) {}
+
+		unsigned get_name_ix(string const &name) {
+			auto it(name_map.find(name));
+			if (it != name_map.end()) return it->second;
+			unsigned const ix(names.size());
+			names.push_back(name);
+			name_map[name] = ix;
+			return ix;
+		}
+		unsigned get_name_ix(char const *const name) {
+			auto it(name_ptr_map.find(name));
+			if (it != name_ptr_map.end()) return it->second;
+			unsigned const ix(get_name_ix(string(name)));
+			name_ptr_map[name] = ix;
+			return ix;
+		}
+		template<typename T> void add(T const &name, unsigned long long start, unsigned long long end) {
+			std::lock_guard<std::mutex> lock(mutex);
+			zone_t const zone = {start, end, get_name_ix(name)};
+			zones.push_back(zone);
+		}
+		void reset() { // frees the memory; the buffer itself is kept, since its thread may still hold a reference to it
+			std::lock_guard<std::mutex> lock(mutex);
+			vector<zone_t>().swap(zones);
+			name_ptr_map.clear();
+			name_map.clear();
+			names.clear();
+		}
+	};
+	std::mutex mutex; // protects bufs, counters, and counter_samples
+	vector<std::unique_ptr<thread_buf_t>> bufs;
+	thread_buf_t const *main_buf=nullptr; // the buffer of the thread that started the trace
+	map<string, std::unique_ptr<trace_counter_t>> counters;
+	vector<counter_sample_t> counter_samples;
+	unsigned long long start_time=0;
+
+	double to_us(unsigned long long t) const {return 0.001*double((t > start_time) ? (t - start_time) : 0);}
+public:
+	thread_buf_t &get_thread_buf() {
+		thread_local thread_buf_t *buf(nullptr);
+		
+		if (buf == nullptr) {
+			std::lock_guard<std::mutex> lock(mutex);
+			unsigned const tid(bufs.size()), worker_ix(get_job_worker_index());
+			bufs.emplace_back(new thread_buf_t(tid, (worker_ix ? ("Job Worker " + std::to_string(worker_ix)) : ("Thread " + std::to_string(tid)))));
+			buf = bufs.back().get();
+		}
+		return *buf;
+	}
+	trace_counter_t &get_counter(char const *const name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<trace_counter_t> &counter(counters[name]);
+		if (!counter) {counter.reset(new trace_counter_t(name));}
+		return *counter;
+	}
+	void sample_counters() {
+		unsigned long long const time(get_trace_time_ns());
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto &i : counters) {
+			counter_sample_t const sample = {time, i.second->get_and_reset(), i.second.get()};
+			counter_samples.push_back(sample);
+		}
+	}
+	void start() { // must be called by the main thread
+		thread_buf_t const &buf(get_thread_buf());
+		std::lock_guard<std::mutex> lock(mutex);
+		main_buf = &buf;
+		for (auto &b : bufs) {b->reset();}
+		for (auto &i : counters) {i.second->get_and_reset();}
+		counter_samples.clear();
+		start_time = get_trace_time_ns();
+	}
+	bool write(string const &fn) {
+		std::ofstream out(fn);
+		if (!out.good()) {std::cerr << "Error: Failed to open trace file " << fn << " for write" << endl; return 0;}
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned num_zones(0);
+		bool first(1);
+		out << "{\"traceEvents\":[";
+
+		for (auto &b : bufs) {
+			std::lock_guard<std::mutex> buf_lock(b->mutex);
+			out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << b->tid
+				<< ",\"args\":{\"name\":\"" << escape_json_string((b.get() == main_buf) ? string("Main Thread") : b->label) << "\"}}";
+			first = 0;
+
+			for (zone_t const &z : b->zones) {
+				out << ",\n{\"name\":\"" << escape_json_string(b->names[z.name_ix]) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << b->tid
+					<< ",\"ts\":" << to_us(z.start) << ",\"dur\":" << 0.001*double(z.end - z.start) << "}";
+			}
+			num_zones += b->zones.size();
+		} // for b
+		for (counter_sample_t const &s : counter_samples) {
+			out << (first ? "\n" : ",\n") << "{\"name\":\"" << escape_json_string(s.counter->name) << "\",\"ph\":\"C\",\"pid\":0,\"tid\":0,\"ts\":" << to_us(s.time)
+				<< ",\"args\":{\"value\":" << s.value << "}}";
+			first = 0;
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+		cout << "Wrote " << num_zones << " trace zones and " << counter_samples.size() << " counter samples from " << bufs.size() << " threads to " << fn << endl;
+		counter_samples.clear();
+		for (auto &b : bufs) {b->reset();} // free the zones and names until the next trace
+		return out.good();
+	}
+};
+
+trace_recorder_t trace_recorder; // Note: thread buffers are registered on first use and live until exit, but their contents are freed after each trace
+
+unsigned long long get_trace_time_ns() { // never returns zero, which is used to mean "not tracing"
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() + 1;
+}
+void add_trace_zone(char const *const name, unsigned long long start_ns) {
+	if (trace_enabled.load(std::memory_order_relaxed)) {trace_recorder.get_thread_buf().add(name, start_ns, get_trace_time_ns());}
+}
+void add_trace_zone(string const &name, unsigned long long start_ns) {
+	if (trace_enabled.load(std::memory_order_relaxed)) {trace_recorder.get_thread_buf().add(name, start_ns, get_trace_time_ns());}
+}
+trace_counter_t &get_trace_counter(char const *const name) {return trace_recorder.get_counter(name);}
+
+void trace_frame_end() {
+	if (trace_enabled.load(std::memory_order_relaxed)) {trace_recorder.sample_counters();}
+}
+void start_trace() {
+	trace_recorder.start();
+	trace_enabled = 1;
+}
+bool stop_trace_and_write(string const &fn) {
+	if (!trace_enabled) return 0;
+	trace_enabled = 0;
+	return trace_recorder.write(fn);
+}
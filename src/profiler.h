@@ -5,6 +5,7 @@
 
 #include <string>
 #include <chrono>
+#include <atomic>
 
 using namespace std::chrono;
 
@@ -13,10 +14,45 @@ class highres_timer_t { // should this share a base class with timer_t?
 	bool enabled, no_loading_screen;
 	high_resolution_clock::time_point timer1;
 	high_resolution_clock clock;
+	unsigned long long trace_start;
 public:
-	highres_timer_t(char const *const name_,  bool enabled_=1, bool nls=0) : name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()) {}
-	highres_timer_t(std::string const &name_, bool enabled_=1, bool nls=0) : name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()) {}
+	highres_timer_t(char const *const name_,  bool enabled_=1, bool nls=0);
+	highres_timer_t(std::string const &name_, bool enabled_=1, bool nls=0);
 	~highres_timer_t() {end();}
 	void end();
 };
 
+
+// Hierarchical, per-thread trace zones exported in Chrome trace event format (chrome://tracing, Perfetto).
+// Zones nest by time on each thread, so child zones show up under their parents. When tracing is disabled a zone is a single branch.
+extern std::atomic<bool> trace_enabled; // relaxed loads: a zone that starts or ends while tracing is toggled may be dropped
+unsigned long long get_trace_time_ns();
+void add_trace_zone(char const *const name, unsigned long long start_ns); // name must be a string literal or otherwise persistent
+void add_trace_zone(std::string const &name, unsigned long long start_ns);
+void start_trace();
+bool stop_trace_and_write(std::string const &fn);
+void trace_frame_end(); // emits counter values for this frame and resets them
+
+class trace_zone_t {
+	char const *name;
+	unsigned long long start;
+public:
+	trace_zone_t(char const *const name_) : name(name_), start(trace_enabled.load(std::memory_order_relaxed) ? get_trace_time_ns() : 0) {}
+	~trace_zone_t() {if (start) {add_trace_zone(name, start);}}
+};
+
+class trace_counter_t { // per-frame counter such as cobjs tested or rays traced
+	std::atomic<unsigned long long> value;
+public:
+	char const *const name;
+	trace_counter_t(char const *const name_) : value(0), name(name_) {}
+	void add(unsigned long long n) {value.fetch_add(n, std::memory_order_relaxed);}
+	unsigned long long get_and_reset() {return value.exchange(0);}
+};
+trace_counter_t &get_trace_counter(char const *const name); // same counter for every call with the same name
+
+#define TRACE_ZONE_CAT2(a, b) a##b
+#define TRACE_ZONE_CAT(a, b) TRACE_ZONE_CAT2(a, b)
+#define TRACE_ZONE(name) trace_zone_t const TRACE_ZONE_CAT(trace_zone_, __LINE__)(name)
+#define TRACE_COUNTER_ADD(name, n) {if (trace_enabled.load(std::memory_order_relaxed)) {static trace_counter_t &counter_(get_trace_counter(name)); counter_.add(n);}}
+
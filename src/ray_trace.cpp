@@ -6,6 +6,7 @@
 #include "mesh.h"
 #include "model3d.h"
 #include "binary_file_io.h"
+#include "profiler.h"
 #include <atomic>
 #include <thread>
 
@@ -20,13 +21,15 @@ float const ICE_ALBEDO    = 0.8;
 
 bool keep_beams(0); // debugging mode
 bool kill_raytrace(0);
+bool use_ray_packets(1); // trace primary rays in packets with SIMD BVH node tests
+bool progressive_lighting(0); // trace sky/global/local lighting in the background in passes that are blended in as they finish
 bool no_stat_moving(0); // generally not thread safe for dynamic lighting update, since BVH is rebuilt per-frame; also, wrong to cache lighting for moving cobjs
 unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), DYNAMIC_RAYS(1000000), NUM_THREADS(1), MAX_RAY_BOUNCES(20);
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 
-extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
+extern bool compress_lighting_files, has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
 extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
 extern float water_plane_z, temperature, snow_depth, ray_step_size_mult, first_ray_weight[];
 extern char *lighting_file[];
@@ -260,12 +263,14 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 
 
 void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr,
+	line_packet_t const *packet=nullptr, unsigned packet_ix=0) // packet: optional precomputed cobj intersection for the clipped p1 => p2
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
 	//assert(!is_nan(p1) && !is_nan(p2));
 	++tot_rays;
+	TRACE_COUNTER_ADD("Light Rays Cast", 1);
 
 	// find intersection point with scene cobjs
 	point orig_p1(p1);
@@ -277,7 +282,9 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 	float t(0.0), zval(0.0);
 	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
 	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
+	bool coll(0);
+	if (packet) {coll = packet->get_hit(packet_ix, cpos, cnorm, cindex);} // already traced as part of a packet
+	else {coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving);} // fast=1, exclude voxels, maybe skip init colls
 	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
 
 	// find the intersection point with the model3ds
@@ -495,16 +502,73 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 }
 
 
+// queues primary rays and finds their first cobj intersections in packets, then casts them in the order they were added;
+// most useful for coherent rays such as sky rays from the same point or parallel sun/moon rays
+class light_ray_caster_t {
+
+	struct queued_ray_t {
+		point p1, p2;
+		colorRGBA color;
+		float weight;
+		int packet_ix; // -1 = not in the packet (clipped away)
+	};
+	lmap_manager_t *lmgr;
+	float line_length;
+	int ignore_cobj, ltype;
+	rand_gen_t &rgen;
+	cobj_ray_accum_map_t *accum_map;
+	line_packet_t packet;
+	queued_ray_t rays[line_packet_t::SIZE];
+	unsigned num_rays;
+
+public:
+	light_ray_caster_t(lmap_manager_t *lmgr_, float line_length_, int ignore_cobj_, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_) :
+		lmgr(lmgr_), line_length(line_length_), ignore_cobj(ignore_cobj_), ltype(ltype_), rgen(rgen_), accum_map(accum_map_), num_rays(0) {}
+	~light_ray_caster_t() {flush();}
+
+	void cast(point const &p1, point const &p2, float weight, colorRGBA const &color) {
+		if (!use_ray_packets || world_mode != WMODE_GROUND) { // trace immediately
+			cast_light_ray(lmgr, p1, p2, weight, weight, color, line_length, ignore_cobj, ltype, 0, rgen, accum_map);
+			return;
+		}
+		queued_ray_t &r(rays[num_rays++]);
+		r.p1 = p1; r.p2 = p2; r.color = color; r.weight = weight; r.packet_ix = -1;
+		point c1(p1), c2(p2);
+
+		// same clipping as cast_light_ray(), which will clip again to the same result
+		if (do_line_clip_scene(c1, c2, min(zbottom, czmin), max(ztop, czmax)) && !((display_mode & 0x01) && is_under_mesh(c1))) {
+			r.packet_ix = packet.num;
+			packet.add(c1, c2, (c1 == p1)); // skip init colls if not clipped
+		}
+		if (num_rays == line_packet_t::SIZE) {flush();}
+	}
+	void flush() {
+		if (packet.num > 0) {check_coll_line_exact_tree_packet(packet, ignore_cobj, 0, 1, no_stat_moving);} // include voxels
+
+		for (unsigned i = 0; i < num_rays; ++i) {
+			queued_ray_t const &r(rays[i]);
+			cast_light_ray(lmgr, r.p1, r.p2, r.weight, r.weight, r.color, line_length, ignore_cobj, ltype, 0, rgen, accum_map, nullptr,
+				((r.packet_ix >= 0) ? &packet : nullptr), max(r.packet_ix, 0));
+		}
+		packet.clear();
+		num_rays = 0;
+	}
+};
+
+
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
 	bool is_thread, verbose, randomized, is_running;
+	float ray_frac; // fraction of the total rays to trace, < 1.0 for progressive lighting passes
 	cube_t update_bcube;
 	lmap_manager_t *lmgr;
 	cobj_ray_accum_map_t accum_map;
 
-	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0)
-		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), lmgr(nullptr) {update_bcube.set_to_zeros();}
+	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0, float rf=1.0)
+		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), ray_frac(rf), lmgr(nullptr) {update_bcube.set_to_zeros();}
+
+	unsigned get_num_rays(unsigned nrays) const {return ((ray_frac == 1.0) ? nrays/num : unsigned(ray_frac*nrays/num + 0.5));} // this thread's share of nrays
 
 	void pre_run(rand_gen_t &rgen) {
 		assert(lmgr);
@@ -543,7 +607,8 @@ public:
 	}
 	void run(void (*func)(rt_data *)) {
 		assert(threads.size() == data.size());
-		for (unsigned t = 0; t < threads.size(); ++t) {threads[t] = std::thread(func, (rt_data *)(&data[t]));}
+		auto traced_func([func](rt_data *d) {TRACE_ZONE("Ray Trace Thread"); func(d);});
+		for (unsigned t = 0; t < threads.size(); ++t) {threads[t] = std::thread(traced_func, (rt_data *)(&data[t]));}
 	}
 	void join() {
 		for (unsigned t = 0; t < threads.size(); ++t) {threads[t].join();}
@@ -554,10 +619,11 @@ public:
 thread_manager_t<rt_data> thread_manager;
 lmap_manager_t thread_temp_lmap;
 
-bool indir_lighting_updated() {return (global_lighting_update && (lmap_manager.was_updated || thread_temp_lmap.was_updated));} // only for global updates
+bool progressive_lighting_next_frame();
+void wait_for_progressive_lighting_pass();
 
 
-void kill_current_raytrace_threads() {
+void stop_raytrace_threads() {
 
 	if (thread_manager.is_active()) { // can't have two running at once, so kill the existing one
 		// cancel thread?
@@ -581,6 +647,7 @@ void update_lmap_from_temp_copy() {
 
 void check_for_lighting_finished() { // to be called about once per frame
 
+	if (progressive_lighting_next_frame()) return; // progressive lighting passes are using the threads
 	if (!thread_manager.is_active()) return; // inactive
 	if (thread_manager.any_threads_running()) return; // still running
 	thread_manager.join_and_clear(); // clear() or join_and_clear()?
@@ -589,9 +656,13 @@ void check_for_lighting_finished() { // to be called about once per frame
 
 
 // see https://computing.llnl.gov/tutorials/pthreads/ (for old pthread implementation - now using std::thread)
-void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype, unsigned job_id=0) {
-
-	kill_current_raytrace_threads();
+// progressive lighting passes trace ray_frac of the rays into dest_lmgr, using pass_ix to select a different random sequence for each pass
+void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype,
+	unsigned job_id=0, float ray_frac=1.0, unsigned pass_ix=0, lmap_manager_t *dest_lmgr=nullptr)
+{
+	if (dest_lmgr == nullptr) {wait_for_progressive_lighting_pass();} // let the current pass finish rather than killing it
+	stop_raytrace_threads();
+	lmap_manager.finish_pending_reads(); // ray tracing adds to the lighting values
 	assert(num_threads > 0 && num_threads < 100);
 	assert(!keep_beams || num_threads == 1); // could use a mutex instead to make this legal
 	bool const single_thread(num_threads == 1);
@@ -599,11 +670,13 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 	thread_manager.create(num_threads);
 	vector<rt_data> &data(thread_manager.data);
 	if (use_temp_lmap) {thread_temp_lmap.init_from(lmap_manager);}
+	unsigned long long const start_rays(tot_rays);
+	auto const start_time(high_resolution_clock::now());
 
 	for (unsigned t = 0; t < data.size(); ++t) {
 		// create a custom lmap_manager_t for each thread then merge them together?
-		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
-		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
+		data[t] = rt_data(t, num_threads, (234323*(t+1) + 7919*pass_ix), !single_thread, (verbose && t == 0), randomized, ltype, job_id, ray_frac);
+		data[t].lmgr = (dest_lmgr ? dest_lmgr : (use_temp_lmap ? &thread_temp_lmap : &lmap_manager));
 	}
 	if (single_thread && blocking) { // threads disabled
 		start_func((rt_data *)(&data[0]));
@@ -624,6 +697,13 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 			}
 		}
 		thread_manager.clear();
+
+		if (verbose) { // report throughput, including secondary rays
+			unsigned long long const num_rays(tot_rays - start_rays);
+			float const secs(duration_cast<duration<float>>(high_resolution_clock::now() - start_time).count());
+			cout << "Ray trace: " << num_rays << " rays in " << secs << "s = " << unsigned(num_rays/max(secs, 0.001f)) << " rays/s"
+				 << (use_ray_packets ? " (packets)" : "") << endl;
+		}
 	}
 	//cout << "total rays: " << tot_rays << ", hits: " << num_hits << ", cells touched: " << cells_touched << endl;
 	//tot_rays = num_hits = cells_touched = 0;
@@ -641,12 +721,10 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+void trace_one_global_ray(light_ray_caster_t &caster, point const &pos, point const &pt, colorRGBA const &color, float ray_wt, bool is_scene_cube, float line_length) {
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	caster.cast(pos, end_pt, ray_wt, color);
 }
 
 
@@ -656,6 +734,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 	float const line_length(2.0*get_scene_radius());
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
 	float proj_area[3] = {0}, tot_area(0.0);
+	light_ray_caster_t caster(lmgr, line_length, -1, ltype, rgen, accum_map);
 
 	for (unsigned i = 0; i < 3; ++i) { // adjust the number or weight of rays based on sun/moon position, or simply modify color scale?
 		if (disabled_edges & EFLAGS[i][ldir[i] < 0.0]) continue; // should this be here, or should we just skip them later?
@@ -681,7 +760,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(caster, pos, pt, color, ray_wt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -698,10 +777,11 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(caster, pos, pt, color, ray_wt, is_scene_cube, line_length);
 				}
 			}
 		}
+		caster.flush();
 		if (verbose) {cout << endl;}
 	} // for i
 }
@@ -719,12 +799,12 @@ void trace_ray_block_global_light(rt_data *data, point const &pos, colorRGBA con
 		float const ray_wt(RAY_WEIGHT*weight*color.alpha/GLOBAL_RAYS);
 		assert(ray_wt > 0.0);
 		cube_t const bnds(get_scene_bounds());
-		trace_ray_block_global_cube(data->lmgr, bnds, pos, color, ray_wt, max(1U, GLOBAL_RAYS/data->num), LIGHTING_GLOBAL, 0, 1, data->verbose, data->randomized, rgen, &data->accum_map);
+		trace_ray_block_global_cube(data->lmgr, bnds, pos, color, ray_wt, max(1U, data->get_num_rays(GLOBAL_RAYS)), LIGHTING_GLOBAL, 0, 1, data->verbose, data->randomized, rgen, &data->accum_map);
 	}
 	for (cube_light_src_vect::const_iterator i = global_cube_lights.begin(); i != global_cube_lights.end(); ++i) {
 		if (data->num == 0 || i->num_rays == 0) continue; // disabled
 		if (data->verbose) {cout << "Cube volume light source " << (i - global_cube_lights.begin()) << " of " << global_cube_lights.size() << endl;}
-		unsigned const num_rays(i->num_rays/data->num);
+		unsigned const num_rays(data->get_num_rays(i->num_rays));
 		float const cube_weight(RAY_WEIGHT*weight*i->intensity/i->num_rays);
 		trace_ray_block_global_cube(data->lmgr, i->bounds, pos, color, cube_weight, num_rays, LIGHTING_GLOBAL, i->disabled_edges, 0, data->verbose, data->randomized, rgen, &data->accum_map);
 		cube_start_rays += num_rays;
@@ -760,7 +840,7 @@ void trace_ray_block_sky(rt_data *data) {
 
 	if (NPTS > 0 && NRAYS > 0) {
 		float const ray_wt(get_sky_light_ray_weight());
-		unsigned const block_npts(max(1U, NPTS/data->num));
+		unsigned const block_npts(max(1U, data->get_num_rays(NPTS)));
 		vector<point> pts(block_npts);
 		vector<vector3d> dirs(NRAYS);
 
@@ -770,6 +850,7 @@ void trace_ray_block_sky(rt_data *data) {
 			} while (pts[p].z < zbottom); // force above zbottom
 		}
 		sort(pts.begin(), pts.end());
+		light_ray_caster_t caster(data->lmgr, line_length, -1, LIGHTING_SKY, rgen, &data->accum_map);
 		if (data->verbose) {cout << "Sky light source progress (of " << block_npts << "): 0";}
 
 		for (unsigned p = 0; p < block_npts; ++p) {
@@ -789,16 +870,19 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				caster.cast(pt, end_pt, ray_wt, WHITE);
 				++start_rays;
 			}
+			caster.flush(); // don't mix rays from different points in a packet
 		}
 		if (data->verbose) {cout << endl;}
 	}
+	light_ray_caster_t cube_caster(data->lmgr, line_length, -1, LIGHTING_SKY, rgen, &data->accum_map);
+
 	for (cube_light_src_vect::const_iterator i = sky_cube_lights.begin(); i != sky_cube_lights.end(); ++i) {
 		if (kill_raytrace) break;
 		if (data->num == 0 || i->num_rays == 0) continue; // disabled
-		unsigned const num_rays(i->num_rays/data->num);
+		unsigned const num_rays(data->get_num_rays(i->num_rays));
 		float const cube_weight(RAY_WEIGHT*i->intensity/i->num_rays);
 		if (data->verbose) {cout << "Cube volume light source " << (i - sky_cube_lights.begin()) << " of " << sky_cube_lights.size() << ", progress (of " << 1+num_rays/1000 << "): 0";}
 		cube_start_rays += num_rays;
@@ -810,8 +894,9 @@ void trace_ray_block_sky(rt_data *data) {
 			vector3d dir(rgen.signed_rand_vector_spherical().get_norm()); // need high quality distribution
 			dir.z = -fabs(dir.z); // make sure z is negative since this is supposed to be light from the sky
 			point const end_pt(pt + dir*line_length);
-			cast_light_ray(data->lmgr, pt, end_pt, cube_weight, cube_weight, i->color, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+			cube_caster.cast(pt, end_pt, cube_weight, i->color);
 		}
+		cube_caster.flush();
 		if (data->verbose) {cout << endl;}
 	}
 	if (data->verbose) {
@@ -936,6 +1021,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 				normal[dim] = (dir ? 1.0 : -1.0);
 				point start_pt;
 				start_pt[dim] = cube.d[dim][dir] + 1.0E-5*radius*normal[dim]; // move slightly away from cube edge
+				light_ray_caster_t caster(lmgr, line_length, -1, ltype, rgen, nullptr); // init_cobj not used here
 				//cout << TXT(dim) << TXT(dir) << TXT(d1) << TXT(d2) << TXT(side_area[dim]) << TXT(side_rays) << endl;
 
 				for (unsigned n = 0; n < side_rays; ++n) {
@@ -945,7 +1031,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 					start_pt[d1] = rgen.rand_uniform(cube.d[d1][0], cube.d[d1][1]);
 					start_pt[d2] = rgen.rand_uniform(cube.d[d2][0], cube.d[d2][1]);
 					point const end_pt(start_pt + dir*line_length);
-					cast_light_ray(lmgr, start_pt, end_pt, ray_wt, ray_wt, lcolor, line_length, -1, ltype, 0, rgen, nullptr); // init_cobj not used here
+					caster.cast(start_pt, end_pt, ray_wt, lcolor);
 				} // for n
 			} // for dir
 		} // for dim
@@ -955,6 +1041,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 	int init_cobj(-1);
 	check_coll_line(lpos, lpos2, init_cobj, -1, 1, 2); // find most opaque (max alpha) containing object
 	assert(init_cobj < (int)coll_objects.size());
+	light_ray_caster_t caster(lmgr, line_length, init_cobj, ltype, rgen, nullptr);
 
 	for (unsigned n = 0; n < num_rays; ++n) {
 		if (kill_raytrace) break;
@@ -991,7 +1078,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 			if (line_light) {start_pt += n*delta;} // fixed spacing along the length of the line
 		}
 		point const end_pt(start_pt + dir*line_length);
-		cast_light_ray(lmgr, start_pt, end_pt, weight, weight, lcolor, line_length, init_cobj, ltype, 0, rgen, nullptr);
+		caster.cast(start_pt, end_pt, weight, lcolor);
 	} // for n
 }
 
@@ -1010,7 +1097,7 @@ void trace_ray_block_local(rt_data *data) {
 	}
 	for (unsigned i = 0; i < light_sources_a.size(); ++i) {
 		if (data->verbose) {increment_printed_number(i);}
-		unsigned const light_nrays(light_sources_a[i].get_num_rays()), NRAYS(light_nrays ? light_nrays : LOCAL_RAYS), num_rays(max(1U, NRAYS/data->num));
+		unsigned const light_nrays(light_sources_a[i].get_num_rays()), NRAYS(light_nrays ? light_nrays : LOCAL_RAYS), num_rays(max(1U, data->get_num_rays(NRAYS)));
 		ray_trace_local_light_source(data->lmgr, light_sources_a[i], line_length, num_rays, rgen, data->ltype, NRAYS);
 	}
 	if (data->verbose) {cout << endl;}
@@ -1045,6 +1132,124 @@ typedef void (*ray_trace_func)(rt_data *);
 ray_trace_func const rt_funcs[NUM_LIGHTING_TYPES] = {trace_ray_block_sky, trace_ray_block_global, trace_ray_block_local, trace_ray_block_cobj_accum, trace_ray_block_dynamic};
 
 
+// traces lighting in background passes of increasing size: the first pass has 1/256 of the rays so that usable lighting is available quickly,
+// and each pass is accumulated into a separate lmap that's rescaled by the fraction of rays traced so far and copied into lmap_manager
+class progressive_lighting_t {
+
+	static unsigned const TOTAL_UNITS = 256, MAX_PASS_UNITS = 16; // pass sizes in units of 1/256 of the rays: 1, 1, 2, 4, 8, 16, 16, ...
+	vector<int> queued_ltypes;
+	lmap_manager_t accum_lmap; // sum of all passes for the current ltype
+	int ltype = -1;
+	unsigned pass = 0, units_done = 0, pass_units = 0;
+	unsigned long long pass_start_rays = 0;
+	bool pass_running = 0, platforms_expanded = 0;
+	high_resolution_clock::time_point start_time;
+
+	float get_elapsed_secs() const {return duration_cast<duration<float>>(high_resolution_clock::now() - start_time).count();}
+
+	void start_next_ltype() {
+		if (queued_ltypes.empty()) {cancel(); return;} // done
+		ltype = queued_ltypes.front();
+		queued_ltypes.erase(queued_ltypes.begin());
+		lmap_manager.finish_pending_reads(); // required for init_from()
+		accum_lmap.init_from(lmap_manager);
+		accum_lmap.clear_lighting_values(ltype);
+		lmap_manager.clear_lighting_values(ltype);
+		pass = units_done = 0;
+		start_time = high_resolution_clock::now();
+		launch_pass();
+	}
+	void launch_pass() {
+		assert(units_done < TOTAL_UNITS && !pass_running);
+		pass_units = min(max(units_done, 1U), min(MAX_PASS_UNITS, (TOTAL_UNITS - units_done)));
+		pass_start_rays = tot_rays;
+		no_stat_moving  = 1; // the static moving BVH is refit every frame while the pass runs, so it's not thread safe; no need to set back
+		if (enable_platform_lights(ltype)) {pre_rt_bvh_build_hook(); platforms_expanded = 1;} // same as the blocking path
+		launch_threaded_job(max(1U, NUM_THREADS-1), rt_funcs[ltype], 0, 0, 0, 0, ltype, 0, float(pass_units)/TOTAL_UNITS, pass, &accum_lmap); // reserve a thread for rendering
+		pass_running = 1;
+	}
+	void finish_pass() {
+		assert(pass_running);
+		thread_manager.join_and_clear();
+		pass_running = 0;
+		unexpand_platforms();
+		units_done  += pass_units;
+		++pass;
+		// the lighting values are linear in the number of rays, so scale by the inverse of the fraction of rays traced to get the current estimate
+		float const frac_done(float(units_done)/TOTAL_UNITS), change(lmap_manager.copy_scaled_lighting_values(accum_lmap, ltype, 1.0/frac_done));
+		lmap_manager.was_updated = 1;
+		string const type_names[3] = {"Sky", "Global", "Local"};
+		cout << "Progressive " << type_names[ltype] << " lighting pass " << pass << ": " << 100.0*frac_done << "% of rays (" << (tot_rays - pass_start_rays)
+			 << " this pass), RMS change " << 100.0*change << "%, " << get_elapsed_secs() << "s" << endl;
+	}
+	void unexpand_platforms() {
+		if (platforms_expanded) {post_rt_bvh_build_hook(); platforms_expanded = 0;}
+	}
+	void finish_ltype() {
+		cout << "Progressive lighting converged after " << pass << " passes in " << get_elapsed_secs() << "s" << endl;
+		if (write_light_files[ltype]) {lmap_manager.write_data_to_file(lighting_file[ltype], ltype);}
+		start_next_ltype();
+	}
+public:
+	bool is_active() const {return (ltype >= 0);}
+
+	void add(int ltype_) {
+		assert(ltype_ == LIGHTING_SKY || ltype_ == LIGHTING_GLOBAL || ltype_ == LIGHTING_LOCAL);
+		queued_ltypes.push_back(ltype_);
+		if (!is_active()) {start_next_ltype();}
+	}
+	bool next_frame() { // returns true if active
+		if (!is_active()) return 0;
+		if (pass_running) {
+			if (thread_manager.any_threads_running()) return 1; // still running
+			finish_pass();
+		}
+		if (units_done < TOTAL_UNITS) {launch_pass();} else {finish_ltype();}
+		return is_active();
+	}
+	void wait_for_pass() {
+		if (pass_running) {finish_pass();} // blocks until the threads finish; the next pass is launched next frame
+	}
+	void finish_all() {
+		while (is_active()) {wait_for_pass(); next_frame();}
+	}
+	void cancel() { // Note: threads must not be running
+		unexpand_platforms();
+		queued_ltypes.clear();
+		ltype = -1;
+		pass_running = 0;
+		accum_lmap.clear_cells();
+	}
+};
+
+progressive_lighting_t progressive_lighting_mgr;
+
+bool progressive_lighting_next_frame   () {return progressive_lighting_mgr.next_frame();}
+void wait_for_progressive_lighting_pass() {progressive_lighting_mgr.wait_for_pass();}
+void finish_progressive_lighting       () {progressive_lighting_mgr.finish_all();}
+
+bool indir_lighting_updated() { // global updates or progressive lighting
+	return (progressive_lighting_mgr.is_active() || (global_lighting_update && (lmap_manager.was_updated || thread_temp_lmap.was_updated)));
+}
+
+void kill_current_raytrace_threads() {
+	stop_raytrace_threads();
+	progressive_lighting_mgr.cancel();
+}
+
+bool use_progressive_lighting(int ltype) {
+
+	if (!progressive_lighting || (ltype != LIGHTING_SKY && ltype != LIGHTING_GLOBAL && ltype != LIGHTING_LOCAL)) return 0;
+	if (read_light_files[LIGHTING_COBJ_ACCUM] || write_light_files[LIGHTING_COBJ_ACCUM]) return 0; // cobj accum lighting requires the full sky lighting to be traced first
+	if (!enable_platform_lights(ltype)) return 1;
+
+	for (cobj_id_set_t::const_iterator i = coll_objects.platform_ids.begin(); i != coll_objects.platform_ids.end(); ++i) {
+		if (coll_objects.get_cobj(*i).is_update_light_platform()) return 0; // merged accum map is required for platform lighting updates
+	}
+	return 1;
+}
+
+
 void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 
 	bool const dynamic(is_ltype_dynamic(ltype));
@@ -1066,6 +1271,12 @@ void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 	else {
 		if (c_ltype != LIGHTING_LOCAL && !dynamic) {cout << X_SCENE_SIZE << " " << Y_SCENE_SIZE << " " << Z_SCENE_SIZE << " " << czmin << " " << czmax << endl;}
 		all_models.build_cobj_trees(1);
+
+		if (!dynamic && use_progressive_lighting(c_ltype)) {
+			if (verbose) {cout << "Tracing lighting progressively in the background" << endl;}
+			progressive_lighting_mgr.add(c_ltype);
+			return; // lighting file is written when the last pass finishes
+		}
 		if (enable_platform_lights(ltype)) {pre_rt_bvh_build_hook();}
 		launch_threaded_job(NUM_THREADS, rt_funcs[c_ltype], verbose, 1, 0, 0, ltype);
 		if (enable_platform_lights(ltype)) {post_rt_bvh_build_hook();}
@@ -1096,6 +1307,7 @@ void check_update_global_lighting(unsigned lights) {
 	if (!global_lighting_update || !(read_light_files[LIGHTING_GLOBAL] || write_light_files[LIGHTING_GLOBAL])) return;
 	if (!(lights & (SUN_SHADOW | MOON_SHADOW))) return;
 	if (GLOBAL_RAYS == 0 && global_cube_lights.empty()) return; // nothing to do
+	if (progressive_lighting_mgr.is_active()) return; // initial lighting is still being traced
 	if (!pre_lighting_update()) return; // lmap is not yet allocated
 	// Note: we could check if the sun/moon is visible, but it might have been visible previously and now is not, and in that case we still need to update lighting
 	no_stat_moving = 1; // disable static moving cobjs for async updates, which aren't thread safe because the BVH is rebuilt every frame; no need to set back after first frame
@@ -1135,6 +1347,7 @@ void check_all_platform_cobj_lighting_update() {
 bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 
 	assert(fn != nullptr);
+	if (is_lighting_cache_file(fn, 0)) {return read_cache_file(fn, ltype);} // compressed; decoded over the next several frames
 	binary_file_reader reader;
 	if (!reader.open(fn)) return 0;
 	cout << "Reading lighting file from " << fn << endl;
@@ -1163,9 +1376,11 @@ bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 }
 
 
-bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
+bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) {
 
 	if (fn == nullptr || strcmp(fn, "''") == 0 || strcmp(fn, "\"\"") == 0) return 0; // don't write
+	finish_pending_reads();
+	if (compress_lighting_files) {return write_cache_file(fn, ltype);}
 	binary_file_writer writer;
 	if (!writer.open(fn)) return 0;
 	cout << "Writing lighting file to " << fn << endl;
@@ -1186,6 +1401,7 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 void lmap_manager_t::clear_lighting_values(int ltype) {
 
 	assert(ltype < NUM_LIGHTING_TYPES && !is_ltype_dynamic(ltype));
+	finish_pending_reads();
 	unsigned const num(lmcell::get_dsz(ltype));
 
 	for (vector<lmcell>::iterator i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {
@@ -6,6 +6,7 @@
 #include "draw_utils.h"
 #include "model3d.h"
 #include "shaders.h"
+#include "job_system.h"
 
 bool  const ENABLE_CUBE_MAP_MIPMAPS = 1;
 unsigned const DEF_CUBE_MAP_TEX_SZ  = 768;
@@ -177,12 +178,11 @@ void create_cobj_draw_streams(vector<face_draw_params_t> const &faces) { // refl
 	vector<unsigned> &to_draw(coll_objects.get_cur_draw_stream());
 	for (auto i = faces.begin()+1; i != faces.end(); ++i) {i->to_draw = to_draw;} // deep copy list of all drawable cobjs
 
-#pragma omp parallel for schedule(static,64) num_threads(3) if (to_draw.size() > 256)
-	for (int i = 0; i < (int)to_draw.size(); ++i) {
+	parallel_for_jobs(0, (int)to_draw.size(), [&](int i) {
 		coll_obj const &c(coll_objects.get_cobj(to_draw[i]));
 		assert(c.cp.draw);
 		bool skip_all(c.no_draw());
-		if (!skip_all && c.group_id >= 0) continue; // grouped cobjs can't be culled
+		if (!skip_all && c.group_id >= 0) return; // grouped cobjs can't be culled
 		unsigned is_occluded(faces.size() == 6 ? check_occlusion(faces.front().pdu, c) : 2); // 2 = unknown; precompute if all 6 sides updated because one will be visible
 
 		for (auto f = faces.begin(); f != faces.end(); ++f) {
@@ -194,7 +194,7 @@ void create_cobj_draw_streams(vector<face_draw_params_t> const &faces) { // refl
 			}
 			if (skip) {f->to_draw[i] = TO_DRAW_SKIP_VAL;} // mark as skipped
 		}
-	}
+	}, 64, ((to_draw.size() > 256) ? 0 : 1));
 }
 
 void set_custom_viewport(unsigned tex_size, float fov_angle, float near_plane, float far_plane) {
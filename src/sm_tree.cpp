@@ -7,6 +7,7 @@
 #include "small_tree.h"
 #include "gl_ext_arb.h"
 #include "shaders.h"
+#include "job_system.h"
 
 
 float const SM_TREE_SIZE    = 0.05;
@@ -90,8 +91,7 @@ void small_tree_group::finalize(bool low_detail) {
 	vbo_mgr.clear(0); // clear_pts_mem = 0
 	vbo_mgr.reserve_pts(num_pine_trees*(low_detail ? 1 : PINE_TREE_NPTS));
 	if (!low_detail) {vbo_mgr.reserve_offsets(num_pine_trees);}
-#pragma omp parallel for schedule(static,1) num_threads(4) if (!low_detail)
-	for (int i = 0; i < (int)size(); ++i) {operator[](i).calc_points(vbo_mgr, low_detail);}
+	parallel_for_jobs(0, (int)size(), [&](int i) {operator[](i).calc_points(vbo_mgr, low_detail);}, 1, (low_detail ? 1 : 0));
 
 	if (num_pine_trees > 0) {
 		for (const_iterator i = begin(); i != end(); ++i) {palm_vbo_mem += i->get_palm_mem();}
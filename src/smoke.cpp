@@ -31,7 +31,7 @@ cube_t cur_smoke_bb;
 vector<unsigned char> smoke_tex_data; // several MB
 
 extern bool no_smoke_over_mesh, no_sun_lpos_update;
-extern unsigned create_voxel_landscape;
+extern unsigned create_voxel_landscape, lighting_cache_chunks_per_frame;
 extern int animate2, display_mode, scrolling, game_mode, frame_counter, precip_mode;
 extern float czmin0, rain_wetness, fticks, dist_to_fire_sq;
 extern double sim_ticks;
@@ -130,7 +130,7 @@ void add_smoke(point const &pos, float val) {
 	lmcell *const lmc(lmap_manager.get_lmcell(pos));
 	if (!lmc) return;
 	int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
-	if (point_outside_mesh(xpos, ypos) || pos.z >= v_collision_matrix[ypos][xpos].zmax || pos.z < mesh_height[ypos][xpos]) return; // above all cobjs/outside
+	if (point_outside_mesh(xpos, ypos) || pos.z >= v_collision_grid.get_zmax(xpos, ypos) || pos.z < mesh_height[ypos][xpos]) return; // above all cobjs/outside
 	if (no_smoke_over_mesh && !is_mesh_disabled(xpos, ypos)) return;
 	if (!check_smoke_bounds(pos)) return;
 	//if (!check_coll_line(pos, point(pos.x, pos.y, czmax), cindex, -1, 1, 0)) return; // too slow
@@ -219,7 +219,7 @@ void distribute_smoke() { // called at most once per frame
 				lmcell &lmc(vldata[z]);
 				if (lmc.smoke < SMOKE_THRESH) {lmc.smoke = 0.0;}
 				if (lmc.smoke == 0.0) continue;
-				//if (get_zval(z) > v_collision_matrix[y][x].zmax) {lmc.smoke = 0.0; continue;} // open space above - smoke goes up
+				//if (get_zval(z) > v_collision_grid.get_zmax(x, y)) {lmc.smoke = 0.0; continue;} // open space above - smoke goes up
 				next_smoke_man.add_smoke(x, y, z, lmc.smoke);
 
 				if (dx) {
@@ -371,6 +371,13 @@ bool upload_smoke_indir_texture() {
 		have_indir_smoke_tex = 0;
 		return 0;
 	}
+	if (lmap_manager.has_pending_reads()) { // lighting cache files are decoded a few chunks per frame
+		unsigned y_range[2] = {0, 0};
+
+		if (lmap_manager.decode_pending_reads(max(lighting_cache_chunks_per_frame, 1U), y_range) > 0 && smoke_tid != 0 && y_range[0] < y_range[1]) {
+			update_smoke_indir_tex_range(0, MESH_X_SIZE, y_range[0], y_range[1], 0, MESH_SIZE[2], 1); // update lighting for decoded rows
+		}
+	}
 	assert((MESH_Y_SIZE%SMOKE_SEND_SKIP) == 0);
 	// ok when texture z size is not a power of 2
 	unsigned const sz(MESH_X_SIZE*MESH_Y_SIZE*MESH_SIZE[2]), ncomp(4);
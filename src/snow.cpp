@@ -6,6 +6,7 @@
 #include "gl_ext_arb.h"
 #include "shaders.h"
 #include "model3d.h"
+#include "job_system.h"
 
 
 unsigned const VOXELS_PER_DIV = 8; // 1024 for 128 vertex mesh
@@ -230,9 +231,38 @@ public:
 };
 
 
-class voxel_map : public map<voxel_t, zval_avg> { // must be a sorted map
+struct voxel_map_entry_t {
+	voxel_t v;
+	bool used = 0; // already added to a strip
+	zval_avg z;
+	voxel_map_entry_t() {}
+	voxel_map_entry_t(voxel_t const &v_, zval_avg const &z_) : v(v_), z(z_) {}
+	bool operator<(voxel_map_entry_t const &e) const {return (v < e.v);}
+};
+
+enum {ADJ_Z_UNUSED=0, ADJ_Z_MARK_USED, ADJ_Z_ALL}; // find_adj_z() modes
+
+struct snow_voxel_accum_t;
+
+class voxel_map { // flat array sorted by {x, y, z} with an index of where each x value starts
+	vector<voxel_map_entry_t> entries;
+	vector<unsigned> x_start;
+	int x_min = 0;
+
+	void get_x_range(int x, unsigned &start, unsigned &end) const {
+		if (x < x_min || x+1 >= x_min + (int)x_start.size()) {start = end = 0; return;} // x not in the map
+		start = x_start[x - x_min];
+		end   = x_start[x - x_min + 1];
+	}
 public:
-	zval_avg find_adj_z(voxel_t &v, zval_avg const &zv_old, float depth, voxel_map *cur_x_map=NULL);
+	typedef vector<voxel_map_entry_t>::iterator iterator;
+	size_t size () const {return entries.size ();}
+	bool   empty() const {return entries.empty();}
+	iterator begin() {return entries.begin();}
+	iterator end  () {return entries.end  ();}
+	void finalize();
+	void build(vector<snow_voxel_accum_t> const &accum);
+	zval_avg find_adj_z(voxel_t &v, zval_avg const &zv_old, float depth, unsigned mode);
 	bool read(char const *const fn);
 	bool write(char const *const fn) const;
 };
@@ -243,39 +273,175 @@ struct data_block { // packed voxel_z_pair for read/write
 	count_type c = 0;
 	float z = 0.0;
 
-	void add_to_map(voxel_map &vmap) const {
+	voxel_map_entry_t get_entry() const {
 		voxel_t v;
 		for (unsigned i = 0; i < 3; ++i) v.p[i] = p[i];
-		vmap[v] = zval_avg(c, z);
+		return voxel_map_entry_t(v, zval_avg(c, z));
 	}
-	void set_from_map_iter(voxel_map::const_iterator it) {
-		for (unsigned i = 0; i < 3; ++i) p[i] = it->first.p[i];
-		c = it->second.c;
-		z = it->second.z;
+	void set_from_entry(voxel_map_entry_t const &e) {
+		for (unsigned i = 0; i < 3; ++i) p[i] = e.v.p[i];
+		c = e.z.c;
+		z = e.z.z;
 	}
 };
 
 
+// **************** SNOW HIT ACCUMULATION ****************
+
+// voxels packed into 48 bits in {x, y, z} order, with the sign bits flipped so that unsigned order matches signed order
+uint64_t get_voxel_key(voxel_t const &v) {
+	uint64_t key(0);
+	for (unsigned i = 0; i < 3; ++i) {key = (key << 16) | (uint16_t(v.p[i]) ^ 0x8000);}
+	return key;
+}
+voxel_t get_key_voxel(uint64_t key) {
+	voxel_t v;
+	for (unsigned i = 0; i < 3; ++i) {v.p[2-i] = coord_type(uint16_t(key >> (16*i)) ^ 0x8000);}
+	return v;
+}
+
+struct snow_hit_t {
+	uint64_t key;
+	float z;
+	uint64_t get_key() const {return key;}
+};
+
+struct snow_voxel_accum_t {
+	uint64_t key;
+	unsigned count;
+	float zsum;
+	uint64_t get_key() const {return key;}
+};
+
+// stable LSD radix sort on 48-bit keys using 16-bit digits; if parallel, each thread histograms and scatters its own chunk
+template<typename T> void radix_sort_voxel_keys(vector<T> &v, vector<T> &temp, bool parallel) {
+
+	unsigned const NUM_BUCKETS = (1 << 16);
+	size_t const n(v.size());
+	if (n <= 1) return;
+	int const num_chunks(parallel ? max(1, min((int)get_num_job_threads(), int(n/65536)+1)) : 1);
+	vector<size_t> counts(num_chunks*NUM_BUCKETS);
+	temp.resize(n);
+
+	for (unsigned shift = 0; shift < 48; shift += 16) {
+		std::fill(counts.begin(), counts.end(), 0);
+
+		parallel_for_jobs(0, num_chunks, [&](int c) { // one chunk per job thread
+			size_t *const cc(counts.data() + c*NUM_BUCKETS);
+			for (size_t i = c*n/num_chunks; i < (c+1)*n/num_chunks; ++i) {++cc[(v[i].get_key() >> shift) & 0xFFFF];}
+		});
+		size_t pos(0);
+		bool skip(0);
+
+		for (unsigned d = 0; d < NUM_BUCKETS && !skip; ++d) { // convert counts to start offsets
+			for (int c = 0; c < num_chunks; ++c) {
+				size_t &cc(counts[c*NUM_BUCKETS + d]);
+				if (cc == n) {skip = 1; break;} // all keys have the same digit, nothing to do for this pass
+				size_t const sz(cc);
+				cc   = pos;
+				pos += sz;
+			}
+		}
+		if (skip) continue;
+
+		parallel_for_jobs(0, num_chunks, [&](int c) {
+			size_t *const cc(counts.data() + c*NUM_BUCKETS);
+			for (size_t i = c*n/num_chunks; i < (c+1)*n/num_chunks; ++i) {temp[cc[(v[i].get_key() >> shift) & 0xFFFF]++] = v[i];}
+		});
+		v.swap(temp);
+	} // for shift
+}
+
+// combine adjacent entries with the same key
+void reduce_voxel_accum(vector<snow_voxel_accum_t> &accum) {
+
+	size_t num(0);
+
+	for (size_t i = 0; i < accum.size(); ++i) {
+		if (num > 0 && accum[num-1].key == accum[i].key) {accum[num-1].count += accum[i].count; accum[num-1].zsum += accum[i].zsum;}
+		else {accum[num++] = accum[i];}
+	}
+	accum.resize(num);
+}
+
+class snow_hit_buffer_t { // per-thread snowflake hits, periodically sorted and merged into this thread's voxel sums
+	vector<snow_hit_t> hits, hits_temp;
+	vector<snow_voxel_accum_t> runs, merged;
+public:
+	vector<snow_voxel_accum_t> accum; // sorted by key
+
+	static unsigned const HIT_BUFFER_SIZE = (1 << 20); // max hits before a flush; hits and hits_temp grow as needed, so small scenes use little memory
+
+	void add(point const &pos) {
+		hits.push_back(snow_hit_t({get_voxel_key(voxel_t(pos)), pos.z}));
+		if (hits.size() >= HIT_BUFFER_SIZE) {flush();}
+	}
+	void flush() {
+		radix_sort_voxel_keys(hits, hits_temp, 0); // serial, since each thread sorts its own hits
+		runs.clear();
+
+		for (snow_hit_t const &h : hits) {
+			if (!runs.empty() && runs.back().key == h.key) {++runs.back().count; runs.back().zsum += h.z;}
+			else {runs.push_back(snow_voxel_accum_t({h.key, 1, h.z}));}
+		}
+		hits.clear();
+		merged.resize(accum.size() + runs.size());
+		std::merge(accum.begin(), accum.end(), runs.begin(), runs.end(), merged.begin(), [](snow_voxel_accum_t const &a, snow_voxel_accum_t const &b) {return (a.key < b.key);});
+		reduce_voxel_accum(merged);
+		accum.swap(merged);
+	}
+};
+
+
+// **************** VOXEL MAP ****************
+
+void voxel_map::build(vector<snow_voxel_accum_t> const &accum) { // accum must be sorted and reduced
+
+	entries.clear();
+	entries.reserve(accum.size());
+
+	for (snow_voxel_accum_t const &a : accum) {
+		count_type const c(min(a.count, MAX_COUNT)); // clamp the count, but keep the average z
+		entries.emplace_back(get_key_voxel(a.key), zval_avg(c, a.zsum*float(c)/float(a.count)));
+	}
+	finalize();
+}
+
+void voxel_map::finalize() {
+
+	if (!std::is_sorted(entries.begin(), entries.end())) {sort(entries.begin(), entries.end());}
+	x_start.clear();
+	if (entries.empty()) return;
+	x_min = entries.front().v.p[0];
+	int const x_max(entries.back().v.p[0]);
+	x_start.resize(x_max - x_min + 2);
+	unsigned ix(0);
+
+	for (int x = x_min; x <= x_max+1; ++x) {
+		while (ix < entries.size() && entries[ix].v.p[0] < x) {++ix;}
+		x_start[x - x_min] = ix;
+	}
+}
+
+
 // this tends to take a large fraction of the preprocessing time
-zval_avg voxel_map::find_adj_z(voxel_t &v, zval_avg const &zv_old, float depth, voxel_map *cur_x_map) {
+zval_avg voxel_map::find_adj_z(voxel_t &v, zval_avg const &zv_old, float depth, unsigned mode) {
 
 	coord_type best_dz(0);
 	zval_avg res;
-	voxel_t v2_s(v), v2_e(v);
-	v2_s.p[2] -= min(Z_CHECK_RANGE, (int)v2_s.p[2]);
-	v2_e.p[2] += Z_CHECK_RANGE+1; // one past the end
-
-	for (iterator it = lower_bound(v2_s); it != end() && it->first < v2_e;) { // Note: no increment of it
-		zval_avg const z2(it->second);
+	voxel_map_entry_t v2_s(v, zval_avg()), v2_e(v, zval_avg());
+	v2_s.v.p[2] -= min(Z_CHECK_RANGE, (int)v2_s.v.p[2]);
+	v2_e.v.p[2] += Z_CHECK_RANGE+1; // one past the end
+	unsigned x_start_ix(0), x_end_ix(0);
+	get_x_range(v.p[0], x_start_ix, x_end_ix);
+
+	for (auto it = std::lower_bound(entries.begin()+x_start_ix, entries.begin()+x_end_ix, v2_s); it != entries.begin()+x_end_ix && *it < v2_e; ++it) {
+		if (it->used && mode != ADJ_Z_ALL) continue; // already added to a strip
+		zval_avg const z2(it->z);
 		assert(z2.valid());
-		if (zv_old.valid() && fabs(z2.getz() - zv_old.getz()) > depth) {++it; continue;} // delta z too large
-		voxel_t const v2(it->first);
-
-		if (cur_x_map) {
-			erase(it++);
-			(*cur_x_map)[v2] = z2;
-		} else {++it;}
-		coord_type const dz(v2.p[2] - v.p[2]);
+		if (zv_old.valid() && fabs(z2.getz() - zv_old.getz()) > depth) continue; // delta z too large
+		if (mode == ADJ_Z_MARK_USED) {it->used = 1;}
+		coord_type const dz(it->v.p[2] - v.p[2]);
 		if (!res.valid() || abs(dz) < abs(best_dz)) {best_dz = dz;}
 		res.c += z2.c;
 		res.z += z2.z;
@@ -296,14 +462,14 @@ bool voxel_map::read(char const *const fn) {
 	unsigned map_size(0);
 	size_t const sz_read(fread(&map_size, sizeof(unsigned), 1, fp));
 	assert(sz_read == 1);
-	data_block data;
-	
-	for (unsigned i = 0; i < map_size; ++i) {
-		size_t const nr(fread(&data, sizeof(data_block), 1, fp));
-		assert(nr == 1);
-		data.add_to_map(*this);
-	}
+	vector<data_block> data(map_size);
+	size_t const nr(fread(data.data(), sizeof(data_block), map_size, fp));
+	assert(nr == map_size);
 	checked_fclose(fp);
+	entries.clear();
+	entries.reserve(map_size);
+	for (data_block const &d : data) {entries.push_back(d.get_entry());}
+	finalize(); // entries were written in sorted order, but sort anyway in case the file came from elsewhere
 	return 1;
 }
 
@@ -319,13 +485,10 @@ bool voxel_map::write(char const *const fn) const {
 	unsigned const map_size((unsigned)size()); // should be size_t?
 	size_t const sz_write(fwrite(&map_size, sizeof(map_size), 1, fp));
 	assert(sz_write == 1);
-	data_block data;
-
-	for (const_iterator i = begin(); i != end(); ++i) {
-		data.set_from_map_iter(i);
-		size_t const nw(fwrite(&data, sizeof(data_block), 1, fp));
-		assert(nw == 1);
-	}
+	vector<data_block> data(map_size);
+	for (unsigned i = 0; i < map_size; ++i) {data[i].set_from_entry(entries[i]);}
+	size_t const nw(fwrite(data.data(), sizeof(data_block), map_size, fp));
+	assert(nw == map_size);
 	checked_fclose(fp);
 	return 1;
 }
@@ -496,55 +659,65 @@ void create_snow_map(voxel_map &vmap) {
 	wind_vector.z = 0.0; // zval is unused/ignored
 	all_models.build_cobj_trees(1);
 	cout << "Snow accumulation progress (out of " << num_per_dim << "):     0";
-
-#pragma omp parallel for schedule(dynamic,1)
-	for (int y = 0; y < num_per_dim; ++y) {
-		if (omp_get_thread_num_3dw() == 0) {increment_printed_number(y);} // progress for thread 0
-		rand_gen_t rgen;
-		rgen.set_state(123, y);
-
-		for (int x = 0; x < num_per_dim; ++x) {
-			point pos1(-X_SCENE_SIZE + x*xscale, -Y_SCENE_SIZE + y*yscale, zval), pos2;
-			// add slightly more randomness for numerical precision reasons
-			for (unsigned d = 0; d < 2; ++d) {pos1[d] += SMALL_NUMBER*rgen.signed_rand_float();}
-			if (!get_mesh_ice_pt(pos1, pos2)) continue; // only pos1/pos2 zvals differ; skip if invalid point
-			assert(pos2.z < pos1.z);
-			pos1 += get_rand_snow_vect(rgen, 1.0); // add some gaussian randomness for better distribution
-			pos1 -= wind_vector; // offset starting point by wind vector (upwind)
-			point cpos;
-			vector3d cnorm;
-			bool invalid(0);
-			unsigned iter(0);
-			
-			while (check_snow_line_coll(pos1, pos2, cpos, cnorm)) {
-				if (cnorm.z > 0.0) { // collision with a surface that points up - we're done
-					pos2 = cpos;
-					break;
-				}
-				if (snow_random == 0.0 || iter > 100) { // something odd happened
-					invalid = 1;
-					break;
-				}
-				// collision with vertical or bottom surface
-				float const val(CLIP_TO_01((pos1.z - zbottom)*zv_scale));
-				vector3d const delta(get_rand_snow_vect(rgen, 0.1*val));
-				pos1 = cpos - (pos2 - pos1).get_norm()*SMALL_NUMBER; // push a small amount back from the object
-				pos2 = pos1 + ((dot_product(delta, cnorm) < 0.0) ? -delta : delta);
+	vector<snow_voxel_accum_t> accum;
+
+#pragma omp parallel
+	{
+		snow_hit_buffer_t hit_buffer;
+
+#pragma omp for schedule(dynamic,1)
+		for (int y = 0; y < num_per_dim; ++y) {
+			if (omp_get_thread_num_3dw() == 0) {increment_printed_number(y);} // progress for thread 0
+			rand_gen_t rgen;
+			rgen.set_state(123, y);
+
+			for (int x = 0; x < num_per_dim; ++x) {
+				point pos1(-X_SCENE_SIZE + x*xscale, -Y_SCENE_SIZE + y*yscale, zval), pos2;
+				// add slightly more randomness for numerical precision reasons
+				for (unsigned d = 0; d < 2; ++d) {pos1[d] += SMALL_NUMBER*rgen.signed_rand_float();}
+				if (!get_mesh_ice_pt(pos1, pos2)) continue; // only pos1/pos2 zvals differ; skip if invalid point
+				assert(pos2.z < pos1.z);
+				pos1 += get_rand_snow_vect(rgen, 1.0); // add some gaussian randomness for better distribution
+				pos1 -= wind_vector; // offset starting point by wind vector (upwind)
+				point cpos;
+				vector3d cnorm;
+				bool invalid(0);
+				unsigned iter(0);
 				
-				if (!get_mesh_ice_pt(pos2, pos2)) { // invalid point
-					invalid = 1;
-					break;
-				}
-				++iter;
-			} // end while
-			if (!invalid) {
-				voxel_t const voxel(pos2);
+				while (check_snow_line_coll(pos1, pos2, cpos, cnorm)) {
+					if (cnorm.z > 0.0) { // collision with a surface that points up - we're done
+						pos2 = cpos;
+						break;
+					}
+					if (snow_random == 0.0 || iter > 100) { // something odd happened
+						invalid = 1;
+						break;
+					}
+					// collision with vertical or bottom surface
+					float const val(CLIP_TO_01((pos1.z - zbottom)*zv_scale));
+					vector3d const delta(get_rand_snow_vect(rgen, 0.1*val));
+					pos1 = cpos - (pos2 - pos1).get_norm()*SMALL_NUMBER; // push a small amount back from the object
+					pos2 = pos1 + ((dot_product(delta, cnorm) < 0.0) ? -delta : delta);
+					
+					if (!get_mesh_ice_pt(pos2, pos2)) { // invalid point
+						invalid = 1;
+						break;
+					}
+					++iter;
+				} // end while
+				if (!invalid) {hit_buffer.add(pos2);}
+			} // for x
+		} // for y
+		hit_buffer.flush();
 #pragma omp critical(snow_map_update)
-				vmap[voxel].update(pos2.z);
-			}
-		} // for x
-	} // for y
+		accum.insert(accum.end(), hit_buffer.accum.begin(), hit_buffer.accum.end()); // once per thread
+	} // omp parallel
 	cout << endl;
+	// merge the per-thread voxel sums
+	vector<snow_voxel_accum_t> temp;
+	radix_sort_voxel_keys(accum, temp, 1);
+	reduce_voxel_accum(accum);
+	vmap.build(accum);
 }
 
 
@@ -558,8 +731,7 @@ void add_strip(strip_vect_t const &strip, bool is_edge, int xval, int y_start) {
 
 void create_snow_strips(voxel_map &vmap) {
 
-	// create strips of snow for rendering
-	voxel_map cur_x_map, last_x_map;
+	// create strips of snow for rendering; entries are marked as used when added to a strip
 	unsigned const num_xy_voxels(VOXELS_PER_DIV*VOXELS_PER_DIV*XY_MULT_SIZE);
 	float const delta_depth(snow_depth*num_xy_voxels/(1024.0f*1024.0f*num_snowflakes));
 	unsigned n_strips(0), n_edge_strips(0), strip_len(0), edge_strip_len(0);
@@ -569,21 +741,18 @@ void create_snow_strips(voxel_map &vmap) {
 	snow_strips.clear();
 	snow_strips.reserve(8*num_xy_voxels/MAX_STRIP_LEN); // should be more than enough
 
-	while (!vmap.empty()) {
-		pair<voxel_t, zval_avg> start(*vmap.begin());
-		voxel_t v1(start.first);
-		zval_avg zv(start.second);
+	for (auto start = vmap.begin(); start != vmap.end(); ++start) {
+		if (start->used) continue; // already added to a strip
+		voxel_t v1(start->v);
+		zval_avg zv(start->z);
 		assert(zv.valid());
 
-		if (v1.p[0] != last_x) { // we moved on to the next x-value, so update the x maps
+		if (v1.p[0] != last_x) { // we moved on to the next x-value
 			last_x = v1.p[0];
-			last_x_map.clear();
-			cur_x_map.swap(last_x_map);
 			bool const did_ins(x_strip_map.insert(make_pair(last_x, (unsigned)snow_strips.size())).second);
-			assert(did_ins); // map should guarantee strictly increasing x
+			assert(did_ins); // sorted voxel map should guarantee strictly increasing x
 		}
-		vmap.erase(vmap.begin());
-		cur_x_map[v1] = zv;
+		start->used = 1;
 		vs.resize(0);
 		--v1.p[1];
 		vs.push_back(voxel_z_pair(v1)); // zero start
@@ -592,7 +761,7 @@ void create_snow_strips(voxel_map &vmap) {
 		
 		while (1) { // generate a strip in y with constant x
 			++v1.p[1];
-			zv = vmap.find_adj_z(v1, zv, snow_depth, &cur_x_map);
+			zv = vmap.find_adj_z(v1, zv, snow_depth, ADJ_Z_MARK_USED);
 			//if (!zv.valid()) --v1.p[1]; // move back one step
 			vs.push_back(voxel_z_pair(v1, zv));
 			if (!zv.valid()) break; // end of strip
@@ -616,7 +785,7 @@ void create_snow_strips(voxel_map &vmap) {
 				bool const end_element(i == 0 || i+1 == sz);
 				voxel_t v2(vs[i].v);
 				++v2.p[0]; // move to next x row
-				zval_avg z2(vmap.find_adj_z(v2, vs[i].z, snow_depth));
+				zval_avg z2(vmap.find_adj_z(v2, vs[i].z, snow_depth, ADJ_Z_UNUSED));
 				if (end_element) z2.c = 0; // zero terminate start/end points
 				strip.add(vs[i], delta_depth); // first edge
 				strip.add(voxel_z_pair(v2, z2), delta_depth); // second edge
@@ -625,7 +794,7 @@ void create_snow_strips(voxel_map &vmap) {
 				if ((end_pos - start_pos) <= 3) continue; // too small for edge srtips
 				voxel_t v3(vs[i].v);
 				--v3.p[0]; // move to prev x row
-				zval_avg z3(last_x_map.find_adj_z(v3, vs[i].z, snow_depth));
+				zval_avg z3(vmap.find_adj_z(v3, vs[i].z, snow_depth, ADJ_Z_ALL)); // prev x row has already been added to strips
 				
 				if (!end_element && !z3.valid()) {
 					last_edge = (unsigned)edge_strip.size() + 2;
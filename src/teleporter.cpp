@@ -56,6 +56,12 @@ bool maybe_teleport_object(point &opos, float oradius, int player_id, int type,
 	return 0;
 }
 
+bool have_teleporters() { // static or active dynamic teleporters
+	if (!teleporters[0].empty()) return 1;
+	int const group(coll_id[TELEPORTER]);
+	return (group >= 0 && obj_groups[group].is_enabled() && obj_groups[group].end_id > 0);
+}
+
 void setup_dynamic_teleporters() {
 
 	if (coll_id[TELEPORTER] < 0) return;
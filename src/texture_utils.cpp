@@ -3,6 +3,7 @@
 // 4/3/22
 #include "3DWorld.h"
 #include "function_registry.h"
+#include "job_system.h"
 
 #define STB_DXT_IMPLEMENTATION
 #include "stb_dxt.h"
@@ -18,8 +19,9 @@ void dxt_texture_compress(uint8_t const *const data, vector<uint8_t> &comp_data,
 	unsigned const block_sz(has_alpha ? 16 : 8), x_blocks((width + 3)/4), y_blocks((height + 3)/4); // take ceil()
 	comp_data.resize(x_blocks*y_blocks*block_sz);
 
-#pragma omp parallel for schedule(static)
-	for (int y = 0; y < height; y += 4) {
+	// jobs rather than OpenMP, since this is also called from texture upload jobs running on worker threads
+	parallel_for_jobs(0, y_blocks, [&](int yb) {
+		int const y(4*yb);
 		uint8_t block[4*4*4] = {};
 
 		for (int x = 0; x < width; x += 4) {
@@ -32,99 +34,78 @@ void dxt_texture_compress(uint8_t const *const data, vector<uint8_t> &comp_data,
 					if (!has_alpha) {block[bix + 3] = 255;} // set alpha=255
 				}
 			}
-			unsigned const comp_offset(((y/4)*x_blocks + (x/4))*block_sz);
+			unsigned const comp_offset((yb*x_blocks + (x/4))*block_sz);
 			assert(comp_offset < comp_data.size());
 			stb_compress_dxt_block(&comp_data[comp_offset], block, has_alpha, /*STB_DXT_NORMAL*/STB_DXT_HIGHQUAL);
 		} // for x
-	} // for y
+	}, 4); // 4 block rows per job
 }
 
-void texture_t::compress_and_send_texture() {
-	//highres_timer_t timer("compress_and_send_texture", 1, 1); // enabled, no loading screen; 2676ms
-	vector<uint8_t> comp_data; // reuse across calls doesn't seem to help much
-	dxt_texture_compress(data, comp_data, width, height, ncolors);
-	GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, comp_data.size(), comp_data.data());)
-}
+// compression and mipmap creation for do_gl_init(), in the order of GL mipmap levels;
+// the base level is compressed here with custom compression; mipmaps are created here for custom compression and custom alpha mipmaps, otherwise on the GPU;
+// full_mip_chain creates all mipmaps here, using a box filter in place of the GPU's, which is needed for texture cache files
+void texture_t::calc_gl_levels(texture_levels_t &levels, bool full_mip_chain) const { // 2676ms compress + 1623ms compressed mipmaps + 558ms custom mipmaps for city + cars + people
 
-void texture_t::create_compressed_mipmaps() {
-	//highres_timer_t timer("create_compressed_mipmaps", 1, 1); // enabled, no loading screen; 1623ms total for city + cars + people
 	assert(is_allocated());
-	vector<uint8_t> idatav, odata, comp_data; // reuse across calls doesn't seem to help much
+	assert(width > 0 && height > 0);
+	bool const custom_compress(uses_custom_compress()), custom_alpha(use_mipmaps == 3 || use_mipmaps == 4);
+	levels.clear();
+	levels.emplace_back(width, height, custom_compress);
+	if (custom_compress) {dxt_texture_compress(data, levels.back().data, width, height, ncolors);}
+	if (!custom_alpha && !((custom_compress || full_mip_chain) && (use_mipmaps == 1 || use_mipmaps == 2))) return; // no CPU mipmaps
+	vector<uint8_t> idatav, odata; // reuse across calls doesn't seem to help much
 
 	for (unsigned w = width, h = height, level = 1; w > 1 || h > 1; w >>= 1, h >>= 1, ++level) {
-		unsigned const w1(max(w, 1U)), h1(max(h, 1U)), w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
-		unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
-		uint8_t const *const idata((level == 1) ? data : idatav.data());
-		odata.resize(ncolors*w2*h2);
-
-#pragma omp parallel for schedule(static)
-		for (int y = 0; y < (int)h2; ++y) { // simple 2x2 box filter
-			for (int x = 0; x < (int)w2; ++x) {
-				unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
-
-				for (int n = 0; n < ncolors; ++n) {
-					odata[ix1+n] = uint8_t(((unsigned)idata[ix2+n] + idata[ix2+xinc+n] + idata[ix2+yinc+n] + idata[ix2+yinc+xinc+n]) >> 2);
-				}
-			}
-		}
-		dxt_texture_compress(odata.data(), comp_data, w2, h2, ncolors);
-		GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, level, calc_internal_format(), w2, h2, 0, comp_data.size(), comp_data.data());)
+		unsigned const w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
+		calc_mipmap_level(((level == 1) ? data : idatav.data()), max(w, 1U), max(h, 1U), odata, custom_alpha);
+		// custom alpha mipmaps are sent uncompressed and compressed by the driver when the internal format is compressed
+		levels.emplace_back(w2, h2, (custom_compress && !custom_alpha));
+		if (levels.back().compressed) {dxt_texture_compress(odata.data(), levels.back().data, w2, h2, ncolors);}
+		else {levels.back().data = odata;}
 		idatav.swap(odata);
 	} // for level
 }
 
-void texture_t::create_custom_mipmaps() { // 558ms total for city + cars + people
+// creates the next mipmap level of size max(w/2,1) x max(h/2,1) from idata of size w x h: simple 2x2 box filter, or custom alpha mipmaps
+void texture_t::calc_mipmap_level(uint8_t const *const idata, unsigned w1, unsigned h1, vector<uint8_t> &odata, bool custom_alpha) const {
 
-	assert(is_allocated());
-	vector<uint8_t> idatav, odata;
+	unsigned const w2(max(w1>>1, 1U)), h2(max(h1>>1, 1U));
+	unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
 	color_wrapper cw(color); // for use_mipmaps == 4 with RGBA
+	odata.resize(ncolors*w2*h2);
 
-	for (unsigned w = width, h = height, level = 1; w > 1 || h > 1; w >>= 1, h >>= 1, ++level) {
-		unsigned const w1(max(w, 1U)), h1(max(h, 1U)), w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
-		unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
-		uint8_t const *const idata((level == 1) ? data : idatav.data());
-		odata.resize(ncolors*w2*h2);
-
-		for (unsigned y = 0; y < h2; ++y) {
-			for (unsigned x = 0; x < w2; ++x) {
-				unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
+	parallel_for_jobs(0, h2, [&](int y) {
+		for (unsigned x = 0; x < w2; ++x) {
+			unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
 
-				if (ncolors == 1) {
-					odata[ix1] = uint8_t(((unsigned)idata[ix2] + idata[ix2+xinc] + idata[ix2+yinc] + idata[ix2+yinc+xinc]) >> 2);
+			if (!custom_alpha || ncolors != 4) {
+				for (int n = 0; n < ncolors; ++n) {
+					odata[ix1+n] = uint8_t(((unsigned)idata[ix2+n] + idata[ix2+xinc+n] + idata[ix2+yinc+n] + idata[ix2+yinc+xinc+n]) >> 2);
 				}
-				else if (ncolors == 3) {
-					UNROLL_3X(odata[ix1+i_] = uint8_t(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) >> 2);)
+			}
+			else { // custom alpha mipmaps
+				unsigned const a1(idata[ix2+3]), a2(idata[ix2+xinc+3]), a3(idata[ix2+yinc+3]), a4(idata[ix2+yinc+xinc+3]);
+				unsigned const a_sum(a1 + a2 + a3 + a4);
+
+				if (a_sum == 0) { // fully transparent
+					if (use_mipmaps == 4) {UNROLL_3X(odata[ix1+i_] = cw.c[i_];)} // use average texture color
+					else { // color is average of all 4 values
+						UNROLL_3X(odata[ix1+i_] = uint8_t(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) / 4);)
+					}
+					odata[ix1+3] = 0;
 				}
-				else { // custom alpha mipmaps
-					assert(ncolors == 4);
-					unsigned const a1(idata[ix2+3]), a2(idata[ix2+xinc+3]), a3(idata[ix2+yinc+3]), a4(idata[ix2+yinc+xinc+3]);
-					unsigned const a_sum(a1 + a2 + a3 + a4);
-
-					if (a_sum == 0) { // fully transparent
-						if (use_mipmaps == 4) {UNROLL_3X(odata[ix1+i_] = cw.c[i_];)} // use average texture color
-						else { // color is average of all 4 values
-							UNROLL_3X(odata[ix1+i_] = uint8_t(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) / 4);)
-						}
-						odata[ix1+3] = 0;
+				else { // pre-multiplied and normalized colors
+					if (use_mipmaps == 4) {
+						unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
+						UNROLL_3X(odata[ix1+i_] = uint8_t((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_] + a_cw*cw.c[i_]) / 1020);)
 					}
-					else { // pre-multiplied and normalized colors
-						if (use_mipmaps == 4) {
-							unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
-							UNROLL_3X(odata[ix1+i_] = uint8_t((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_] + a_cw*cw.c[i_]) / 1020);)
-						}
-						else {
-							UNROLL_3X(odata[ix1+i_] = uint8_t((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_]) / a_sum);)
-						}
-						odata[ix1+3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(mipmap_alpha_weight*a_sum)));
+					else {
+						UNROLL_3X(odata[ix1+i_] = uint8_t((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_]) / a_sum);)
 					}
+					odata[ix1+3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(mipmap_alpha_weight*a_sum)));
 				}
-			} // for x
-		} // for y
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // needed for mipmap levels where width*ncolors is not aligned
-		glTexImage2D(GL_TEXTURE_2D, level, calc_internal_format(), w2, h2, 0, calc_format(), get_data_format(), odata.data());
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-		idatav.swap(odata);
-	} // for level
+			}
+		} // for x
+	}, max(1U, 16384U/(ncolors*w2))); // at least ~16KB of output per job
 }
 
-
@@ -8,6 +8,7 @@
 #include "openal_wrap.h"
 #include "heightmap.h"
 #include "profiler.h"
+#include "job_system.h"
 
 
 bool const DEBUG_TILES        = 0;
@@ -77,7 +78,8 @@ extern tree_data_manager_t tree_data_manager;
 extern pt_line_drawer tree_scenery_pld;
 extern tree_placer_t tree_placer;
 
-bool enable_terrain_env(ENABLE_TERRAIN_ENV);
+bool enable_terrain_env(ENABLE_TERRAIN_ENV), tile_streaming(1);
+float tile_upload_budget_ms(2.0); // main thread time for inserting and uploading streamed tiles per frame; 0 = unlimited
 void set_water_plane_uniforms(shader_t &s);
 void create_pine_tree_instances();
 unsigned get_tree_inst_gpu_mem();
@@ -383,6 +385,7 @@ void tile_t::clear() {
 	mesh_weight_data.clear();
 	weight_data.clear();
 	zvals.clear();
+	normal_data.clear();
 	clear_shadows();
 	pine_trees.clear_all();
 	decid_trees.clear();
@@ -448,7 +451,7 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 		if (!results_ready) {assert(no_wait); return 0;} // cached heights are not yet ready
 		ao_zvals.resize(context_sz*context_sz);
 
-#pragma omp parallel for schedule(static,1)
+#pragma omp parallel for schedule(static,1) if (get_job_worker_index() == 0)
 		for (int y = 0; y < (int)context_sz; ++y) {
 			for (unsigned x = 0; x < context_sz; ++x) {ao_zvals[y*context_sz + x] = height_gen.eval_index(x, y);}
 		}
@@ -459,7 +462,7 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	}
 	float const xy_mult(1.0/float(size)), wpz_max(get_max_sea_level());
 
-#pragma omp parallel for schedule(static,1)
+#pragma omp parallel for schedule(static,1) if (get_job_worker_index() == 0) // job workers run one tile each
 	for (int y = 0; y < (int)zvsize; ++y) {
 		for (unsigned x = 0; x < zvsize; ++x) {
 			float &zval(zvals[y*zvsize + x]);
@@ -512,6 +515,13 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	return 1; // results are ready
 }
 
+void tile_t::create_zvals_normals_ao(mesh_xy_grid_cache_t &height_gen) { // CPU work for a new tile; no GL calls, so this can run in a job
+
+	create_zvals(height_gen, 0);
+	calc_normal_data();
+	if (enable_tiled_mesh_ao) {calc_mesh_ao_lighting();}
+}
+
 void tile_t::get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const {
 
 	float const rx1(pos.x - radius), ry1(pos.y - radius), rx2(pos.x + radius), ry2(pos.y + radius);
@@ -579,7 +589,7 @@ void tile_t::calc_mesh_ao_lighting() {
 	float const dz(0.5*HALF_DXY);
 	ao_lighting.resize(stride*stride);
 
-#pragma omp parallel
+#pragma omp parallel if (get_job_worker_index() == 0)
 	{
 		if (!use_ao_zvals) {
 #pragma omp for schedule(static,1)
@@ -831,10 +841,10 @@ void create_or_update_texture(unsigned &tid, bool tid_is_valid, unsigned stride,
 	}
 }
 
-void tile_t::upload_normal_texture(bool tid_is_valid) {
+void tile_t::calc_normal_data() {
 
-	//timer_t timer("Create Normal Texture");
-	vector<unsigned char> normal_data(4*stride*stride, 0);
+	//timer_t timer("Calc Normal Data");
+	normal_data.resize(4*stride*stride, 0);
 	min_normal_z = 1.0;
 
 	for (unsigned y = 0; y < stride; ++y) {
@@ -845,7 +855,12 @@ void tile_t::upload_normal_texture(bool tid_is_valid) {
 			UNROLL_3X(normal_data[ix_off+i_] = (unsigned char)(127.0*(norm[i_] + 1.0)););
 		}
 	}
+}
+
+void tile_t::upload_normal_texture(bool tid_is_valid) {
+	if (normal_data.empty()) {calc_normal_data();} // not precomputed by a streaming job
 	create_or_update_texture(normal_tid, tid_is_valid, stride, normal_data);
+	clear_cont(normal_data); // only needed for the upload
 }
 
 void tile_t::upload_shadow_map_texture(bool tid_is_valid) {
@@ -1052,12 +1067,11 @@ void tile_t::create_texture(mesh_xy_grid_cache_t &height_gen) {
 		get_city_sphere_coll_cubes(query_pos, radius, 1, 1, exclude_cubes, &allow_cubes);
 		has_tunnel |= tile_contains_tunnel(get_mesh_bcube());
 
-#pragma omp parallel for schedule(static,1) num_threads(2)
-		for (int y = 0; y < (int)tsize-DEBUG_TILE_BOUNDS; ++y) {
+		parallel_for_jobs(0, (int)tsize-DEBUG_TILE_BOUNDS, [&](int y) {
 			for (unsigned x = 0; x < tsize-DEBUG_TILE_BOUNDS; ++x) {
 				rand_vals[y*tsize + x] = noise_scale*height_gen.eval_index(x, y, 50);
 			}
-		}
+		});
 		for (unsigned y = 0; y < tsize-DEBUG_TILE_BOUNDS; ++y) { // not threadsafe
 			float const yv(float(y)*xy_mult);
 
@@ -2120,6 +2134,7 @@ tile_draw_t::tile_draw_t() : buildings_valid(0), tiles_gen_prev_frame(0), terrai
 void tile_draw_t::clear(bool no_regen_buildings) {
 
 	clear_vbos_tids(); // needed to clear vbo, ivbo, and free list
+	finish_tile_gen_jobs();
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear();} // may not be necessary
 	to_draw.clear();
 	tiles.clear();
@@ -2170,8 +2185,11 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	int const x2( tile_radius + toffx), y2( tile_radius + toffy);
 	unsigned const init_tiles((unsigned)tiles.size());
 	bool const create_buildings_first(FLATTEN_BUILDING_TILE && using_tiled_terrain_hmap_tex());
+	// stream tiles from background jobs when generating heights from CPU noise; GPU noise needs the GL context, and heightmaps can be edited by the player
+	bool const streaming(tile_streaming && mesh_gen_mode < MGEN_SIMPLEX_GPU && !using_tiled_terrain_hmap_tex() && !create_buildings_first && get_num_job_threads() > 1);
 	unsigned num_erased(0);
 	min_camera_dist = FAR_DISTANCE;
+	if (!streaming) {finish_tile_gen_jobs();} // mode change
 	// Note: we may want to calculate distant low-res or larger tiles when the camera is high above the mesh
 
 	if (!to_gen_zvals.empty()) {
@@ -2192,18 +2210,21 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 			++num_erased;
 		} else {++i;}
 	}
-	for (int y = y1; y <= y2; ++y ) { // create new tiles
-		for (int x = x1; x <= x2; ++x ) {
-			tile_xy_pair const txy(x, y);
-			if (tiles.find(txy) != tiles.end()) continue; // already exists
-			tile_t tile(get_tile_size(), x, y);
-			if (!tile.rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) continue; // too far away to create
-			tile_t *new_tile(new tile_t(tile));
-			to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
-			// in this mode, we need to place buildings and flatten the heightmap before calculating tile heights
-			if (create_buildings_first) {create_buildings_tile(x, y, 1);}
-		} // for x
-	} // for y
+	if (streaming) {stream_tiles(cpos, camera, tile_radius);}
+	else {
+		for (int y = y1; y <= y2; ++y ) { // create new tiles
+			for (int x = x1; x <= x2; ++x ) {
+				tile_xy_pair const txy(x, y);
+				if (tiles.find(txy) != tiles.end()) continue; // already exists
+				tile_t tile(get_tile_size(), x, y);
+				if (!tile.rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) continue; // too far away to create
+				tile_t *new_tile(new tile_t(tile));
+				to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
+				// in this mode, we need to place buildings and flatten the heightmap before calculating tile heights
+				if (create_buildings_first) {create_buildings_tile(x, y, 1);}
+			} // for x
+		} // for y
+	}
 	//if (to_gen_zvals.size() < max_cpu_tiles) {to_gen_zvals.clear();} // block until at least max_cpu_tiles tiles to generate (lower average gen time, but causes more slow frames/lag)
 	unsigned const num_to_gen(to_gen_zvals.size());
 	unsigned gen_this_frame(min(num_to_gen, max_tile_gen_per_frame));
@@ -2295,6 +2316,123 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	return terrain_zmin;
 }
 
+double get_tile_stream_time_ms() {return 1000.0*duration_cast<duration<double>>(high_resolution_clock::now().time_since_epoch()).count();}
+
+tile_draw_t::tile_gen_job_t::tile_gen_job_t(tile_t *tile_, double request_time) : tile(tile_), radius(tile_->calc_radius()), request_time_ms(request_time) {
+	unsigned const tile_size(get_tile_size());
+	tile_xy_pair const txy(tile->get_tile_xy_pair());
+	cx = txy.x*tile_size + tile_size/2;
+	cy = txy.y*tile_size + tile_size/2;
+}
+
+void tile_draw_t::tile_stream_stats_t::add(double gen_ms, double latency_ms) {
+	++num_tiles;
+	tot_gen_ms     += gen_ms;
+	tot_latency_ms += latency_ms;
+	max_eq(max_gen_ms,     gen_ms);
+	max_eq(max_latency_ms, latency_ms);
+	add_timing_sample("Tile Create Latency", latency_ms); // included in benchmark reports
+}
+void tile_draw_t::tile_stream_stats_t::print() const {
+	if (num_tiles == 0) return;
+	cout << "Tile streaming: " << num_tiles << " tiles, gen time avg " << tot_gen_ms/num_tiles << " ms max " << max_gen_ms
+		 << " ms, latency (needed to inserted) avg " << tot_latency_ms/num_tiles << " ms max " << max_latency_ms << " ms, blocking waits " << num_waits << endl;
+}
+
+// Generates zvals, normals, and AO for new tiles in background jobs, requesting tiles ahead of the camera in its direction of motion.
+// The main thread only inserts finished tiles, which are then uploaded by pre_draw(), up to tile_upload_budget_ms per frame.
+// Every insert is charged its measured time, and the measured upload time from pre_draw() is charged to the next frame.
+void tile_draw_t::stream_tiles(point const &cpos, point const &camera, int tile_radius) { // camera is cpos in model space
+
+	TRACE_ZONE("Stream Tiles");
+	float const wait_dist_tiles = 0.1; // tiles this close to the camera are waited on rather than leaving a hole under the player
+	double const cur_time(get_tile_stream_time_ms());
+	float const tile_rad(get_scaled_tile_radius());
+	bool const first_frame(tiles.empty()); // block until the initial tiles are ready so that the first drawn frame is complete
+
+	// predict where the camera will be by the time newly requested tiles have been generated
+	vector3d const move((cpos.x - last_stream_camera.x), (cpos.y - last_stream_camera.y), 0.0);
+	if (first_frame || move.mag() > tile_rad) {camera_vel = zero_vector;} // teleport, nothing to predict from
+	else if (cur_time > last_stream_time_ms) {camera_vel = 0.8f*camera_vel + (0.2f/float(cur_time - last_stream_time_ms))*move;}
+	last_stream_camera  = cpos;
+	last_stream_time_ms = cur_time;
+	vector3d pred_move(camera_vel*float(2.0*avg_gen_ms + 50.0)); // twice the generation time plus a few frames
+	float const pred_dist(pred_move.mag()), max_pred_dist(CREATE_DIST_TILES*tile_rad);
+	if (pred_dist > max_pred_dist) {pred_move *= max_pred_dist/pred_dist;}
+	point const pred_pos(cpos + pred_move), pred_camera(camera + pred_move);
+
+	// request tiles within the create distance of either the current or the predicted camera position, nearest to the predicted position first
+	int const toffx(int(0.5*camera.x/X_SCENE_SIZE)), toffy(int(0.5*camera.y/Y_SCENE_SIZE));
+	int const poffx(int(0.5*pred_camera.x/X_SCENE_SIZE)), poffy(int(0.5*pred_camera.y/Y_SCENE_SIZE));
+	unsigned const max_jobs(first_frame ? UINT_MAX : 4*get_num_job_threads()); // limit tiles in flight so that stale requests don't delay new ones
+	draw_vect_t to_request;
+
+	for (int y = min(toffy, poffy) - tile_radius; y <= max(toffy, poffy) + tile_radius; ++y) {
+		for (int x = min(toffx, poffx) - tile_radius; x <= max(toffx, poffx) + tile_radius; ++x) {
+			tile_xy_pair const txy(x, y);
+			if (tiles.find(txy) != tiles.end() || gen_jobs.find(txy) != gen_jobs.end()) continue; // already exists or requested
+			tile_t tile(get_tile_size(), x, y);
+			if (!tile.rel_dist_to_camera_xy_lt(CREATE_DIST_TILES) && !tile.rel_dist_to_pt_xy_lt(pred_pos, CREATE_DIST_TILES)) continue; // too far away to create
+			to_request.emplace_back((p2p_dist_xy(pred_pos, tile.get_center()) + (tile.is_visible() ? 0.0 : FAR_CLIP)), new tile_t(tile));
+		}
+	}
+	if (gen_jobs.size() + to_request.size() > max_jobs) {sort(to_request.begin(), to_request.end());} // sort by priority if not all requested
+
+	for (auto i = to_request.begin(); i != to_request.end(); ++i) { // workers take the oldest jobs first
+		if (gen_jobs.size() >= max_jobs) {delete i->second; continue;} // request in a later frame
+		tile_gen_job_t *const gj(new tile_gen_job_t(i->second, cur_time));
+		gen_jobs[i->second->get_tile_xy_pair()].reset(gj);
+		gj->job = add_background_job([gj]() {gj->tile->create_zvals_normals_ao(gj->height_gen); gj->done_time_ms = get_tile_stream_time_ms();}, vector<job_handle_t>(), "Tile Gen");
+	}
+	// collect finished tiles that are needed now; prefetched tiles are kept until the camera gets close enough
+	vector<pair<float, tile_gen_job_t *>> ready;
+
+	for (auto i = gen_jobs.begin(); i != gen_jobs.end(); ) { // Note: no ++i
+		tile_gen_job_t &gj(*i->second);
+		bool const needed(gj.is_within(cpos, CREATE_DIST_TILES)), urgent(first_frame || gj.is_within(cpos, wait_dist_tiles));
+		if (needed && gj.needed_time_ms == 0.0) {gj.needed_time_ms = cur_time;}
+
+		if (!job_is_done(gj.job)) {
+			if (!urgent) {++i; continue;} // still being generated
+			wait_for_job(gj.job);
+			if (!first_frame) {++stream_stats.num_waits;}
+		}
+		if (!needed && !urgent) {
+			if (!gj.is_within(cpos, DELETE_DIST_TILES) && !gj.is_within(pred_pos, CREATE_DIST_TILES)) {gen_jobs.erase(i++);} // mispredicted, drop it
+			else {++i;}
+			continue;
+		}
+		ready.emplace_back((urgent ? -1.0 : gj.tile->get_draw_priority()), &gj);
+		++i;
+	} // for i
+	sort(ready.begin(), ready.end());
+	double budget_used(upload_debt_ms); // uploads since the last call
+	unsigned num_inserted(0);
+
+	for (auto i = ready.begin(); i != ready.end(); ++i) {
+		tile_gen_job_t &gj(*i->second);
+		bool const urgent(i->first < 0.0);
+		if (!urgent && tile_upload_budget_ms > 0.0 && budget_used >= tile_upload_budget_ms) break; // over budget, insert the rest in a later frame
+		double const insert_start_ms(get_tile_stream_time_ms());
+		double const gen_ms(gj.done_time_ms - gj.request_time_ms), latency_ms(max(0.0, (cur_time - max(gj.needed_time_ms, gj.request_time_ms))));
+		avg_gen_ms = ((avg_gen_ms == 0.0) ? gen_ms : (0.9*avg_gen_ms + 0.1*gen_ms));
+		stream_stats.add(gen_ms, latency_ms);
+		tile_xy_pair const txy(gj.tile->get_tile_xy_pair());
+		insert_tile(gj.tile.release());
+		gen_jobs.erase(txy); // frees gj
+		budget_used += get_tile_stream_time_ms() - insert_start_ms;
+		++num_inserted;
+	} // for i
+	upload_debt_ms = max(0.0, (budget_used - tile_upload_budget_ms)); // carry any overrun into the next frame
+	TRACE_COUNTER_ADD("Tiles Streamed", num_inserted);
+	if (DEBUG_TILES && num_inserted > 0) {cout << "stream: inserted " << num_inserted << ", pending " << gen_jobs.size() << ", camera vel " << camera_vel.str() << endl;}
+}
+
+void tile_draw_t::finish_tile_gen_jobs() { // wait for and drop tiles that are being generated
+	for (auto i = gen_jobs.begin(); i != gen_jobs.end(); ++i) {wait_for_job(i->second->job);}
+	gen_jobs.clear();
+}
+
 float tile_draw_t::get_actual_zmin() const {return min(zmin, terrain_zmin);}
 
 
@@ -2579,8 +2717,12 @@ void tile_draw_t::pre_draw() { // view-dependent updates/GPU uploads
 	assert(!height_gens.empty());
 	
 	for (vector<tile_t *>::iterator i = to_update.begin(); i != to_update.end(); ++i) {
+		bool const first_upload(!(*i)->textures_created());
+		double const upload_start_ms(first_upload ? get_tile_stream_time_ms() : 0.0);
 		(*i)->pre_draw(height_gens[0]);
 
+		if (first_upload) {upload_debt_ms += get_tile_stream_time_ms() - upload_start_ms;} // charged to the next stream_tiles() call
+
 		if ((*i)->can_have_trees()) {
 			(*i)->update_pine_tree_state(1);
 			(*i)->update_decid_trees();
@@ -3515,6 +3657,7 @@ void draw_tiled_terrain(int reflection_pass) {
 void draw_tiled_terrain_lightning(bool reflection_pass) {terrain_tile_draw.update_lightning(reflection_pass);}
 void end_tiled_terrain_lightning() {terrain_tile_draw.end_lightning();}
 void clear_tiled_terrain(bool no_regen_buildings) {terrain_tile_draw.clear(no_regen_buildings);}
+void print_tile_stream_stats() {terrain_tile_draw.print_tile_stream_stats();}
 void draw_tiled_terrain_clouds(bool reflection_pass) {terrain_tile_draw.draw_tile_clouds(reflection_pass);}
 void draw_tiled_terrain_decid_tree_shadows() {terrain_tile_draw.draw_decid_tree_shadows();}
 void reset_tiled_terrain_state() {terrain_tile_draw.clear_vbos_tids();}
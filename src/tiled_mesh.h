@@ -13,6 +13,7 @@
 #include "tree_3dw.h"
 #include "shadow_map.h"
 #include "animals.h"
+#include "job_system.h"
 #include <unordered_map>
 #include <unordered_set>
 
@@ -179,7 +180,7 @@ private:
 	float sub_zmin[4][4] = {0}, sub_zmax[4][4] = {0};
 	vector<float> zvals, ao_zvals;
 	vector<tree_map_val> tree_map;
-	vector<unsigned char> mesh_weight_data, weight_data, ao_lighting;
+	vector<unsigned char> mesh_weight_data, weight_data, ao_lighting, normal_data; // normal_data is only kept between a streaming job and the upload
 	vector<unsigned char> smask[NUM_LIGHT_SRC];
 	vector<float> sh_out[NUM_LIGHT_SRC][2];
 	vect_smap_t<tile_smap_data_t> smap_data;
@@ -291,6 +292,7 @@ public:
 	void clear_vbo_tid(tile_shadow_map_manager *smap_manager);
 	void clear_pine_tree_vbos() {pine_trees.clear_vbos();}
 	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait);
+	void create_zvals_normals_ao(mesh_xy_grid_cache_t &height_gen);
 	void get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const;
 	float get_zval_at(float x, float y, bool in_global_space) const;
 
@@ -302,6 +304,7 @@ public:
 
 	// *** shadows ***
 	void calc_mesh_ao_lighting();
+	void calc_normal_data();
 	void calc_shadows_for_light(unsigned l);
 	static void proc_tile_queue(tile_t *init_tile, unsigned l);
 	void calc_shadows(bool calc_sun, bool calc_moon, bool no_push=0);
@@ -340,9 +343,10 @@ public:
 	float get_rel_dist_to_camera(bool xy_dist=1) const {
 		return max(0.0f, (xy_dist ? p2p_dist_xy(get_camera_pos(), get_center()) : p2p_dist(get_camera_pos(), get_center())) - radius)/get_scaled_tile_radius();
 	}
-	bool rel_dist_to_camera_xy_lt(float rel_dist) const {
-		return dist_xy_less_than(get_camera_pos(), get_center(), (rel_dist*get_scaled_tile_radius() + radius));
+	bool rel_dist_to_pt_xy_lt(point const &pt, float rel_dist) const {
+		return dist_xy_less_than(pt, get_center(), (rel_dist*get_scaled_tile_radius() + radius));
 	}
+	bool rel_dist_to_camera_xy_lt(float rel_dist) const {return rel_dist_to_pt_xy_lt(get_camera_pos(), rel_dist);}
 	float get_bsphere_radius_inc_water() const;
 	bool use_as_occluder() const;
 	bool mesh_sphere_intersect(point const &pos, float rradius) const;
@@ -357,6 +361,7 @@ public:
 		return ((ENABLE_TREE_LOD && !force_high_detail) ? CLIP_TO_01(GEOMORPH_THRESH*(get_tree_dist_scale(has_palm) - 1.0f)) : 0.0);
 	}
 	float get_draw_priority() const;
+	bool textures_created() const {return (weight_tid != 0);}
 
 	// *** trees ***
 	template <typename T> void postproc_trees(T const &trees, float &tzmax) { // pine/decidious trees
@@ -444,6 +449,32 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	tile_shadow_map_manager smap_manager;
 	vector<pair<float, tile_xy_pair>> shadow_recomp_queue;
 
+	struct tile_gen_job_t { // a tile whose zvals, normals, and AO are being generated by a background job
+		unique_ptr<tile_t> tile;
+		mesh_xy_grid_cache_t height_gen;
+		job_handle_t job;
+		int cx, cy; // tile center in mesh coordinates; the tile itself can't be read until the job is done
+		float radius;
+		double request_time_ms, needed_time_ms=0.0, done_time_ms=0.0; // done_time_ms is written by the job
+
+		tile_gen_job_t(tile_t *tile_, double request_time);
+		bool is_within(point const &pt, float rel_dist) const {
+			point const center(get_xval(cx + xoff - xoff2), get_yval(cy + yoff - yoff2), 0.0);
+			return dist_xy_less_than(pt, center, (rel_dist*get_scaled_tile_radius() + radius));
+		}
+	};
+	struct tile_stream_stats_t {
+		unsigned num_tiles=0, num_waits=0;
+		double tot_gen_ms=0.0, max_gen_ms=0.0, tot_latency_ms=0.0, max_latency_ms=0.0;
+		void add(double gen_ms, double latency_ms);
+		void print() const;
+	};
+	unordered_map<tile_xy_pair, unique_ptr<tile_gen_job_t>, hash_tile_xy_pair> gen_jobs;
+	tile_stream_stats_t stream_stats;
+	point last_stream_camera=all_zeros;
+	vector3d camera_vel=zero_vector; // per ms, smoothed; used to predict which tiles will be needed next
+	double last_stream_time_ms=0.0, avg_gen_ms=0.0, upload_debt_ms=0.0; // upload_debt_ms: measured tile upload time not yet charged to the budget
+
 	struct occluder_pts_t {
 		point cube_pts[4];
 		void calc_cube_top_points(cube_t const &bcube);
@@ -456,10 +487,12 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	vector<occluder_cubes_t> occluders; // reused across draw calls
 	vector<unsigned> occluder_ixs; // reused across draw calls
 	void insert_tile(tile_t *tile);
+	void stream_tiles(point const &cpos, point const &camera, int tile_radius);
+	void finish_tile_gen_jobs();
 
 public:
 	tile_draw_t();
-	~tile_draw_t() {/*clear();*/}
+	~tile_draw_t() {finish_tile_gen_jobs();} // gen jobs reference their tiles; don't clear(), which frees GL state
 	void clear(bool no_regen_buildings);
 	void free_compute_shader();
 	float update(float &min_camera_dist);
@@ -510,6 +543,7 @@ public:
 	int get_tid_under_point(point const &pos) const;
 	bool line_intersect_mesh(point const &v1, point const &v2, float &t, tile_t *&intersected_tile, int &xpos, int &ypos, float inc_trees) const;
 	float get_actual_zmin() const;
+	void print_tile_stream_stats() const {stream_stats.print();}
 	void add_or_remove_trees_at(point const &pos, float radius, bool add_trees, int brush_shape);
 	void add_or_remove_grass_at(point const &pos, float radius, bool add_grass, int brush_shape, float brush_weight);
 }; // tile_draw_t
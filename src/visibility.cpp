@@ -5,6 +5,7 @@
 #include "3DWorld.h"
 #include "mesh.h"
 #include "physics_objects.h"
+#include "job_system.h"
 
 
 int const FAST_LIGHT_VIS    = 1;
@@ -524,23 +525,18 @@ public:
 		assert(smask != NULL);
 		dir  = -lpos.get_norm();
 		dist = 2.0*XY_SUM_SIZE/sqrt(dir.x*dir.x + dir.y*dir.y);
-		#pragma omp parallel sections num_threads(2)
-		{
-			#pragma omp section
-			{
+		run_jobs_in_parallel([this]() {
 				float const xval(get_xval((dir.x > 0) ? 0 : xsize));
 				for (int y = 0; y < 2*ysize; ++y) { // half increments
 					trace_shadow_path(point(xval, (-Y_SCENE_SIZE + 0.5*DY_VAL*y), 0.0));
 				}
-			}
-			#pragma omp section
-			{
+			},
+			[this]() {
 				float const yval(get_yval((dir.y > 0) ? 0 : ysize));
 				for (int x = 0; x < 2*xsize; ++x) { // half increments
 					trace_shadow_path(point((-X_SCENE_SIZE + 0.5*DX_VAL*x), yval, 0.0));
 				}
-			}
-		}
+			});
 	}
 };
 
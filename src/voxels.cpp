@@ -11,7 +11,9 @@
 #include "file_utils.h"
 #include "openal_wrap.h"
 #include "cobj_bsp_tree.h"
+#include "job_system.h"
 #include <glm/gtc/noise.hpp>
+#include <chrono>
 
 
 bool const DEBUG_BLOCKS    = 0;
@@ -29,7 +31,7 @@ voxel_model_ground terrain_voxel_model(GROUND_NUM_LOD);
 voxel_brush_params_t voxel_brush_params;
 bool voxel_ppb_enable_falling(0);
 
-extern bool group_back_face_cull, voxel_shadows_updated;
+extern bool group_back_face_cull, voxel_shadows_updated, cpu_noise_gen;
 extern int dynamic_mesh_scroll, rand_gen_index, scrolling, display_mode, display_framerate, voxel_editing, mesh_gen_mode, mesh_freq_filter;
 extern float FAR_CLIP;
 extern double tfticks;
@@ -54,6 +56,7 @@ void noise_texture_manager_t::procedural_gen(unsigned size, int rseed, float mag
 	voxels.clear();
 	voxels.init(tsize, tsize, tsize, vector3d(1,1,1), all_zeros, 0.0, 1);
 	voxels.create_procedural(mag, freq, offset, 1, rseed, 654+rand_gen_index, 0, 0); // always use sines; verbose=0
+	gen_size.store(tsize, std::memory_order_release);
 }
 
 void noise_texture_manager_t::ensure_tid() {
@@ -69,6 +72,7 @@ void noise_texture_manager_t::bind_texture(unsigned tu_id) const {
 void noise_texture_manager_t::clear() {
 	free_texture(noise_tid);
 	tsize = 0;
+	gen_size.store(0, std::memory_order_release);
 }
 
 float noise_texture_manager_t::eval_at(point const &pos) const {
@@ -291,6 +295,17 @@ void voxel_manager::create_procedural(float mag, float freq, vector3d const &off
 	else {
 		gen_rx_ry(rx, ry);
 	}
+	if (gen_mode >= MGEN_SIMPLEX_GPU && (cpu_noise_gen || benchmark_cpu_only())) { // vectorized CPU version of the gen_voxel_weights shader
+#pragma omp parallel for schedule(static,1)
+		for (int y = 0; y < (int)ny; ++y) {
+			for (unsigned x = 0; x < nx; ++x) { // z values are contiguous
+				float *const vals(&get_ref(x, y, 0));
+				gen_simplex_fbm_3d_line_simd(vals, nz, (get_pt_at(x, y, 0) + offset), vector3d(0.0, 0.0, vsz.z), mag, 0.25*freq, rx, ry, 5); // 5 octaves, to match the shader
+				if (normalize_to_1) {for (unsigned z = 0; z < nz; ++z) {vals[z] = CLIP_TO_pm1(vals[z]);}}
+			}
+		}
+		return;
+	}
 	if (gen_mode >= MGEN_SIMPLEX_GPU) { // GPU simplex
 		unsigned tid(0);
 		compute_shader_comp_t cshader("noise_2d_3d.part*+gen_voxel_weights", nz, nx, ny, 16, 16, 1); // Note: {x,y,z} is reordered to {z,x,y}
@@ -675,16 +690,12 @@ void voxel_model::remove_unconnected_outside_modified_blocks(bool postproc_brush
 		for (vector<unsigned>::const_iterator i = xy_updated.begin(); i != xy_updated.end(); ++i) {
 			unsigned const x((*i)%nx), y((*i)/nx);
 			assert(x < nx && y < ny);
-			unsigned const bx1(max(0, (int)x-1)/xblocks), by1(max(0, (int)y-1)/yblocks);
-			unsigned const bx2(min((int)nx-1, (int)x+1)/xblocks), by2(min((int)nx-1, (int)y+1)/yblocks);
+			map<unsigned, voxel_bounds_t> col_blocks;
+			add_modified_column(x, y, 0, nz-1, col_blocks); // any voxel in the column may have changed
+			add_modified_blocks(col_blocks);
 		
-			for (unsigned by = by1; by <= by2; ++by) {
-				for (unsigned bx = bx1; bx <= bx2; ++bx) {
-					unsigned const bix(by*num_blocks + bx);
-					assert(bix < tri_data[0].size());
-					modified_blocks.insert(bix);
-					if (falling_voxels_shift_down) {next_frame_modified_blocks.insert(bix);} // make sure we continue to update these blocks next frame
-				}
+			if (falling_voxels_shift_down) { // make sure we continue to update these blocks next frame
+				for (auto const &b : col_blocks) {next_frame_modified_blocks.insert(b.first);}
 			}
 		}
 	}
@@ -1005,7 +1016,7 @@ unsigned voxel_model::get_block_ix(unsigned voxel_ix) const {
 }
 
 
-voxel_model::voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned num_lod_levels) : voxel_manager(use_mesh_), volume_added(0), noise_tex_gen(ntg) {
+voxel_model::voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned num_lod_levels) : voxel_manager(use_mesh_), volume_added(0), noise_tex_gen(ntg), async_updates(0) {
 
 	assert(num_lod_levels > 0);
 	tri_data.resize(num_lod_levels);
@@ -1015,11 +1026,18 @@ voxel_model::voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned
 
 
 voxel_model_ground::voxel_model_ground(unsigned num_lod_levels)
-	: voxel_model(&private_ntg, 1, num_lod_levels), add_cobjs(0), add_as_fixed(0), cobj_tree(&coll_objects) {}
+	: voxel_model(&private_ntg, 1, num_lod_levels), add_cobjs(0), add_as_fixed(0), cobj_tree(&coll_objects)
+{
+	async_updates = 1; // update edited blocks in the background so that voxel editing doesn't stall the frame
+}
 
 
 void voxel_model::clear() {
 
+	wait_for_remesh_job();
+	remesh_batch = remesh_batch_t();
+	queued_updates.clear();
+	dirty_bounds.clear();
 	free_context();
 	assert(tri_data.size() == boundary_vnmap.size());
 	
@@ -1040,7 +1058,7 @@ void voxel_model_ground::clear() {
 	
 	voxel_model::clear();
 	for (unsigned i = 0; i < data_blocks.size(); ++i) {clear_block(i);} // unnecessary?
-	data_blocks.clear();
+	data_blocks.clear(); // also removes pending cobjs from any discarded remesh job
 }
 
 
@@ -1076,12 +1094,11 @@ bool voxel_model_ground::clear_block(unsigned block_ix) {
 
 
 // returns the number of triangles created
-unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level) {
+// tri_block is usually tri_data[lod_level][block_ix], but may be a separate block when called from a remesh job
+unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level, tri_data_t::value_type &tri_block) {
 
 	assert(lod_level < tri_data.size());
-	tri_data_t &td(tri_data[lod_level]);
-	assert(block_ix < td.size());
-	auto &tri_block(td[block_ix]);
+	assert(block_ix < tri_data[lod_level].size());
 	assert(tri_block.empty());
 	vix_cache.init(xblocks+1, yblocks+1, nz, vsz, zero_vector, vert_ix_cache_entry(), 1);
 	unsigned const xbix(block_ix%params.num_blocks), ybix(block_ix/params.num_blocks), step(1 << lod_level);
@@ -1100,7 +1117,7 @@ unsigned voxel_model::create_block(voxel_ix_cache &vix_cache, unsigned block_ix,
 			pt_to_ix[lod_level][block_ix].pt = (point((xbix+0.5)*xblocks, (ybix+0.5)*yblocks, nz/2)*vsz + lo_pos);
 			pt_to_ix[lod_level][block_ix].ix = block_ix;
 		}
-		if (lod_level == 0) {create_block_hook(block_ix);}
+		if (lod_level == 0) {create_block_hook(block_ix, tri_block);}
 		tri_block.finalize(3); // needed to compute bounding sphere and vertex normals
 	}
 	else { // count_only
@@ -1117,37 +1134,42 @@ unsigned voxel_model::create_block_all_lods(unsigned block_ix, bool first_create
 	voxel_ix_cache vix_cache; // reused across LODs
 
 	for (unsigned lod = 0; lod < (count_only ? 1 : tri_data.size()); ++lod) { // in count_only mode we only process the LOD 0
-		unsigned const lod_count(create_block(vix_cache, block_ix, first_create, count_only, lod));
+		unsigned const lod_count(create_block(vix_cache, block_ix, first_create, count_only, lod, tri_data[lod][block_ix]));
 		if (lod == 0) {count = lod_count;} // only count LOD 0
 	}
 	return count;
 }
 
 
-void voxel_model_ground::create_block_hook(unsigned block_ix) { // lod_level == 0
-
-	if (!add_cobjs) return; // nothing to do
-	cobj_params cparams[3];
+void voxel_model_ground::get_cobj_params(cobj_params cparams[3]) const {
 
 	for (unsigned d = 0; d < 3; ++d) {
 		colorRGBA const color(params.base_color.modulate_with((d == 2) ? WHITE : params.colors[d]));
 		cparams[d] = cobj_params(params.elasticity, color, 0, 0, NULL, 0, params.tids[d]);
 		cparams[d].cobj_type = COBJ_TYPE_VOX_TERRAIN;
 	}
-	assert(block_ix < data_blocks.size());
-	assert(data_blocks[block_ix].cids.empty());
-	tri_data_t::value_type const &td(tri_data[0][block_ix]);
+}
+
+
+// called in parallel for different blocks; polygons are written to the block's pending list and added to coll_objects later by post_create_blocks_hook()
+void voxel_model_ground::create_block_hook(unsigned block_ix, tri_data_t::value_type const &td) { // lod_level == 0
+
+	if (!add_cobjs) return; // nothing to do
+	assert(block_ix < data_blocks.size()); // Note: the block's current cobjs may not have been removed yet if this is a remesh job
+	data_block_t &db(data_blocks[block_ix]);
+	assert(!db.has_pending && db.pending.empty()); // each block is only created once per pass
+	db.has_pending = 1;
 	unsigned const num_verts(td.num_verts());
 	assert((num_verts % 3) == 0);
-	data_blocks[block_ix].cids.reserve(num_verts/3);
 
-	#pragma omp critical(add_coll_polygon)
 	for (unsigned v = 0; v < num_verts; v += 3) {
 		point const pts[3] = {td.get_vert(v+0).v, td.get_vert(v+1).v, td.get_vert(v+2).v};
 		vector3d const normal(get_poly_norm(pts));
 		if (normal == zero_vector) continue; // degenerate polygon, skip it
-		unsigned const cp_ix((params.top_tex_used && normal.z > 0.5) ? 2 : fabs(eval_noise_texture_at((pts[0] + pts[1] + pts[2])/3.0)) > 0.5);
-		int cindex(-1);
+		pending_cobj_t pc;
+		pc.normal = normal;
+		pc.cp_ix  = ((params.top_tex_used && normal.z > 0.5) ? 2 : fabs(eval_noise_texture_at((pts[0] + pts[1] + pts[2])/3.0)) > 0.5);
+		pc.npts   = 0;
 
 #if 1 // only gets here ~5% of the time for the large voxel terrain scene
 		if (v+3 < num_verts) { // have a next triangle
@@ -1155,25 +1177,55 @@ void voxel_model_ground::create_block_hook(unsigned block_ix) { // lod_level ==
 
 			if ((normal - get_poly_norm(pts2)).mag_sq() < 0.0001) {
 				if (pts2[0] == pts[1] && pts2[2] == pts[2]) { // merge two tris into a quad
-					point const quad_pts[4] = {pts[0], pts[1], pts2[1], pts[2]};
-					cindex = add_simple_coll_polygon(quad_pts, 4, cparams[cp_ix], normal);
+					pc.pts[0] = pts[0]; pc.pts[1] = pts[1]; pc.pts[2] = pts2[1]; pc.pts[3] = pts[2];
+					pc.npts = 4;
 					v += 3; // skip the second triangle
 				}
 				else if (pts2[1] == pts[1] && pts2[0] == pts[2]) { // merge two tris into a quad
-					point const quad_pts[4] = {pts[0], pts[1], pts2[2], pts[2]};
-					cindex = add_simple_coll_polygon(quad_pts, 4, cparams[cp_ix], normal);
+					pc.pts[0] = pts[0]; pc.pts[1] = pts[1]; pc.pts[2] = pts2[2]; pc.pts[3] = pts[2];
+					pc.npts = 4;
 					v += 3; // skip the second triangle
 				}
 			}
 		}
 #endif
-		if (cindex < 0) {cindex = add_simple_coll_polygon(pts, 3, cparams[cp_ix], normal);}
-		if (add_as_fixed) {coll_objects.get_cobj(cindex).fixed = 1;} // mark as fixed so that lmap cells will be generated and cobjs will be re-added
-		data_blocks[block_ix].cids.push_back(cindex);
+		if (pc.npts == 0) {
+			UNROLL_3X(pc.pts[i_] = pts[i_];)
+			pc.npts = 3;
+		}
+		db.pending.push_back(pc);
+	}
+}
+
+
+// adds the pending polygons of all created blocks to coll_objects in block order, so that cobj IDs don't depend on which threads created which blocks
+void voxel_model_ground::post_create_blocks_hook() {
+
+	if (!add_cobjs) return; // nothing to do
+	vector<unsigned> blocks;
+	cobj_params cparams[3];
+	get_cobj_params(cparams);
+
+	for (unsigned block_ix = 0; block_ix < data_blocks.size(); ++block_ix) {
+		data_block_t &db(data_blocks[block_ix]);
+		if (!db.has_pending) continue;
+		assert(db.cids.empty());
+		db.cids.reserve(db.pending.size());
+
+		for (pending_cobj_t const &pc : db.pending) {
+			int const cindex(add_simple_coll_polygon(pc.pts, pc.npts, cparams[pc.cp_ix], pc.normal));
+			if (add_as_fixed) {coll_objects.get_cobj(cindex).fixed = 1;} // mark as fixed so that lmap cells will be generated and cobjs will be re-added
+			db.cids.push_back(cindex);
+		}
+		db.pending.clear(); // keep the memory for the next update
+		db.has_pending = 0;
+		blocks.push_back(block_ix);
 	}
-	// Note: this call is really only safe to do without trying to the add_coll_polygon critical section because
-	// coll_objects has been reserved ahead of time and won't be resized (meaning the pointers are always valid)
-	cobj_tree.add_cobjs_for_block(data_blocks[block_ix].cids, block_ix%params.num_blocks, block_ix/params.num_blocks);
+	// coll_objects won't be resized, so the per-block trees can be built in parallel
+	parallel_for_jobs(0, (int)blocks.size(), [&](int i) {
+		unsigned const block_ix(blocks[i]);
+		cobj_tree.add_cobjs_for_block(data_blocks[block_ix].cids, block_ix%params.num_blocks, block_ix/params.num_blocks);
+	});
 }
 
 
@@ -1195,7 +1247,8 @@ void voxel_model::calc_ao_dirs() {
 }
 
 
-void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_only) {
+// computes AO for the voxel columns of a block within the x/y range of region; if ao_updates is non-null, changed values are added to it rather than written
+void voxel_model::calc_ao_lighting_for_region(unsigned block_ix, voxel_bounds_t const &region, bool increase_only, vector<ao_update_t> *ao_updates) {
 
 	if (ao_lighting.empty()) return; // nothing to do
 	float const norm(params.ao_weight_scale/ao_dirs.size());
@@ -1206,10 +1259,13 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 	unsigned const zstep(use_mesh ? max(1U, nz/MESH_SIZE[2]) : 1U);
 	unsigned const x_end(min(nx, (xbix+1)*xblocks)), y_end(min(ny, (ybix+1)*yblocks));
 	unsigned const voxel_sz[3] = {nx, ny, nz};
+	// align the region to the AO step grid of the block so that the results are the same as for the entire block
+	unsigned const x_start(xbix*xblocks + (max(region.v[0][0], xbix*xblocks) - xbix*xblocks)/xstep*xstep), x_stop(min(x_end, region.v[0][1]+1));
+	unsigned const y_start(ybix*yblocks + (max(region.v[1][0], ybix*yblocks) - ybix*yblocks)/ystep*ystep), y_stop(min(y_end, region.v[1][1]+1));
 	
-	#pragma omp parallel for schedule(dynamic,1)
-	for (int yi = ybix*yblocks; yi < (int)y_end; yi += ystep) {
-		for (unsigned xi = xbix*xblocks; xi < x_end; xi += xstep) {
+	#pragma omp parallel for schedule(dynamic,1) if (ao_updates == nullptr)
+	for (int yi = y_start; yi < (int)y_stop; yi += ystep) {
+		for (unsigned xi = x_start; xi < x_stop; xi += xstep) {
 			if (xi == 0 || yi == 0 || xi >= nx-xstep || (unsigned)yi >= ny-ystep) continue; // at the mesh edges
 			bool saw_inside(0);
 
@@ -1251,7 +1307,9 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 				for (unsigned yy = yi; yy < min(y_end, yi+ystep); ++yy) {
 					for (unsigned xx = xi; xx < min(x_end, xi+xstep); ++xx) {
 						for (unsigned zz = zi; zz < min(nz, zi+zstep); ++zz) {
-							ao_lighting.set(xx, yy, zz, ao_val);
+							if (ao_updates == nullptr) {ao_lighting.set(xx, yy, zz, ao_val); continue;}
+							unsigned const ix(ao_lighting.get_ix(xx, yy, zz));
+							if (ao_lighting[ix] != ao_val) {ao_updates->push_back(ao_update_t({ix, ao_val}));}
 						}
 					}
 				}
@@ -1261,6 +1319,11 @@ void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_on
 }
 
 
+void voxel_model::calc_ao_lighting_for_block(unsigned block_ix, bool increase_only) {
+	calc_ao_lighting_for_region(block_ix, get_block_bounds(block_ix), increase_only, nullptr);
+}
+
+
 void voxel_model_space::calc_ao_lighting_for_block(unsigned block_ix, bool increase_only) {
 
 	voxel_model::calc_ao_lighting_for_block(block_ix, increase_only);
@@ -1287,11 +1350,16 @@ bool voxel_model::update_voxel_sphere_region(point const &center, float radius,
 {
 	assert(radius > 0.0);
 	if (val_at_center == 0.0 || empty()) return 0;
+
+	if (remesh_job) { // the remesh job is reading the voxels, so apply this edit after it finishes
+		queued_updates.push_back(queued_update_t({center, radius, val_at_center, spherical, falloff_exp, shooter, num_fragments}));
+		return 0; // nothing has been updated yet, and damage_pos isn't set
+	}
 	bool const material_removed(val_at_center < 0.0);
 	if (params.invert) val_at_center *= -1.0; // is this correct?
 	unsigned const num[3] = {nx, ny, nz};
 	unsigned bounds[3][2] = {}; // {x,y,z} x {lo,hi}
-	std::set<unsigned> blocks_to_update;
+	map<unsigned, voxel_bounds_t> blocks_to_update;
 	float const dist_adjust(0.5*vsz.mag()); // single voxel diagonal half-width
 	bool saw_inside(0), saw_outside(0);
 
@@ -1302,6 +1370,7 @@ bool voxel_model::update_voxel_sphere_region(point const &center, float radius,
 	for (unsigned y = bounds[1][0]; y <= bounds[1][1]; ++y) {
 		for (unsigned x = bounds[0][0]; x <= bounds[0][1]; ++x) {
 			bool was_updated(0);
+			unsigned zmin(nz), zmax(0);
 
 			for (unsigned z = bounds[2][0]; z <= bounds[2][1]; ++z) {
 				point const pos(get_pt_at(x, y, z));
@@ -1316,26 +1385,18 @@ bool voxel_model::update_voxel_sphere_region(point const &center, float radius,
 				if (val == prev_val) continue; // no change
 				calc_outside_val(x, y, z, ((outside.get(x, y, z) & UNDER_MESH_BIT) != 0));
 				was_updated = 1;
+				zmin = min(zmin, z);
+				zmax = max(zmax, z);
 				(val_is_outside(val,      params) ? saw_outside : saw_inside) = 1;
 				(val_is_outside(prev_val, params) ? saw_outside : saw_inside) = 1;
 				if (damage_pos) {*damage_pos = pos;}
 			}
-			if (!was_updated) continue;
-			// check adjacent voxels since we will need to update our neighbors at the boundaries
-			unsigned const bx1(max((int)x-1, 0        )/xblocks), by1(max((int)y-1, 0        )/yblocks);
-			unsigned const bx2(min((int)x+1, (int)nx-1)/xblocks), by2(min((int)y+1, (int)ny-1)/yblocks);
-
-			for (unsigned by = by1; by <= by2; ++by) {
-				for (unsigned bx = bx1; bx <= bx2; ++bx) {
-					unsigned const block_ix(by*params.num_blocks + bx);
-					assert(block_ix < tri_data[0].size());
-					blocks_to_update.insert(block_ix);
-				}
-			}
+			if (was_updated) {add_modified_column(x, y, zmin, zmax, blocks_to_update);}
 		}
 	}
 	if (!saw_inside || !saw_outside) return 0; // nothing else to do
-	std::copy(blocks_to_update.begin(), blocks_to_update.end(), inserter(modified_blocks, modified_blocks.begin()));
+
+	add_modified_blocks(blocks_to_update);
 
 	if (material_removed) {
 		maybe_create_fragments(center, radius, shooter, num_fragments, 1);
@@ -1372,8 +1433,193 @@ unsigned voxel_model::get_texture_at(point const &pos) const {
 }
 
 
+void voxel_model::add_modified_column(unsigned x, unsigned y, unsigned z1, unsigned z2, map<unsigned, voxel_bounds_t> &blocks) const {
+
+	// check adjacent voxels since we will need to update our neighbors at the boundaries
+	unsigned const bx1(max((int)x-1, 0        )/xblocks), by1(max((int)y-1, 0        )/yblocks);
+	unsigned const bx2(min((int)x+1, (int)nx-1)/xblocks), by2(min((int)y+1, (int)ny-1)/yblocks);
+	voxel_bounds_t const col(x, x, y, y, z1, z2);
+
+	for (unsigned by = by1; by <= by2; ++by) {
+		for (unsigned bx = bx1; bx <= bx2; ++bx) {
+			unsigned const block_ix(by*params.num_blocks + bx);
+			assert(block_ix < tri_data[0].size());
+			auto it(blocks.find(block_ix));
+			if (it == blocks.end()) {blocks[block_ix] = col;} else {it->second.union_with(col);}
+		}
+	}
+}
+
+
+void voxel_model::add_modified_blocks(map<unsigned, voxel_bounds_t> const &blocks) {
+
+	for (auto const &b : blocks) {
+		if (modified_blocks.insert(b.first).second) {dirty_bounds[b.first] = b.second;} // newly modified
+		else { // already modified; expand the bounds unless the entire block has changed
+			auto it(dirty_bounds.find(b.first));
+			if (it != dirty_bounds.end()) {it->second.union_with(b.second);}
+		}
+	}
+}
+
+
+voxel_model::voxel_bounds_t voxel_model::get_block_bounds(unsigned block_ix) const {
+
+	unsigned const xbix(block_ix%params.num_blocks), ybix(block_ix/params.num_blocks);
+	return voxel_bounds_t(xbix*xblocks, min(nx, (xbix+1)*xblocks)-1, ybix*yblocks, min(ny, (ybix+1)*yblocks)-1, 0, nz-1);
+}
+
+
+unsigned voxel_model::get_lod_mask(voxel_bounds_t const &bounds) const {
+
+	unsigned const num[3] = {nx, ny, nz};
+	unsigned lod_mask(1); // LOD 0 reads every voxel
+
+	for (unsigned lod = 1; lod < tri_data.size(); ++lod) { // higher LODs only read voxels at multiples of their step and at the upper edges
+		unsigned const step(1 << lod);
+		bool uses_voxel(1);
+
+		for (unsigned d = 0; d < 3 && uses_voxel; ++d) {
+			unsigned const first_sample((bounds.v[d][0] + step - 1)/step*step);
+			uses_voxel = (first_sample <= bounds.v[d][1] || bounds.v[d][1] >= num[d]-1);
+		}
+		if (uses_voxel) {lod_mask |= (1 << lod);}
+	}
+	return lod_mask;
+}
+
+
+// called on the main thread; remeshes the modified blocks and recomputes AO within ao_radius of their changed voxels on worker threads
+void voxel_model::start_remesh_job() {
+
+	assert(!remesh_job);
+	remesh_batch_t &rb(remesh_batch);
+	rb.blocks.clear();
+	rb.ao_regions.clear();
+	rb.ao_updates.clear();
+	rb.increase_only = !volume_added; // update can only remove, so lighting can only increase
+	map<unsigned, voxel_bounds_t> ao_regions;
+	unsigned ao_reach(0); // max distance in voxels that a change can affect AO
+
+	if (!ao_lighting.empty()) {
+		for (step_dir_t const &d : ao_dirs) {ao_reach = max(ao_reach, d.nsteps+1);} // add 1 for the bias to the positive side
+		ao_reach += max(nx/MESH_X_SIZE, ny/MESH_Y_SIZE); // plus one AO step
+	}
+	for (unsigned block_ix : modified_blocks) {
+		auto it(dirty_bounds.find(block_ix));
+		voxel_bounds_t const bounds((it == dirty_bounds.end()) ? get_block_bounds(block_ix) : it->second);
+		remesh_block_t b;
+		b.block_ix = block_ix;
+		b.lod_mask = get_lod_mask(bounds);
+		b.num_tris = 0;
+		b.lods.resize(tri_data.size(), tri_data_t::value_type(0));
+		rb.blocks.push_back(b);
+		if (ao_lighting.empty()) continue;
+		// clip the range of changed voxels expanded by ao_reach to each block it overlaps
+		unsigned const x1(max((int)bounds.v[0][0]-(int)ao_reach, 0)), x2(min(bounds.v[0][1]+ao_reach, nx-1));
+		unsigned const y1(max((int)bounds.v[1][0]-(int)ao_reach, 0)), y2(min(bounds.v[1][1]+ao_reach, ny-1));
+
+		for (unsigned by = y1/yblocks; by <= min(y2/yblocks, params.num_blocks-1); ++by) {
+			for (unsigned bx = x1/xblocks; bx <= min(x2/xblocks, params.num_blocks-1); ++bx) {
+				unsigned const ao_bix(by*params.num_blocks + bx);
+				voxel_bounds_t const bb(get_block_bounds(ao_bix));
+				voxel_bounds_t const region(max(x1, bb.v[0][0]), min(x2, bb.v[0][1]), max(y1, bb.v[1][0]), min(y2, bb.v[1][1]), 0, nz-1);
+				auto it(ao_regions.find(ao_bix));
+				if (it == ao_regions.end()) {ao_regions[ao_bix] = region;} else {it->second.union_with(region);}
+			}
+		}
+	} // for block_ix
+	rb.ao_regions.assign(ao_regions.begin(), ao_regions.end());
+	rb.ao_updates.resize(rb.ao_regions.size());
+	remesh_job = add_background_job([this]() {run_remesh_batch();}, vector<job_handle_t>(), "Voxel Remesh"); // never run inline by a wait on the main thread
+}
+
+
+// runs in a job; only reads the voxels, and writes to remesh_batch and the pending cobjs of the remeshed blocks
+void voxel_model::run_remesh_batch() {
+
+	remesh_batch_t &rb(remesh_batch);
+
+	parallel_for_jobs(0, (int)rb.blocks.size(), [&](int i) {
+		remesh_block_t &b(rb.blocks[i]);
+		voxel_ix_cache vix_cache; // reused across LODs
+
+		for (unsigned lod = 0; lod < b.lods.size(); ++lod) {
+			if (!(b.lod_mask & (1 << lod))) continue; // unchanged
+			unsigned const count(create_block(vix_cache, b.block_ix, 0, 0, lod, b.lods[lod]));
+			if (lod == 0) {b.num_tris = count;}
+		}
+	});
+	parallel_for_jobs(0, (int)rb.ao_regions.size(), [&](int i) {
+		calc_ao_lighting_for_region(rb.ao_regions[i].first, rb.ao_regions[i].second, rb.increase_only, &rb.ao_updates[i]);
+	});
+}
+
+
+// called on the main thread after the remesh job has finished; swaps in the new blocks and AO values
+void voxel_model::apply_remesh_batch() {
+
+	remesh_batch_t &rb(remesh_batch);
+	vector<unsigned> blocks_to_update;
+	bool something_removed(0);
+	unsigned tot_num_added(0);
+
+	for (remesh_block_t &b : rb.blocks) {
+		for (unsigned lod = 0; lod < b.lods.size(); ++lod) { // move unchanged LODs out so that they're not cleared
+			if (!(b.lod_mask & (1 << lod))) {std::swap(b.lods[lod], tri_data[lod][b.block_ix]);}
+		}
+		something_removed |= clear_block(b.block_ix);
+		for (unsigned lod = 0; lod < b.lods.size(); ++lod) {std::swap(b.lods[lod], tri_data[lod][b.block_ix]);} // swap in the new and unchanged LODs
+		tot_num_added += (b.num_tris > 0);
+		blocks_to_update.push_back(b.block_ix);
+	}
+	rb.blocks.clear(); // free the cleared triangle data
+	if (something_removed) {purge_coll_freed(0);} // unecessary?
+	post_create_blocks_hook();
+
+	if (tot_num_added > 0 || something_removed) { // something was added or removed
+		if (!boundary_vnmap[0].empty()) { // fix block boundary vertex normals
+			for (unsigned i = 0; i < blocks_to_update.size(); ++i) {
+				update_boundary_normals_for_block(blocks_to_update[i], 0);
+			}
+		}
+		for (unsigned i = 0; i < rb.ao_regions.size(); ++i) {
+			if (rb.ao_updates[i].empty()) continue;
+			for (ao_update_t const &u : rb.ao_updates[i]) {ao_lighting[u.ix] = u.val;}
+			blocks_to_update.push_back(rb.ao_regions[i].first);
+		}
+		sort(blocks_to_update.begin(), blocks_to_update.end()); // blocks must be sorted by y then x
+		blocks_to_update.erase(std::unique(blocks_to_update.begin(), blocks_to_update.end()), blocks_to_update.end());
+		update_blocks_hook(blocks_to_update, tot_num_added);
+	}
+	rb.ao_regions.clear();
+	rb.ao_updates.clear();
+}
+
+
+void voxel_model::finish_remesh_job() {
+
+	assert(remesh_job);
+	wait_for_job(remesh_job);
+	remesh_job.reset();
+	apply_remesh_batch();
+	vector<queued_update_t> updates;
+	updates.swap(queued_updates);
+
+	for (queued_update_t const &u : updates) { // apply edits made while the job was running; the modified blocks will be remeshed by the next job
+		update_voxel_sphere_region(u.center, u.radius, u.val_at_center, u.spherical, u.falloff_exp, NULL, u.shooter, u.num_fragments);
+	}
+}
+
+
+// with async_updates, voxels can't be modified while a remesh job is running, so falling voxels (remove_unconnected >= 2)
+// advance one step per completed remesh job rather than one step per frame
 void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 
+	if (remesh_job) {
+		if (!postproc_brushes_mode && !job_is_done(remesh_job)) return; // keep drawing the current blocks until the job is done
+		finish_remesh_job();
+	}
 	if (modified_blocks.empty()) return;
 	//RESET_TIME;
 
@@ -1393,6 +1639,14 @@ void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 			remove_unconnected_outside_modified_blocks(0);
 		}
 	}
+	if (async_updates && !postproc_brushes_mode && get_num_job_threads() > 1) { // with no workers, the job would only run when waited on
+		start_remesh_job();
+		modified_blocks = next_frame_modified_blocks;
+		next_frame_modified_blocks.clear();
+		dirty_bounds.clear();
+		volume_added = 0;
+		return;
+	}
 	bool something_removed(0);
 	vector<unsigned> blocks_to_update(modified_blocks.begin(), modified_blocks.end());
 	
@@ -1402,11 +1656,9 @@ void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 	if (something_removed) {purge_coll_freed(0);} // unecessary?
 	vector<unsigned> num_added(blocks_to_update.size(), 0);
 	unsigned tot_num_added(0);
+	parallel_for_jobs(0, (int)blocks_to_update.size(), [&](int i) {num_added[i] = (create_block_all_lods(blocks_to_update[i], 0, 0) > 0);});
+	post_create_blocks_hook();
 
-#pragma omp parallel for schedule(dynamic,1)
-	for (int i = 0; i < (int)blocks_to_update.size(); ++i) {
-		num_added[i] = (create_block_all_lods(blocks_to_update[i], 0, 0) > 0);
-	}
 	for (auto i = num_added.begin(); i != num_added.end(); ++i) {tot_num_added += *i;}
 
 	// Note: this part only needs to be done once per block at the end of the while loop, but in practice is fast anyway
@@ -1424,6 +1676,7 @@ void voxel_model::proc_pending_updates(bool postproc_brushes_mode) {
 	}
 	modified_blocks = next_frame_modified_blocks;
 	next_frame_modified_blocks.clear();
+	dirty_bounds.clear();
 	volume_added = 0;
 }
 
@@ -1514,7 +1767,7 @@ void voxel_model::build(bool verbose, bool do_ao_lighting) {
 		assert((ny%(params.num_blocks*lod_blocks)) == 0);
 		assert((nz%lod_blocks) == 0);
 	}
-	if (noise_tex_gen) { // noise_tex_gen is shared across voxel asteroids and rocks, so we need to make sure exactly one is created
+	if (noise_tex_gen && !noise_tex_gen->is_generated(NOISE_TSIZE)) { // noise_tex_gen is shared across voxel asteroids and rocks, so we need to make sure exactly one is created
 		#pragma omp critical(noise_texture_creation)
 		noise_tex_gen->procedural_gen(NOISE_TSIZE, params.texture_rseed, 1.0, params.noise_freq);
 	}
@@ -1547,11 +1800,24 @@ void voxel_model::build(bool verbose, bool do_ao_lighting) {
 	pre_build_hook();
 	if (verbose) {PRINT_TIME("  Pre Build");}
 
-	#pragma omp parallel for schedule(dynamic,1)
-	for (int block = 0; block < (int)tot_blocks; ++block) {
+	vector<float> block_times(tot_blocks, 0.0);
+	auto const create_start(std::chrono::high_resolution_clock::now());
+
+	parallel_for_jobs(0, (int)tot_blocks, [&](int block) {
+		auto const t(std::chrono::high_resolution_clock::now());
 		create_block_all_lods(block, 1, 0);
-	}
-	if (verbose) {PRINT_TIME("  Triangles to Model");}
+		block_times[block] = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - t).count();
+	});
+	if (verbose) {
+		float const wall_time(std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - create_start).count());
+		float tot_block_time(0.0);
+		for (float t : block_times) {tot_block_time += t;}
+		cout << "  Triangles to Model: " << tot_blocks << " blocks, " << 1000.0*tot_block_time << "ms of block time in " << 1000.0*wall_time << "ms on "
+			 << get_num_job_threads() << " threads = " << tot_block_time/max(wall_time, 1.0E-6f) << "x speedup" << endl;
+		PRINT_TIME("  Triangles to Model");
+	}
+	post_create_blocks_hook();
+	if (verbose) {PRINT_TIME("  Add Cobjs");}
 
 	if (tot_blocks > 1) { // merge triangle vertices along block seams
 		for (unsigned block_ix = 0; block_ix < tot_blocks; ++block_ix) {
@@ -1575,11 +1841,7 @@ void voxel_model_ground::pre_build_hook() {
 	if (!PRE_ALLOC_COBJS) return; // nothing to do
 	vector<unsigned> num_triangles(tri_data[0].size(), 0);
 	unsigned tot_num_triangles(0);
-
-	#pragma omp parallel for schedule(dynamic,1)
-	for (int block = 0; block < (int)tri_data[0].size(); ++block) {
-		num_triangles[block] = create_block_all_lods(block, 1, 1);
-	}
+	parallel_for_jobs(0, (int)tri_data[0].size(), [&](int block) {num_triangles[block] = create_block_all_lods(block, 1, 1);});
 	for (auto i = num_triangles.begin(); i != num_triangles.end(); ++i) {tot_num_triangles += *i;}
 
 	if (2*coll_objects.size() < tot_num_triangles) {
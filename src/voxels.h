@@ -5,6 +5,8 @@
 
 #include "3DWorld.h"
 #include "model3d.h"
+#include "job_system.h"
+#include <atomic>
 
 struct coll_tquad;
 
@@ -228,11 +230,13 @@ public:
 class noise_texture_manager_t {
 
 	unsigned noise_tid, tsize;
+	std::atomic<unsigned> gen_size; // set after voxels are generated, so that other threads can check it without a lock
 	voxel_manager voxels;
 
 public:
-	noise_texture_manager_t() : noise_tid(0), tsize(0) {}
+	noise_texture_manager_t() : noise_tid(0), tsize(0), gen_size(0) {}
 	void make_private_copy() {noise_tid = 0;} // Note: to be called *only* after a deep copy
+	bool is_generated(unsigned size) const {return (gen_size.load(std::memory_order_acquire) == size);}
 	void procedural_gen(unsigned size, int rseed=321, float mag=1.0, float freq=1.0, vector3d const &offset=zero_vector);
 	void ensure_tid();
 	void bind_texture(unsigned tu_id) const;
@@ -274,6 +278,41 @@ protected:
 	typedef map<point, merge_vn_t> vert_norm_map_t;
 	vector<vert_norm_map_t> boundary_vnmap;
 
+	struct voxel_bounds_t { // inclusive {x,y,z} x {lo,hi} voxel index ranges
+		unsigned v[3][2];
+		voxel_bounds_t() {UNROLL_3X(v[i_][0] = UINT_MAX; v[i_][1] = 0;)}
+		voxel_bounds_t(unsigned x1, unsigned x2, unsigned y1, unsigned y2, unsigned z1, unsigned z2) {v[0][0] = x1; v[0][1] = x2; v[1][0] = y1; v[1][1] = y2; v[2][0] = z1; v[2][1] = z2;}
+		void union_with(voxel_bounds_t const &b) {UNROLL_3X(v[i_][0] = min(v[i_][0], b.v[i_][0]); v[i_][1] = max(v[i_][1], b.v[i_][1]);)}
+	};
+	map<unsigned, voxel_bounds_t> dirty_bounds; // changed voxels of modified_blocks; blocks with no entry are treated as entirely changed
+
+	// incremental updates: modified blocks and the AO near changed voxels are recomputed by a job, then swapped in by apply_remesh_batch()
+	struct ao_update_t {
+		unsigned ix;
+		unsigned char val;
+	};
+	struct remesh_block_t {
+		unsigned block_ix, lod_mask, num_tris;
+		vector<tri_data_t::value_type> lods; // new triangles for LODs in lod_mask; empty for the others
+	};
+	struct remesh_batch_t {
+		vector<remesh_block_t> blocks;
+		vector<pair<unsigned, voxel_bounds_t>> ao_regions; // {block_ix, voxel range within the block}
+		vector<vector<ao_update_t>> ao_updates; // changed AO values, one per AO region
+		bool increase_only=0;
+	};
+	struct queued_update_t { // voxel edit made while the remesh job is reading the voxels
+		point center;
+		float radius, val_at_center;
+		bool spherical;
+		int falloff_exp, shooter;
+		unsigned num_fragments;
+	};
+	bool async_updates;
+	remesh_batch_t remesh_batch;
+	job_handle_t remesh_job;
+	vector<queued_update_t> queued_updates;
+
 	struct comp_by_dist {
 		point const p;
 		comp_by_dist(point const &p_) : p(p_) {}
@@ -283,24 +322,36 @@ protected:
 	void remove_unconnected_outside_modified_blocks(bool postproc_brushes_mode);
 	unsigned get_block_ix(unsigned voxel_ix) const;
 	virtual bool clear_block(unsigned block_ix);
-	unsigned create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level);
+	unsigned create_block(voxel_ix_cache &vix_cache, unsigned block_ix, bool first_create, bool count_only, unsigned lod_level, tri_data_t::value_type &tri_block);
 	unsigned create_block_all_lods(unsigned block_ix, bool first_create, bool count_only);
 	void update_boundary_normals_for_block(unsigned block_ix, bool calc_average);
 	void finalize_boundary_vmap();
 	void calc_ao_dirs();
+	void calc_ao_lighting_for_region(unsigned block_ix, voxel_bounds_t const &region, bool increase_only, vector<ao_update_t> *ao_updates);
 	virtual void calc_ao_lighting_for_block(unsigned block_ix, bool increase_only);
 	void calc_ao_lighting();
+	voxel_bounds_t get_block_bounds(unsigned block_ix) const;
+	void add_modified_column(unsigned x, unsigned y, unsigned z1, unsigned z2, map<unsigned, voxel_bounds_t> &blocks) const;
+	void add_modified_blocks(map<unsigned, voxel_bounds_t> const &blocks);
+	unsigned get_lod_mask(voxel_bounds_t const &bounds) const;
+	void start_remesh_job();
+	void run_remesh_batch();
+	void apply_remesh_batch();
+	void finish_remesh_job();
+	void wait_for_remesh_job() {if (remesh_job) {wait_for_job(remesh_job); remesh_job.reset();}} // results are discarded
 
 	virtual void maybe_create_fragments(point const &center, float radius, int shooter, unsigned num_fragments, bool directly_from_update) const {} // do nothing
-	virtual void create_block_hook(unsigned block_ix) {}
+	virtual void create_block_hook(unsigned block_ix, tri_data_t::value_type const &td) {}
+	virtual void post_create_blocks_hook() {}
 	virtual void update_blocks_hook(vector<unsigned> const &blocks_to_update, unsigned num_added) {}
 	virtual void pre_build_hook() {}
 	virtual void pre_render(bool is_shadow_pass) {}
 
 public:
 	voxel_model(noise_texture_manager_t *ntg, bool use_mesh_, unsigned num_lod_levels);
-	virtual ~voxel_model() {}
+	virtual ~voxel_model() {wait_for_remesh_job();} // the job references this model
 	void clear();
+	// returns 0 for edits queued while a remesh job is running (async_updates only), since they're applied after the job finishes
 	bool update_voxel_sphere_region(point const &center, float radius, float val_at_center, bool spherical, int falloff_exp,
 		point *damage_pos=NULL, int shooter=-1, unsigned num_fragments=0);
 	unsigned get_texture_at(point const &pos) const;
@@ -328,21 +379,31 @@ class voxel_model_ground : public voxel_model {
 	noise_texture_manager_t private_ntg;
 	voxel_query_tree cobj_tree;
 
+	struct pending_cobj_t { // polygon from create_block_hook(), waiting to be added to coll_objects
+		point pts[4];
+		vector3d normal;
+		unsigned char npts, cp_ix;
+	};
 	struct data_block_t {
 		vector<unsigned> cids; // references into coll_objects
+		vector<pending_cobj_t> pending; // written by create_block_hook() for this block only, so no locking is needed
+		bool has_pending=0; // the block was (re)created and its cobjs haven't been added yet; may have no pending cobjs
 		//unsigned tri_data_ix;
-		void clear() {cids.clear();}
+		void clear() {cids.clear();} // pending cobjs are kept, since a remesh job may have created them before the block was cleared
 	};
 	vector<data_block_t> data_blocks;
 
+	void get_cobj_params(cobj_params cparams[3]) const;
 	virtual bool clear_block(unsigned block_ix);
 	virtual void maybe_create_fragments(point const &center, float radius, int shooter, unsigned num_fragments, bool directly_from_update) const;
-	virtual void create_block_hook(unsigned block_ix);
+	virtual void create_block_hook(unsigned block_ix, tri_data_t::value_type const &td);
+	virtual void post_create_blocks_hook();
 	virtual void update_blocks_hook(vector<unsigned> const &blocks_to_update, unsigned num_added);
 	virtual void pre_build_hook();
 
 public:
 	voxel_model_ground(unsigned num_lod_levels=1);
+	~voxel_model_ground() {wait_for_remesh_job();} // the job also writes to the pending cobjs, which are destroyed before the base class
 	void clear();
 	void build(bool add_cobjs_, bool add_as_fixed_, bool verbose);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj, bool exact) const {